@@ -0,0 +1,197 @@
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <ankh/lang/exceptions.hpp>
+#include <ankh/lang/interpreter.hpp>
+#include <ankh/lang/lexer.hpp>
+#include <ankh/lang/optimizer.hpp>
+#include <ankh/lang/parser.hpp>
+#include <ankh/lang/program.hpp>
+#include <ankh/lang/static_analyzer.hpp>
+#include <ankh/lang/vm.hpp>
+
+// Runs a fixed corpus of scripts through every phase of ankh and reports, per workload and phase,
+// one JSON object per line on stdout.
+//
+// usage: ankh-bench [--iterations N] [workload...]
+
+static size_t allocations = 0;
+static size_t allocated_bytes = 0;
+
+void *operator new(size_t size) {
+    ++allocations;
+    allocated_bytes += size;
+
+    if (void *ptr = std::malloc(size == 0 ? 1 : size); ptr != nullptr) {
+        return ptr;
+    }
+
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+
+void operator delete(void *ptr, size_t) noexcept { std::free(ptr); }
+
+void operator delete[](void *ptr, size_t) noexcept { std::free(ptr); }
+
+static const std::vector<std::string> WORKLOADS = {"recursive-fib", "string-building", "array-append",
+                                                   "dict-lookup",   "closures",        "interpolation"};
+
+struct Measurement {
+    std::chrono::nanoseconds wall{0};
+    size_t allocations = 0;
+    size_t allocated_bytes = 0;
+};
+
+// Measures only the phase itself, the setup it needs is excluded
+class Stopwatch {
+  public:
+    explicit Stopwatch(Measurement &measurement) noexcept
+        : measurement_(measurement), allocations_(allocations), allocated_bytes_(allocated_bytes),
+          start_(std::chrono::steady_clock::now()) {}
+
+    ~Stopwatch() noexcept {
+        measurement_.wall += std::chrono::steady_clock::now() - start_;
+        measurement_.allocations += allocations - allocations_;
+        measurement_.allocated_bytes += allocated_bytes - allocated_bytes_;
+    }
+
+  private:
+    Measurement &measurement_;
+    const size_t allocations_;
+    const size_t allocated_bytes_;
+    const std::chrono::steady_clock::time_point start_;
+};
+
+static std::optional<std::string> read_workload(const std::string &name) {
+    std::ifstream file(std::string{ANKH_BENCH_CORPUS} + "/" + name + ".sh");
+    if (!file) {
+        return std::nullopt;
+    }
+
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+
+    return buffer.str();
+}
+
+static void report(const std::string &workload, const char *phase, size_t iterations, const Measurement &m) {
+    const double seconds = std::chrono::duration<double>(m.wall).count();
+    const double ops_per_sec = seconds > 0 ? iterations / seconds : 0;
+
+    std::printf("{\"workload\": \"%s\", \"phase\": \"%s\", \"iterations\": %zu, \"wall_ns\": %lld, "
+                "\"ns_per_op\": %lld, \"ops_per_sec\": %.2f, \"allocations_per_op\": %zu, "
+                "\"allocated_bytes_per_op\": %zu}\n",
+                workload.c_str(), phase, iterations, static_cast<long long>(m.wall.count()),
+                static_cast<long long>(m.wall.count() / iterations), ops_per_sec, m.allocations / iterations,
+                m.allocated_bytes / iterations);
+    std::fflush(stdout);
+}
+
+static void bench(const std::string &workload, const std::string &source, size_t iterations) {
+    Measurement lex, parse, analyze, optimize, interpret, vm;
+
+    for (size_t i = 0; i < iterations; ++i) {
+        std::vector<ankh::lang::Token> tokens;
+        {
+            Stopwatch stopwatch(lex);
+            tokens = ankh::lang::scan(source);
+        }
+
+        // the parser scans the source as it goes so this includes lexing it again
+        ankh::lang::Program program;
+        {
+            Stopwatch stopwatch(parse);
+            ankh::lang::Parser parser(source);
+            program = parser.parse();
+        }
+
+        {
+            Stopwatch stopwatch(analyze);
+            ankh::lang::StaticAnalyzer analyzer;
+            analyzer.resolve(program);
+        }
+
+        {
+            Stopwatch stopwatch(optimize);
+            ankh::lang::Optimizer optimizer;
+            optimizer.optimize(program);
+        }
+
+        {
+            ankh::lang::Interpreter interpreter;
+
+            Stopwatch stopwatch(interpret);
+            interpreter.interpret(std::move(program));
+        }
+
+        // each engine consumes its program so the VM gets a fresh one
+        ankh::lang::Program vm_program = ankh::lang::parse(source);
+        {
+            ankh::lang::VM machine;
+
+            Stopwatch stopwatch(vm);
+            machine.interpret(std::move(vm_program));
+        }
+    }
+
+    report(workload, "lex", iterations, lex);
+    report(workload, "parse", iterations, parse);
+    report(workload, "analyze", iterations, analyze);
+    report(workload, "optimize", iterations, optimize);
+    report(workload, "interpret", iterations, interpret);
+    report(workload, "vm", iterations, vm);
+}
+
+int main(int argc, char **argv) {
+    size_t iterations = 10;
+    std::vector<std::string> workloads;
+    for (int i = 1; i < argc; ++i) {
+        if (std::string_view{argv[i]} == "--iterations" && i + 1 < argc) {
+            iterations = std::strtoul(argv[++i], nullptr, 10);
+        } else {
+            workloads.push_back(argv[i]);
+        }
+    }
+
+    if (iterations == 0) {
+        std::cerr << "ankh-bench: the number of iterations must be positive\n";
+        return EXIT_FAILURE;
+    }
+
+    if (workloads.empty()) {
+        workloads = WORKLOADS;
+    }
+
+    for (const auto &workload : workloads) {
+        auto source = read_workload(workload);
+        if (!source.has_value()) {
+            std::cerr << "ankh-bench: unknown workload '" << workload << "'\n";
+            return EXIT_FAILURE;
+        }
+
+        try {
+            bench(workload, source.value(), iterations);
+        } catch (const std::exception &e) {
+            std::cerr << "ankh-bench: " << workload << ": " << e.what() << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
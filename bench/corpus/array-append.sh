@@ -0,0 +1,11 @@
+#!/usr/bin/env ankhsh
+
+let xs = []
+for let i = 0; i < 5000; ++i {
+    xs = append(xs, i)
+}
+
+let total = 0
+for let i = 0; i < len(xs); ++i {
+    total += xs[i]
+}
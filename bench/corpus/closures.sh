@@ -0,0 +1,17 @@
+#!/usr/bin/env ankhsh
+
+fn makeCounter() {
+    let i = 0
+    fn count() {
+        ++i
+        return i
+    }
+
+    return count
+}
+
+let counter = makeCounter()
+let total = 0
+for let i = 0; i < 5000; ++i {
+    total += counter()
+}
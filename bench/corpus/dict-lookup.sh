@@ -0,0 +1,14 @@
+#!/usr/bin/env ankhsh
+
+let d = {
+    alpha: 1, bravo: 2, charlie: 3, delta: 4, echo: 5, foxtrot: 6, golf: 7, hotel: 8,
+    india: 9, juliett: 10, kilo: 11, lima: 12, mike: 13, november: 14, oscar: 15, papa: 16
+}
+
+let ks = keys(d)
+let total = 0
+for let i = 0; i < 200; ++i {
+    for let k = 0; k < len(ks); ++k {
+        total += d[ks[k]]
+    }
+}
@@ -0,0 +1,8 @@
+#!/usr/bin/env ankhsh
+
+let total = 0
+let line = ""
+for let i = 0; i < 1000; ++i {
+    total += i
+    line = "i={i} total={total}"
+}
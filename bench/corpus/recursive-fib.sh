@@ -0,0 +1,11 @@
+#!/usr/bin/env ankhsh
+
+fn fib(n) {
+    if n <= 1 {
+        return n
+    }
+
+    return fib(n - 2) + fib(n - 1)
+}
+
+let result = fib(18)
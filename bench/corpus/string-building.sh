@@ -0,0 +1,9 @@
+#!/usr/bin/env ankhsh
+
+let s = ""
+for let i = 0; i < 2000; ++i {
+    s = s + "x"
+    s = append(s, i)
+}
+
+let result = len(s)
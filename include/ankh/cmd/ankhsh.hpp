@@ -2,15 +2,28 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <fstream>
 #include <iostream>
 #include <optional>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 #include <ankh/log.hpp>
 
+#include <ankh/lang/cache.hpp>
 #include <ankh/lang/exceptions.hpp>
 #include <ankh/lang/interpreter.hpp>
+#include <ankh/lang/native.hpp>
 #include <ankh/lang/parser.hpp>
+#include <ankh/lang/profiler.hpp>
+#include <ankh/lang/vm.hpp>
+
+#include <ankh/sys/sys.hpp>
 
 // #include <fmt/color.hpp>
 
@@ -21,8 +34,9 @@ static void print_error(const char *msg) noexcept {
 
 static void print_error(const std::string &msg) noexcept { print_error(msg.c_str()); }
 
-static int execute(ankh::lang::Interpreter &interpreter, const std::string &script) noexcept {
-    ankh::lang::Program program = ankh::lang::parse(script);
+// Engine is either the tree-walking Interpreter or the bytecode VM
+template <typename Engine>
+static int execute(Engine &engine, ankh::lang::Program program) noexcept {
     if (program.has_errors()) {
         for (const auto &e : program.errors) {
             print_error(e);
@@ -31,7 +45,7 @@ static int execute(ankh::lang::Interpreter &interpreter, const std::string &scri
     }
 
     try {
-        interpreter.interpret(std::move(program));
+        engine.interpret(std::move(program));
     } catch (const ankh::lang::InterpretationException &e) {
         print_error(e.what());
         return EXIT_FAILURE;
@@ -40,51 +54,94 @@ static int execute(ankh::lang::Interpreter &interpreter, const std::string &scri
     return EXIT_SUCCESS;
 }
 
-static std::optional<std::string> read_file(const std::string &path) noexcept {
-    std::FILE *fp = std::fopen(path.c_str(), "r");
-    if (fp == nullptr) {
+static std::optional<std::string> readline(const char *prompt) noexcept {
+    std::cout << prompt;
+    if (std::string line; std::getline(std::cin, line)) {
+        return {line};
+    }
+
+    return std::nullopt;
+}
+
+// Where the program parsed from the source is cached, which is $XDG_CACHE_HOME/ankh or ~/.cache/ankh.
+// Programs are named after the hash of their source so a script which is edited gets a fresh entry.
+static std::optional<std::filesystem::path> cache_path(std::string_view source) noexcept {
+    std::filesystem::path dir;
+    if (const char *cache_home = std::getenv("XDG_CACHE_HOME"); cache_home != nullptr && *cache_home != '\0') {
+        dir = cache_home;
+    } else if (const char *home = std::getenv("HOME"); home != nullptr && *home != '\0') {
+        dir = std::filesystem::path(home) / ".cache";
+    } else {
         return std::nullopt;
     }
 
-    std::string result;
-    {
-        char buffer[1024 * 64] = {0};
-        size_t n = 0;
-        do {
-            n = fread(buffer, sizeof(buffer[0]), sizeof(buffer), fp);
-            if (n != 0) {
-                result += buffer;
-            }
-        } while (n == sizeof(buffer));
+    return dir / "ankh" / std::format("{:016x}.ankhc", ankh::lang::source_hash(source));
+}
+
+// Loads the program cached for the source, parsing it and caching the result when there is none yet.
+// Failing to cache the program only means it's parsed again the next time around.
+static ankh::lang::Program load_program(std::string_view source) {
+    const auto path = cache_path(source);
+    if (!path.has_value()) {
+        return ankh::lang::parse_in_place(source);
     }
 
-    std::fclose(fp);
+    if (const auto cached = ankh::sys::MappedFile::open(path->string()); cached.has_value()) {
+        if (auto program = ankh::lang::deserialize(cached->contents(), source); program.has_value()) {
+            ANKH_DEBUG("loaded the program cached in {}", path->string());
+            return std::move(program.value());
+        }
+    }
 
-    return {result};
-}
+    ankh::lang::Program program = ankh::lang::parse_in_place(source);
+    if (program.has_errors()) {
+        return program;
+    }
 
-static std::optional<std::string> readline(const char *prompt) noexcept {
-    std::cout << prompt;
-    if (std::string line; std::getline(std::cin, line)) {
-        return {line};
+    std::error_code ec;
+    std::filesystem::create_directories(path->parent_path(), ec);
+    if (ec || !ankh::sys::write_file(path->string(), ankh::lang::serialize(program, source))) {
+        ANKH_DEBUG("could not cache the program in {}", path->string());
     }
 
-    return std::nullopt;
+    return program;
 }
 
-namespace ankh {
+// The profile being taken of the interpreter, if any
+struct Profile {
+    ankh::lang::Profiler profiler;
+    std::string path;
+};
 
-inline int shell_loop(int argc, char **argv) {
-    ankh::lang::Interpreter interpreter;
+static Profile *current_profile = nullptr;
 
-    if (argc > 1) {
-        if (auto possible_script = read_file(argv[1]); possible_script) {
-            return execute(interpreter, possible_script.value());
-        }
+// Writes the sampled call stacks to the profile's path and a table of where the time went to stderr.
+// This is also called at exit since scripts may end by calling exit().
+static void report_profile() {
+    Profile *profile = std::exchange(current_profile, nullptr);
+    if (profile == nullptr) {
+        return;
+    }
 
-        ankh::log::error("could not open script '%s'\n", argv[1]);
+    profile->profiler.stop();
 
-        return EXIT_FAILURE;
+    std::ofstream out(profile->path);
+    profile->profiler.write_folded(out);
+    if (!out) {
+        print_error(std::format("could not write the profile to '{}'", profile->path));
+    }
+
+    profile->profiler.write_table(std::cerr);
+}
+
+namespace ankh {
+
+template <typename Engine>
+inline int run(Engine &engine, const std::optional<ankh::sys::MappedFile> &script, bool use_cache) {
+    if (script.has_value()) {
+        // the lexer works on the mapping directly; it stays mapped for as long as the engine lives
+        const std::string_view source = script->contents();
+        return execute(engine, use_cache ? load_program(source) : ankh::lang::parse_in_place(source));
     }
 
     // when our shell exits, we want to ensure it exits
@@ -102,12 +159,105 @@ inline int shell_loop(int argc, char **argv) {
             ANKH_DEBUG("empty line");
         } else {
             ANKH_DEBUG("read line: {}", line);
-            prev_process_exit_code = execute(interpreter, line);
+            prev_process_exit_code = execute(engine, ankh::lang::parse(line));
         }
     }
 
     return prev_process_exit_code;
 }
 
+// Loads the natives of the extensions into the engine, reporting whichever can't be loaded
+template <typename Engine> static bool load_extensions(Engine &engine, const std::vector<std::string> &paths) noexcept {
+    try {
+        ankh::lang::Natives natives;
+        for (const std::string &path : paths) {
+            ankh::lang::load_extension(path, natives);
+        }
+        engine.load(natives);
+    } catch (const std::runtime_error &e) {
+        print_error(e.what());
+        return false;
+    }
+
+    return true;
 }
 
+// usage: ankhsh [--vm] [--no-cache] [--profile[=FILE]] [--extension=FILE]... [script]
+// --profile samples where the interpreter spends its time, writing the call stacks to FILE (ankh.folded by default)
+// in the folded format flame graph tools read and a table of the time spent in each function to stderr.
+// --extension loads the native functions defined by the shared object FILE, see ANKH_EXTENSION.
+inline int shell_loop(int argc, char **argv) {
+    bool use_vm = false;
+    bool use_cache = true;
+    const char *profile_path = nullptr;
+    std::vector<std::string> extensions;
+    const char *script_path = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg{argv[i]};
+        if (arg == "--vm") {
+            use_vm = true;
+        } else if (arg == "--no-cache") {
+            use_cache = false;
+        } else if (arg == "--profile") {
+            profile_path = "ankh.folded";
+        } else if (arg.starts_with("--profile=")) {
+            profile_path = argv[i] + std::string_view{"--profile="}.size();
+        } else if (arg.starts_with("--extension=")) {
+            extensions.emplace_back(arg.substr(std::string_view{"--extension="}.size()));
+        } else if (script_path == nullptr) {
+            script_path = argv[i];
+        }
+    }
+
+    // the script is opened before the engine is created so it outlives the programs parsed from it
+    std::optional<ankh::sys::MappedFile> script;
+    if (script_path != nullptr) {
+        script = ankh::sys::MappedFile::open(script_path);
+        if (!script.has_value()) {
+            ankh::log::error("could not open script '%s'\n", script_path);
+
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (use_vm) {
+        if (profile_path != nullptr) {
+            print_error("--profile is only supported by the interpreter");
+        }
+
+        ankh::lang::VM vm;
+        if (!load_extensions(vm, extensions)) {
+            return EXIT_FAILURE;
+        }
+
+        return run(vm, script, use_cache);
+    }
+
+    ankh::lang::Interpreter interpreter;
+    if (!load_extensions(interpreter, extensions)) {
+        return EXIT_FAILURE;
+    }
+
+    if (profile_path == nullptr) {
+        return run(interpreter, script, use_cache);
+    }
+
+    Profile profile{ankh::lang::Profiler{}, profile_path};
+    if (!profile.profiler.start()) {
+        print_error("could not start the profiler");
+        return run(interpreter, script, use_cache);
+    }
+
+    current_profile = &profile;
+    std::atexit(report_profile);
+    interpreter.profile(&profile.profiler);
+
+    const int status = run(interpreter, script, use_cache);
+
+    interpreter.profile(nullptr);
+    report_profile();
+
+    return status;
+}
+
+}
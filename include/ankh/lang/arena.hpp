@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace ankh::lang {
+
+// A bump allocator carving objects out of large blocks.
+// Nothing is freed individually: every block is released at once when the arena is destroyed.
+class Arena {
+  public:
+    Arena() noexcept = default;
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    Arena(Arena &&other) noexcept
+        : blocks_(std::move(other.blocks_)), cursor_(std::exchange(other.cursor_, nullptr)),
+          end_(std::exchange(other.end_, nullptr)) {}
+
+    Arena &operator=(Arena &&other) noexcept {
+        blocks_ = std::move(other.blocks_);
+        cursor_ = std::exchange(other.cursor_, nullptr);
+        end_ = std::exchange(other.end_, nullptr);
+
+        return *this;
+    }
+
+    void *allocate(size_t size, size_t alignment) {
+        std::byte *begin = align(cursor_, alignment);
+        if (begin == nullptr || begin + size > end_) {
+            // oversized requests get a block of their own so the one being filled isn't wasted
+            if (size + alignment > BLOCK_SIZE) {
+                return align(add_block(size + alignment), alignment);
+            }
+
+            cursor_ = add_block(BLOCK_SIZE);
+            end_ = cursor_ + BLOCK_SIZE;
+            begin = align(cursor_, alignment);
+        }
+
+        cursor_ = begin + size;
+
+        return begin;
+    }
+
+    template <class T, class... Args> T *make(Args &&...args) {
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    // Copies the text into the arena, returning a view of the copy which stays valid as long as the arena
+    std::string_view copy(std::string_view text) {
+        char *begin = static_cast<char *>(allocate(text.size(), alignof(char)));
+        std::memcpy(begin, text.data(), text.size());
+
+        return {begin, text.size()};
+    }
+
+    // Takes over the blocks of the other arena so whatever was allocated in it lives as long as this one
+    void merge(Arena &&other) {
+        for (auto &block : other.blocks_) {
+            blocks_.push_back(std::move(block));
+        }
+
+        other.blocks_.clear();
+        other.cursor_ = nullptr;
+        other.end_ = nullptr;
+    }
+
+  private:
+    std::byte *add_block(size_t size) {
+        // the memory is left uninitialized since whatever is placed in it gets constructed anyway
+        std::unique_ptr<std::byte[]> block(new std::byte[size]);
+        std::byte *begin = block.get();
+        blocks_.push_back(std::move(block));
+
+        return begin;
+    }
+
+    static std::byte *align(std::byte *ptr, size_t alignment) noexcept {
+        if (ptr == nullptr) {
+            return nullptr;
+        }
+
+        const auto address = reinterpret_cast<std::uintptr_t>(ptr);
+
+        return ptr + ((alignment - address % alignment) % alignment);
+    }
+
+  private:
+    static constexpr size_t BLOCK_SIZE = 32 * 1024;
+
+    std::vector<std::unique_ptr<std::byte[]>> blocks_;
+    std::byte *cursor_ = nullptr;
+    std::byte *end_ = nullptr;
+};
+
+// Destroys an object living in an arena, leaving its memory to be released along with the arena
+struct ArenaDeleter {
+    template <class T> void operator()(T *ptr) const noexcept { ptr->~T(); }
+};
+
+template <class T> using ArenaPtr = std::unique_ptr<T, ArenaDeleter>;
+
+} // namespace ankh::lang
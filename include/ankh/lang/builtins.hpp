@@ -1,72 +1,117 @@
 #pragma once
 
+#include <array>
+#include <cstddef>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
 #include <ankh/lang/callable.hpp>
+#include <ankh/lang/expr_result.hpp>
+#include <ankh/lang/native.hpp>
 #include <ankh/log.hpp>
 
-#define ANKH_DECLARE_BUILTIN_TYPE(ClassName, method)                                                                   \
-    template <class T, class I> class ClassName : public BuiltIn<T, I> {                                               \
-      public:                                                                                                          \
-        ClassName(I *interpreter, EnvironmentPtr<T> closure, std::string name, int arity)                              \
-            : BuiltIn<T, I>(interpreter, closure, name, arity) {}                                                      \
-                                                                                                                       \
-      protected:                                                                                                       \
-        virtual void invoke(const std::vector<ExprResult> &args) override { this->interpreter_->method(args); }        \
-    }
-
 namespace ankh::lang {
 
+// What the builtins keep between calls, of which every interpreter and VM has its own
+struct BuiltinState {
+    // the exit status of the most recently run command
+    int last_status = 0;
+};
+
+// The state of the engine calling a native, made active by the innermost BuiltinScope of the thread, if any
+inline BuiltinState *&active_builtin_state() noexcept {
+    thread_local BuiltinState *state = nullptr;
+
+    return state;
+}
+
+// Shows the natives called on the thread the state for as long as it's alive, after which the previous one is active
+// again
+class BuiltinScope {
+  public:
+    explicit BuiltinScope(BuiltinState &state) noexcept : prev_(std::exchange(active_builtin_state(), &state)) {}
+
+    BuiltinScope(const BuiltinScope &) = delete;
+    BuiltinScope &operator=(const BuiltinScope &) = delete;
+
+    ~BuiltinScope() noexcept { active_builtin_state() = prev_; }
+
+  private:
+    BuiltinState *prev_;
+};
+
+// A native function defined as a global of the interpreter, either a builtin or one loaded through Interpreter::load
 template <class T, class I> class BuiltIn : public Callable {
   public:
-    BuiltIn(I *interpreter, EnvironmentPtr<T> closure, std::string name, size_t arity)
-        : interpreter_(interpreter), closure_(closure), name_(name), arity_(arity) {}
+    BuiltIn(I *interpreter, std::string name, size_t arity, NativeFunction fn)
+        : interpreter_(interpreter), name_(std::move(name)), arity_(arity), fn_(fn) {}
 
-    virtual std::string name() const noexcept override { return name_; }
+    virtual std::string_view name() const noexcept override { return name_; }
 
     virtual size_t arity() const noexcept override { return arity_; }
 
-    virtual void invoke(const std::vector<ExpressionPtr> &args) override {
-        EnvironmentPtr<T> environment(make_env<T>(closure_));
-        ANKH_DEBUG("closure environment {} created", environment->scope());
+    virtual T invoke(const std::vector<ExpressionPtr> &args) override {
+        const BuiltinScope state(interpreter_->builtin_state());
 
-        for (size_t i = 0; i < arity(); ++i) {
-            ANKH_VERIFY(environment->declare("param" + std::to_string(i), {}));
+        // the arguments of nearly every call fit on the stack
+        if (args.size() <= INLINE_ARGS) {
+            std::array<T, INLINE_ARGS> evaluated;
+            for (size_t i = 0; i < args.size(); ++i) {
+                evaluated[i] = interpreter_->evaluate(args[i]);
+            }
+
+            return fn_(std::span<T>(evaluated.data(), args.size()));
         }
 
-        std::vector<ExprResult> evaluated_args;
-        for (size_t i = 0; i < args.size(); ++i) {
-            evaluated_args.push_back(interpreter_->evaluate(args[i]));
+        std::vector<T> evaluated;
+        evaluated.reserve(args.size());
+        for (const ExpressionPtr &arg : args) {
+            evaluated.push_back(interpreter_->evaluate(arg));
         }
 
-        invoke(evaluated_args);
+        return fn_(evaluated);
     }
 
-  protected:
-    virtual void invoke(const std::vector<ExprResult> &args) = 0;
+    // Calls the builtin with arguments evaluated already
+    T call(std::span<T> args) {
+        const BuiltinScope state(interpreter_->builtin_state());
 
-  protected:
-    I *interpreter_;
+        return fn_(args);
+    }
+
+    // The number of arguments evaluated on the stack rather than on the heap
+    static constexpr size_t INLINE_ARGS = 4;
 
   private:
-    EnvironmentPtr<T> closure_;
+    I *interpreter_;
     const std::string name_;
     const size_t arity_;
+    const NativeFunction fn_;
 };
 
-// System Builtins
-ANKH_DECLARE_BUILTIN_TYPE(PrintFn, print);
-ANKH_DECLARE_BUILTIN_TYPE(ExitFn, exit);
-ANKH_DECLARE_BUILTIN_TYPE(LengthFn, length);
-ANKH_DECLARE_BUILTIN_TYPE(ExportFn, exportfn);
+} // namespace ankh::lang
 
-// Number Builtins
-ANKH_DECLARE_BUILTIN_TYPE(IntFn, cast_int);
+// The implementations of the builtins, shared by every execution engine
+namespace ankh::lang::builtins {
 
-// Array Builtins
-ANKH_DECLARE_BUILTIN_TYPE(AppendFn, append);
+// Every builtin, for the engines to load
+const Natives &natives();
 
-// String Builtins
-ANKH_DECLARE_BUILTIN_TYPE(StrFn, str);
+ExprResult print(std::span<ExprResult> args);
+ExprResult exit(std::span<ExprResult> args);
+ExprResult length(std::span<ExprResult> args);
+ExprResult cast_int(std::span<ExprResult> args);
+ExprResult append(std::span<ExprResult> args);
+ExprResult str(std::span<ExprResult> args);
+ExprResult keys(std::span<ExprResult> args);
+ExprResult exportfn(std::span<ExprResult> args);
+// The exit status of the most recently run command, like the shell's $?
+ExprResult status(std::span<ExprResult> args);
 
-// Dictionary Builtins
-ANKH_DECLARE_BUILTIN_TYPE(KeysFn, keys);
-} // namespace ankh::lang
+// Runs the command of a $(...) expression, yielding its output and recording its exit status in the engine's state
+ExprResult run_command(const std::string &cmd, BuiltinState &state);
+
+} // namespace ankh::lang::builtins
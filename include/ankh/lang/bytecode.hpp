@@ -0,0 +1,170 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <ankh/lang/expr_result.hpp>
+#include <ankh/lang/slot.hpp>
+#include <ankh/lang/token.hpp>
+
+namespace ankh::lang {
+
+// Every instruction is a single byte opcode followed by its operands, if any.
+// Operands are stored little endian: locals, upvalues and argument counts are 16 bits wide,
+// constants, globals, jump offsets and element counts are 32 bits wide.
+#define ANKH_OPCODES(X)                                                                                                \
+    X(CONSTANT)      /* u32 constant */                                                                                \
+    X(NIL)                                                                                                             \
+    X(ANKH_TRUE)                                                                                                       \
+    X(ANKH_FALSE)                                                                                                      \
+    X(POP)                                                                                                             \
+    X(GET_LOCAL)     /* u16 slot */                                                                                    \
+    X(SET_LOCAL)     /* u16 slot */                                                                                    \
+    X(GET_GLOBAL)    /* u32 global */                                                                                  \
+    X(SET_GLOBAL)    /* u32 global */                                                                                  \
+    X(DEFINE_GLOBAL) /* u32 global */                                                                                  \
+    X(GET_UPVALUE)   /* u16 upvalue */                                                                                 \
+    X(SET_UPVALUE)   /* u16 upvalue */                                                                                 \
+    X(CLOSE_UPVALUE)                                                                                                   \
+    X(EQ)                                                                                                              \
+    X(NEQ)                                                                                                             \
+    X(GT)                                                                                                              \
+    X(GTE)                                                                                                             \
+    X(LT)                                                                                                              \
+    X(LTE)                                                                                                             \
+    X(ADD)                                                                                                             \
+    X(SUB)                                                                                                             \
+    X(MUL)                                                                                                             \
+    X(DIV)                                                                                                             \
+    X(AND)           /* u32 forward offset */                                                                          \
+    X(OR)            /* u32 forward offset */                                                                          \
+    X(CHECK_BOOL)                                                                                                      \
+    X(NEGATE)                                                                                                          \
+    X(NOT)                                                                                                             \
+    X(JUMP)          /* u32 forward offset */                                                                          \
+    X(JUMP_IF_FALSE) /* u32 forward offset */                                                                          \
+    X(LOOP)          /* u32 backward offset */                                                                         \
+    X(CALL_REASSIGN) /* u16 argument count, then the SET_* of the variable passed first */                             \
+    X(CALL)          /* u16 argument count */                                                                          \
+    X(CLOSURE)       /* u32 prototype, then (u8 is local, u16 index) per upvalue */                                    \
+    X(ANKH_RETURN)                                                                                                     \
+    X(ARRAY)         /* u32 element count */                                                                           \
+    X(DICT)          /* u32 entry count */                                                                             \
+    X(INDEX)                                                                                                           \
+    X(SLICE)         /* u8 SLICE_HAS_BEGIN | SLICE_HAS_END */                                                          \
+    X(COMMAND)       /* u32 constant */                                                                                \
+    X(INTERPOLATE)   /* u32 part count */                                                                              \
+    X(ECHO)                                                                                                            \
+    X(PANIC)         /* u32 constant */
+
+// ankh prefixes avoid clashing with the TRUE/FALSE/RETURN macros defined in some libraries
+enum class OpCode : std::uint8_t {
+#define ANKH_OPCODE_ENUM(op) op,
+    ANKH_OPCODES(ANKH_OPCODE_ENUM)
+#undef ANKH_OPCODE_ENUM
+};
+
+std::string opcode_str(OpCode op) noexcept;
+
+inline constexpr std::uint8_t SLICE_HAS_BEGIN = 1 << 0;
+inline constexpr std::uint8_t SLICE_HAS_END = 1 << 1;
+
+struct Prototype;
+
+// A chunk is the compiled code of a single function along with everything the code refers to.
+class Chunk {
+  public:
+    void write(std::uint8_t byte, const Token &marker);
+    void write_u16(std::uint16_t value, const Token &marker);
+    void write_u32(std::uint32_t value, const Token &marker);
+
+    void patch_u32(size_t offset, std::uint32_t value) noexcept;
+
+    size_t add_constant(ExprResult constant);
+    size_t add_prototype(std::unique_ptr<Prototype> prototype);
+
+    // The token responsible for the instruction containing the byte at offset
+    const Token &marker(size_t offset) const noexcept;
+
+    size_t size() const noexcept { return code_.size(); }
+
+    const std::uint8_t *code() const noexcept { return code_.data(); }
+
+    const ExprResult &constant(size_t i) const noexcept { return constants_[i]; }
+
+    const Prototype *prototype(size_t i) const noexcept { return prototypes_[i].get(); }
+
+    size_t prototype_count() const noexcept { return prototypes_.size(); }
+
+  private:
+    // markers are run length encoded since consecutive instructions usually share them
+    struct MarkerRun {
+        size_t offset;
+        size_t marker;
+    };
+
+    std::vector<std::uint8_t> code_;
+    std::vector<ExprResult> constants_;
+    std::vector<std::unique_ptr<Prototype>> prototypes_;
+    std::vector<Token> markers_;
+    std::vector<MarkerRun> runs_;
+};
+
+struct Prototype {
+    std::string name;
+    size_t arity;
+    size_t upvalue_count = 0;
+    Chunk chunk;
+
+    Prototype(std::string name, size_t arity) : name(std::move(name)), arity(arity) {}
+};
+
+inline std::uint16_t read_u16(const std::uint8_t *code) noexcept {
+    return static_cast<std::uint16_t>(code[0] | (code[1] << 8));
+}
+
+inline std::uint32_t read_u32(const std::uint8_t *code) noexcept {
+    return static_cast<std::uint32_t>(code[0]) | (static_cast<std::uint32_t>(code[1]) << 8) |
+           (static_cast<std::uint32_t>(code[2]) << 16) | (static_cast<std::uint32_t>(code[3]) << 24);
+}
+
+struct Global {
+    std::string name;
+    ExprResult value;
+    bool defined = false;
+};
+
+// The global variables of a VM.
+// The compiler resolves every global name to an index once so the VM never looks globals up by name.
+class Globals {
+  public:
+    // The index of the global with the given name, which is reserved if it doesn't exist yet
+    size_t resolve(std::string_view name);
+
+    std::optional<size_t> find(std::string_view name) const noexcept;
+
+    Global &operator[](size_t i) noexcept { return globals_[i]; }
+
+    const Global &operator[](size_t i) const noexcept { return globals_[i]; }
+
+    friend void trace_value(const Globals &globals, Tracer &tracer) {
+        for (const Global &global : globals.globals_) {
+            trace_value(global.value, tracer);
+        }
+    }
+
+  private:
+    std::vector<Global> globals_;
+    std::unordered_map<std::string, size_t, NameHash, std::equal_to<>> indexes_;
+};
+
+// A human readable listing of the prototype's code, and that of every prototype nested in it
+std::string disassemble(const Prototype &prototype);
+
+} // namespace ankh::lang
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <ankh/lang/expr.hpp>
+#include <ankh/lang/program.hpp>
+#include <ankh/lang/slot.hpp>
+#include <ankh/lang/statement.hpp>
+#include <ankh/lang/token.hpp>
+
+namespace ankh::lang {
+
+// A fingerprint of the source a program is cached for (64-bit FNV-1a)
+std::uint64_t source_hash(std::string_view source) noexcept;
+
+// Serializes a parsed, analyzed and optimized program without errors so it can be loaded again without its source
+// being scanned, parsed or analyzed. Only the machine which wrote it is expected to read it back.
+std::string serialize(const Program &program, std::string_view source);
+
+// Loads a program serialized from the source. Nothing is returned if the data is corrupt or was written for different
+// source or by another version of ankh, in which case the source has to be parsed again.
+std::optional<Program> deserialize(std::string_view data, std::string_view source) noexcept;
+
+// Identifies the node which follows in the serialized program
+enum class CacheTag : std::uint8_t {
+    NONE,
+    BINARY,
+    LOGICAL,
+    UNARY,
+    LITERAL,
+    PAREN,
+    IDENTIFIER,
+    CALL,
+    LAMBDA,
+    COMMAND,
+    ARRAY,
+    INDEX,
+    SLICE,
+    DICTIONARY,
+    STRING,
+    EXPRESSION_STATEMENT,
+    VARIABLE_DECLARATION,
+    ASSIGNMENT,
+    COMPOUND_ASSIGNMENT,
+    INC_OR_DEC,
+    BLOCK,
+    IF,
+    WHILE,
+    FOR,
+    BREAK,
+    FUNCTION_DECLARATION,
+    RETURN,
+};
+
+class CacheWriter : public ExpressionVisitor<ExprResult>, public StatementVisitor<void> {
+  public:
+    std::string write(const Program &program, std::string_view source);
+
+  private:
+    virtual ExprResult visit(BinaryExpression *expr) override;
+    virtual ExprResult visit(LogicalExpression *expr) override;
+    virtual ExprResult visit(UnaryExpression *expr) override;
+    virtual ExprResult visit(LiteralExpression *expr) override;
+    virtual ExprResult visit(ParenExpression *expr) override;
+    virtual ExprResult visit(IdentifierExpression *expr) override;
+    virtual ExprResult visit(CallExpression *expr) override;
+    virtual ExprResult visit(LambdaExpression *expr) override;
+    virtual ExprResult visit(CommandExpression *cmd) override;
+    virtual ExprResult visit(ArrayExpression *expr) override;
+    virtual ExprResult visit(IndexExpression *expr) override;
+    virtual ExprResult visit(SliceExpression *expr) override;
+    virtual ExprResult visit(DictionaryExpression *expr) override;
+    virtual ExprResult visit(StringExpression *expr) override;
+
+    virtual void visit(ExpressionStatement *stmt) override;
+    virtual void visit(VariableDeclaration *stmt) override;
+    virtual void visit(AssignmentStatement *stmt) override;
+    virtual void visit(CompoundAssignment *stmt) override;
+    virtual void visit(IncOrDecIdentifierStatement *stmt) override;
+    virtual void visit(BlockStatement *stmt) override;
+    virtual void visit(IfStatement *stmt) override;
+    virtual void visit(WhileStatement *stmt) override;
+    virtual void visit(ForStatement *stmt) override;
+    virtual void visit(BreakStatement *stmt) override;
+    virtual void visit(FunctionDeclaration *stmt) override;
+    virtual void visit(ReturnStatement *stmt) override;
+
+    // Missing nodes, such as an if without an else, are written as well so the reader knows they are missing
+    void write(const ExpressionPtr &expr);
+    void write(const StatementPtr &stmt);
+    void write(const std::vector<ExpressionPtr> &exprs);
+    void write(const Token &token);
+    void write(const std::vector<Token> &tokens);
+    void write(const std::optional<Slot> &slot);
+    void write(const Slot &slot);
+    void write(const std::vector<Slot> &slots);
+    void write(const Captures &captures);
+    void write(const Locals &locals);
+    void write_value(const std::optional<ExprResult> &value);
+    void write_string(std::string_view str);
+
+    template <class T> void put(std::string &output, T value);
+    template <class T> void put(T value) { put(body_, value); }
+
+  private:
+    // the text of every token, written once and referred to by offset
+    std::string strings_;
+    std::unordered_map<std::string_view, std::uint32_t> offsets_;
+    std::string body_;
+};
+
+class CacheReader {
+  public:
+    // The data is read from the start and the nodes are allocated in the program's arena
+    CacheReader(std::string_view data, Program &program) noexcept;
+
+    bool read_header(std::string_view source);
+    void read_statements();
+
+  private:
+    ExpressionPtr read_expression();
+    StatementPtr read_statement();
+    // Same as the above but the node may be missing
+    ExpressionPtr read_optional_expression();
+    StatementPtr read_optional_statement();
+
+    std::vector<ExpressionPtr> read_expressions();
+    Token read_token();
+    std::vector<Token> read_tokens();
+    // What a slot is read for, which decides what it's checked against
+    enum class SlotUse {
+        // reading or assigning a variable of any scope the environment can reach
+        ACCESS,
+        // defining a variable of the scope itself
+        DECLARATION,
+        // capturing a variable for a closure
+        CAPTURE
+    };
+
+    // Reads a closure's body within the scope of its parameters and locals, capturing the upvalues
+    StatementPtr read_closure_body(const std::vector<Token> &params, const Locals &locals, const Captures &captures,
+                                   const std::vector<Slot> &upvalues);
+    // Slots are checked against the scopes enclosing them, so one out of range is an error like any other corruption
+    std::optional<Slot> read_slot(SlotUse use);
+    Slot read_slot_value(SlotUse use);
+    // The variables a closure captures from the scopes it's created in
+    std::vector<Slot> read_slots();
+    Captures read_captures(const Locals &locals);
+    Locals read_locals();
+    std::optional<ExprResult> read_value();
+    std::string_view read_bytes(size_t size);
+    std::string_view read_string();
+
+    template <class T> T get();
+    // The number of elements which follow, each taking up at least a byte
+    std::uint32_t get_count();
+
+  private:
+    std::string_view data_;
+    size_t cursor_;
+    Program &program_;
+    // the text the tokens refer to, copied into the program's arena
+    std::string_view strings_;
+
+    // A scope enclosing the nodes being read
+    struct Scope {
+        const Locals *locals;
+        const Captures *captures;
+        // those of the closure whose outermost scope this is, null for any other scope
+        const std::vector<Slot> *upvalues;
+    };
+
+    // innermost last, empty at the top level
+    std::vector<Scope> scopes_;
+};
+
+} // namespace ankh::lang
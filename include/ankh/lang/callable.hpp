@@ -2,9 +2,12 @@
 
 #include <memory>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
 #include <ankh/lang/expr.hpp>
+#include <ankh/lang/expr_result.hpp>
 #include <ankh/lang/lambda.hpp>
 #include <ankh/lang/statement.hpp>
 
@@ -14,78 +17,139 @@
 
 namespace ankh::lang {
 
-struct Callable {
-    virtual ~Callable() = default;
+// Shares ownership of a callable with the values referring to it
+class CallablePtr {
+  public:
+    CallablePtr() noexcept : callable_(nullptr) {}
 
-    virtual std::string name() const noexcept = 0;
+    explicit CallablePtr(Callable *callable) noexcept : callable_(callable) {
+        if (callable_ != nullptr) {
+            retain(callable_);
+        }
+    }
 
-    virtual size_t arity() const noexcept = 0;
+    CallablePtr(const CallablePtr &other) noexcept : CallablePtr(other.callable_) {}
 
-    virtual void invoke(const std::vector<ExpressionPtr> &args) = 0;
-};
+    CallablePtr(CallablePtr &&other) noexcept : callable_(std::exchange(other.callable_, nullptr)) {}
 
-using CallablePtr = std::unique_ptr<Callable>;
+    CallablePtr &operator=(CallablePtr other) noexcept {
+        std::swap(callable_, other.callable_);
+
+        return *this;
+    }
+
+    ~CallablePtr() noexcept {
+        if (callable_ != nullptr) {
+            release(callable_);
+        }
+    }
+
+    Callable *get() const noexcept { return callable_; }
+
+    Callable *operator->() const noexcept { return callable_; }
+
+  private:
+    Callable *callable_;
+};
 
 template <class T, class... Args> CallablePtr make_callable(Args &&...args) noexcept {
-    return std::make_unique<T>(std::forward<Args>(args)...);
+    return CallablePtr(new T(std::forward<Args>(args)...));
 }
 
+// Makes the interpreter cache the calls it makes in the call sites of a program for as long as it's alive, after which
+// it goes back to the ones it was using before
+template <class I> class CallSiteScope {
+  public:
+    CallSiteScope(I *interpreter, CallSite *sites) noexcept
+        : interpreter_(interpreter), prev_(interpreter->use_call_sites(sites)) {}
+
+    CallSiteScope(const CallSiteScope &) = delete;
+    CallSiteScope &operator=(const CallSiteScope &) = delete;
+
+    ~CallSiteScope() noexcept { interpreter_->use_call_sites(prev_); }
+
+  private:
+    I *interpreter_;
+    CallSite *prev_;
+};
+
+// Functions and lambdas run with the caches of the program they're declared in, whichever program calls them
 template <class T, class I> class Function : public Callable {
   public:
-    Function(I *interpreter, FunctionDeclaration *decl, EnvironmentPtr<T> closure)
-        : interpreter_(interpreter), decl_(decl), closure_(closure) {}
+    Function(I *interpreter, FunctionDeclaration *decl, Upvalues<T> upvalues, CallSite *sites)
+        : interpreter_(interpreter), decl_(decl), upvalues_(std::move(upvalues)), sites_(sites) {}
 
-    virtual std::string name() const noexcept override { return decl_->name.str; }
+    virtual std::string_view name() const noexcept override { return decl_->name.str; }
 
     virtual size_t arity() const noexcept override { return decl_->params.size(); }
 
-    virtual void invoke(const std::vector<ExpressionPtr> &args) override {
-        EnvironmentPtr<T> environment(make_env<T>(closure_));
+    virtual T invoke(const std::vector<ExpressionPtr> &args) override {
+        // everything the body reads from outside the call is either captured or global
+        ScopedEnvironment<T> environment(interpreter_->frames(), nullptr, &decl_->locals, &decl_->captures, &upvalues_);
         ANKH_DEBUG("closure environment {} created", environment->scope());
         for (size_t i = 0; i < args.size(); ++i) {
-            const ExprResult arg = interpreter_->evaluate(args[i]);
-            if (!environment->declare(decl_->params[i].str, arg)) {
-                ANKH_FATAL("function parameter '{}' should always be declarable");
-            }
+            // parameters occupy the first slots of the environment in declaration order
+            environment->define(i, interpreter_->evaluate(args[i]));
         }
 
+        // the arguments are the caller's, so the body alone runs with the caches of the function's program
+        const CallSiteScope<I> call_sites(interpreter_, sites_);
         BlockStatement *block = static_cast<BlockStatement *>(decl_->body.get());
-        interpreter_->execute_block(block, environment);
+        if (interpreter_->execute_block(block, environment.get()) == Completion::RETURN) {
+            return interpreter_->take_return_value();
+        }
+
+        return {};
     }
 
+    virtual void trace(Tracer &tracer) const override { trace_value(upvalues_, tracer); }
+
+    virtual void clear() noexcept override { upvalues_.clear(); }
+
   private:
     I *interpreter_;
     FunctionDeclaration *decl_;
-    EnvironmentPtr<T> closure_;
+    Upvalues<T> upvalues_;
+    CallSite *sites_;
 };
 
 template <class T, class I> class Lambda : public Callable {
   public:
-    Lambda(I *interpreter, LambdaExpression *lambda, EnvironmentPtr<T> closure)
-        : interpreter_(interpreter), lambda_(lambda), closure_(closure) {}
+    Lambda(I *interpreter, LambdaExpression *lambda, Upvalues<T> upvalues, CallSite *sites)
+        : interpreter_(interpreter), lambda_(lambda), upvalues_(std::move(upvalues)), sites_(sites) {}
 
-    virtual std::string name() const noexcept override { return lambda_->generated_name; }
+    virtual std::string_view name() const noexcept override { return lambda_->generated_name; }
 
     virtual size_t arity() const noexcept override { return lambda_->params.size(); }
 
-    virtual void invoke(const std::vector<ExpressionPtr> &args) override {
-        EnvironmentPtr<T> environment(make_env<T>(closure_));
+    virtual T invoke(const std::vector<ExpressionPtr> &args) override {
+        // everything the body reads from outside the call is either captured or global
+        ScopedEnvironment<T> environment(interpreter_->frames(), nullptr, &lambda_->locals, &lambda_->captures,
+                                         &upvalues_);
         ANKH_DEBUG("closure environment {} created", environment->scope());
         for (size_t i = 0; i < args.size(); ++i) {
-            const ExprResult arg = interpreter_->evaluate(args[i]);
-            if (!environment->declare(lambda_->params[i].str, arg)) {
-                ANKH_FATAL("function parameter '{}' should always be declarable");
-            }
+            // parameters occupy the first slots of the environment in declaration order
+            environment->define(i, interpreter_->evaluate(args[i]));
         }
 
+        const CallSiteScope<I> call_sites(interpreter_, sites_);
         BlockStatement *block = static_cast<BlockStatement *>(lambda_->body.get());
-        interpreter_->execute_block(block, environment);
+        if (interpreter_->execute_block(block, environment.get()) == Completion::RETURN) {
+            return interpreter_->take_return_value();
+        }
+
+        return {};
     }
 
+    virtual void trace(Tracer &tracer) const override { trace_value(upvalues_, tracer); }
+
+    virtual void clear() noexcept override { upvalues_.clear(); }
+
   private:
     I *interpreter_;
     LambdaExpression *lambda_;
-    EnvironmentPtr<T> closure_;
+    Upvalues<T> upvalues_;
+    CallSite *sites_;
 };
 
 } // namespace ankh::lang
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <ankh/lang/bytecode.hpp>
+#include <ankh/lang/expr.hpp>
+#include <ankh/lang/lambda.hpp>
+#include <ankh/lang/program.hpp>
+#include <ankh/lang/statement.hpp>
+
+namespace ankh::lang {
+
+// Compiles programs into bytecode for the VM.
+// Variables declared at the top level of a program are globals; every other variable lives on the VM stack
+// and is captured by closures through upvalues.
+class Compiler : public ExpressionVisitor<ExprResult>, public StatementVisitor<void> {
+  public:
+    explicit Compiler(Globals &globals);
+
+    // Compiles the program into a function, taking no arguments, which runs the program's statements
+    std::unique_ptr<Prototype> compile(const Program &program);
+
+  private:
+    virtual ExprResult visit(BinaryExpression *expr) override;
+    virtual ExprResult visit(LogicalExpression *expr) override;
+    virtual ExprResult visit(UnaryExpression *expr) override;
+    virtual ExprResult visit(LiteralExpression *expr) override;
+    virtual ExprResult visit(ParenExpression *expr) override;
+    virtual ExprResult visit(IdentifierExpression *expr) override;
+    virtual ExprResult visit(CallExpression *expr) override;
+    virtual ExprResult visit(LambdaExpression *expr) override;
+    virtual ExprResult visit(CommandExpression *expr) override;
+    virtual ExprResult visit(ArrayExpression *expr) override;
+    virtual ExprResult visit(IndexExpression *expr) override;
+    virtual ExprResult visit(SliceExpression *expr) override;
+    virtual ExprResult visit(DictionaryExpression *expr) override;
+    virtual ExprResult visit(StringExpression *expr) override;
+
+    virtual void visit(ExpressionStatement *stmt) override;
+    virtual void visit(VariableDeclaration *stmt) override;
+    virtual void visit(AssignmentStatement *stmt) override;
+    virtual void visit(CompoundAssignment *stmt) override;
+    virtual void visit(IncOrDecIdentifierStatement *stmt) override;
+    virtual void visit(BlockStatement *stmt) override;
+    virtual void visit(IfStatement *stmt) override;
+    virtual void visit(WhileStatement *stmt) override;
+    virtual void visit(ForStatement *stmt) override;
+    virtual void visit(BreakStatement *stmt) override;
+    virtual void visit(FunctionDeclaration *stmt) override;
+    virtual void visit(ReturnStatement *stmt) override;
+
+  private:
+    struct Local {
+        std::string_view name;
+        size_t depth;
+        bool captured;
+        // false while the slot is only reserved for a variable declared further down its scope, see reserve_locals()
+        bool declared = true;
+    };
+
+    struct Upvalue {
+        std::uint16_t index;
+        // whether the upvalue captures a local of the enclosing function or one of its upvalues
+        bool is_local;
+    };
+
+    struct Loop {
+        // the scope depth the loop's body is nested in
+        size_t depth;
+        std::vector<size_t> breaks;
+    };
+
+    struct FunctionState {
+        std::unique_ptr<Prototype> prototype;
+        std::vector<Local> locals;
+        std::vector<Upvalue> upvalues;
+        std::vector<Loop> loops;
+        size_t depth;
+        // the depth of the scope a function declaration is declared in, whose variables its body sees even when
+        // they're declared after it, as it does with the interpreter. Lambdas only see what's declared before them.
+        std::optional<size_t> declared_in = std::nullopt;
+    };
+
+    void compile(const ExpressionPtr &expr);
+    void compile(const StatementPtr &stmt);
+
+    void compile_function(std::string_view name, const std::vector<Token> &params, const StatementPtr &body,
+                          const Token &marker, std::optional<size_t> declared_in = std::nullopt);
+    void compile_interpolation(const StringExpression *expr);
+    void compile_call(const CallExpression *expr, OpCode op);
+
+    FunctionState &current() noexcept;
+    Chunk &chunk() noexcept;
+    bool is_global_scope() const noexcept;
+
+    void begin_scope() noexcept;
+    void end_scope(const Token &marker);
+    void discard_locals(size_t depth, const Token &marker);
+
+    // Reserves the slots of the variables declared in a scope which declares functions, for the functions to capture
+    // before the variables are declared
+    void reserve_locals(const std::vector<StatementPtr> &statements);
+    void declare_local(const Token &name);
+    // The slot reserved for the variable in the current scope, if any, which is declared from then on
+    std::optional<std::uint16_t> declare_reserved(const Token &name) noexcept;
+    // Reserved slots are only found from a function declared at that depth or deeper
+    std::optional<std::uint16_t> resolve_local(FunctionState &fn, std::string_view name,
+                                               std::optional<size_t> reserved_from = std::nullopt) const noexcept;
+    std::optional<std::uint16_t> resolve_upvalue(size_t fn, std::string_view name);
+    std::uint16_t add_upvalue(FunctionState &fn, std::uint16_t index, bool is_local, const Token &marker);
+
+    void emit_get(const Token &name);
+    void emit_set(const Token &name);
+
+    void emit(OpCode op, const Token &marker);
+    void emit_u16(OpCode op, std::uint16_t operand, const Token &marker);
+    void emit_u32(OpCode op, std::uint32_t operand, const Token &marker);
+    void emit_constant(ExprResult constant, const Token &marker);
+    size_t emit_jump(OpCode op, const Token &marker);
+    void patch_jump(size_t offset);
+    void emit_loop(size_t start, const Token &marker);
+
+    std::uint32_t make_constant(ExprResult constant, const Token &marker);
+
+  private:
+    Globals &globals_;
+    std::vector<FunctionState> functions_;
+    // the most recently emitted marker, used by constructs without a token of their own
+    Token marker_;
+};
+
+} // namespace ankh::lang
@@ -1,11 +1,16 @@
 #pragma once
 
+#include <deque>
 #include <memory>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
+#include <ankh/lang/slot.hpp>
+#include <ankh/lang/types/gc.hpp>
 #include <ankh/log.hpp>
 
 namespace ankh::lang {
@@ -14,16 +19,85 @@ template <class T> class Environment;
 
 template <class T> using EnvironmentPtr = std::shared_ptr<Environment<T>>;
 
+// The variables a closure captured, each in a cell it shares with the scope which declared it
+template <class T> using Upvalues = std::vector<Gc<T>>;
+
+// An environment holds the variables of a single scope.
+// Locals resolved by the static analyzer live in a fixed size array of slots and are accessed by index, except for
+// those captured by closures which live in cells of their own so they can outlive the scope.
+// Globals, which may be declared across many programs, are kept by name.
 template <class T> class Environment {
   public:
-    Environment(EnvironmentPtr<T> enclosing = nullptr)
-        : enclosing_(enclosing), scope_(enclosing_ == nullptr ? 0 : 1 + enclosing->scope()) {}
+    Environment(EnvironmentPtr<T> enclosing = nullptr, const Locals *locals = nullptr,
+                const Captures *captures = nullptr, const Upvalues<T> *upvalues = nullptr) {
+        reset(std::move(enclosing), locals, captures, upvalues);
+    }
 
-    ANKH_NO_DISCARD bool assign(const std::string &name, const T &result) noexcept {
-        if (contains(name)) {
+    // Starts the environment over for another scope, keeping the room already reserved for the slots.
+    // The upvalues are those of the closure being called, if any, and are otherwise inherited from the enclosing scope.
+    void reset(EnvironmentPtr<T> enclosing, const Locals *locals, const Captures *captures,
+               const Upvalues<T> *upvalues) {
+        const size_t size = locals == nullptr ? 0 : locals->size();
+        slots_.clear();
+        slots_.resize(size);
+
+        cells_.clear();
+        if (captures != nullptr && !captures->empty()) {
+            cells_.resize(size);
+            for (const size_t index : *captures) {
+                cells_[index] = Gc<T>::make();
+            }
+        }
+
+        locals_ = locals;
+        values_.clear();
+        upvalues_ = upvalues == nullptr && enclosing != nullptr ? enclosing->upvalues_ : upvalues;
+        enclosing_ = std::move(enclosing);
+        scope_ = enclosing_ == nullptr ? 0 : 1 + enclosing_->scope();
+        ++generation_;
+    }
+
+    const T &value(const Slot &slot) const noexcept {
+        const T &result = at(slot);
+        ANKH_DEBUG("SLOT ({}, {}) = '{}' @ scope '{}'", slot.depth, slot.index, result.stringify(), scope());
+
+        return result;
+    }
+
+    void assign(const Slot &slot, const T &result) noexcept {
+        ANKH_DEBUG("SLOT ASSIGNMENT ({}, {}) = '{}' @ scope '{}'", slot.depth, slot.index, result.stringify(), scope());
+
+        at(slot) = result;
+    }
+
+    void define(size_t index, const T &result) noexcept {
+        ANKH_DEBUG("SLOT PUT {} = '{}' @ scope '{}'", index, result.stringify(), scope());
+
+        local(index) = result;
+    }
+
+    // The cells of the captured variables at the slots, for a closure created in this scope to share
+    Upvalues<T> capture(const std::vector<Slot> &slots) const {
+        Upvalues<T> upvalues;
+        upvalues.reserve(slots.size());
+        for (const Slot &slot : slots) {
+            upvalues.push_back(slot.upvalue ? (*upvalues_)[slot.index] : ancestor(slot.depth)->cells_[slot.index]);
+        }
+
+        return upvalues;
+    }
+
+    ANKH_NO_DISCARD bool assign(std::string_view name, const T &result) noexcept {
+        if (const auto it = values_.find(name); it != values_.end()) {
             ANKH_DEBUG("ASSIGNMENT '{}' = '{}' @ scope '{}'", name, result.stringify(), scope());
 
-            values_[name] = result;
+            it->second = result;
+
+            return true;
+        }
+
+        if (const auto index = slot_of(name); index.has_value()) {
+            local(index.value()) = result;
 
             return true;
         }
@@ -37,24 +111,28 @@ template <class T> class Environment {
         return false;
     }
 
-    ANKH_NO_DISCARD bool declare(const std::string &name, const T &result) noexcept {
+    ANKH_NO_DISCARD bool declare(std::string_view name, const T &result) noexcept {
         ANKH_DEBUG("PUT '{}' = '{}' @ scope '{}'", name, result.stringify(), scope());
         if (contains(name)) {
             ANKH_DEBUG("'{}' cannot be declared because it already exists in scope {}", name, scope());
             return false;
         }
 
-        values_[name] = result;
+        values_.emplace(name, result);
 
         return true;
     }
 
-    std::optional<T> value(const std::string &name) const noexcept {
+    std::optional<T> value(std::string_view name) const noexcept {
         if (const auto it = values_.find(name); it != values_.end()) {
             ANKH_DEBUG("IDENTIFIER '{}' = '{}' @ scope '{}'", name, it->second.stringify(), scope());
             return {it->second};
         }
 
+        if (const auto index = slot_of(name); index.has_value()) {
+            return {local(index.value())};
+        }
+
         if (enclosing_ != nullptr) {
             ANKH_DEBUG("IDENTIFIER LOOKUP '{}' @ enclosing scope '{}'", name, enclosing_->scope());
             return enclosing_->value(name);
@@ -63,18 +141,161 @@ template <class T> class Environment {
         return std::nullopt;
     }
 
-    bool contains(const std::string &key) const noexcept { return values_.count(key) > 0; }
+    // The value a name is bound to in this scope itself, if any. The value is updated in place when the variable is
+    // assigned and stays where it is until the environment starts over, see generation().
+    const T *binding(std::string_view name) const noexcept {
+        const auto it = values_.find(name);
+
+        return it == values_.end() ? nullptr : &it->second;
+    }
+
+    bool contains(std::string_view key) const noexcept { return values_.count(key) > 0 || slot_of(key).has_value(); }
 
     size_t scope() const noexcept { return scope_; }
 
+    // Changes every time the environment starts over, so a binding found in it is still valid as long as the
+    // generation it was found in is the current one. Generations are counted per environment: they only tell apart
+    // the bindings of a single one.
+    size_t generation() const noexcept { return generation_; }
+
+    // The variables of the scope itself, the captured ones through their cells
+    friend void trace_value(const Environment &env, Tracer &tracer) {
+        trace_value(env.slots_, tracer);
+        trace_value(env.cells_, tracer);
+        for (const auto &[name, value] : env.values_) {
+            trace_value(value, tracer);
+        }
+    }
+
+  private:
+    const T &at(const Slot &slot) const noexcept {
+        if (slot.upvalue) {
+            return *(*upvalues_)[slot.index];
+        }
+
+        return ancestor(slot.depth)->local(slot.index);
+    }
+
+    T &at(const Slot &slot) noexcept { return const_cast<T &>(std::as_const(*this).at(slot)); }
+
+    const T &local(size_t index) const noexcept {
+        if (!cells_.empty() && cells_[index]) {
+            return *cells_[index];
+        }
+
+        return slots_[index];
+    }
+
+    T &local(size_t index) noexcept { return const_cast<T &>(std::as_const(*this).local(index)); }
+
+    const Environment<T> *ancestor(size_t depth) const noexcept {
+        const Environment<T> *env = this;
+        for (size_t i = 0; i < depth; ++i) {
+            env = env->enclosing_.get();
+        }
+
+        return env;
+    }
+
+    Environment<T> *ancestor(size_t depth) noexcept {
+        return const_cast<Environment<T> *>(std::as_const(*this).ancestor(depth));
+    }
+
+    // Slots are only looked up by name when the caller has no static resolution to go by
+    std::optional<size_t> slot_of(std::string_view name) const noexcept {
+        if (locals_ == nullptr) {
+            return std::nullopt;
+        }
+
+        for (size_t i = locals_->size(); i > 0; --i) {
+            if ((*locals_)[i - 1] == name) {
+                return {i - 1};
+            }
+        }
+
+        return std::nullopt;
+    }
+
   private:
-    std::unordered_map<std::string, T> values_;
+    std::vector<T> slots_;
+    // the cells of the captured variables, indexed like the slots; empty when nothing is captured
+    std::vector<Gc<T>> cells_;
+    const Locals *locals_;
+    std::unordered_map<std::string, T, NameHash, std::equal_to<>> values_;
+    // the variables captured by the closure whose call this scope is part of
+    const Upvalues<T> *upvalues_;
     EnvironmentPtr<T> enclosing_;
-    const size_t scope_;
+    size_t scope_;
+    // starts at 1 after the first reset so that no environment is ever of generation 0
+    size_t generation_ = 0;
 };
 
 template <class T, class... Args> EnvironmentPtr<T> make_env(Args &&...args) noexcept {
     return std::make_shared<Environment<T>>(std::forward<Args>(args)...);
 }
 
+// The environments of the scopes being executed.
+// Closures only hold on to the cells of the variables they capture, never to whole environments, so scopes are
+// entered and exited in LIFO order and their environments are kept in a stack and reused. Entering a scope allocates
+// nothing once the stack has grown as deep as the program goes, unless the scope has variables closures capture.
+template <class T> class Frames {
+  public:
+    Frames() = default;
+
+    Frames(const Frames &) = delete;
+    Frames &operator=(const Frames &) = delete;
+
+    // The environment is only borrowed: the pointer owns nothing and must not be used once the frame is popped
+    EnvironmentPtr<T> push(EnvironmentPtr<T> enclosing, const Locals *locals, const Captures *captures,
+                           const Upvalues<T> *upvalues) {
+        if (top_ == frames_.size()) {
+            frames_.emplace_back();
+        }
+
+        Environment<T> &frame = frames_[top_++];
+        frame.reset(std::move(enclosing), locals, captures, upvalues);
+
+        // aliasing an empty pointer doesn't allocate a control block
+        return EnvironmentPtr<T>(EnvironmentPtr<T>(), &frame);
+    }
+
+    void pop() noexcept {
+        // the values go away with the scope, just like they would if the environment were destroyed
+        frames_[--top_].reset(nullptr, nullptr, nullptr, nullptr);
+    }
+
+    // The scopes being executed, leaving out the environments kept for reuse
+    friend void trace_value(const Frames &frames, Tracer &tracer) {
+        for (size_t i = 0; i < frames.top_; ++i) {
+            trace_value(frames.frames_[i], tracer);
+        }
+    }
+
+  private:
+    // a deque never moves its elements so the borrowed pointers stay valid as the stack grows
+    std::deque<Environment<T>> frames_;
+    size_t top_ = 0;
+};
+
+// The environment of a scope, borrowed from the frame stack for as long as the scope is being executed
+template <class T> class ScopedEnvironment {
+  public:
+    ScopedEnvironment(Frames<T> &frames, EnvironmentPtr<T> enclosing, const Locals *locals, const Captures *captures,
+                      const Upvalues<T> *upvalues = nullptr)
+        : frames_(frames), env_(frames.push(std::move(enclosing), locals, captures, upvalues)) {}
+
+    ScopedEnvironment(const ScopedEnvironment &) = delete;
+    ScopedEnvironment &operator=(const ScopedEnvironment &) = delete;
+
+    ~ScopedEnvironment() noexcept { frames_.pop(); }
+
+    const EnvironmentPtr<T> &get() const noexcept { return env_; }
+
+    Environment<T> *operator->() const noexcept { return env_.get(); }
+
+  private:
+    Frames<T> &frames_;
+    EnvironmentPtr<T> env_;
+};
+
 } // namespace ankh::lang
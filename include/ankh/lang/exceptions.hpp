@@ -22,6 +22,14 @@ struct ParseException : public std::runtime_error {
     explicit ParseException(const std::string &msg) : std::runtime_error(msg) {}
 };
 
+struct CacheException : public std::runtime_error {
+    explicit CacheException(const std::string &msg) : std::runtime_error(msg) {}
+};
+
+struct ExtensionException : public std::runtime_error {
+    explicit ExtensionException(const std::string &msg) : std::runtime_error(msg) {}
+};
+
 template <class E, class... Args> ANKH_NO_RETURN void panic(const Token &marker, const char *fmt, Args &&...args) {
     const std::string fmt_str = "{}:{}, " + std::string{fmt};
     const std::string str = std::vformat(fmt_str, std::make_format_args(marker.line, marker.col, args...));
@@ -1,17 +1,21 @@
 #pragma once
 
 #include <memory>
+#include <optional>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include <ankh/lang/arena.hpp>
 #include <ankh/lang/expr_result.hpp>
+#include <ankh/lang/slot.hpp>
 #include <ankh/lang/token.hpp>
 
 namespace ankh::lang {
 
 // forward declare our expression types for the visitor
 struct BinaryExpression;
+struct LogicalExpression;
 struct UnaryExpression;
 struct LiteralExpression;
 struct ParenExpression;
@@ -29,6 +33,7 @@ template <class R> struct ExpressionVisitor {
     virtual ~ExpressionVisitor() = default;
 
     virtual R visit(BinaryExpression *expr) = 0;
+    virtual R visit(LogicalExpression *expr) = 0;
     virtual R visit(UnaryExpression *expr) = 0;
     virtual R visit(LiteralExpression *expr) = 0;
     virtual R visit(ParenExpression *expr) = 0;
@@ -45,7 +50,7 @@ template <class R> struct ExpressionVisitor {
 
 struct Expression;
 
-using ExpressionPtr = std::unique_ptr<Expression>;
+using ExpressionPtr = ArenaPtr<Expression>;
 
 struct Expression {
     virtual ~Expression() = default;
@@ -68,8 +73,8 @@ template <class T> std::string stringify(const std::vector<T> &elems) noexcept {
     return result;
 }
 
-template <class T, class... Args> ExpressionPtr make_expression(Args &&...args) {
-    return std::make_unique<T>(std::forward<Args>(args)...);
+template <class T, class... Args> ExpressionPtr make_expression(Arena &arena, Args &&...args) {
+    return ExpressionPtr(arena.make<T>(std::forward<Args>(args)...));
 }
 
 struct BinaryExpression : public Expression {
@@ -83,7 +88,24 @@ struct BinaryExpression : public Expression {
     virtual ExprResult accept(ExpressionVisitor<ExprResult> *visitor) override { return visitor->visit(this); }
 
     virtual std::string stringify() const noexcept override {
-        return left->stringify() + " " + op.str + " " + right->stringify();
+        return left->stringify() + " " + std::string{op.str} + " " + right->stringify();
+    }
+};
+
+// && and || are kept apart from the other binary operators since their right operand is only evaluated when
+// the left operand doesn't already decide the result
+struct LogicalExpression : public Expression {
+    ExpressionPtr left;
+    Token op;
+    ExpressionPtr right;
+
+    LogicalExpression(ExpressionPtr left, Token op, ExpressionPtr right)
+        : left(std::move(left)), op(std::move(op)), right(std::move(right)) {}
+
+    virtual ExprResult accept(ExpressionVisitor<ExprResult> *visitor) override { return visitor->visit(this); }
+
+    virtual std::string stringify() const noexcept override {
+        return left->stringify() + " " + std::string{op.str} + " " + right->stringify();
     }
 };
 
@@ -95,29 +117,44 @@ struct UnaryExpression : public Expression {
 
     virtual ExprResult accept(ExpressionVisitor<ExprResult> *visitor) override { return visitor->visit(this); }
 
-    virtual std::string stringify() const noexcept override { return op.str + right->stringify(); }
+    virtual std::string stringify() const noexcept override { return std::string{op.str} + right->stringify(); }
 };
 
 struct LiteralExpression : public Expression {
     Token literal;
+    // set by the optimizer so the literal isn't converted every time it's evaluated
+    std::optional<ExprResult> value;
 
     LiteralExpression(Token literal) : literal(std::move(literal)) {}
 
+    LiteralExpression(Token literal, ExprResult value) : literal(std::move(literal)), value(std::move(value)) {}
+
     virtual ExprResult accept(ExpressionVisitor<ExprResult> *visitor) override { return visitor->visit(this); }
 
-    virtual std::string stringify() const noexcept override { return literal.str; }
+    virtual std::string stringify() const noexcept override { return std::string{literal.str}; }
 
     bool is_number() const noexcept { return literal.type == TokenType::NUMBER; }
 };
 
 struct StringExpression : public Expression {
     Token str;
+    // The string is split by the parser into the literal text around each substituted expression.
+    // There is always one more literal than substitutions.
+    std::vector<std::string> literals;
+    std::vector<ExpressionPtr> substitutions;
+    // A malformed string is only reported if it's evaluated
+    std::optional<std::string> error;
 
-    StringExpression(Token str) : str(std::move(str)) {}
+    StringExpression(Token str) : str(std::move(str)), literals{std::string{this->str.str}} {}
+
+    StringExpression(Token str, std::vector<std::string> literals, std::vector<ExpressionPtr> substitutions)
+        : str(std::move(str)), literals(std::move(literals)), substitutions(std::move(substitutions)) {}
+
+    StringExpression(Token str, std::string error) : str(std::move(str)), error(std::move(error)) {}
 
     virtual ExprResult accept(ExpressionVisitor<ExprResult> *visitor) override { return visitor->visit(this); }
 
-    virtual std::string stringify() const noexcept override { return str.str; }
+    virtual std::string stringify() const noexcept override { return std::string{str.str}; }
 };
 
 struct ParenExpression : public Expression {
@@ -132,18 +169,35 @@ struct ParenExpression : public Expression {
 
 struct IdentifierExpression : public Expression {
     Token name;
+    // set by the static analyzer for locals; globals are looked up by name
+    std::optional<Slot> slot;
 
     IdentifierExpression(Token name) : name(std::move(name)) {}
 
     virtual ExprResult accept(ExpressionVisitor<ExprResult> *visitor) override { return visitor->visit(this); }
 
-    virtual std::string stringify() const noexcept override { return name.str; }
+    virtual std::string stringify() const noexcept override { return std::string{name.str}; }
+};
+
+// A cache of what a call site's callee is bound to, filled in the first time the call is made.
+// Callees which are globals are read straight from their binding afterwards rather than looked up by name.
+// Every interpreter keeps caches of its own, indexed by CallExpression::site, so programs are never modified by
+// running them.
+struct CallSite {
+    enum class Callee { UNKNOWN, GLOBAL, OTHER };
+
+    Callee callee = Callee::UNKNOWN;
+    // the generation of the environment the binding is in, which is only valid for as long as that doesn't change
+    size_t generation = 0;
+    const ExprResult *binding = nullptr;
 };
 
 struct CallExpression : public Expression {
     Token marker;
     ExpressionPtr callee;
     std::vector<ExpressionPtr> args;
+    // the index of the call among those of its program, numbered by the static analyzer
+    size_t site = 0;
 
     CallExpression(Token marker, ExpressionPtr callee, std::vector<ExpressionPtr> args)
         : marker(std::move(marker)), callee(std::move(callee)), args(std::move(args)) {}
@@ -162,7 +216,7 @@ struct CommandExpression : public Expression {
 
     virtual ExprResult accept(ExpressionVisitor<ExprResult> *visitor) override { return visitor->visit(this); }
 
-    virtual std::string stringify() const noexcept override { return cmd.str; }
+    virtual std::string stringify() const noexcept override { return std::string{cmd.str}; }
 };
 
 struct ArrayExpression : public Expression {
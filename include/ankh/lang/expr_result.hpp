@@ -1,18 +1,42 @@
 #pragma once
 
+#include <functional>
+#include <new>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
+#include <ankh/lang/arena.hpp>
 #include <ankh/lang/types/array.hpp>
 #include <ankh/lang/types/dictionary.hpp>
+#include <ankh/lang/types/gc.hpp>
+#include <ankh/lang/types/string.hpp>
 
 #include <ankh/log.hpp>
-#include <utility>
 
 namespace ankh::lang {
 
 using Number = double;
 
-struct Callable;
+struct Expression;
+struct ExprResult;
+
+// Functions, lambdas and builtins. They are declared here rather than along with their implementations in
+// lang/callable.hpp so that values can count the references to them without a call.
+struct Callable : public Collectable {
+    // Owned by the callable, so it's only valid for as long as the callable is
+    virtual std::string_view name() const noexcept = 0;
+
+    virtual size_t arity() const noexcept = 0;
+
+    virtual ExprResult invoke(const std::vector<ArenaPtr<Expression>> &args) = 0;
+
+    // Most callables, such as builtins, refer to no values at all
+    virtual void trace(Tracer &tracer) const override { ANKH_UNUSED(tracer); }
+
+    virtual void clear() noexcept override {}
+};
 
 enum class ExprResultType { RT_STRING, RT_NUMBER, RT_BOOL, RT_CALLABLE, RT_ARRAY, RT_DICT, RT_NIL };
 
@@ -37,27 +61,57 @@ inline std::string expr_result_type_str(ankh::lang::ExprResultType type) noexcep
     }
 }
 
+// A tagged value. Strings, arrays, dicts and callables live behind a single reference counted pointer so that
+// a value is two words and creating numbers, booleans or nil never allocates.
 struct ExprResult {
-
-    std::string str;
     union {
         Number n;
         bool b;
         Callable *callable;
+        String str;
+        Array<ExprResult> array;
+        Dictionary<ExprResult> dict;
     };
-
-    Array<ExprResult> array;
-    Dictionary<ExprResult> dict;
     ExprResultType type;
 
-    ExprResult() : type(ExprResultType::RT_NIL) {}
+    ExprResult() noexcept : n(0), type(ExprResultType::RT_NIL) {}
     ExprResult(std::string str) : str(std::move(str)), type(ExprResultType::RT_STRING) {}
-    ExprResult(Number n) : n(n), type(ExprResultType::RT_NUMBER) {}
-    ExprResult(bool b) : b(b), type(ExprResultType::RT_BOOL) {}
-    ExprResult(Callable *callable) : callable(callable), type(ExprResultType::RT_CALLABLE) {}
+    ExprResult(String str) noexcept : str(std::move(str)), type(ExprResultType::RT_STRING) {}
+    ExprResult(Number n) noexcept : n(n), type(ExprResultType::RT_NUMBER) {}
+    ExprResult(bool b) noexcept : b(b), type(ExprResultType::RT_BOOL) {}
+    ExprResult(Callable *callable) noexcept : callable(callable), type(ExprResultType::RT_CALLABLE) {
+        retain(callable);
+    }
+
+    ExprResult(Array<ExprResult> array) noexcept : array(std::move(array)), type(ExprResultType::RT_ARRAY) {}
+    ExprResult(Dictionary<ExprResult> dict) noexcept : dict(std::move(dict)), type(ExprResultType::RT_DICT) {}
+
+    // the payload starts out zeroed so copying a boolean or nil never leaves the rest of it uninitialized
+    ExprResult(const ExprResult &other) noexcept : n(0), type(other.type) { copy(other); }
+
+    ExprResult(ExprResult &&other) noexcept : n(0), type(other.type) { move(std::move(other)); }
+
+    ExprResult &operator=(const ExprResult &other) noexcept {
+        if (this != &other) {
+            // other may be owned by this value, e.g. an element of this array
+            ExprResult copy(other);
+            *this = std::move(copy);
+        }
+
+        return *this;
+    }
 
-    ExprResult(Array<ExprResult> array) : array(array), type(ExprResultType::RT_ARRAY) {}
-    ExprResult(Dictionary<ExprResult> dict) : dict(dict), type(ExprResultType::RT_DICT) {}
+    ExprResult &operator=(ExprResult &&other) noexcept {
+        if (this != &other) {
+            destroy();
+            type = other.type;
+            move(std::move(other));
+        }
+
+        return *this;
+    }
+
+    ~ExprResult() noexcept { destroy(); }
 
     std::string stringify() const noexcept;
 
@@ -87,6 +141,144 @@ struct ExprResult {
     }
 
     friend bool operator!=(const ExprResult &lhs, const ExprResult &rhs) noexcept { return !(operator==(lhs, rhs)); }
+
+  private:
+    void copy(const ExprResult &other) noexcept {
+        switch (other.type) {
+        case ExprResultType::RT_STRING:
+            new (&str) String(other.str);
+            break;
+        case ExprResultType::RT_ARRAY:
+            new (&array) Array<ExprResult>(other.array);
+            break;
+        case ExprResultType::RT_DICT:
+            new (&dict) Dictionary<ExprResult>(other.dict);
+            break;
+        case ExprResultType::RT_NUMBER:
+            n = other.n;
+            break;
+        case ExprResultType::RT_BOOL:
+            b = other.b;
+            break;
+        case ExprResultType::RT_CALLABLE:
+            callable = other.callable;
+            retain(callable);
+            break;
+        case ExprResultType::RT_NIL:
+            break;
+        }
+    }
+
+    // leaves other as nil
+    void move(ExprResult &&other) noexcept {
+        switch (other.type) {
+        case ExprResultType::RT_STRING:
+            new (&str) String(std::move(other.str));
+            break;
+        case ExprResultType::RT_ARRAY:
+            new (&array) Array<ExprResult>(std::move(other.array));
+            break;
+        case ExprResultType::RT_DICT:
+            new (&dict) Dictionary<ExprResult>(std::move(other.dict));
+            break;
+        case ExprResultType::RT_NUMBER:
+            n = other.n;
+            break;
+        case ExprResultType::RT_BOOL:
+            b = other.b;
+            break;
+        case ExprResultType::RT_CALLABLE:
+            callable = other.callable;
+            // the reference is taken over rather than released
+            other.type = ExprResultType::RT_NIL;
+            break;
+        case ExprResultType::RT_NIL:
+            break;
+        }
+
+        other.destroy();
+        other.type = ExprResultType::RT_NIL;
+    }
+
+    void destroy() noexcept {
+        switch (type) {
+        case ExprResultType::RT_STRING:
+            str.~String();
+            break;
+        case ExprResultType::RT_ARRAY:
+            array.~Array();
+            break;
+        case ExprResultType::RT_DICT:
+            dict.~Dictionary();
+            break;
+        case ExprResultType::RT_CALLABLE:
+            release(callable);
+            break;
+        default:
+            break;
+        }
+    }
 };
 
+static_assert(sizeof(ExprResult) == 16, "ExprResult should be two words");
+
+inline void trace_value(const ExprResult &value, Tracer &tracer) {
+    switch (value.type) {
+    case ExprResultType::RT_ARRAY:
+        trace_value(value.array, tracer);
+        break;
+    case ExprResultType::RT_DICT:
+        trace_value(value.dict, tracer);
+        break;
+    case ExprResultType::RT_CALLABLE:
+        tracer.visit(value.callable);
+        break;
+    default:
+        break;
+    }
+}
+
 } // namespace ankh::lang
+
+// Values which compare equal hash equally, so any value can be a dictionary key
+template <> struct std::hash<ankh::lang::ExprResult> {
+    size_t operator()(const ankh::lang::ExprResult &result) const noexcept {
+        using ankh::lang::ExprResultType;
+
+        switch (result.type) {
+        case ExprResultType::RT_NIL:
+            return 0;
+        case ExprResultType::RT_STRING:
+            return std::hash<ankh::lang::String>{}(result.str);
+        case ExprResultType::RT_NUMBER:
+            // 0 and -0 are equal
+            return result.n == 0 ? 0 : std::hash<ankh::lang::Number>{}(result.n);
+        case ExprResultType::RT_BOOL:
+            return std::hash<bool>{}(result.b);
+        case ExprResultType::RT_CALLABLE:
+            return std::hash<ankh::lang::Callable *>{}(result.callable);
+        case ExprResultType::RT_ARRAY: {
+            size_t hash = result.array.size();
+            for (size_t i = 0; i < result.array.size(); ++i) {
+                hash = combine(hash, operator()(result.array[i]));
+            }
+            return hash;
+        }
+        case ExprResultType::RT_DICT: {
+            // equal dictionaries may have been built in different orders so their entries are combined commutatively
+            size_t hash = result.dict.size();
+            for (const auto &[key, value] : result.dict) {
+                hash += combine(operator()(key), operator()(value));
+            }
+            return hash;
+        }
+        default:
+            std::unreachable();
+        }
+    }
+
+  private:
+    static size_t combine(size_t seed, size_t hash) noexcept {
+        return seed ^ (hash + 0x9e3779b97f4a7c15 + (seed << 6) + (seed >> 2));
+    }
+};
@@ -1,47 +1,77 @@
 #pragma once
 
+#include <optional>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include <ankh/lang/builtins.hpp>
 #include <ankh/lang/callable.hpp>
 #include <ankh/lang/env.hpp>
 #include <ankh/lang/expr.hpp>
 #include <ankh/lang/expr_result.hpp>
 #include <ankh/lang/lambda.hpp>
+#include <ankh/lang/native.hpp>
+#include <ankh/lang/profiler.hpp>
 #include <ankh/lang/program.hpp>
 #include <ankh/lang/statement.hpp>
 
 namespace ankh::lang {
 
-class Interpreter : public ExpressionVisitor<ExprResult>, public StatementVisitor<void> {
+class Interpreter : public ExpressionVisitor<ExprResult>, public StatementVisitor<void>, private Roots {
   public:
     Interpreter();
+    virtual ~Interpreter() noexcept;
 
     void interpret(Program &&program);
 
-    virtual ExprResult evaluate(const ExpressionPtr &expr);
-    void execute(const StatementPtr &stmt);
+    // Runs a prepared program without consuming it. The interpreter holds on to the program, which its functions and
+    // lambdas refer to, until it's reset. Throws an InterpretationException if the program has errors.
+    void run(const PreparedProgram &program);
+
+    // Starts over as a fresh interpreter would, but for the natives loaded so far, and lets go of the programs run.
+    // Functions and lambdas taken out of the interpreter must not be used once it's reset.
+    void reset();
+
+    // Defines the natives as globals. Throws an InterpretationException if one of them is already defined.
+    void load(const Natives &natives);
 
-    void execute_block(const BlockStatement *stmt, EnvironmentPtr<ExprResult> environment);
+    // Sets a global for the programs run from now on, declaring it if it isn't yet
+    void set_global(std::string_view name, const ExprResult &value);
 
-    // Builtins
+    std::optional<ExprResult> global(std::string_view name) const noexcept;
+
+    virtual ExprResult evaluate(const ExpressionPtr &expr);
+    Completion execute(const StatementPtr &stmt);
 
-    void print(const std::vector<ExprResult> &args) const;
-    void exit(const std::vector<ExprResult> &args) const;
-    void length(const std::vector<ExprResult> &args) const;
-    void cast_int(const std::vector<ExprResult> &args) const;
-    void append(const std::vector<ExprResult> &args) const;
-    void str(const std::vector<ExprResult> &args) const;
-    void keys(const std::vector<ExprResult> &args) const;
-    void exportfn(const std::vector<ExprResult> &args) const;
+    Completion execute_block(const BlockStatement *stmt, EnvironmentPtr<ExprResult> environment);
+
+    // Consumes the return completion, yielding the value of the return statement which caused it
+    ExprResult take_return_value() noexcept;
 
     inline const Environment<ExprResult> &environment() const noexcept { return *current_env_; }
 
+    inline Frames<ExprResult> &frames() noexcept { return frames_; }
+
     inline const std::unordered_map<std::string, CallablePtr> &functions() const noexcept { return functions_; }
 
+    // Samples the calls made from now on into the profiler, or stops sampling them when it's null
+    inline void profile(Profiler *profiler) noexcept { profiler_ = profiler; }
+
+    // The heap of the values created by the programs the interpreter runs
+    inline Heap &heap() noexcept { return heap_; }
+
+    // What the builtins keep between the calls the interpreter makes, cleared when it's reset
+    inline BuiltinState &builtin_state() noexcept { return builtin_state_; }
+
+    // Caches the calls made from now on in the call sites given, returning the ones used so far, see CallSiteScope
+    inline CallSite *use_call_sites(CallSite *sites) noexcept { return std::exchange(sites_, sites); }
+
   private:
     virtual ExprResult visit(BinaryExpression *expr) override;
+    virtual ExprResult visit(LogicalExpression *expr) override;
     virtual ExprResult visit(UnaryExpression *expr) override;
     virtual ExprResult visit(LiteralExpression *expr) override;
     virtual ExprResult visit(ParenExpression *expr) override;
@@ -68,28 +98,61 @@ class Interpreter : public ExpressionVisitor<ExprResult>, public StatementVisito
     virtual void visit(FunctionDeclaration *stmt) override;
     virtual void visit(ReturnStatement *stmt) override;
 
+    // The value called by a call, read through the call site's cache when the callee is a global
+    ExprResult callee_of(CallExpression *expr);
+
+    void assign(const AssignmentStatement *stmt, const ExprResult &result);
+    // Evaluates the call of `xs = f(xs, ...)` such that a builtin can modify xs in place
+    ExprResult reassign_argument(AssignmentStatement *stmt);
+
     std::string substitute(const StringExpression *expr);
-    ExprResult evaluate_single_expr(const Token &marker, const std::string &str);
-    void declare_function(FunctionDeclaration *decl, EnvironmentPtr<ExprResult> env);
+    void declare_function(FunctionDeclaration *decl, const EnvironmentPtr<ExprResult> &env);
+
+    // the roots of the heap are the global environment and those of the scopes being executed
+    virtual void trace(Tracer &tracer) const override;
 
   private:
+    // declared first so every value the interpreter holds is freed before it
+    Heap heap_;
+    // declared next so the frames outlive every environment borrowing one
+    Frames<ExprResult> frames_;
     EnvironmentPtr<ExprResult> current_env_;
     EnvironmentPtr<ExprResult> global_;
-    std::vector<Program> programs_;
+    // A program run by the interpreter along with the caches of its call sites
+    struct RunProgram {
+        PreparedProgram program;
+        std::vector<CallSite> sites;
+    };
+
+    std::vector<RunProgram> programs_;
+    // the caches of the call sites of the program whose code is running
+    CallSite *sites_ = nullptr;
+
+    // how the most recently executed statement completed and, for a return, the value returned
+    Completion completion_ = Completion::NORMAL;
+    ExprResult return_value_;
+
+    Profiler *profiler_ = nullptr;
 
     class ScopeGuard {
       public:
-        ScopeGuard(ankh::lang::Interpreter *interpreter, ankh::lang::EnvironmentPtr<ExprResult> enclosing);
+        ScopeGuard(ankh::lang::Interpreter *interpreter, ankh::lang::EnvironmentPtr<ExprResult> enclosing,
+                   const Locals *locals, const Captures *captures);
         ~ScopeGuard();
 
       private:
         ankh::lang::Interpreter *interpreter_;
+        // the environment is released only once the previous one is current again
+        ScopedEnvironment<ExprResult> env_;
         ankh::lang::EnvironmentPtr<ExprResult> prev_;
     };
 
     // TODO: this assumes all functions are in global namespace
     // That's OK for now but needs to be revisited when implementing modules
     std::unordered_map<std::string, CallablePtr> functions_;
+    // defined again whenever the interpreter is reset
+    std::vector<CallablePtr> natives_;
+    BuiltinState builtin_state_;
 };
 
 } // namespace ankh::lang
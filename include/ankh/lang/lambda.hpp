@@ -14,6 +14,12 @@ struct LambdaExpression : public Expression {
     std::string generated_name;
     std::vector<Token> params;
     StatementPtr body;
+    // the parameters, which make up the scope enclosing the body
+    Locals locals;
+    // the variables of the scope which closures capture, see BlockStatement
+    Captures captures;
+    // where the variables the closure captures are found when it's created, in upvalue order
+    std::vector<Slot> upvalues;
 
     LambdaExpression(Token marker, std::string generated_name, std::vector<Token> params, StatementPtr body)
         : marker(std::move(marker)), generated_name(std::move(generated_name)), params(std::move(params)),
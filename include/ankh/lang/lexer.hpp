@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include <ankh/lang/token.hpp>
@@ -9,10 +10,10 @@ namespace ankh::lang {
 
 class Lexer {
   public:
-    Lexer(std::string text);
+    // The tokens are views into the text, which has to outlive them
+    Lexer(std::string_view text);
 
     Token next();
-    Token peek() noexcept;
 
     bool is_eof() const noexcept;
 
@@ -31,18 +32,20 @@ class Lexer {
     char peekc() const noexcept;
     char advance() noexcept;
 
-    Token tokenize(char c, TokenType type) const noexcept;
-    Token tokenize(const std::string &s, TokenType type) const noexcept;
+    // The text from start up to the cursor
+    std::string_view lexeme(size_t start) const noexcept;
+    Token tokenize(std::string_view s, TokenType type) const noexcept;
 
   private:
-    const std::string text_;
+    const std::string_view text_;
     size_t cursor_;
     size_t line_;
     size_t col_;
 };
 
-bool is_keyword(const std::string &str) noexcept;
+bool is_keyword(std::string_view str) noexcept;
 
-std::vector<Token> scan(const std::string &source);
+// Tokenizes the source without copying any of it: the tokens refer to the source, which has to outlive them
+std::vector<Token> scan(std::string_view source);
 
 } // namespace ankh::lang
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <limits>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <ankh/def.hpp>
+
+#include <ankh/lang/exceptions.hpp>
+#include <ankh/lang/expr_result.hpp>
+#include <ankh/lang/operators.hpp>
+#include <ankh/lang/types/array.hpp>
+#include <ankh/lang/types/dictionary.hpp>
+
+namespace ankh::lang {
+
+// A function implemented in C++ which scripts call like any other. The arguments have already been evaluated and
+// checked against the function's arity and are the function's to take over: a value which isn't shared with any
+// variable can be modified in place.
+using NativeFunction = ExprResult (*)(std::span<ExprResult> args);
+
+struct NativeDefinition {
+    std::string name;
+    size_t arity;
+    NativeFunction fn;
+};
+
+// The name of a native known at compile time, so that a typed native can report its bad arguments by name
+template <size_t N> struct NativeName {
+    char str[N];
+
+    constexpr NativeName(const char (&name)[N]) noexcept { std::copy_n(name, N, str); }
+};
+
+ANKH_NO_RETURN inline void argument_panic(const char *name, size_t position, const char *expected,
+                                         const ExprResult &arg) {
+    builtin_panic<InterpretationException>(name, "argument {} must be {} rather than {}", position, expected,
+                                           expr_result_type_str(arg.type));
+}
+
+// Converts the arguments of typed natives from values and their results back to values.
+// Strings may be taken as std::string_view, which refers to the argument and is only valid during the call.
+template <class T> struct Marshal;
+
+template <> struct Marshal<ExprResult> {
+    static ExprResult &&from(ExprResult &arg, const char *name, size_t position) noexcept {
+        ANKH_UNUSED(name);
+        ANKH_UNUSED(position);
+
+        return std::move(arg);
+    }
+
+    static ExprResult to(ExprResult result) noexcept { return result; }
+};
+
+template <> struct Marshal<Number> {
+    static Number from(const ExprResult &arg, const char *name, size_t position) {
+        if (arg.type != ExprResultType::RT_NUMBER) {
+            argument_panic(name, position, "a number", arg);
+        }
+
+        return arg.n;
+    }
+
+    static ExprResult to(Number result) noexcept { return result; }
+};
+
+template <> struct Marshal<bool> {
+    static bool from(const ExprResult &arg, const char *name, size_t position) {
+        if (arg.type != ExprResultType::RT_BOOL) {
+            argument_panic(name, position, "a boolean", arg);
+        }
+
+        return arg.b;
+    }
+
+    static ExprResult to(bool result) noexcept { return result; }
+};
+
+template <std::integral T> struct Marshal<T> {
+    static T from(const ExprResult &arg, const char *name, size_t position) {
+        if (arg.type != ExprResultType::RT_NUMBER || !is_integer(arg.n)) {
+            argument_panic(name, position, "an integer", arg);
+        }
+
+        // the bounds are powers of two (or zero) so they're exact as numbers, unlike the greatest value of T
+        const Number lowest = static_cast<Number>(std::numeric_limits<T>::min());
+        const Number bound = std::ldexp(Number{1}, std::numeric_limits<T>::digits);
+        if (!(arg.n >= lowest && arg.n < bound)) {
+            argument_panic(name, position, "an integer in range", arg);
+        }
+
+        return static_cast<T>(arg.n);
+    }
+
+    static ExprResult to(T result) noexcept { return static_cast<Number>(result); }
+};
+
+template <> struct Marshal<std::string> {
+    static std::string from(const ExprResult &arg, const char *name, size_t position) {
+        if (arg.type != ExprResultType::RT_STRING) {
+            argument_panic(name, position, "a string", arg);
+        }
+
+        return arg.str.value();
+    }
+
+    static ExprResult to(std::string result) { return result; }
+};
+
+template <> struct Marshal<std::string_view> {
+    static std::string_view from(const ExprResult &arg, const char *name, size_t position) {
+        if (arg.type != ExprResultType::RT_STRING) {
+            argument_panic(name, position, "a string", arg);
+        }
+
+        return arg.str.value();
+    }
+
+    static ExprResult to(std::string_view result) { return std::string{result}; }
+};
+
+template <> struct Marshal<Array<ExprResult>> {
+    static Array<ExprResult> from(ExprResult &arg, const char *name, size_t position) {
+        if (arg.type != ExprResultType::RT_ARRAY) {
+            argument_panic(name, position, "an array", arg);
+        }
+
+        return std::move(arg.array);
+    }
+
+    static ExprResult to(Array<ExprResult> result) noexcept { return result; }
+};
+
+template <> struct Marshal<Dictionary<ExprResult>> {
+    static Dictionary<ExprResult> from(ExprResult &arg, const char *name, size_t position) {
+        if (arg.type != ExprResultType::RT_DICT) {
+            argument_panic(name, position, "a dict", arg);
+        }
+
+        return std::move(arg.dict);
+    }
+
+    static ExprResult to(Dictionary<ExprResult> result) noexcept { return result; }
+};
+
+template <class R, class... Args> constexpr size_t arity_of(R (*fn)(Args...)) noexcept {
+    ANKH_UNUSED(fn);
+
+    return sizeof...(Args);
+}
+
+template <NativeName Name, class R, class... Args, size_t... I>
+ExprResult call_typed(R (*fn)(Args...), std::span<ExprResult> args, std::index_sequence<I...>) {
+    static_assert((!std::is_same_v<Args, ExprResult &> && ...), "values are taken by value or const reference");
+
+    if constexpr (std::is_void_v<R>) {
+        fn(Marshal<std::remove_cvref_t<Args>>::from(args[I], Name.str, I + 1)...);
+
+        return {};
+    } else {
+        return Marshal<std::remove_cvref_t<R>>::to(
+            fn(Marshal<std::remove_cvref_t<Args>>::from(args[I], Name.str, I + 1)...));
+    }
+}
+
+// The native function calling a typed one with its arguments converted
+template <NativeName Name, auto F> ExprResult typed_native(std::span<ExprResult> args) {
+    return call_typed<Name>(F, args, std::make_index_sequence<arity_of(F)>{});
+}
+
+// The native functions an embedder or an extension makes available to scripts, see Interpreter::load and VM::load
+class Natives {
+  public:
+    // Defines a function taking its arguments as they are
+    void define(std::string name, size_t arity, NativeFunction fn) {
+        definitions_.push_back(NativeDefinition{std::move(name), arity, fn});
+    }
+
+    // Defines a function taking and returning C++ types, e.g. `std::string repeat(std::string_view, int)` with
+    // `natives.define<"repeat", repeat>()`. Arguments of the wrong type are reported before the function is called.
+    template <NativeName Name, auto F> void define() { define(Name.str, arity_of(F), &typed_native<Name, F>); }
+
+    const std::vector<NativeDefinition> &definitions() const noexcept { return definitions_; }
+
+  private:
+    std::vector<NativeDefinition> definitions_;
+};
+
+// The function a shared object defines to be loaded as an extension, e.g.
+//
+//     ANKH_EXTENSION(natives) { natives.define<"repeat", repeat>(); }
+//
+// Extensions are built against the same headers as the host and without linking ankhlang, whose symbols the host
+// exports: values are shared between the two, and so must be the heap they live in.
+#define ANKH_EXTENSION(natives) extern "C" void ankh_extension(ankh::lang::Natives &natives)
+
+// Loads the shared object at the path and adds the natives it defines. Extensions are never unloaded since values may
+// refer to their functions for as long as the process runs.
+// Throws an ExtensionException if the shared object can't be loaded or isn't an extension.
+void load_extension(const std::string &path, Natives &natives);
+
+} // namespace ankh::lang
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <algorithm>
+#include <initializer_list>
+#include <optional>
+
+#include <ankh/lang/exceptions.hpp>
+#include <ankh/lang/expr_result.hpp>
+#include <ankh/lang/token.hpp>
+
+// The semantics of the language's operators, shared by every execution engine.
+// Each operation reports errors against the provided marker token.
+
+namespace ankh::lang {
+
+inline bool operands_are(ExprResultType type, std::initializer_list<ExprResult> elems) noexcept {
+    return std::all_of(elems.begin(), elems.end(), [=](const ExprResult &result) { return type == result.type; });
+}
+
+bool is_integer(Number n) noexcept;
+
+Number to_num(const Token &literal);
+
+ExprResult negate(const Token &marker, const ExprResult &result);
+
+ExprResult invert(const Token &marker, const ExprResult &result);
+
+ExprResult eqeq(const Token &marker, const ExprResult &left, const ExprResult &right);
+
+ExprResult division(const Token &marker, const ExprResult &left, const ExprResult &right);
+
+// Applies the binary operator, other than the logical ones, to its operands
+ExprResult binary(const Token &op, const ExprResult &left, const ExprResult &right);
+
+ExprResult unary(const Token &op, const ExprResult &right);
+
+// We handle + separately as it has two overloads for numbers and strings
+// The generic arithmetic() function overloads all of the general arithmetic operations
+// on only numbers
+ExprResult plus(const Token &marker, const ExprResult &left, const ExprResult &right);
+
+bool truthy(const Token &marker, const ExprResult &result);
+
+// Whether the left operand of a logical operator decides the result on its own,
+// in which case it is the result and the right operand is never evaluated
+bool short_circuits(const Token &marker, const ExprResult &left);
+
+// The result of a logical operator whose left operand didn't short circuit it is its right operand
+ExprResult logical(const Token &marker, const ExprResult &right);
+
+ExprResult index(const Token &marker, const ExprResult &indexee, const ExprResult &index);
+
+ExprResult slice(const Token &marker, const ExprResult &indexee, const std::optional<ExprResult> &begin,
+                 const std::optional<ExprResult> &end);
+
+template <class BinaryOperation>
+ExprResult arithmetic(const Token &marker, const ExprResult &left, const ExprResult &right, BinaryOperation op) {
+    if (operands_are(ExprResultType::RT_NUMBER, {left, right})) {
+        return op(left.n, right.n);
+    }
+
+    panic<InterpretationException>(
+        marker, "runtime error: unknown overload of operator({}) with LHS as {} and RHS as {}", marker.str,
+        expr_result_type_str(left.type), expr_result_type_str(right.type));
+}
+
+template <class Compare>
+ExprResult compare(const Token &marker, const ExprResult &left, const ExprResult &right, Compare cmp) {
+    if (operands_are(ExprResultType::RT_NUMBER, {left, right})) {
+        return cmp(left.n, right.n);
+    }
+
+    if (operands_are(ExprResultType::RT_STRING, {left, right})) {
+        return cmp(left.str, right.str);
+    }
+
+    panic<InterpretationException>(
+        marker, "runtime error: unknown overload of operator({}) with LHS as {} and RHS as {}", marker.str,
+        expr_result_type_str(left.type), expr_result_type_str(right.type));
+}
+
+} // namespace ankh::lang
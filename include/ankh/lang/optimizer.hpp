@@ -0,0 +1,70 @@
+#pragma once
+
+#include <optional>
+
+#include <ankh/lang/arena.hpp>
+#include <ankh/lang/expr.hpp>
+#include <ankh/lang/program.hpp>
+#include <ankh/lang/statement.hpp>
+#include <ankh/lang/token.hpp>
+
+namespace ankh::lang {
+
+class Optimizer : public ExpressionVisitor<ExprResult>, public StatementVisitor<void> {
+  public:
+    // Rewrites the program so less of it is left to be done at runtime.
+    // Literals are converted to their values once and expressions made up only of constants are folded into literals.
+    // Expressions which would fail are left as they are so the error is still raised if they are ever evaluated.
+    void optimize(Program &program);
+
+  private:
+    virtual ExprResult visit(BinaryExpression *expr) override;
+    virtual ExprResult visit(LogicalExpression *expr) override;
+    virtual ExprResult visit(UnaryExpression *expr) override;
+    virtual ExprResult visit(LiteralExpression *expr) override;
+    virtual ExprResult visit(ParenExpression *expr) override;
+    virtual ExprResult visit(IdentifierExpression *expr) override;
+    virtual ExprResult visit(CallExpression *expr) override;
+    virtual ExprResult visit(LambdaExpression *expr) override;
+    virtual ExprResult visit(CommandExpression *cmd) override;
+    virtual ExprResult visit(ArrayExpression *expr) override;
+    virtual ExprResult visit(IndexExpression *expr) override;
+    virtual ExprResult visit(SliceExpression *expr) override;
+    virtual ExprResult visit(DictionaryExpression *expr) override;
+    virtual ExprResult visit(StringExpression *expr) override;
+
+    virtual void visit(ExpressionStatement *stmt) override;
+    virtual void visit(VariableDeclaration *stmt) override;
+    virtual void visit(AssignmentStatement *stmt) override;
+    virtual void visit(CompoundAssignment *stmt) override;
+    virtual void visit(IncOrDecIdentifierStatement *stmt) override;
+    virtual void visit(BlockStatement *stmt) override;
+    virtual void visit(IfStatement *stmt) override;
+    virtual void visit(WhileStatement *stmt) override;
+    virtual void visit(ForStatement *stmt) override;
+    virtual void visit(BreakStatement *stmt) override;
+    virtual void visit(FunctionDeclaration *stmt) override;
+    virtual void visit(ReturnStatement *stmt) override;
+
+    // Optimizes the expression, replacing it with a literal if it folds into a constant
+    void optimize(ExpressionPtr &expr);
+    void optimize(const StatementPtr &stmt);
+
+    // Records that the expression being optimized folds into the value, reported at the marker
+    void fold(const Token &marker, ExprResult value);
+
+    // The value of the expression if it's a constant
+    static const ExprResult *constant(const ExpressionPtr &expr) noexcept;
+
+  private:
+    struct Folded {
+        Token marker;
+        ExprResult value;
+    };
+
+    std::optional<Folded> folded_;
+    // where the folded literals are allocated, which is the arena of the program being optimized
+    Arena *arena_ = nullptr;
+};
+
+} // namespace ankh::lang
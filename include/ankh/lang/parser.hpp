@@ -1,9 +1,13 @@
 #pragma once
 
+#include <array>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include <ankh/lang/arena.hpp>
 #include <ankh/lang/expr.hpp>
+#include <ankh/lang/lexer.hpp>
 #include <ankh/lang/program.hpp>
 #include <ankh/lang/statement.hpp>
 #include <ankh/lang/token.hpp>
@@ -12,7 +16,9 @@ namespace ankh::lang {
 
 class Parser {
   public:
-    explicit Parser(const std::vector<Token> &tokens);
+    // The source is scanned as the parser goes so it has to outlive the parsed program.
+    // The arena holds whatever the tokens refer to, such as the source itself.
+    explicit Parser(std::string_view source, Arena arena = Arena());
 
     Program parse() noexcept;
 
@@ -47,6 +53,8 @@ class Parser {
     ExpressionPtr index(ExpressionPtr indexable);
     ExpressionPtr access(ExpressionPtr accessible);
     ExpressionPtr primary();
+    ExpressionPtr parse_string(const Token &str);
+    ExpressionPtr parse_substitution(const Token &marker, const std::string &str);
     ExpressionPtr lambda();
     ExpressionPtr parse_array();
 
@@ -56,9 +64,14 @@ class Parser {
 
     void semicolon();
 
-    const Token &prev() const noexcept;
-    const Token &curr() const noexcept;
-    const Token &advance() noexcept;
+    // Tokens are returned by value since their slot in the window is reused as the parser advances
+    Token prev() const noexcept;
+    Token curr() const noexcept;
+    Token advance() noexcept;
+
+    // Scans the token at the cursor into the window.
+    // A token which can't be scanned is reported as an error and skipped.
+    void scan_current() noexcept;
 
     bool match(TokenType type) noexcept;
     bool match(std::initializer_list<TokenType> types) noexcept;
@@ -71,8 +84,15 @@ class Parser {
     void synchronize_next_statement() noexcept;
 
   private:
-    std::vector<Token> tokens_;
+    // the parser only ever looks at the previous and current tokens so that's all that is kept of the source
+    static constexpr size_t WINDOW = 2;
+
+    Lexer lexer_;
+    std::array<Token, WINDOW> window_;
     size_t cursor_;
+    std::vector<std::string> errors_;
+    // the nodes are allocated here until the parsed program takes it over
+    Arena arena_;
 };
 
 template <class ExpectedType, class Ptr> ExpectedType *instance(const Ptr &ptr) noexcept {
@@ -83,6 +103,13 @@ template <class ExpectedType, class Ptr> bool instanceof (const Ptr &ptr) noexce
     return instance<ExpectedType>(ptr) != nullptr;
 }
 
+// Parses the source, which is copied into the program so the program can outlive it
 Program parse(const std::string &source);
 
+// Parses the source without copying it, so it has to outlive the program e.g. a script mapped into memory
+Program parse_in_place(std::string_view source);
+
+// Parses the source into a program to be run many times, which has errors if the source can't be parsed
+PreparedProgram prepare(const std::string &source);
+
 } // namespace ankh::lang
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <ankh/lang/expr_result.hpp>
+#include <ankh/lang/token.hpp>
+
+namespace ankh::lang {
+
+// A sampling profiler for the interpreter.
+// A SIGPROF timer ticks every interval of CPU time. The signal handler only counts the ticks: the interpreter samples
+// its call stack the next time it executes a statement or makes a call, where the stack is consistent, and charges the
+// sample with the CPU time used since the previous one, since the timer is only as precise as the kernel's clock tick.
+// Samples are aggregated by call stack as they are taken.
+// Arguments are evaluated once the call has been entered, so they are charged to the function called with them.
+class Profiler {
+  public:
+    // The time sampled in a function itself and in the functions it called
+    struct Times {
+        std::chrono::microseconds self{0};
+        std::chrono::microseconds total{0};
+    };
+
+    explicit Profiler(std::chrono::microseconds interval = std::chrono::milliseconds(1)) noexcept
+        : interval_(interval) {}
+    ~Profiler() noexcept { stop(); }
+
+    Profiler(const Profiler &) = delete;
+    Profiler &operator=(const Profiler &) = delete;
+
+    // Only a single profiler can be running at a time since the ticks come from a process wide signal
+    bool start() noexcept;
+    void stop() noexcept;
+
+    // The callee is kept alive by the call for as long as it's on the stack
+    void enter(const Callable *callee, const Token &site) {
+        frames_.push_back(Frame{callee, &site});
+        poll();
+    }
+
+    void leave() noexcept { frames_.pop_back(); }
+
+    void poll() {
+        if (ticks_.load(std::memory_order_relaxed) != 0) {
+            sample();
+        }
+    }
+
+    // Every call stack sampled along with its time in microseconds, in the folded format flame graph tools read:
+    // `<script>;fib (12:5);fib (4:16) 420`, with each function named along with the line and column it's called at
+    void write_folded(std::ostream &out) const;
+
+    // The self and total time of every function sampled, sorted by self time
+    void write_table(std::ostream &out) const;
+
+    std::chrono::microseconds total() const noexcept { return total_; }
+
+    const std::unordered_map<std::string, Times> &functions() const noexcept { return functions_; }
+
+  private:
+    struct Frame {
+        const Callable *callee;
+        const Token *site;
+    };
+
+    void sample();
+
+    static void tick(int signal) noexcept;
+
+  private:
+    // written by the signal handler, which has no way to tell which profiler is running
+    static std::atomic<size_t> ticks_;
+
+    const std::chrono::microseconds interval_;
+    bool running_ = false;
+    std::vector<Frame> frames_;
+    std::unordered_map<std::string, std::chrono::microseconds> stacks_;
+    std::unordered_map<std::string, Times> functions_;
+    std::chrono::microseconds total_{0};
+    // the CPU time when the previous sample was taken
+    std::chrono::microseconds sampled_{0};
+};
+
+} // namespace ankh::lang
@@ -1,17 +1,35 @@
 #pragma once
 
+#include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
-#include <ankh/lang/hop_table.hpp>
+#include <ankh/lang/arena.hpp>
 #include <ankh/lang/statement.hpp>
 
 namespace ankh::lang {
 
 struct Program {
+    // owns the memory of every node in the program so it has to outlive the statements
+    Arena arena;
     std::vector<StatementPtr> statements;
     std::vector<std::string> errors;
-    HopTable hop_table;
+    // the number of call expressions in the program, see CallExpression::site
+    size_t call_sites = 0;
+
+    Program() = default;
+    Program(Program &&other) noexcept = default;
+
+    Program &operator=(Program &&other) noexcept {
+        // the old statements are destroyed before the arena holding them is released
+        statements = std::move(other.statements);
+        errors = std::move(other.errors);
+        call_sites = other.call_sites;
+        arena = std::move(other.arena);
+
+        return *this;
+    }
 
     bool has_errors() const noexcept { return errors.size() > 0; }
 
@@ -20,4 +38,8 @@ struct Program {
     const StatementPtr &operator[](size_t i) const noexcept { return statements[i]; }
 };
 
+// A program prepared once to be run any number of times, by any number of interpreters, see Interpreter::run.
+// Running a program leaves it as it was.
+using PreparedProgram = std::shared_ptr<const Program>;
+
 } // namespace ankh::lang
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace ankh::lang {
+
+// The location of a resolved local variable at runtime.
+// The variable lives `depth` environments up from the current one at index `index` of that environment's slots.
+// Variables captured from outside the enclosing function are upvalues instead: `index` is the position of the
+// variable among those the closure being executed captured and `depth` isn't used.
+struct Slot {
+    size_t depth;
+    size_t index;
+    bool upvalue = false;
+};
+
+inline bool operator==(const Slot &lhs, const Slot &rhs) noexcept {
+    return lhs.depth == rhs.depth && lhs.index == rhs.index && lhs.upvalue == rhs.upvalue;
+}
+
+// The names of the variables declared in a single scope, in slot order
+using Locals = std::vector<std::string>;
+
+// The slots of the variables of a single scope which closures capture
+using Captures = std::vector<size_t>;
+
+// Hashes names so they can be looked up by the view the tokens hold without building a string
+struct NameHash {
+    using is_transparent = void;
+
+    size_t operator()(std::string_view name) const noexcept { return std::hash<std::string_view>{}(name); }
+};
+
+} // namespace ankh::lang
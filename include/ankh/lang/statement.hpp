@@ -1,10 +1,13 @@
 #pragma once
 
 #include <memory>
+#include <optional>
 #include <utility>
 #include <vector>
 
+#include <ankh/lang/arena.hpp>
 #include <ankh/lang/expr.hpp>
+#include <ankh/lang/slot.hpp>
 #include <ankh/lang/token.hpp>
 
 namespace ankh::lang {
@@ -42,7 +45,12 @@ template <class R> struct StatementVisitor {
 
 struct Statement;
 
-using StatementPtr = std::unique_ptr<Statement>;
+// How executing a statement completed.
+// Break and return statements complete abruptly, which skips the rest of the enclosing statements
+// until the loop or call they belong to consumes the completion.
+enum class Completion { NORMAL, BREAK, RETURN };
+
+using StatementPtr = ArenaPtr<Statement>;
 
 struct Statement {
     virtual ~Statement() = default;
@@ -51,8 +59,8 @@ struct Statement {
     virtual std::string stringify() const noexcept = 0;
 };
 
-template <class T, class... Args> StatementPtr make_statement(Args &&...args) {
-    return std::make_unique<T>(std::forward<Args>(args)...);
+template <class T, class... Args> StatementPtr make_statement(Arena &arena, Args &&...args) {
+    return StatementPtr(arena.make<T>(std::forward<Args>(args)...));
 }
 
 struct ExpressionStatement : public Statement {
@@ -68,19 +76,26 @@ struct ExpressionStatement : public Statement {
 struct AssignmentStatement : public Statement {
     Token name;
     ExpressionPtr initializer;
+    std::optional<Slot> slot;
+    // set by the static analyzer when the variable is the first argument of the call it's assigned the result of, as
+    // in `xs = append(xs, x)`, so its value can be handed over to the call rather than shared with it
+    bool reassigns_argument = false;
 
     AssignmentStatement(Token name, ExpressionPtr initializer)
         : name(std::move(name)), initializer(std::move(initializer)) {}
 
     virtual void accept(StatementVisitor<void> *visitor) override { visitor->visit(this); }
 
-    virtual std::string stringify() const noexcept override { return name.str + " = " + initializer->stringify(); }
+    virtual std::string stringify() const noexcept override {
+        return std::string{name.str} + " = " + initializer->stringify();
+    }
 };
 
 struct CompoundAssignment : public Statement {
     Token target;
     Token op;
     ExpressionPtr value;
+    std::optional<Slot> slot;
 
     CompoundAssignment(Token target, Token op, ExpressionPtr value)
         : target(std::move(target)), op(std::move(op)), value(std::move(value)) {}
@@ -88,7 +103,7 @@ struct CompoundAssignment : public Statement {
     virtual void accept(StatementVisitor<void> *visitor) override { return visitor->visit(this); }
 
     virtual std::string stringify() const noexcept override {
-        return target.str + " " + op.str + " " + value->stringify();
+        return std::string{target.str} + " " + std::string{op.str} + " " + value->stringify();
     }
 };
 
@@ -98,6 +113,7 @@ struct VariableDeclaration : public Statement {
     Token name;
     ExpressionPtr initializer;
     StorageClass storage_class;
+    std::optional<Slot> slot;
 
     VariableDeclaration(Token name, ExpressionPtr initializer, StorageClass storage_class)
         : name(std::move(name)), initializer(std::move(initializer)), storage_class(storage_class) {}
@@ -114,12 +130,15 @@ struct VariableDeclaration : public Statement {
             std::unreachable();
         }
 
-        return result + " " + name.str + " = " + initializer->stringify();
+        return result + " " + std::string{name.str} + " = " + initializer->stringify();
     }
 };
 
 struct BlockStatement : public Statement {
     std::vector<StatementPtr> statements;
+    Locals locals;
+    // set by the static analyzer; captured variables live in cells of their own which outlive the scope
+    Captures captures;
 
     BlockStatement(std::vector<StatementPtr> statements) : statements(std::move(statements)) {}
 
@@ -149,7 +168,7 @@ template <class Derived> struct IncOrDecStatement : public Statement {
 
     virtual void accept(StatementVisitor<void> *visitor) override { visitor->visit(static_cast<Derived *>(this)); }
 
-    virtual std::string stringify() const noexcept override { return op.str + expr->stringify(); }
+    virtual std::string stringify() const noexcept override { return std::string{op.str} + expr->stringify(); }
 };
 
 struct IncOrDecIdentifierStatement : public IncOrDecStatement<IncOrDecIdentifierStatement> {
@@ -196,6 +215,9 @@ struct ForStatement : public Statement {
     ExpressionPtr condition;
     StatementPtr mutator;
     StatementPtr body;
+    Locals locals;
+    // the variables of the scope which closures capture, see BlockStatement
+    Captures captures;
 
     ForStatement(Token marker, StatementPtr init, ExpressionPtr condition, StatementPtr mutator, StatementPtr body)
         : marker(std::move(marker)), init(std::move(init)), condition(std::move(condition)),
@@ -216,13 +238,20 @@ struct BreakStatement : public Statement {
 
     virtual void accept(StatementVisitor<void> *visitor) override { visitor->visit(this); }
 
-    virtual std::string stringify() const noexcept override { return tok.str; }
+    virtual std::string stringify() const noexcept override { return std::string{tok.str}; }
 };
 
 struct FunctionDeclaration : public Statement {
     Token name;
     std::vector<Token> params;
     StatementPtr body;
+    std::optional<Slot> slot;
+    // the parameters, which make up the scope enclosing the body
+    Locals locals;
+    // the variables of the scope which closures capture, see BlockStatement
+    Captures captures;
+    // where the variables the closure captures are found when it's created, in upvalue order
+    std::vector<Slot> upvalues;
 
     FunctionDeclaration(Token name, std::vector<Token> params, StatementPtr body)
         : name(std::move(name)), params(std::move(params)), body(std::move(body)) {}
@@ -1,22 +1,27 @@
 #pragma once
 
+#include <optional>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
 #include <ankh/lang/expr.hpp>
-#include <ankh/lang/hop_table.hpp>
 #include <ankh/lang/program.hpp>
+#include <ankh/lang/slot.hpp>
 #include <ankh/lang/statement.hpp>
 
 namespace ankh::lang {
 
 class StaticAnalyzer : public ExpressionVisitor<ExprResult>, public StatementVisitor<void> {
   public:
-    HopTable resolve(const Program &program);
+    // Resolves every local variable in the program to the slot it occupies at runtime and works out which variables
+    // each closure captures. Both are recorded on the AST nodes themselves, as are the indexes of the call sites.
+    void resolve(Program &program);
 
   private:
     virtual ExprResult visit(BinaryExpression *expr) override;
+    virtual ExprResult visit(LogicalExpression *expr) override;
     virtual ExprResult visit(UnaryExpression *expr) override;
     virtual ExprResult visit(LiteralExpression *expr) override;
     virtual ExprResult visit(ParenExpression *expr) override;
@@ -48,8 +53,33 @@ class StaticAnalyzer : public ExpressionVisitor<ExprResult>, public StatementVis
 
     enum class LoopType { NONE, LOOP };
 
+    struct Variable {
+        bool defined;
+        size_t index;
+        bool captured = false;
+    };
+
     struct Scope {
-        std::unordered_map<std::string, bool> variables;
+        // keyed by the names the tokens hold, which outlive the analysis
+        std::unordered_map<std::string_view, Variable> variables;
+        // the names of the scope's variables in slot order; nullptr for the global scope
+        Locals *locals;
+        // the slots of the scope's variables which closures capture; nullptr for the global scope
+        Captures *captures;
+        // the functions declared in the scope whose bodies are left to analyze once the rest of the scope has been
+        std::vector<FunctionDeclaration *> functions;
+
+        Scope(Locals *locals, Captures *captures) : locals(locals), captures(captures) {}
+    };
+
+    // A function or lambda being analyzed
+    struct Closure {
+        // the first of the scopes making up the closure, which holds its parameters
+        size_t scope;
+        // the variables captured from outside the closure
+        std::vector<Slot> *upvalues;
+
+        Closure(size_t scope, std::vector<Slot> *upvalues) : scope(scope), upvalues(upvalues) {}
     };
 
     struct Analysis {
@@ -59,9 +89,13 @@ class StaticAnalyzer : public ExpressionVisitor<ExprResult>, public StatementVis
         Analysis(FunctionType fn_type, LoopType loop_type) : fn_type(fn_type), loop_type(loop_type) {}
     };
 
-    void begin_scope();
+    void begin_scope(Locals *locals, Captures *captures);
     void end_scope();
 
+    // The closure's parameters make up its first scope
+    void begin_closure(Locals *locals, Captures *captures, std::vector<Slot> *upvalues);
+    void end_closure();
+
     void begin_analysis(FunctionType fn_type, LoopType loop_type) noexcept;
     void end_analysis() noexcept;
 
@@ -74,7 +108,7 @@ class StaticAnalyzer : public ExpressionVisitor<ExprResult>, public StatementVis
     Scope &top() noexcept;
     const Scope &top() const noexcept;
 
-    void declare(const Token &token);
+    std::optional<Slot> declare(const Token &token);
     void define(const Token &token);
 
     bool is_declared_but_not_defined(const Token &token) const noexcept;
@@ -82,12 +116,24 @@ class StaticAnalyzer : public ExpressionVisitor<ExprResult>, public StatementVis
     void analyze(const ExpressionPtr &expr);
     void analyze(const StatementPtr &stmt);
 
-    void resolve(const void *entity, const Token &name);
+    // Analyzes the statements making up the current scope. The functions declared in the scope are declared before
+    // anything else and their bodies are analyzed last, so they can refer to one another and to every variable of the
+    // scope no matter the order they're declared in.
+    void analyze_scope(const std::vector<StatementPtr> &statements);
+    void analyze_function(FunctionDeclaration *stmt);
+
+    std::optional<Slot> resolve(const Token &name);
+    // Resolves the name as seen from the code nested in that many closures, capturing it from the enclosing closure
+    // if it's declared there
+    std::optional<Slot> resolve(const Token &name, size_t nesting);
+    // Records that the innermost of those closures captures the variable found at the slot, yielding its upvalue
+    Slot capture(const Token &name, const Slot &slot, size_t nesting);
 
   private:
     std::vector<Scope> scopes_;
+    std::vector<Closure> closures_;
     std::vector<Analysis> analyses_;
-    HopTable hop_table_;
+    size_t call_sites_ = 0;
 };
 
 } // namespace ankh::lang
@@ -2,6 +2,7 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
 
 // #include <fmt/core.h>
 
@@ -63,13 +64,13 @@ enum class TokenType {
 std::string token_type_str(TokenType type) noexcept;
 
 struct Token {
-    std::string str;
+    // a view into the source the token was scanned from, which the program keeps alive
+    std::string_view str;
     TokenType type;
     size_t line;
     size_t col;
 
-    Token(std::string str, TokenType type, size_t line, size_t col)
-        : str(std::move(str)), type(type), line(line), col(col) {}
+    Token(std::string_view str, TokenType type, size_t line, size_t col) : str(str), type(type), line(line), col(col) {}
 };
 
 inline bool operator==(const Token &lhs, const Token &rhs) noexcept {
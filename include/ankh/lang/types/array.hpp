@@ -1,23 +1,31 @@
 #pragma once
 
-#include <memory>
+#include <utility>
 #include <vector>
 
+#include <ankh/lang/types/gc.hpp>
+
 namespace ankh::lang {
 
+// An array value.
+// Copies share the same elements; appending copies them first unless this is the only reference, so arrays behave
+// like values without every copy costing one.
 template <class T> class Array {
     using ArrayType = std::vector<T>;
 
   public:
-    Array() : elems_(std::make_shared<ArrayType>()) {}
-    Array(ArrayType elems) : elems_(std::make_shared<ArrayType>(std::move(elems))) {}
+    Array() : elems_(Gc<ArrayType>::make()) {}
+    Array(ArrayType elems) : elems_(Gc<ArrayType>::make(std::move(elems))) {}
 
-    void append(const T &elem) noexcept { elems_->push_back(elem); }
+    void append(T elem) {
+        if (!elems_.unique()) {
+            elems_ = Gc<ArrayType>::make(*elems_);
+        }
+        elems_->push_back(std::move(elem));
+    }
 
     bool empty() const noexcept { return elems_->empty(); }
 
-    T &operator[](size_t i) noexcept { return (*elems_)[i]; }
-
     const T &operator[](size_t i) const noexcept { return (*elems_)[i]; }
 
     size_t size() const noexcept { return elems_->size(); }
@@ -26,8 +34,10 @@ template <class T> class Array {
 
     friend bool operator!=(const Array<T> &lhs, const Array<T> &rhs) noexcept { return !(operator==(lhs, rhs)); }
 
+    friend void trace_value(const Array<T> &array, Tracer &tracer) { trace_value(array.elems_, tracer); }
+
   private:
-    std::shared_ptr<ArrayType> elems_;
+    Gc<ArrayType> elems_;
 };
 
 } // namespace ankh::lang
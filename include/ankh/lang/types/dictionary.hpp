@@ -1,55 +1,166 @@
 #pragma once
 
-#include <algorithm>
-#include <memory>
+#include <cstdint>
+#include <functional>
 #include <optional>
 #include <string>
 #include <vector>
 
 #include <ankh/lang/types/entry.hpp>
+#include <ankh/lang/types/gc.hpp>
 
 namespace ankh::lang {
 
+// An insertion ordered hash map.
+// Entries are stored densely in the order they were inserted and found through an open addressing index of them.
 template <class T> class Dictionary {
     using ElementType = Entry<T>;
     using DictionaryType = std::vector<ElementType>;
-    using DictionaryIterator = typename std::shared_ptr<DictionaryType>::element_type::iterator;
+    using DictionaryIterator = typename DictionaryType::iterator;
+
+    // An empty slot has no entry; otherwise it refers to entries[entry - 1]
+    struct Slot {
+        std::uint32_t entry = 0;
+        std::uint32_t hash = 0;
+    };
+
+    struct Table {
+        DictionaryType entries;
+        std::vector<Slot> slots;
+
+        friend void trace_value(const Table &table, Tracer &tracer) {
+            for (const ElementType &entry : table.entries) {
+                trace_value(entry.key, tracer);
+                trace_value(entry.value, tracer);
+            }
+        }
+    };
 
   public:
-    Dictionary() : Dictionary(DictionaryType{}) {}
-    Dictionary(DictionaryType dict) : dict_(std::make_shared<DictionaryType>(std::move(dict))) {}
+    Dictionary() : table_(Gc<Table>::make()) {}
+    Dictionary(DictionaryType dict) : Dictionary() {
+        for (auto &entry : dict) {
+            insert(std::move(entry.key), std::move(entry.value));
+        }
+    }
 
-    bool empty() const noexcept { return dict_->empty(); }
+    bool empty() const noexcept { return table_->entries.empty(); }
 
-    size_t size() const noexcept { return dict_->size(); }
+    size_t size() const noexcept { return table_->entries.size(); }
 
-    DictionaryIterator begin() const noexcept { return dict_->begin(); }
+    DictionaryIterator begin() const noexcept { return table_->entries.begin(); }
 
-    DictionaryIterator end() const noexcept { return dict_->end(); }
+    DictionaryIterator end() const noexcept { return table_->entries.end(); }
 
-    DictionaryIterator begin() noexcept { return dict_->begin(); }
+    DictionaryIterator begin() noexcept { return table_->entries.begin(); }
 
-    DictionaryIterator end() noexcept { return dict_->end(); }
+    DictionaryIterator end() noexcept { return table_->entries.end(); }
 
-    bool insert(const T &key, const T &value) noexcept {
-        if (!this->value(key)) {
-            dict_->push_back(ElementType{key, value});
+    // The first value inserted for a key is kept; growing the entries or their index can throw
+    bool insert(T key, T value) {
+        Table &table = *table_;
+        // keep the index at most half full so probe sequences stay short
+        if (2 * (table.entries.size() + 1) > table.slots.size()) {
+            grow();
+        }
+
+        const std::uint32_t hash = hash_of(key);
+        const size_t mask = table.slots.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            Slot &slot = table.slots[i];
+            if (slot.entry == 0) {
+                table.entries.emplace_back(std::move(key), std::move(value));
+                slot.entry = static_cast<std::uint32_t>(table.entries.size());
+                slot.hash = hash;
+
+                return true;
+            }
+
+            if (slot.hash == hash && table.entries[slot.entry - 1].key == key) {
+                return false;
+            }
+        }
+    }
 
-            return true;
+    const ElementType *find(const T &key) const noexcept {
+        const Table &table = *table_;
+        if (table.entries.empty()) {
+            return nullptr;
         }
 
-        return false;
+        const std::uint32_t hash = hash_of(key);
+        const size_t mask = table.slots.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            const Slot &slot = table.slots[i];
+            if (slot.entry == 0) {
+                return nullptr;
+            }
+
+            if (slot.hash == hash && table.entries[slot.entry - 1].key == key) {
+                return &table.entries[slot.entry - 1];
+            }
+        }
     }
 
     std::optional<ElementType> value(const T &key) const noexcept {
-        auto it = std::find_if(dict_->cbegin(), dict_->cend(), [&](const Entry<T> &entry) { return entry.key == key; });
+        const ElementType *entry = find(key);
 
-        return it == dict_->cend() ? std::nullopt : std::optional<ElementType>{*it};
+        return entry == nullptr ? std::nullopt : std::optional<ElementType>{*entry};
     }
 
     std::optional<ElementType> value(const std::string &key) const noexcept { return value(T(key)); }
 
+    // Dictionaries are equal when they map the same keys to the same values, regardless of insertion order
+    friend bool operator==(const Dictionary<T> &lhs, const Dictionary<T> &rhs) noexcept {
+        if (lhs.size() != rhs.size()) {
+            return false;
+        }
+
+        for (const auto &[key, value] : lhs) {
+            const ElementType *entry = rhs.find(key);
+            if (entry == nullptr || entry->value != value) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    friend bool operator!=(const Dictionary<T> &lhs, const Dictionary<T> &rhs) noexcept { return !(lhs == rhs); }
+
+    friend void trace_value(const Dictionary<T> &dict, Tracer &tracer) { trace_value(dict.table_, tracer); }
+
+  private:
+    static std::uint32_t hash_of(const T &key) noexcept {
+        const std::uint64_t hash = std::hash<T>{}(key);
+
+        // fold the high bits in since only the low bits pick the slot
+        return static_cast<std::uint32_t>(hash ^ (hash >> 32));
+    }
+
+    void grow() {
+        Table &table = *table_;
+
+        const size_t capacity = table.slots.empty() ? 8 : 2 * table.slots.size();
+        const size_t mask = capacity - 1;
+
+        std::vector<Slot> slots(capacity);
+        for (const Slot &slot : table.slots) {
+            if (slot.entry == 0) {
+                continue;
+            }
+
+            size_t i = slot.hash & mask;
+            while (slots[i].entry != 0) {
+                i = (i + 1) & mask;
+            }
+            slots[i] = slot;
+        }
+
+        table.slots = std::move(slots);
+    }
+
   private:
-    std::shared_ptr<DictionaryType> dict_;
+    Gc<Table> table_;
 };
 } // namespace ankh::lang
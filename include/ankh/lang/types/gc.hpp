@@ -0,0 +1,255 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace ankh::lang {
+
+class Collectable;
+
+// Visits the collectable objects another one refers to
+struct Tracer {
+    virtual ~Tracer() = default;
+
+    virtual void visit(Collectable *object) = 0;
+};
+
+class Heap;
+
+// An object which can take part in a reference cycle: arrays, dicts, callables and the cells of captured variables.
+// Collectables are reference counted like any other value and freed along with their last reference, but they are
+// also kept in the heap they were created in so that the cycles nothing else refers to anymore can be found and
+// freed, see Heap.
+class Collectable {
+  public:
+    Collectable() noexcept;
+    virtual ~Collectable() noexcept;
+
+    Collectable(const Collectable &) = delete;
+    Collectable &operator=(const Collectable &) = delete;
+
+    // Calls the tracer once for every reference this object holds to a collectable one
+    virtual void trace(Tracer &tracer) const = 0;
+
+    // Drops the references this object holds, which breaks the cycles it's part of
+    virtual void clear() noexcept = 0;
+
+    size_t refs = 0;
+
+  private:
+    friend class Heap;
+
+    // null once the heap is gone, which leaves whatever is still alive to reference counting alone
+    Heap *heap_;
+    Collectable *prev_ = nullptr;
+    Collectable *next_ = nullptr;
+    // the references which don't come from other collectables, only meaningful while collecting
+    size_t external_ = 0;
+    bool reachable_ = false;
+};
+
+inline void retain(Collectable *object) noexcept { ++object->refs; }
+
+inline void release(Collectable *object) noexcept {
+    if (--object->refs == 0) {
+        delete object;
+    }
+}
+
+// What the owner of a heap refers to directly, e.g. the environments of an interpreter
+struct Roots {
+    virtual ~Roots() = default;
+
+    // Calls the tracer once for every collectable object referred to
+    virtual void trace(Tracer &tracer) const = 0;
+};
+
+// Every collectable object created while the heap was the active one, see HeapScope.
+// Reference counting frees everything but cycles. Those are found by tracing from the roots, and from any object
+// referred to more times than the other collectables refer to it, since it's in use from outside the heap by a value
+// being evaluated or the host. Whatever is left is only referred to by garbage.
+// Each interpreter and VM has a heap of its own, so none is ever shared between threads. Objects of other heaps are
+// never traced into, and the objects they refer to are always in use.
+class Heap {
+  public:
+    constexpr explicit Heap(const Roots *roots = nullptr) noexcept : roots_(roots) {}
+
+    Heap(const Heap &) = delete;
+    Heap &operator=(const Heap &) = delete;
+
+    // Frees the garbage left and lets go of the objects still in use
+    ~Heap() noexcept;
+
+    size_t size() const noexcept { return size_; }
+
+    // Frees the objects only unreachable cycles refer to, yielding how many there were
+    size_t collect();
+
+    // Collects once the heap has doubled in size since the last collection, so the time spent tracing stays
+    // proportional to the number of objects allocated
+    void maybe_collect() {
+        if (size_ >= threshold_) {
+            collect();
+            threshold_ = std::max(MIN_THRESHOLD, 2 * size_);
+        }
+    }
+
+  private:
+    friend class Collectable;
+
+    void link(Collectable *object) noexcept {
+        object->next_ = head_;
+        if (head_ != nullptr) {
+            head_->prev_ = object;
+        }
+        head_ = object;
+        ++size_;
+    }
+
+    void unlink(Collectable *object) noexcept {
+        if (object->prev_ != nullptr) {
+            object->prev_->next_ = object->next_;
+        } else {
+            head_ = object->next_;
+        }
+        if (object->next_ != nullptr) {
+            object->next_->prev_ = object->prev_;
+        }
+        --size_;
+    }
+
+  private:
+    static constexpr size_t MIN_THRESHOLD = 1024;
+
+    const Roots *roots_;
+    Collectable *head_ = nullptr;
+    size_t size_ = 0;
+    size_t threshold_ = MIN_THRESHOLD;
+};
+
+// The heap made active by the innermost HeapScope of the thread, if any
+inline Heap *&active_heap() noexcept {
+    thread_local Heap *heap = nullptr;
+
+    return heap;
+}
+
+// The heap of the values created on the thread outside of any interpreter or VM
+inline Heap &thread_heap() noexcept {
+    thread_local Heap heap;
+
+    return heap;
+}
+
+// The heap new collectables are kept in
+inline Heap &heap() noexcept {
+    Heap *active = active_heap();
+
+    return active != nullptr ? *active : thread_heap();
+}
+
+// Keeps the collectables created on the thread in the heap for as long as it's alive, after which the previous one
+// is active again
+class HeapScope {
+  public:
+    explicit HeapScope(Heap &heap) noexcept : prev_(std::exchange(active_heap(), &heap)) {}
+
+    HeapScope(const HeapScope &) = delete;
+    HeapScope &operator=(const HeapScope &) = delete;
+
+    ~HeapScope() noexcept { active_heap() = prev_; }
+
+  private:
+    Heap *prev_;
+};
+
+inline Collectable::Collectable() noexcept : heap_(&heap()) { heap_->link(this); }
+
+inline Collectable::~Collectable() noexcept {
+    if (heap_ != nullptr) {
+        heap_->unlink(this);
+    }
+}
+
+// A reference counted pointer to a value which is a collectable object of its own.
+// The value is traced through the trace_value() overload found for its type and cleared by resetting it.
+template <class T> class Gc {
+    struct Box : public Collectable {
+        T value;
+
+        template <class... Args> explicit Box(Args &&...args) : value(std::forward<Args>(args)...) {}
+
+        virtual void trace(Tracer &tracer) const override { trace_value(value, tracer); }
+
+        virtual void clear() noexcept override { value = T(); }
+    };
+
+  public:
+    // A pointer to nothing, which must not be dereferenced
+    Gc() noexcept : box_(nullptr) {}
+
+    template <class... Args> static Gc make(Args &&...args) {
+        // collecting before the box exists means no object is ever traced half constructed
+        heap().maybe_collect();
+
+        return Gc(new Box(std::forward<Args>(args)...));
+    }
+
+    Gc(const Gc &other) noexcept : box_(other.box_) {
+        if (box_ != nullptr) {
+            retain(box_);
+        }
+    }
+
+    Gc(Gc &&other) noexcept : box_(std::exchange(other.box_, nullptr)) {}
+
+    Gc &operator=(const Gc &other) noexcept {
+        Gc copy(other);
+        std::swap(box_, copy.box_);
+
+        return *this;
+    }
+
+    Gc &operator=(Gc &&other) noexcept {
+        Gc moved(std::move(other));
+        std::swap(box_, moved.box_);
+
+        return *this;
+    }
+
+    ~Gc() noexcept {
+        if (box_ != nullptr) {
+            release(box_);
+        }
+    }
+
+    T &operator*() const noexcept { return box_->value; }
+
+    T *operator->() const noexcept { return &box_->value; }
+
+    bool unique() const noexcept { return box_->refs == 1; }
+
+    explicit operator bool() const noexcept { return box_ != nullptr; }
+
+    friend void trace_value(const Gc &gc, Tracer &tracer) {
+        if (gc.box_ != nullptr) {
+            tracer.visit(gc.box_);
+        }
+    }
+
+  private:
+    explicit Gc(Box *box) noexcept : box_(box) { retain(box_); }
+
+  private:
+    Box *box_;
+};
+
+template <class T> void trace_value(const std::vector<T> &elems, Tracer &tracer) {
+    for (const T &elem : elems) {
+        trace_value(elem, tracer);
+    }
+}
+
+} // namespace ankh::lang
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+
+namespace ankh::lang {
+
+// A non-atomic, intrusively reference counted pointer.
+// It is half the size of a std::shared_ptr, which lets heap allocated values fit in a single ExprResult word.
+template <class T> class Rc {
+    struct Box {
+        size_t refs;
+        T value;
+
+        template <class... Args> explicit Box(Args &&...args) : refs(1), value(std::forward<Args>(args)...) {}
+    };
+
+  public:
+    // A pointer to nothing, which must not be dereferenced
+    Rc() noexcept : box_(nullptr) {}
+
+    template <class... Args> static Rc make(Args &&...args) { return Rc(new Box(std::forward<Args>(args)...)); }
+
+    Rc(const Rc &other) noexcept : box_(other.box_) {
+        if (box_ != nullptr) {
+            ++box_->refs;
+        }
+    }
+
+    Rc(Rc &&other) noexcept : box_(std::exchange(other.box_, nullptr)) {}
+
+    Rc &operator=(const Rc &other) noexcept {
+        Rc copy(other);
+        std::swap(box_, copy.box_);
+
+        return *this;
+    }
+
+    Rc &operator=(Rc &&other) noexcept {
+        Rc moved(std::move(other));
+        std::swap(box_, moved.box_);
+
+        return *this;
+    }
+
+    ~Rc() noexcept {
+        if (box_ != nullptr && --box_->refs == 0) {
+            delete box_;
+        }
+    }
+
+    T &operator*() const noexcept { return box_->value; }
+
+    T *operator->() const noexcept { return &box_->value; }
+
+    bool unique() const noexcept { return box_->refs == 1; }
+
+    explicit operator bool() const noexcept { return box_ != nullptr; }
+
+  private:
+    explicit Rc(Box *box) noexcept : box_(box) {}
+
+  private:
+    Box *box_;
+};
+
+} // namespace ankh::lang
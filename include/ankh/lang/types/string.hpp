@@ -0,0 +1,58 @@
+#pragma once
+
+#include <compare>
+#include <functional>
+#include <string>
+#include <string_view>
+
+#include <ankh/lang/types/rc.hpp>
+
+namespace ankh::lang {
+
+// An immutable, reference counted string.
+// Copies share the same characters; appending copies them first unless this is the only reference.
+class String {
+  public:
+    String() : String(std::string{}) {}
+    String(std::string str) : str_(Rc<std::string>::make(std::move(str))) {}
+
+    const std::string &value() const noexcept { return *str_; }
+
+    operator const std::string &() const noexcept { return *str_; }
+
+    bool empty() const noexcept { return str_->empty(); }
+
+    size_t size() const noexcept { return str_->size(); }
+
+    size_t length() const noexcept { return str_->length(); }
+
+    char operator[](size_t i) const noexcept { return (*str_)[i]; }
+
+    const char *c_str() const noexcept { return str_->c_str(); }
+
+    String &operator+=(std::string_view str) {
+        if (!str_.unique()) {
+            str_ = Rc<std::string>::make(*str_);
+        }
+        str_->append(str);
+
+        return *this;
+    }
+
+    friend bool operator==(const String &lhs, const String &rhs) noexcept { return lhs.value() == rhs.value(); }
+
+    friend bool operator==(const String &lhs, std::string_view rhs) noexcept { return lhs.value() == rhs; }
+
+    friend std::strong_ordering operator<=>(const String &lhs, const String &rhs) noexcept {
+        return lhs.value() <=> rhs.value();
+    }
+
+  private:
+    Rc<std::string> str_;
+};
+
+} // namespace ankh::lang
+
+template <> struct std::hash<ankh::lang::String> {
+    size_t operator()(const ankh::lang::String &str) const noexcept { return std::hash<std::string>{}(str.value()); }
+};
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <ankh/lang/builtins.hpp>
+#include <ankh/lang/bytecode.hpp>
+#include <ankh/lang/callable.hpp>
+#include <ankh/lang/expr_result.hpp>
+#include <ankh/lang/native.hpp>
+#include <ankh/lang/program.hpp>
+#include <ankh/lang/types/gc.hpp>
+
+namespace ankh::lang {
+
+// A variable captured by a closure.
+// While the variable is still on the stack, the upvalue refers to its slot.
+// Once the variable goes out of scope, the upvalue takes ownership of its value.
+struct Upvalue {
+    size_t slot = 0;
+    bool open = true;
+    ExprResult closed;
+
+    Upvalue() noexcept = default;
+
+    explicit Upvalue(size_t slot) noexcept : slot(slot) {}
+
+    // the value of an open upvalue is on the stack, which isn't part of the heap
+    friend void trace_value(const Upvalue &upvalue, Tracer &tracer) { trace_value(upvalue.closed, tracer); }
+};
+
+// Upvalues are collectable like the cells the interpreter captures, so closures capturing themselves are freed
+using UpvaluePtr = Gc<Upvalue>;
+
+// The callables created by the VM. They can't be invoked by the tree-walking interpreter.
+struct Object : public Callable {
+    enum class Kind { CLOSURE, NATIVE };
+
+    explicit Object(Kind kind) : kind(kind) {}
+
+    virtual ExprResult invoke(const std::vector<ExpressionPtr> &args) override;
+
+    const Kind kind;
+};
+
+struct Closure : public Object {
+    const Prototype *prototype;
+    std::vector<UpvaluePtr> upvalues;
+
+    explicit Closure(const Prototype *prototype)
+        : Object(Kind::CLOSURE), prototype(prototype), upvalues(prototype->upvalue_count) {}
+
+    virtual std::string_view name() const noexcept override { return prototype->name; }
+
+    virtual size_t arity() const noexcept override { return prototype->arity; }
+
+    virtual void trace(Tracer &tracer) const override { trace_value(upvalues, tracer); }
+
+    virtual void clear() noexcept override { upvalues.clear(); }
+};
+
+struct Native : public Object {
+    const std::string fn_name;
+    const size_t fn_arity;
+    const NativeFunction fn;
+
+    Native(std::string name, size_t arity, NativeFunction fn)
+        : Object(Kind::NATIVE), fn_name(std::move(name)), fn_arity(arity), fn(fn) {}
+
+    virtual std::string_view name() const noexcept override { return fn_name; }
+
+    virtual size_t arity() const noexcept override { return fn_arity; }
+};
+
+// A stack based virtual machine executing the bytecode produced by the Compiler.
+// It is an alternative to the tree-walking Interpreter with the same semantics.
+class VM : private Roots {
+  public:
+    VM();
+    ~VM() noexcept;
+
+    void interpret(Program &&program);
+
+    std::optional<ExprResult> global(const std::string &name) const noexcept;
+
+    // Defines the natives as globals. Throws an InterpretationException if one of them is already defined.
+    void load(const Natives &natives);
+
+    // The heap of the values created by the programs the VM runs
+    Heap &heap() noexcept { return heap_; }
+
+  private:
+    struct CallFrame {
+        Closure *closure;
+        const std::uint8_t *ip;
+        // the stack index of the called closure, which is followed by its arguments and locals
+        size_t base;
+    };
+
+    void run();
+
+    // The closure is owned by the values referring to it, starting with the one the caller pushes on the stack
+    CallablePtr make_closure(const Prototype *prototype);
+
+    UpvaluePtr capture_upvalue(size_t slot);
+    void close_upvalues(size_t slot) noexcept;
+
+    ExprResult &upvalue(const Closure *closure, size_t index) noexcept;
+
+    // Replaces the native and its arguments on top of the stack with the result of calling it.
+    // The variable the result is assigned to, if any, gives its value up for the native to hold the only reference.
+    void call_native(const Native *native, size_t argc, ExprResult *reassigned);
+    // The variable assigned by the SET_* instruction at ip
+    ExprResult &assigned(const std::uint8_t *ip, const CallFrame *frame) noexcept;
+
+    void reset() noexcept;
+
+    // the roots of the heap are the stack, the open upvalues and the globals
+    virtual void trace(Tracer &tracer) const override;
+
+  private:
+    // declared first so every value the VM holds is freed before it
+    Heap heap_;
+    std::vector<ExprResult> stack_;
+    std::vector<CallFrame> frames_;
+    // sorted by slot
+    std::vector<UpvaluePtr> open_upvalues_;
+    Globals globals_;
+
+    // the natives the VM defined as globals and what they keep between calls
+    std::vector<CallablePtr> natives_;
+    BuiltinState builtin_state_;
+    std::vector<std::unique_ptr<Prototype>> scripts_;
+    // the tokens marking the bytecode refer to the text of the programs it was compiled from
+    std::vector<Program> programs_;
+};
+
+} // namespace ankh::lang
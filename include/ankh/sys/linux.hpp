@@ -1,8 +1,29 @@
 #pragma once
 
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
 #include <cstdlib>
+#include <cstring>
 
+#include <optional>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+extern char **environ;
 
 namespace ankh::sys {
 
@@ -10,4 +31,337 @@ inline bool setenv(const std::string &name, const std::string &value) noexcept {
     return ::setenv(name.c_str(), value.c_str(), true) == 0;
 }
 
+// Reads everything up to the end of the file into the output, which starts out with room for size_hint bytes.
+// The buffer doubles whenever it fills up so reading something of unknown size stays linear.
+inline bool read_all(int fd, std::string &output, size_t size_hint = 0) noexcept {
+    // the extra byte lets the read which hits the end of the file happen without growing the buffer
+    output.resize(std::max<size_t>(4096, size_hint + 1));
+
+    size_t size = 0;
+    ssize_t n;
+    do {
+        if (size == output.size()) {
+            output.resize(2 * size);
+        }
+
+        n = ::read(fd, output.data() + size, output.size() - size);
+        if (n > 0) {
+            size += n;
+        }
+    } while (n > 0 || (n == -1 && errno == EINTR));
+    output.resize(size);
+
+    return n == 0;
+}
+
+// Writes the contents to a temporary file which is then renamed over the path, so whoever reads the file sees either
+// its old contents or all of the new ones
+inline bool write_file(const std::string &path, std::string_view contents) noexcept {
+    std::string tmp_path = path + ".XXXXXX";
+    const int fd = ::mkostemp(tmp_path.data(), O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+
+    size_t size = 0;
+    while (size < contents.size()) {
+        const ssize_t n = ::write(fd, contents.data() + size, contents.size() - size);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1) {
+            break;
+        }
+        size += n;
+    }
+
+    bool ok = size == contents.size();
+    ok = ::close(fd) == 0 && ok;
+    ok = ok && ::rename(tmp_path.c_str(), path.c_str()) == 0;
+    if (!ok) {
+        ::unlink(tmp_path.c_str());
+    }
+
+    return ok;
+}
+
+// The contents of a file, mapped straight into memory when it's a regular file and read into a buffer otherwise
+class MappedFile {
+  public:
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    MappedFile(MappedFile &&other) noexcept
+        : mapping_(std::exchange(other.mapping_, nullptr)), size_(std::exchange(other.size_, 0)),
+          buffer_(std::move(other.buffer_)) {}
+
+    MappedFile &operator=(MappedFile &&other) noexcept {
+        MappedFile moved(std::move(other));
+        std::swap(mapping_, moved.mapping_);
+        std::swap(size_, moved.size_);
+        std::swap(buffer_, moved.buffer_);
+
+        return *this;
+    }
+
+    ~MappedFile() noexcept {
+        if (mapping_ != nullptr) {
+            ::munmap(mapping_, size_);
+        }
+    }
+
+    std::string_view contents() const noexcept {
+        if (mapping_ != nullptr) {
+            return {static_cast<const char *>(mapping_), size_};
+        }
+
+        return buffer_;
+    }
+
+    // Nothing is returned if the file can't be opened or read
+    static std::optional<MappedFile> open(const std::string &path) noexcept {
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            return std::nullopt;
+        }
+
+        MappedFile file;
+
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            ::close(fd);
+            return std::nullopt;
+        }
+
+        const bool is_regular = S_ISREG(st.st_mode);
+        if (is_regular && st.st_size > 0) {
+            void *mapping = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping != MAP_FAILED) {
+                ::madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+                ::close(fd);
+
+                file.mapping_ = mapping;
+                file.size_ = st.st_size;
+
+                return file;
+            }
+        }
+
+        // pipes and the like have no size to go by, while regular files which can't be mapped are read in one go
+        const bool ok = read_all(fd, file.buffer_, is_regular ? st.st_size : 0);
+        ::close(fd);
+        if (!ok) {
+            return std::nullopt;
+        }
+
+        return file;
+    }
+
+  private:
+    MappedFile() noexcept = default;
+
+  private:
+    void *mapping_ = nullptr;
+    size_t size_ = 0;
+    std::string buffer_;
+};
+
+// What a command wrote to stdout and how it exited, following the shell's conventions for the status:
+// 128 + the signal number if it was killed by one and 127 if it couldn't be found
+struct Process {
+    std::string output;
+    int status;
+};
+
+// Splits a command into its arguments the way the shell would for a simple command, honoring quotes and escapes.
+// Nothing is returned if the command needs anything more from the shell, such as pipes, redirection or expansion.
+inline std::optional<std::vector<std::string>> split_command(std::string_view cmd) {
+    // an unquoted character from this set means the shell has to interpret the command
+    constexpr std::string_view SHELL_CHARS = "|&;<>()$`*?[]{}~#=!\n";
+
+    std::vector<std::string> args;
+    std::string arg;
+    bool in_arg = false;
+    for (size_t i = 0; i < cmd.size(); ++i) {
+        const char c = cmd[i];
+        if (c == ' ' || c == '\t') {
+            if (in_arg) {
+                args.push_back(std::move(arg));
+                arg.clear();
+                in_arg = false;
+            }
+        } else if (c == '\'') {
+            const size_t end = cmd.find('\'', i + 1);
+            if (end == std::string_view::npos) {
+                return std::nullopt;
+            }
+            arg.append(cmd.substr(i + 1, end - i - 1));
+            in_arg = true;
+            i = end;
+        } else if (c == '"') {
+            in_arg = true;
+            for (++i; i < cmd.size() && cmd[i] != '"'; ++i) {
+                // $ and ` are still expanded in double quotes
+                if (cmd[i] == '$' || cmd[i] == '`') {
+                    return std::nullopt;
+                }
+                if (cmd[i] == '\\' && i + 1 < cmd.size() && std::strchr("\"\\$`", cmd[i + 1]) != nullptr) {
+                    ++i;
+                }
+                arg += cmd[i];
+            }
+            if (i == cmd.size()) {
+                return std::nullopt;
+            }
+        } else if (c == '\\') {
+            if (i + 1 == cmd.size() || cmd[i + 1] == '\n') {
+                return std::nullopt;
+            }
+            arg += cmd[++i];
+            in_arg = true;
+        } else if (SHELL_CHARS.find(c) != std::string_view::npos) {
+            return std::nullopt;
+        } else {
+            arg += c;
+            in_arg = true;
+        }
+    }
+
+    if (in_arg) {
+        args.push_back(std::move(arg));
+    }
+
+    return args;
+}
+
+// Launches the program named by the first argument and collects its output and exit status into the process.
+// Yields 0 on success or the error which prevented the program from running.
+inline int spawn(std::vector<std::string> &args, Process &process) noexcept {
+    std::vector<char *> argv;
+    for (std::string &arg : args) {
+        argv.push_back(arg.data());
+    }
+    argv.push_back(nullptr);
+
+    int fds[2];
+    if (::pipe2(fds, O_CLOEXEC) != 0) {
+        return errno;
+    }
+
+    posix_spawn_file_actions_t actions;
+    ::posix_spawn_file_actions_init(&actions);
+    ::posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+
+    pid_t pid;
+    const int error = ::posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+
+    ::posix_spawn_file_actions_destroy(&actions);
+    ::close(fds[1]);
+
+    if (error != 0) {
+        ::close(fds[0]);
+        return error;
+    }
+
+    // a failed read leaves whatever was read before it, like the shell does
+    read_all(fds[0], process.output);
+    ::close(fds[0]);
+
+    int status;
+    while (::waitpid(pid, &status, 0) == -1) {
+        if (errno != EINTR) {
+            return errno;
+        }
+    }
+    process.status = WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+
+    return 0;
+}
+
+// Runs the command and returns everything it wrote to stdout along with its exit status, or nothing if it couldn't be
+// launched. Simple commands are executed directly, saving a shell process; everything else goes through /bin/sh.
+inline std::optional<Process> run(const std::string &cmd) noexcept {
+    Process process{"", 0};
+
+    if (auto possible_args = split_command(cmd); possible_args.has_value()) {
+        // the shell runs an empty command successfully without output
+        if (possible_args->empty()) {
+            return process;
+        }
+
+        // builtins such as cd or exit aren't programs so they are left to the shell, which also reports missing ones
+        const int error = spawn(possible_args.value(), process);
+        if (error == 0) {
+            return process;
+        }
+        if (error != ENOENT) {
+            return std::nullopt;
+        }
+    }
+
+    std::vector<std::string> args{"/bin/sh", "-c", cmd};
+    if (spawn(args, process) != 0) {
+        return std::nullopt;
+    }
+
+    return process;
+}
+
+// Loads the shared object at the path for good and yields the address of the symbol it defines, or nothing along with
+// the reason why in error
+inline void *load_symbol(const std::string &path, const char *symbol, std::string &error) noexcept {
+    void *library = ::dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (library == nullptr) {
+        error = ::dlerror();
+        return nullptr;
+    }
+
+    // clears any error left over from before the lookup
+    ::dlerror();
+    void *address = ::dlsym(library, symbol);
+    if (const char *lookup_error = ::dlerror(); lookup_error != nullptr || address == nullptr) {
+        error = lookup_error != nullptr ? lookup_error : std::string{symbol} + " is null";
+        ::dlclose(library);
+        return nullptr;
+    }
+
+    return address;
+}
+
+// The CPU time the process has used so far
+inline std::chrono::microseconds cpu_time() noexcept {
+    struct timespec ts {};
+    ::clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+
+    return std::chrono::seconds(ts.tv_sec) + std::chrono::duration_cast<std::chrono::microseconds>(
+                                                 std::chrono::nanoseconds(ts.tv_nsec));
+}
+
+// Calls the handler with SIGPROF every interval of CPU time the process uses, until the timer is stopped
+inline bool start_profiling_timer(void (*handler)(int), std::chrono::microseconds interval) noexcept {
+    struct sigaction action {};
+    action.sa_handler = handler;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (::sigaction(SIGPROF, &action, nullptr) != 0) {
+        return false;
+    }
+
+    const auto seconds = std::chrono::duration_cast<std::chrono::seconds>(interval);
+    struct itimerval timer {};
+    timer.it_interval.tv_sec = seconds.count();
+    timer.it_interval.tv_usec = (interval - seconds).count();
+    timer.it_value = timer.it_interval;
+
+    return ::setitimer(ITIMER_PROF, &timer, nullptr) == 0;
+}
+
+inline void stop_profiling_timer() noexcept {
+    struct itimerval timer {};
+    ::setitimer(ITIMER_PROF, &timer, nullptr);
+
+    // a tick which was already pending is dropped rather than killing the process
+    std::signal(SIGPROF, SIG_IGN);
+}
+
 } // namespace ankh::sys
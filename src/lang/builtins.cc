@@ -0,0 +1,157 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <ankh/log.hpp>
+
+#include <ankh/sys/sys.hpp>
+
+#include <ankh/lang/builtins.hpp>
+#include <ankh/lang/exceptions.hpp>
+#include <ankh/lang/operators.hpp>
+#include <ankh/lang/types/array.hpp>
+
+const ankh::lang::Natives &ankh::lang::builtins::natives() {
+    static const Natives natives = [] {
+        Natives builtins;
+        builtins.define("print", 1, builtins::print);
+        builtins.define("exit", 1, builtins::exit);
+        builtins.define("len", 1, builtins::length);
+        builtins.define("int", 1, builtins::cast_int);
+        builtins.define("append", 2, builtins::append);
+        builtins.define("str", 1, builtins::str);
+        builtins.define("keys", 1, builtins::keys);
+        builtins.define("export", 2, builtins::exportfn);
+        builtins.define("status", 0, builtins::status);
+
+        return builtins;
+    }();
+
+    return natives;
+}
+
+ankh::lang::ExprResult ankh::lang::builtins::print(std::span<ExprResult> args) {
+    const std::string stringy = args[0].stringify();
+    std::puts(stringy.c_str());
+
+    return {};
+}
+
+ankh::lang::ExprResult ankh::lang::builtins::exit(std::span<ExprResult> args) {
+    const ExprResult &result = args[0];
+
+    if (result.type != ExprResultType::RT_NUMBER) {
+        builtin_panic<InterpretationException>("exit", "{} is not a viable argument type",
+                                               expr_result_type_str(result.type));
+    }
+
+    if (!is_integer(result.n)) {
+        builtin_panic<InterpretationException>("exit", "'{}' is not an integer", result.n);
+    }
+
+    std::exit(result.n);
+}
+
+ankh::lang::ExprResult ankh::lang::builtins::length(std::span<ExprResult> args) {
+    const ExprResult &result = args[0];
+    if (result.type == ExprResultType::RT_ARRAY) {
+        return static_cast<Number>(result.array.size());
+    }
+    if (result.type == ExprResultType::RT_DICT) {
+        return static_cast<Number>(result.dict.size());
+    }
+    if (result.type == ExprResultType::RT_STRING) {
+        return static_cast<Number>(result.str.size());
+    }
+
+    builtin_panic<InterpretationException>("length", "{} is not a viable argument type",
+                                           expr_result_type_str(result.type));
+}
+
+ankh::lang::ExprResult ankh::lang::builtins::cast_int(std::span<ExprResult> args) {
+    const ExprResult &result = args[0];
+    if (result.type == ExprResultType::RT_NUMBER) {
+        Number e = static_cast<std::int64_t>(result.n);
+        ANKH_DEBUG("cast_int(), from {} to {}", result.n, e);
+        return e;
+    }
+
+    if (result.type == ExprResultType::RT_BOOL) {
+        Number e = result.b ? 1 : 0;
+        return e;
+    }
+
+    builtin_panic<InterpretationException>("int", "{} is not a viable argument type",
+                                           expr_result_type_str(result.type));
+}
+
+ankh::lang::ExprResult ankh::lang::builtins::str(std::span<ExprResult> args) { return args[0].stringify(); }
+
+ankh::lang::ExprResult ankh::lang::builtins::append(std::span<ExprResult> args) {
+    // the container is appended to in place when the caller gave up its reference to it
+    ExprResult &container = args[0];
+    ExprResult &value = args[1];
+
+    if (container.type == ExprResultType::RT_STRING) {
+        container.str += value.stringify();
+        return std::move(container);
+    }
+
+    if (container.type == ExprResultType::RT_ARRAY) {
+        container.array.append(std::move(value));
+        return std::move(container);
+    }
+
+    builtin_panic<InterpretationException>("append", "{} is not a viable argument type",
+                                           expr_result_type_str(container.type));
+}
+
+ankh::lang::ExprResult ankh::lang::builtins::keys(std::span<ExprResult> args) {
+    const ExprResult &container = args[0];
+    if (container.type == ExprResultType::RT_DICT) {
+        Array<ExprResult> arr;
+        for (const auto &x : container.dict) {
+            arr.append(x.key);
+        }
+        return arr;
+    }
+
+    builtin_panic<InterpretationException>("keys", "{} is not a viable argument type",
+                                           expr_result_type_str(container.type));
+}
+
+ankh::lang::ExprResult ankh::lang::builtins::exportfn(std::span<ExprResult> args) {
+    const ExprResult &name = args[0];
+    if (name.type != ExprResultType::RT_STRING) {
+        builtin_panic<InterpretationException>("export", "exported name must be a string, not a {}",
+                                               expr_result_type_str(name.type));
+    }
+
+    const std::string value = args[1].stringify();
+
+    return ankh::sys::setenv(name.str, value);
+}
+
+ankh::lang::ExprResult ankh::lang::builtins::status(std::span<ExprResult> args) {
+    ANKH_UNUSED(args);
+
+    // called outside of any engine, no command has been run
+    const BuiltinState *state = active_builtin_state();
+
+    return static_cast<Number>(state != nullptr ? state->last_status : 0);
+}
+
+ankh::lang::ExprResult ankh::lang::builtins::run_command(const std::string &cmd, BuiltinState &state) {
+    auto possible_process = ankh::sys::run(cmd);
+    if (!possible_process.has_value()) {
+        ANKH_FATAL("unable to launch {}", cmd);
+    }
+
+    state.last_status = possible_process->status;
+
+    return std::move(possible_process->output);
+}
@@ -0,0 +1,183 @@
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <string>
+
+#include <format>
+
+#include <ankh/lang/bytecode.hpp>
+#include <ankh/log.hpp>
+
+std::string ankh::lang::opcode_str(OpCode op) noexcept {
+    switch (op) {
+#define ANKH_OPCODE_STR(op)                                                                                            \
+    case OpCode::op:                                                                                                   \
+        return #op;
+        ANKH_OPCODES(ANKH_OPCODE_STR)
+#undef ANKH_OPCODE_STR
+    default:
+        ANKH_FATAL("unknown opcode {}", static_cast<int>(op));
+    }
+}
+
+void ankh::lang::Chunk::write(std::uint8_t byte, const Token &marker) {
+    if (markers_.empty() || markers_.back() != marker) {
+        markers_.push_back(marker);
+    }
+
+    if (runs_.empty() || runs_.back().marker != markers_.size() - 1) {
+        runs_.push_back({code_.size(), markers_.size() - 1});
+    }
+
+    code_.push_back(byte);
+}
+
+void ankh::lang::Chunk::write_u16(std::uint16_t value, const Token &marker) {
+    write(value & 0xff, marker);
+    write((value >> 8) & 0xff, marker);
+}
+
+void ankh::lang::Chunk::write_u32(std::uint32_t value, const Token &marker) {
+    for (int shift = 0; shift < 32; shift += 8) {
+        write((value >> shift) & 0xff, marker);
+    }
+}
+
+void ankh::lang::Chunk::patch_u32(size_t offset, std::uint32_t value) noexcept {
+    for (size_t i = 0; i < 4; ++i) {
+        code_[offset + i] = (value >> (i * 8)) & 0xff;
+    }
+}
+
+size_t ankh::lang::Chunk::add_constant(ExprResult constant) {
+    constants_.push_back(std::move(constant));
+
+    return constants_.size() - 1;
+}
+
+size_t ankh::lang::Chunk::add_prototype(std::unique_ptr<Prototype> prototype) {
+    prototypes_.push_back(std::move(prototype));
+
+    return prototypes_.size() - 1;
+}
+
+const ankh::lang::Token &ankh::lang::Chunk::marker(size_t offset) const noexcept {
+    ANKH_VERIFY(!runs_.empty());
+
+    auto it = std::upper_bound(runs_.begin(), runs_.end(), offset,
+                               [](size_t offset, const MarkerRun &run) { return offset < run.offset; });
+
+    return markers_[std::prev(it)->marker];
+}
+
+size_t ankh::lang::Globals::resolve(std::string_view name) {
+    if (auto it = indexes_.find(name); it != indexes_.end()) {
+        return it->second;
+    }
+
+    globals_.push_back(Global{std::string{name}, {}, false});
+    indexes_.emplace(name, globals_.size() - 1);
+
+    return globals_.size() - 1;
+}
+
+std::optional<size_t> ankh::lang::Globals::find(std::string_view name) const noexcept {
+    if (auto it = indexes_.find(name); it != indexes_.end()) {
+        return it->second;
+    }
+
+    return std::nullopt;
+}
+
+static size_t disassemble_instruction(const ankh::lang::Chunk &chunk, size_t offset, std::string &out) {
+    using ankh::lang::OpCode;
+
+    const std::uint8_t *code = chunk.code();
+    const OpCode op = static_cast<OpCode>(code[offset]);
+    const ankh::lang::Token &marker = chunk.marker(offset);
+
+    out += std::format("{:04} {:>4}:{:<4} {}", offset, marker.line, marker.col, ankh::lang::opcode_str(op));
+
+    size_t next = offset + 1;
+    switch (op) {
+    case OpCode::CONSTANT:
+    case OpCode::COMMAND:
+    case OpCode::PANIC: {
+        const std::uint32_t index = ankh::lang::read_u32(code + next);
+        out += std::format(" {} '{}'", index, chunk.constant(index).stringify());
+        next += 4;
+        break;
+    }
+    case OpCode::GET_LOCAL:
+    case OpCode::SET_LOCAL:
+    case OpCode::GET_UPVALUE:
+    case OpCode::SET_UPVALUE:
+    case OpCode::CALL_REASSIGN:
+    case OpCode::CALL:
+        out += std::format(" {}", ankh::lang::read_u16(code + next));
+        next += 2;
+        break;
+    case OpCode::GET_GLOBAL:
+    case OpCode::SET_GLOBAL:
+    case OpCode::DEFINE_GLOBAL:
+    case OpCode::ARRAY:
+    case OpCode::DICT:
+    case OpCode::INTERPOLATE:
+        out += std::format(" {}", ankh::lang::read_u32(code + next));
+        next += 4;
+        break;
+    case OpCode::JUMP:
+    case OpCode::JUMP_IF_FALSE:
+    case OpCode::AND:
+    case OpCode::OR:
+        out += std::format(" -> {}", next + 4 + ankh::lang::read_u32(code + next));
+        next += 4;
+        break;
+    case OpCode::LOOP:
+        out += std::format(" -> {}", next + 4 - ankh::lang::read_u32(code + next));
+        next += 4;
+        break;
+    case OpCode::SLICE:
+        out += std::format(" {}", code[next]);
+        next += 1;
+        break;
+    case OpCode::CLOSURE: {
+        const std::uint32_t index = ankh::lang::read_u32(code + next);
+        const ankh::lang::Prototype *prototype = chunk.prototype(index);
+        out += std::format(" {} <fn {}>", index, prototype->name);
+        next += 4;
+        for (size_t i = 0; i < prototype->upvalue_count; ++i) {
+            out += std::format(" {}{}", code[next] ? "local " : "upvalue ", ankh::lang::read_u16(code + next + 1));
+            next += 3;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+
+    out += '\n';
+
+    return next;
+}
+
+static void disassemble(const ankh::lang::Prototype &prototype, std::string &out) {
+    out += std::format("== {} ==\n", prototype.name);
+
+    const ankh::lang::Chunk &chunk = prototype.chunk;
+    for (size_t offset = 0; offset < chunk.size();) {
+        offset = disassemble_instruction(chunk, offset, out);
+    }
+
+    // nested prototypes are listed after their parent
+    for (size_t i = 0; i < chunk.prototype_count(); ++i) {
+        disassemble(*chunk.prototype(i), out);
+    }
+}
+
+std::string ankh::lang::disassemble(const Prototype &prototype) {
+    std::string result;
+    ::disassemble(prototype, result);
+
+    return result;
+}
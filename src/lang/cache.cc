@@ -0,0 +1,911 @@
+#include <algorithm>
+#include <cstring>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <ankh/def.hpp>
+#include <ankh/log.hpp>
+
+#include <ankh/lang/cache.hpp>
+#include <ankh/lang/exceptions.hpp>
+#include <ankh/lang/lambda.hpp>
+
+#ifndef ANKH_VERSION
+#define ANKH_VERSION "unknown"
+#endif
+
+// Identifies cached programs
+static constexpr std::string_view MAGIC = "ankhc";
+
+// Bumped whenever the layout of a cached program or of the AST changes, invalidating every cached program
+static constexpr std::uint32_t FORMAT_VERSION = 8;
+
+template <class T> void ankh::lang::CacheWriter::put(std::string &output, T value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+
+    // cached programs are only read back on the machine which wrote them so the native layout will do
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    output.append(bytes, sizeof(T));
+}
+
+template <class T> T ankh::lang::CacheReader::get() {
+    static_assert(std::is_trivially_copyable_v<T>);
+
+    const std::string_view bytes = read_bytes(sizeof(T));
+
+    if constexpr (std::is_same_v<T, bool>) {
+        // not every byte is a valid bool
+        if (bytes[0] != 0 && bytes[0] != 1) {
+            throw CacheException("invalid bool");
+        }
+    }
+
+    T value;
+    std::memcpy(&value, bytes.data(), sizeof(T));
+
+    return value;
+}
+
+std::uint64_t ankh::lang::source_hash(std::string_view source) noexcept {
+    std::uint64_t hash = 0xcbf29ce484222325;
+    for (const char c : source) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 0x100000001b3;
+    }
+
+    return hash;
+}
+
+std::string ankh::lang::serialize(const Program &program, std::string_view source) {
+    CacheWriter writer;
+
+    return writer.write(program, source);
+}
+
+std::optional<ankh::lang::Program> ankh::lang::deserialize(std::string_view data, std::string_view source) noexcept {
+    Program program;
+
+    try {
+        CacheReader reader(data, program);
+        if (!reader.read_header(source)) {
+            return std::nullopt;
+        }
+
+        reader.read_statements();
+    } catch (const std::exception &e) {
+        ANKH_DEBUG("cache: could not load the program: {}", e.what());
+        return std::nullopt;
+    }
+
+    return program;
+}
+
+std::string ankh::lang::CacheWriter::write(const Program &program, std::string_view source) {
+    ANKH_VERIFY(!program.has_errors());
+
+    put(static_cast<std::uint32_t>(program.size()));
+    put(static_cast<std::uint32_t>(program.call_sites));
+    for (const auto &stmt : program.statements) {
+        write(stmt);
+    }
+
+    // the header and the token text are only known once the statements are written
+    std::string output;
+    output.reserve(MAGIC.size() + 64 + strings_.size() + body_.size());
+    output += MAGIC;
+    put(output, FORMAT_VERSION);
+    put(output, static_cast<std::uint32_t>(std::strlen(ANKH_VERSION)));
+    output += ANKH_VERSION;
+    put(output, static_cast<std::uint64_t>(source.size()));
+    put(output, source_hash(source));
+    put(output, static_cast<std::uint32_t>(strings_.size()));
+    output += strings_;
+    output += body_;
+
+    return output;
+}
+
+ankh::lang::ExprResult ankh::lang::CacheWriter::visit(BinaryExpression *expr) {
+    put(CacheTag::BINARY);
+    write(expr->left);
+    write(expr->op);
+    write(expr->right);
+
+    return {};
+}
+
+ankh::lang::ExprResult ankh::lang::CacheWriter::visit(LogicalExpression *expr) {
+    put(CacheTag::LOGICAL);
+    write(expr->left);
+    write(expr->op);
+    write(expr->right);
+
+    return {};
+}
+
+ankh::lang::ExprResult ankh::lang::CacheWriter::visit(UnaryExpression *expr) {
+    put(CacheTag::UNARY);
+    write(expr->op);
+    write(expr->right);
+
+    return {};
+}
+
+ankh::lang::ExprResult ankh::lang::CacheWriter::visit(LiteralExpression *expr) {
+    put(CacheTag::LITERAL);
+    write(expr->literal);
+    write_value(expr->value);
+
+    return {};
+}
+
+ankh::lang::ExprResult ankh::lang::CacheWriter::visit(ParenExpression *expr) {
+    put(CacheTag::PAREN);
+    write(expr->expr);
+
+    return {};
+}
+
+ankh::lang::ExprResult ankh::lang::CacheWriter::visit(IdentifierExpression *expr) {
+    put(CacheTag::IDENTIFIER);
+    write(expr->name);
+    write(expr->slot);
+
+    return {};
+}
+
+ankh::lang::ExprResult ankh::lang::CacheWriter::visit(CallExpression *expr) {
+    put(CacheTag::CALL);
+    write(expr->marker);
+    write(expr->callee);
+    write(expr->args);
+    put(static_cast<std::uint32_t>(expr->site));
+
+    return {};
+}
+
+ankh::lang::ExprResult ankh::lang::CacheWriter::visit(LambdaExpression *expr) {
+    put(CacheTag::LAMBDA);
+    write(expr->marker);
+    write_string(expr->generated_name);
+    write(expr->params);
+    write(expr->locals);
+    write(expr->captures);
+    write(expr->upvalues);
+    write(expr->body);
+
+    return {};
+}
+
+ankh::lang::ExprResult ankh::lang::CacheWriter::visit(CommandExpression *expr) {
+    put(CacheTag::COMMAND);
+    write(expr->cmd);
+
+    return {};
+}
+
+ankh::lang::ExprResult ankh::lang::CacheWriter::visit(ArrayExpression *expr) {
+    put(CacheTag::ARRAY);
+    write(expr->elems);
+
+    return {};
+}
+
+ankh::lang::ExprResult ankh::lang::CacheWriter::visit(IndexExpression *expr) {
+    put(CacheTag::INDEX);
+    write(expr->marker);
+    write(expr->indexee);
+    write(expr->index);
+
+    return {};
+}
+
+ankh::lang::ExprResult ankh::lang::CacheWriter::visit(SliceExpression *expr) {
+    put(CacheTag::SLICE);
+    write(expr->marker);
+    write(expr->indexee);
+    write(expr->begin);
+    write(expr->end);
+
+    return {};
+}
+
+ankh::lang::ExprResult ankh::lang::CacheWriter::visit(DictionaryExpression *expr) {
+    put(CacheTag::DICTIONARY);
+    write(expr->marker);
+    put(static_cast<std::uint32_t>(expr->entries.size()));
+    for (const auto &[k, v] : expr->entries) {
+        write(k);
+        write(v);
+    }
+
+    return {};
+}
+
+ankh::lang::ExprResult ankh::lang::CacheWriter::visit(StringExpression *expr) {
+    put(CacheTag::STRING);
+    write(expr->str);
+
+    put(static_cast<std::uint32_t>(expr->literals.size()));
+    for (const auto &literal : expr->literals) {
+        write_string(literal);
+    }
+    write(expr->substitutions);
+
+    put(expr->error.has_value());
+    if (expr->error.has_value()) {
+        write_string(expr->error.value());
+    }
+
+    return {};
+}
+
+void ankh::lang::CacheWriter::visit(ExpressionStatement *stmt) {
+    put(CacheTag::EXPRESSION_STATEMENT);
+    write(stmt->expr);
+}
+
+void ankh::lang::CacheWriter::visit(VariableDeclaration *stmt) {
+    put(CacheTag::VARIABLE_DECLARATION);
+    write(stmt->name);
+    write(stmt->initializer);
+    put(stmt->storage_class);
+    write(stmt->slot);
+}
+
+void ankh::lang::CacheWriter::visit(AssignmentStatement *stmt) {
+    put(CacheTag::ASSIGNMENT);
+    write(stmt->name);
+    write(stmt->initializer);
+    write(stmt->slot);
+    put(stmt->reassigns_argument);
+}
+
+void ankh::lang::CacheWriter::visit(CompoundAssignment *stmt) {
+    put(CacheTag::COMPOUND_ASSIGNMENT);
+    write(stmt->target);
+    write(stmt->op);
+    write(stmt->value);
+    write(stmt->slot);
+}
+
+void ankh::lang::CacheWriter::visit(IncOrDecIdentifierStatement *stmt) {
+    put(CacheTag::INC_OR_DEC);
+    write(stmt->op);
+    write(stmt->expr);
+}
+
+void ankh::lang::CacheWriter::visit(BlockStatement *stmt) {
+    put(CacheTag::BLOCK);
+    write(stmt->locals);
+    write(stmt->captures);
+    put(static_cast<std::uint32_t>(stmt->statements.size()));
+    for (const auto &statement : stmt->statements) {
+        write(statement);
+    }
+}
+
+void ankh::lang::CacheWriter::visit(IfStatement *stmt) {
+    put(CacheTag::IF);
+    write(stmt->marker);
+    write(stmt->condition);
+    write(stmt->then_block);
+    write(stmt->else_block);
+}
+
+void ankh::lang::CacheWriter::visit(WhileStatement *stmt) {
+    put(CacheTag::WHILE);
+    write(stmt->marker);
+    write(stmt->condition);
+    write(stmt->body);
+}
+
+void ankh::lang::CacheWriter::visit(ForStatement *stmt) {
+    put(CacheTag::FOR);
+    write(stmt->marker);
+    write(stmt->locals);
+    write(stmt->captures);
+    write(stmt->init);
+    write(stmt->condition);
+    write(stmt->mutator);
+    write(stmt->body);
+}
+
+void ankh::lang::CacheWriter::visit(BreakStatement *stmt) {
+    put(CacheTag::BREAK);
+    write(stmt->tok);
+}
+
+void ankh::lang::CacheWriter::visit(FunctionDeclaration *stmt) {
+    put(CacheTag::FUNCTION_DECLARATION);
+    write(stmt->name);
+    write(stmt->params);
+    write(stmt->slot);
+    write(stmt->locals);
+    write(stmt->captures);
+    write(stmt->upvalues);
+    write(stmt->body);
+}
+
+void ankh::lang::CacheWriter::visit(ReturnStatement *stmt) {
+    put(CacheTag::RETURN);
+    write(stmt->tok);
+    write(stmt->expr);
+}
+
+void ankh::lang::CacheWriter::write(const ExpressionPtr &expr) {
+    if (expr == nullptr) {
+        put(CacheTag::NONE);
+        return;
+    }
+
+    expr->accept(this);
+}
+
+void ankh::lang::CacheWriter::write(const StatementPtr &stmt) {
+    if (stmt == nullptr) {
+        put(CacheTag::NONE);
+        return;
+    }
+
+    stmt->accept(this);
+}
+
+void ankh::lang::CacheWriter::write(const std::vector<ExpressionPtr> &exprs) {
+    put(static_cast<std::uint32_t>(exprs.size()));
+    for (const auto &expr : exprs) {
+        write(expr);
+    }
+}
+
+void ankh::lang::CacheWriter::write(const Token &token) {
+    // names tend to repeat throughout a program so their text is only written the first time around
+    const auto [it, inserted] = offsets_.try_emplace(token.str, static_cast<std::uint32_t>(strings_.size()));
+    if (inserted) {
+        strings_ += token.str;
+    }
+
+    put(it->second);
+    put(static_cast<std::uint32_t>(token.str.size()));
+    put(token.type);
+    put(static_cast<std::uint32_t>(token.line));
+    put(static_cast<std::uint32_t>(token.col));
+}
+
+void ankh::lang::CacheWriter::write(const std::vector<Token> &tokens) {
+    put(static_cast<std::uint32_t>(tokens.size()));
+    for (const auto &token : tokens) {
+        write(token);
+    }
+}
+
+void ankh::lang::CacheWriter::write(const std::optional<Slot> &slot) {
+    put(slot.has_value());
+    if (slot.has_value()) {
+        write(slot.value());
+    }
+}
+
+void ankh::lang::CacheWriter::write(const Slot &slot) {
+    put(static_cast<std::uint32_t>(slot.depth));
+    put(static_cast<std::uint32_t>(slot.index));
+    put(slot.upvalue);
+}
+
+void ankh::lang::CacheWriter::write(const std::vector<Slot> &slots) {
+    put(static_cast<std::uint32_t>(slots.size()));
+    for (const auto &slot : slots) {
+        write(slot);
+    }
+}
+
+void ankh::lang::CacheWriter::write(const Captures &captures) {
+    put(static_cast<std::uint32_t>(captures.size()));
+    for (const auto index : captures) {
+        put(static_cast<std::uint32_t>(index));
+    }
+}
+
+void ankh::lang::CacheWriter::write(const Locals &locals) {
+    put(static_cast<std::uint32_t>(locals.size()));
+    for (const auto &local : locals) {
+        write_string(local);
+    }
+}
+
+void ankh::lang::CacheWriter::write_value(const std::optional<ExprResult> &value) {
+    put(value.has_value());
+    if (!value.has_value()) {
+        return;
+    }
+
+    put(value->type);
+    switch (value->type) {
+    case ExprResultType::RT_NUMBER:
+        put(value->n);
+        break;
+    case ExprResultType::RT_STRING:
+        write_string(value->str.value());
+        break;
+    case ExprResultType::RT_BOOL:
+        put(value->b);
+        break;
+    case ExprResultType::RT_NIL:
+        break;
+    default:
+        // only the values of literals are known before the program runs
+        ANKH_FATAL("'{}' values can't be cached", expr_result_type_str(value->type));
+    }
+}
+
+void ankh::lang::CacheWriter::write_string(std::string_view str) {
+    put(static_cast<std::uint32_t>(str.size()));
+    body_ += str;
+}
+
+ankh::lang::CacheReader::CacheReader(std::string_view data, Program &program) noexcept
+    : data_(data), cursor_(0), program_(program) {}
+
+bool ankh::lang::CacheReader::read_header(std::string_view source) {
+    if (read_bytes(MAGIC.size()) != MAGIC || get<std::uint32_t>() != FORMAT_VERSION) {
+        return false;
+    }
+    if (read_string() != ANKH_VERSION) {
+        return false;
+    }
+    if (get<std::uint64_t>() != source.size() || get<std::uint64_t>() != source_hash(source)) {
+        return false;
+    }
+
+    // the tokens are views into this text so it has to live as long as the program
+    strings_ = program_.arena.copy(read_bytes(get<std::uint32_t>()));
+
+    return true;
+}
+
+void ankh::lang::CacheReader::read_statements() {
+    const auto size = get_count();
+    program_.call_sites = get<std::uint32_t>();
+    program_.statements.reserve(size);
+    for (std::uint32_t i = 0; i < size; ++i) {
+        program_.statements.push_back(read_statement());
+    }
+
+    if (cursor_ != data_.size()) {
+        throw CacheException("trailing data after the last statement");
+    }
+}
+
+ankh::lang::ExpressionPtr ankh::lang::CacheReader::read_expression() {
+    ExpressionPtr expr = read_optional_expression();
+    if (expr == nullptr) {
+        throw CacheException("missing expression");
+    }
+
+    return expr;
+}
+
+ankh::lang::StatementPtr ankh::lang::CacheReader::read_statement() {
+    StatementPtr stmt = read_optional_statement();
+    if (stmt == nullptr) {
+        throw CacheException("missing statement");
+    }
+
+    return stmt;
+}
+
+ankh::lang::ExpressionPtr ankh::lang::CacheReader::read_optional_expression() {
+    Arena &arena = program_.arena;
+
+    // the fields are read into locals first since the order function arguments are evaluated in is unspecified
+    const auto tag = get<CacheTag>();
+    switch (tag) {
+    case CacheTag::NONE:
+        return nullptr;
+    case CacheTag::BINARY:
+    case CacheTag::LOGICAL: {
+        ExpressionPtr left = read_expression();
+        Token op = read_token();
+        ExpressionPtr right = read_expression();
+        if (tag == CacheTag::BINARY) {
+            return make_expression<BinaryExpression>(arena, std::move(left), std::move(op), std::move(right));
+        }
+        return make_expression<LogicalExpression>(arena, std::move(left), std::move(op), std::move(right));
+    }
+    case CacheTag::UNARY: {
+        Token op = read_token();
+        ExpressionPtr right = read_expression();
+        return make_expression<UnaryExpression>(arena, std::move(op), std::move(right));
+    }
+    case CacheTag::LITERAL: {
+        Token literal = read_token();
+        std::optional<ExprResult> value = read_value();
+        if (value.has_value()) {
+            return make_expression<LiteralExpression>(arena, std::move(literal), std::move(value.value()));
+        }
+        return make_expression<LiteralExpression>(arena, std::move(literal));
+    }
+    case CacheTag::PAREN:
+        return make_expression<ParenExpression>(arena, read_expression());
+    case CacheTag::IDENTIFIER: {
+        ExpressionPtr expr = make_expression<IdentifierExpression>(arena, read_token());
+        static_cast<IdentifierExpression *>(expr.get())->slot = read_slot(SlotUse::ACCESS);
+        return expr;
+    }
+    case CacheTag::CALL: {
+        Token marker = read_token();
+        ExpressionPtr callee = read_expression();
+        std::vector<ExpressionPtr> args = read_expressions();
+        ExpressionPtr expr =
+            make_expression<CallExpression>(arena, std::move(marker), std::move(callee), std::move(args));
+        // interpreters index the caches of the call sites with it
+        const auto site = get<std::uint32_t>();
+        if (site >= program_.call_sites) {
+            throw CacheException("call site out of range");
+        }
+        static_cast<CallExpression *>(expr.get())->site = site;
+        return expr;
+    }
+    case CacheTag::LAMBDA: {
+        Token marker = read_token();
+        std::string generated_name{read_string()};
+        std::vector<Token> params = read_tokens();
+        Locals locals = read_locals();
+        Captures captures = read_captures(locals);
+        std::vector<Slot> upvalues = read_slots();
+        StatementPtr body = read_closure_body(params, locals, captures, upvalues);
+        ExpressionPtr expr = make_expression<LambdaExpression>(arena, std::move(marker), std::move(generated_name),
+                                                               std::move(params), std::move(body));
+        auto *lambda = static_cast<LambdaExpression *>(expr.get());
+        lambda->locals = std::move(locals);
+        lambda->captures = std::move(captures);
+        lambda->upvalues = std::move(upvalues);
+        return expr;
+    }
+    case CacheTag::COMMAND:
+        return make_expression<CommandExpression>(arena, read_token());
+    case CacheTag::ARRAY:
+        return make_expression<ArrayExpression>(arena, read_expressions());
+    case CacheTag::INDEX: {
+        Token marker = read_token();
+        ExpressionPtr indexee = read_expression();
+        ExpressionPtr index = read_expression();
+        return make_expression<IndexExpression>(arena, std::move(marker), std::move(indexee), std::move(index));
+    }
+    case CacheTag::SLICE: {
+        Token marker = read_token();
+        ExpressionPtr indexee = read_expression();
+        ExpressionPtr begin = read_optional_expression();
+        ExpressionPtr end = read_optional_expression();
+        return make_expression<SliceExpression>(arena, std::move(marker), std::move(indexee), std::move(begin),
+                                                std::move(end));
+    }
+    case CacheTag::DICTIONARY: {
+        Token marker = read_token();
+        const auto size = get_count();
+        std::vector<Entry<ExpressionPtr>> entries;
+        entries.reserve(size);
+        for (std::uint32_t i = 0; i < size; ++i) {
+            ExpressionPtr key = read_expression();
+            ExpressionPtr value = read_expression();
+            entries.emplace_back(std::move(key), std::move(value));
+        }
+        return make_expression<DictionaryExpression>(arena, std::move(marker), std::move(entries));
+    }
+    case CacheTag::STRING: {
+        Token str = read_token();
+        const auto size = get_count();
+        std::vector<std::string> literals;
+        literals.reserve(size);
+        for (std::uint32_t i = 0; i < size; ++i) {
+            literals.emplace_back(read_string());
+        }
+        std::vector<ExpressionPtr> substitutions = read_expressions();
+        ExpressionPtr expr =
+            make_expression<StringExpression>(arena, std::move(str), std::move(literals), std::move(substitutions));
+        if (get<bool>()) {
+            static_cast<StringExpression *>(expr.get())->error = std::string{read_string()};
+        }
+        return expr;
+    }
+    default:
+        throw CacheException("unknown expression");
+    }
+}
+
+ankh::lang::StatementPtr ankh::lang::CacheReader::read_optional_statement() {
+    Arena &arena = program_.arena;
+
+    switch (get<CacheTag>()) {
+    case CacheTag::NONE:
+        return nullptr;
+    case CacheTag::EXPRESSION_STATEMENT:
+        return make_statement<ExpressionStatement>(arena, read_expression());
+    case CacheTag::VARIABLE_DECLARATION: {
+        Token name = read_token();
+        ExpressionPtr initializer = read_expression();
+        const auto storage_class = get<StorageClass>();
+        if (storage_class != StorageClass::LOCAL) {
+            throw CacheException("unknown storage class");
+        }
+        StatementPtr stmt =
+            make_statement<VariableDeclaration>(arena, std::move(name), std::move(initializer), storage_class);
+        static_cast<VariableDeclaration *>(stmt.get())->slot = read_slot(SlotUse::DECLARATION);
+        return stmt;
+    }
+    case CacheTag::ASSIGNMENT: {
+        Token name = read_token();
+        ExpressionPtr initializer = read_expression();
+        StatementPtr stmt = make_statement<AssignmentStatement>(arena, std::move(name), std::move(initializer));
+        auto *assignment = static_cast<AssignmentStatement *>(stmt.get());
+        assignment->slot = read_slot(SlotUse::ACCESS);
+        assignment->reassigns_argument = get<bool>();
+        return stmt;
+    }
+    case CacheTag::COMPOUND_ASSIGNMENT: {
+        Token target = read_token();
+        Token op = read_token();
+        ExpressionPtr value = read_expression();
+        StatementPtr stmt =
+            make_statement<CompoundAssignment>(arena, std::move(target), std::move(op), std::move(value));
+        static_cast<CompoundAssignment *>(stmt.get())->slot = read_slot(SlotUse::ACCESS);
+        return stmt;
+    }
+    case CacheTag::INC_OR_DEC: {
+        Token op = read_token();
+        ExpressionPtr expr = read_expression();
+        return make_statement<IncOrDecIdentifierStatement>(arena, std::move(op), std::move(expr));
+    }
+    case CacheTag::BLOCK: {
+        Locals locals = read_locals();
+        Captures captures = read_captures(locals);
+        scopes_.push_back(Scope{&locals, &captures, nullptr});
+        const auto size = get_count();
+        std::vector<StatementPtr> statements;
+        statements.reserve(size);
+        for (std::uint32_t i = 0; i < size; ++i) {
+            statements.push_back(read_statement());
+        }
+        scopes_.pop_back();
+        StatementPtr stmt = make_statement<BlockStatement>(arena, std::move(statements));
+        auto *block = static_cast<BlockStatement *>(stmt.get());
+        block->locals = std::move(locals);
+        block->captures = std::move(captures);
+        return stmt;
+    }
+    case CacheTag::IF: {
+        Token marker = read_token();
+        ExpressionPtr condition = read_expression();
+        StatementPtr then_block = read_statement();
+        StatementPtr else_block = read_optional_statement();
+        return make_statement<IfStatement>(arena, std::move(marker), std::move(condition), std::move(then_block),
+                                           std::move(else_block));
+    }
+    case CacheTag::WHILE: {
+        Token marker = read_token();
+        ExpressionPtr condition = read_expression();
+        StatementPtr body = read_statement();
+        return make_statement<WhileStatement>(arena, std::move(marker), std::move(condition), std::move(body));
+    }
+    case CacheTag::FOR: {
+        Token marker = read_token();
+        Locals locals = read_locals();
+        Captures captures = read_captures(locals);
+        scopes_.push_back(Scope{&locals, &captures, nullptr});
+        StatementPtr init = read_optional_statement();
+        ExpressionPtr condition = read_optional_expression();
+        StatementPtr mutator = read_optional_statement();
+        StatementPtr body = read_statement();
+        scopes_.pop_back();
+        StatementPtr stmt = make_statement<ForStatement>(arena, std::move(marker), std::move(init),
+                                                         std::move(condition), std::move(mutator), std::move(body));
+        auto *loop = static_cast<ForStatement *>(stmt.get());
+        loop->locals = std::move(locals);
+        loop->captures = std::move(captures);
+        return stmt;
+    }
+    case CacheTag::BREAK:
+        return make_statement<BreakStatement>(arena, read_token());
+    case CacheTag::FUNCTION_DECLARATION: {
+        Token name = read_token();
+        std::vector<Token> params = read_tokens();
+        std::optional<Slot> slot = read_slot(SlotUse::DECLARATION);
+        Locals locals = read_locals();
+        Captures captures = read_captures(locals);
+        std::vector<Slot> upvalues = read_slots();
+        StatementPtr body = read_closure_body(params, locals, captures, upvalues);
+        StatementPtr stmt =
+            make_statement<FunctionDeclaration>(arena, std::move(name), std::move(params), std::move(body));
+        auto *function = static_cast<FunctionDeclaration *>(stmt.get());
+        function->slot = slot;
+        function->locals = std::move(locals);
+        function->captures = std::move(captures);
+        function->upvalues = std::move(upvalues);
+        return stmt;
+    }
+    case CacheTag::RETURN: {
+        Token tok = read_token();
+        ExpressionPtr expr = read_optional_expression();
+        return make_statement<ReturnStatement>(arena, std::move(tok), std::move(expr));
+    }
+    default:
+        throw CacheException("unknown statement");
+    }
+}
+
+std::vector<ankh::lang::ExpressionPtr> ankh::lang::CacheReader::read_expressions() {
+    const auto size = get_count();
+    std::vector<ExpressionPtr> exprs;
+    exprs.reserve(size);
+    for (std::uint32_t i = 0; i < size; ++i) {
+        exprs.push_back(read_expression());
+    }
+
+    return exprs;
+}
+
+ankh::lang::Token ankh::lang::CacheReader::read_token() {
+    const auto offset = get<std::uint32_t>();
+    const auto size = get_count();
+    const auto type = get<TokenType>();
+    const auto line = get<std::uint32_t>();
+    const auto col = get<std::uint32_t>();
+
+    if (offset > strings_.size() || size > strings_.size() - offset || type > TokenType::UNKNOWN) {
+        throw CacheException("invalid token");
+    }
+
+    return Token{strings_.substr(offset, size), type, line, col};
+}
+
+std::vector<ankh::lang::Token> ankh::lang::CacheReader::read_tokens() {
+    const auto size = get_count();
+    std::vector<Token> tokens;
+    tokens.reserve(size);
+    for (std::uint32_t i = 0; i < size; ++i) {
+        tokens.push_back(read_token());
+    }
+
+    return tokens;
+}
+
+ankh::lang::StatementPtr ankh::lang::CacheReader::read_closure_body(const std::vector<Token> &params,
+                                                                     const Locals &locals, const Captures &captures,
+                                                                     const std::vector<Slot> &upvalues) {
+    // the arguments are defined in the first slots
+    if (params.size() > locals.size()) {
+        throw CacheException("parameters out of range");
+    }
+
+    scopes_.push_back(Scope{&locals, &captures, &upvalues});
+    StatementPtr body = read_statement();
+    scopes_.pop_back();
+
+    return body;
+}
+
+std::optional<ankh::lang::Slot> ankh::lang::CacheReader::read_slot(SlotUse use) {
+    if (!get<bool>()) {
+        return std::nullopt;
+    }
+
+    return read_slot_value(use);
+}
+
+ankh::lang::Slot ankh::lang::CacheReader::read_slot_value(SlotUse use) {
+    const auto depth = get<std::uint32_t>();
+    const auto index = get<std::uint32_t>();
+    const auto upvalue = get<bool>();
+
+    // the interpreter never checks the slots it's given, so one out of range would be read out of bounds
+    if (upvalue) {
+        // upvalues are those of the innermost closure, which the environments of its scopes all share
+        const auto closure = std::find_if(scopes_.rbegin(), scopes_.rend(),
+                                          [](const Scope &scope) { return scope.upvalues != nullptr; });
+        if (use == SlotUse::DECLARATION || closure == scopes_.rend() || index >= closure->upvalues->size()) {
+            throw CacheException("upvalue out of range");
+        }
+
+        return Slot{depth, index, upvalue};
+    }
+
+    // the environment of a closure's outermost scope has no enclosing one, and that of the global scope no slots
+    bool in_range = depth < scopes_.size() && (use != SlotUse::DECLARATION || depth == 0);
+    for (size_t i = 0; in_range && i < depth; ++i) {
+        in_range = scopes_[scopes_.size() - 1 - i].upvalues == nullptr;
+    }
+    if (!in_range) {
+        throw CacheException("slot out of range");
+    }
+
+    const Scope &scope = scopes_[scopes_.size() - 1 - depth];
+    if (index >= scope.locals->size() ||
+        (use == SlotUse::CAPTURE && std::find(scope.captures->begin(), scope.captures->end(), index) ==
+                                        scope.captures->end())) {
+        throw CacheException("slot out of range");
+    }
+
+    return Slot{depth, index, upvalue};
+}
+
+std::vector<ankh::lang::Slot> ankh::lang::CacheReader::read_slots() {
+    const auto size = get_count();
+    std::vector<Slot> slots;
+    slots.reserve(size);
+    for (std::uint32_t i = 0; i < size; ++i) {
+        slots.push_back(read_slot_value(SlotUse::CAPTURE));
+    }
+
+    return slots;
+}
+
+ankh::lang::Captures ankh::lang::CacheReader::read_captures(const Locals &locals) {
+    const auto size = get_count();
+    Captures captures;
+    captures.reserve(size);
+    for (std::uint32_t i = 0; i < size; ++i) {
+        const auto index = get<std::uint32_t>();
+        // the environment keeps a cell for each of them alongside its slots
+        if (index >= locals.size()) {
+            throw CacheException("captured variable out of range");
+        }
+        captures.push_back(index);
+    }
+
+    return captures;
+}
+
+ankh::lang::Locals ankh::lang::CacheReader::read_locals() {
+    const auto size = get_count();
+    Locals locals;
+    locals.reserve(size);
+    for (std::uint32_t i = 0; i < size; ++i) {
+        locals.emplace_back(read_string());
+    }
+
+    return locals;
+}
+
+std::optional<ankh::lang::ExprResult> ankh::lang::CacheReader::read_value() {
+    if (!get<bool>()) {
+        return std::nullopt;
+    }
+
+    switch (get<ExprResultType>()) {
+    case ExprResultType::RT_NUMBER:
+        return ExprResult{get<Number>()};
+    case ExprResultType::RT_STRING:
+        return ExprResult{std::string{read_string()}};
+    case ExprResultType::RT_BOOL:
+        return ExprResult{get<bool>()};
+    case ExprResultType::RT_NIL:
+        return ExprResult{};
+    default:
+        throw CacheException("invalid literal value");
+    }
+}
+
+std::string_view ankh::lang::CacheReader::read_bytes(size_t size) {
+    if (size > data_.size() - cursor_) {
+        throw CacheException("unexpected end of data");
+    }
+
+    const std::string_view bytes = data_.substr(cursor_, size);
+    cursor_ += size;
+
+    return bytes;
+}
+
+std::string_view ankh::lang::CacheReader::read_string() { return read_bytes(get<std::uint32_t>()); }
+
+std::uint32_t ankh::lang::CacheReader::get_count() {
+    const auto count = get<std::uint32_t>();
+    if (count > data_.size() - cursor_) {
+        throw CacheException("invalid count");
+    }
+
+    return count;
+}
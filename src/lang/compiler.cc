@@ -0,0 +1,697 @@
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <string>
+#include <utility>
+
+#include <ankh/def.hpp>
+#include <ankh/log.hpp>
+
+#include <ankh/lang/compiler.hpp>
+#include <ankh/lang/exceptions.hpp>
+#include <ankh/lang/operators.hpp>
+#include <ankh/lang/parser.hpp>
+
+ankh::lang::Compiler::Compiler(Globals &globals) : globals_(globals), marker_("", TokenType::UNKNOWN, 0, 0) {}
+
+std::unique_ptr<ankh::lang::Prototype> ankh::lang::Compiler::compile(const Program &program) {
+    functions_.clear();
+    functions_.push_back(FunctionState{std::make_unique<Prototype>("<script>", 0), {}, {}, {}, 0});
+
+    // slot zero of every call frame holds the function being called
+    current().locals.push_back(Local{"", 0, false});
+
+    for (const auto &stmt : program.statements) {
+        compile(stmt);
+    }
+
+    emit(OpCode::NIL, marker_);
+    emit(OpCode::ANKH_RETURN, marker_);
+
+    std::unique_ptr<Prototype> script = std::move(current().prototype);
+    functions_.clear();
+
+    return script;
+}
+
+ankh::lang::ExprResult ankh::lang::Compiler::visit(BinaryExpression *expr) {
+    compile(expr->left);
+    compile(expr->right);
+
+    switch (expr->op.type) {
+    case TokenType::EQEQ:
+        emit(OpCode::EQ, expr->op);
+        break;
+    case TokenType::NEQ:
+        emit(OpCode::NEQ, expr->op);
+        break;
+    case TokenType::GT:
+        emit(OpCode::GT, expr->op);
+        break;
+    case TokenType::GTE:
+        emit(OpCode::GTE, expr->op);
+        break;
+    case TokenType::LT:
+        emit(OpCode::LT, expr->op);
+        break;
+    case TokenType::LTE:
+        emit(OpCode::LTE, expr->op);
+        break;
+    case TokenType::MINUS:
+        emit(OpCode::SUB, expr->op);
+        break;
+    case TokenType::PLUS:
+        emit(OpCode::ADD, expr->op);
+        break;
+    case TokenType::STAR:
+        emit(OpCode::MUL, expr->op);
+        break;
+    case TokenType::FSLASH:
+        emit(OpCode::DIV, expr->op);
+        break;
+    default:
+        panic<InterpretationException>(expr->op, "runtime error: unknown binary operator '{}'", expr->op.str);
+    }
+
+    return {};
+}
+
+ankh::lang::ExprResult ankh::lang::Compiler::visit(LogicalExpression *expr) {
+    compile(expr->left);
+
+    // a deciding left operand is left on the stack as the result and the right operand is jumped over
+    const size_t end_jump = emit_jump(expr->op.type == TokenType::OR ? OpCode::OR : OpCode::AND, expr->op);
+    compile(expr->right);
+    emit(OpCode::CHECK_BOOL, expr->op);
+    patch_jump(end_jump);
+
+    return {};
+}
+
+ankh::lang::ExprResult ankh::lang::Compiler::visit(UnaryExpression *expr) {
+    compile(expr->right);
+
+    switch (expr->op.type) {
+    case TokenType::MINUS:
+        emit(OpCode::NEGATE, expr->op);
+        break;
+    case TokenType::BANG:
+        emit(OpCode::NOT, expr->op);
+        break;
+    default:
+        panic<InterpretationException>(expr->op, "runtime error: unknown unary operator '{}'", expr->op.str);
+    }
+
+    return {};
+}
+
+ankh::lang::ExprResult ankh::lang::Compiler::visit(LiteralExpression *expr) {
+    if (expr->value.has_value()) {
+        const ExprResult &value = expr->value.value();
+        if (value.type == ExprResultType::RT_BOOL) {
+            emit(value.b ? OpCode::ANKH_TRUE : OpCode::ANKH_FALSE, expr->literal);
+        } else if (value.type == ExprResultType::RT_NIL) {
+            emit(OpCode::NIL, expr->literal);
+        } else {
+            emit_constant(value, expr->literal);
+        }
+
+        return {};
+    }
+
+    switch (expr->literal.type) {
+    case TokenType::NUMBER:
+        emit_constant(to_num(expr->literal), expr->literal);
+        break;
+    case TokenType::STRING:
+        emit_constant(std::string{expr->literal.str}, expr->literal);
+        break;
+    case TokenType::ANKH_TRUE:
+        emit(OpCode::ANKH_TRUE, expr->literal);
+        break;
+    case TokenType::ANKH_FALSE:
+        emit(OpCode::ANKH_FALSE, expr->literal);
+        break;
+    case TokenType::NIL:
+        emit(OpCode::NIL, expr->literal);
+        break;
+    default:
+        panic<InterpretationException>(expr->literal, "runtime error: unknown literal expression '{}''",
+                                       expr->literal.str);
+    }
+
+    return {};
+}
+
+ankh::lang::ExprResult ankh::lang::Compiler::visit(ParenExpression *expr) {
+    compile(expr->expr);
+
+    return {};
+}
+
+ankh::lang::ExprResult ankh::lang::Compiler::visit(IdentifierExpression *expr) {
+    emit_get(expr->name);
+
+    return {};
+}
+
+ankh::lang::ExprResult ankh::lang::Compiler::visit(CallExpression *expr) {
+    compile_call(expr, OpCode::CALL);
+
+    return {};
+}
+
+ankh::lang::ExprResult ankh::lang::Compiler::visit(LambdaExpression *expr) {
+    compile_function(expr->generated_name, expr->params, expr->body, expr->marker);
+
+    return {};
+}
+
+ankh::lang::ExprResult ankh::lang::Compiler::visit(CommandExpression *expr) {
+    emit_u32(OpCode::COMMAND, make_constant(std::string{expr->cmd.str}, expr->cmd), expr->cmd);
+
+    return {};
+}
+
+ankh::lang::ExprResult ankh::lang::Compiler::visit(ArrayExpression *expr) {
+    for (const auto &elem : expr->elems) {
+        compile(elem);
+    }
+
+    emit_u32(OpCode::ARRAY, static_cast<std::uint32_t>(expr->elems.size()), marker_);
+
+    return {};
+}
+
+ankh::lang::ExprResult ankh::lang::Compiler::visit(IndexExpression *expr) {
+    compile(expr->indexee);
+    compile(expr->index);
+
+    emit(OpCode::INDEX, expr->marker);
+
+    return {};
+}
+
+ankh::lang::ExprResult ankh::lang::Compiler::visit(SliceExpression *expr) {
+    compile(expr->indexee);
+
+    std::uint8_t flags = 0;
+    if (expr->begin) {
+        compile(expr->begin);
+        flags |= SLICE_HAS_BEGIN;
+    }
+    if (expr->end) {
+        compile(expr->end);
+        flags |= SLICE_HAS_END;
+    }
+
+    emit(OpCode::SLICE, expr->marker);
+    chunk().write(flags, expr->marker);
+
+    return {};
+}
+
+ankh::lang::ExprResult ankh::lang::Compiler::visit(DictionaryExpression *expr) {
+    for (const auto &[key, value] : expr->entries) {
+        compile(key);
+        compile(value);
+    }
+
+    emit_u32(OpCode::DICT, static_cast<std::uint32_t>(expr->entries.size()), expr->marker);
+
+    return {};
+}
+
+ankh::lang::ExprResult ankh::lang::Compiler::visit(StringExpression *expr) {
+    compile_interpolation(expr);
+
+    return {};
+}
+
+void ankh::lang::Compiler::visit(ExpressionStatement *stmt) {
+    compile(stmt->expr);
+
+    emit(OpCode::ECHO, marker_);
+}
+
+void ankh::lang::Compiler::visit(VariableDeclaration *stmt) {
+    compile(stmt->initializer);
+
+    if (is_global_scope()) {
+        emit_u32(OpCode::DEFINE_GLOBAL, static_cast<std::uint32_t>(globals_.resolve(stmt->name.str)), stmt->name);
+    } else if (const auto slot = declare_reserved(stmt->name); slot.has_value()) {
+        emit_u16(OpCode::SET_LOCAL, slot.value(), stmt->name);
+    } else {
+        // the initializer's value is left on the stack in the slot of the new local
+        declare_local(stmt->name);
+    }
+}
+
+void ankh::lang::Compiler::visit(AssignmentStatement *stmt) {
+    if (stmt->reassigns_argument) {
+        // xs = f(xs, ...) calls through CALL_REASSIGN, which relies on the SET_* emitted right after it
+        const auto *call = static_cast<CallExpression *>(stmt->initializer.get());
+        compile_call(call, OpCode::CALL_REASSIGN);
+    } else {
+        compile(stmt->initializer);
+    }
+
+    emit_set(stmt->name);
+}
+
+void ankh::lang::Compiler::visit(CompoundAssignment *stmt) {
+    emit_get(stmt->target);
+    compile(stmt->value);
+
+    switch (stmt->op.type) {
+    case TokenType::PLUSEQ:
+        emit(OpCode::ADD, stmt->op);
+        break;
+    case TokenType::MINUSEQ:
+        emit(OpCode::SUB, stmt->op);
+        break;
+    case TokenType::STAREQ:
+        emit(OpCode::MUL, stmt->op);
+        break;
+    case TokenType::FSLASHEQ:
+        emit(OpCode::DIV, stmt->op);
+        break;
+    default:
+        panic<InterpretationException>(stmt->op, "runtime error: '{}' is not a valid compound assignment operation",
+                                       stmt->op.str);
+    }
+
+    emit_set(stmt->target);
+}
+
+void ankh::lang::Compiler::visit(IncOrDecIdentifierStatement *stmt) {
+    const IdentifierExpression *expr = static_cast<IdentifierExpression *>(stmt->expr.get());
+
+    emit_get(expr->name);
+    emit_constant(1.0, stmt->op);
+
+    switch (stmt->op.type) {
+    case TokenType::INC:
+        emit(OpCode::ADD, stmt->op);
+        break;
+    case TokenType::DEC:
+        emit(OpCode::SUB, stmt->op);
+        break;
+    default:
+        // this shouldn't happen since the parser validates the token is one of the above
+        ANKH_FATAL("'{}' is not a valid increment or decrement operation", stmt->op.str);
+    }
+
+    emit_set(expr->name);
+}
+
+void ankh::lang::Compiler::visit(BlockStatement *stmt) {
+    begin_scope();
+    reserve_locals(stmt->statements);
+    for (const auto &statement : stmt->statements) {
+        compile(statement);
+    }
+    end_scope(marker_);
+}
+
+void ankh::lang::Compiler::visit(IfStatement *stmt) {
+    compile(stmt->condition);
+
+    const size_t else_jump = emit_jump(OpCode::JUMP_IF_FALSE, stmt->marker);
+    compile(stmt->then_block);
+
+    if (stmt->else_block == nullptr) {
+        patch_jump(else_jump);
+        return;
+    }
+
+    const size_t end_jump = emit_jump(OpCode::JUMP, stmt->marker);
+    patch_jump(else_jump);
+    compile(stmt->else_block);
+    patch_jump(end_jump);
+}
+
+void ankh::lang::Compiler::visit(WhileStatement *stmt) {
+    const size_t loop_start = chunk().size();
+
+    compile(stmt->condition);
+    const size_t exit_jump = emit_jump(OpCode::JUMP_IF_FALSE, stmt->marker);
+
+    current().loops.push_back(Loop{current().depth, {}});
+    compile(stmt->body);
+    emit_loop(loop_start, stmt->marker);
+
+    patch_jump(exit_jump);
+    for (size_t jump : current().loops.back().breaks) {
+        patch_jump(jump);
+    }
+    current().loops.pop_back();
+}
+
+void ankh::lang::Compiler::visit(ForStatement *stmt) {
+    begin_scope();
+
+    if (stmt->init) {
+        compile(stmt->init);
+    }
+
+    const size_t loop_start = chunk().size();
+
+    std::optional<size_t> exit_jump;
+    if (stmt->condition) {
+        compile(stmt->condition);
+        exit_jump = emit_jump(OpCode::JUMP_IF_FALSE, stmt->marker);
+    }
+
+    current().loops.push_back(Loop{current().depth, {}});
+    compile(stmt->body);
+    if (stmt->mutator) {
+        compile(stmt->mutator);
+    }
+    emit_loop(loop_start, stmt->marker);
+
+    if (exit_jump) {
+        patch_jump(exit_jump.value());
+    }
+    for (size_t jump : current().loops.back().breaks) {
+        patch_jump(jump);
+    }
+    current().loops.pop_back();
+
+    end_scope(stmt->marker);
+}
+
+void ankh::lang::Compiler::visit(BreakStatement *stmt) {
+    // the static analyzer allows breaking out of a loop from a lambda defined in it but we can't jump across functions
+    if (current().loops.empty()) {
+        panic<InterpretationException>(stmt->tok, "compile error: a break statement can only be within loop scope");
+    }
+
+    discard_locals(current().loops.back().depth, stmt->tok);
+
+    current().loops.back().breaks.push_back(emit_jump(OpCode::JUMP, stmt->tok));
+}
+
+void ankh::lang::Compiler::visit(FunctionDeclaration *stmt) {
+    if (is_global_scope()) {
+        compile_function(stmt->name.str, stmt->params, stmt->body, stmt->name);
+        emit_u32(OpCode::DEFINE_GLOBAL, static_cast<std::uint32_t>(globals_.resolve(stmt->name.str)), stmt->name);
+        return;
+    }
+
+    // the slot of the function was reserved along with the other variables of its scope, which its body can refer to
+    const auto slot = declare_reserved(stmt->name);
+    ANKH_VERIFY(slot.has_value());
+
+    compile_function(stmt->name.str, stmt->params, stmt->body, stmt->name, current().depth);
+    emit_u16(OpCode::SET_LOCAL, slot.value(), stmt->name);
+}
+
+void ankh::lang::Compiler::visit(ReturnStatement *stmt) {
+    if (stmt->expr) {
+        compile(stmt->expr);
+    } else {
+        emit(OpCode::NIL, stmt->tok);
+    }
+
+    emit(OpCode::ANKH_RETURN, stmt->tok);
+}
+
+void ankh::lang::Compiler::compile(const ExpressionPtr &expr) { expr->accept(this); }
+
+void ankh::lang::Compiler::compile(const StatementPtr &stmt) { stmt->accept(this); }
+
+void ankh::lang::Compiler::compile_call(const CallExpression *expr, OpCode op) {
+    compile(expr->callee);
+    for (const auto &arg : expr->args) {
+        compile(arg);
+    }
+
+    if (expr->args.size() > std::numeric_limits<std::uint16_t>::max()) {
+        panic<InterpretationException>(expr->marker, "compile error: too many arguments in call to '{}'",
+                                       expr->callee->stringify());
+    }
+
+    emit_u16(op, static_cast<std::uint16_t>(expr->args.size()), expr->marker);
+}
+
+void ankh::lang::Compiler::compile_function(std::string_view name, const std::vector<Token> &params,
+                                            const StatementPtr &body, const Token &marker,
+                                            std::optional<size_t> declared_in) {
+    functions_.push_back(
+        FunctionState{std::make_unique<Prototype>(std::string{name}, params.size()), {}, {}, {}, 0, declared_in});
+    current().locals.push_back(Local{"", 0, false});
+
+    // the parameters make up the scope enclosing the body
+    begin_scope();
+    for (const auto &param : params) {
+        declare_local(param);
+    }
+    compile(body);
+
+    emit(OpCode::NIL, marker_);
+    emit(OpCode::ANKH_RETURN, marker_);
+
+    FunctionState fn = std::move(current());
+    functions_.pop_back();
+
+    fn.prototype->upvalue_count = fn.upvalues.size();
+
+    const size_t index = chunk().add_prototype(std::move(fn.prototype));
+    emit_u32(OpCode::CLOSURE, static_cast<std::uint32_t>(index), marker);
+    for (const auto &upvalue : fn.upvalues) {
+        chunk().write(upvalue.is_local ? 1 : 0, marker);
+        chunk().write_u16(upvalue.index, marker);
+    }
+}
+
+void ankh::lang::Compiler::compile_interpolation(const StringExpression *expr) {
+    // Errors in the string are only reported if it is evaluated, just like the interpreter does
+    if (expr->error.has_value()) {
+        emit_u32(OpCode::PANIC, make_constant(expr->error.value(), expr->str), expr->str);
+        return;
+    }
+
+    if (expr->substitutions.empty()) {
+        emit_constant(expr->literals.front(), expr->str);
+        return;
+    }
+
+    std::uint32_t parts = 0;
+    const auto emit_literal = [&](const std::string &literal) {
+        if (!literal.empty()) {
+            emit_constant(literal, expr->str);
+            ++parts;
+        }
+    };
+
+    emit_literal(expr->literals.front());
+    for (size_t i = 0; i < expr->substitutions.size(); ++i) {
+        compile(expr->substitutions[i]);
+        ++parts;
+
+        emit_literal(expr->literals[i + 1]);
+    }
+
+    // even a lone substitution has to be turned into a string
+    emit_u32(OpCode::INTERPOLATE, parts, expr->str);
+}
+
+ankh::lang::Compiler::FunctionState &ankh::lang::Compiler::current() noexcept { return functions_.back(); }
+
+ankh::lang::Chunk &ankh::lang::Compiler::chunk() noexcept { return current().prototype->chunk; }
+
+bool ankh::lang::Compiler::is_global_scope() const noexcept {
+    return functions_.size() == 1 && functions_.back().depth == 0;
+}
+
+void ankh::lang::Compiler::begin_scope() noexcept { ++current().depth; }
+
+void ankh::lang::Compiler::end_scope(const Token &marker) {
+    --current().depth;
+
+    discard_locals(current().depth, marker);
+
+    auto &locals = current().locals;
+    while (!locals.empty() && locals.back().depth > current().depth) {
+        locals.pop_back();
+    }
+}
+
+void ankh::lang::Compiler::discard_locals(size_t depth, const Token &marker) {
+    const auto &locals = current().locals;
+    for (size_t i = locals.size(); i > 0 && locals[i - 1].depth > depth; --i) {
+        emit(locals[i - 1].captured ? OpCode::CLOSE_UPVALUE : OpCode::POP, marker);
+    }
+}
+
+void ankh::lang::Compiler::reserve_locals(const std::vector<StatementPtr> &statements) {
+    const auto declares_function = [](const StatementPtr &stmt) {
+        return dynamic_cast<FunctionDeclaration *>(stmt.get()) != nullptr;
+    };
+    // only functions can refer to the variables declared after them
+    if (std::none_of(statements.begin(), statements.end(), declares_function)) {
+        return;
+    }
+
+    for (const auto &stmt : statements) {
+        const Token *name = nullptr;
+        if (const auto *var = dynamic_cast<VariableDeclaration *>(stmt.get()); var != nullptr) {
+            name = &var->name;
+        } else if (const auto *function = dynamic_cast<FunctionDeclaration *>(stmt.get()); function != nullptr) {
+            name = &function->name;
+        }
+
+        if (name != nullptr) {
+            emit(OpCode::NIL, *name);
+            declare_local(*name);
+            // functions are declared throughout their scope, the static analyzer hoists them as well
+            current().locals.back().declared = dynamic_cast<FunctionDeclaration *>(stmt.get()) != nullptr;
+        }
+    }
+}
+
+void ankh::lang::Compiler::declare_local(const Token &name) {
+    if (current().locals.size() > std::numeric_limits<std::uint16_t>::max()) {
+        panic<InterpretationException>(name, "compile error: too many local variables in function");
+    }
+
+    current().locals.push_back(Local{name.str, current().depth, false});
+}
+
+std::optional<std::uint16_t> ankh::lang::Compiler::declare_reserved(const Token &name) noexcept {
+    auto &locals = current().locals;
+    for (size_t i = locals.size(); i > 0 && locals[i - 1].depth == current().depth; --i) {
+        if (locals[i - 1].name == name.str) {
+            locals[i - 1].declared = true;
+            return static_cast<std::uint16_t>(i - 1);
+        }
+    }
+
+    return std::nullopt;
+}
+
+std::optional<std::uint16_t> ankh::lang::Compiler::resolve_local(FunctionState &fn, std::string_view name,
+                                                                 std::optional<size_t> reserved_from) const noexcept {
+    // the callee's slot is unnamed so it never matches
+    for (size_t i = fn.locals.size(); i > 1; --i) {
+        const Local &local = fn.locals[i - 1];
+        const bool visible = local.declared || (reserved_from.has_value() && local.depth >= reserved_from.value());
+        if (visible && local.name == name) {
+            return static_cast<std::uint16_t>(i - 1);
+        }
+    }
+
+    return std::nullopt;
+}
+
+std::optional<std::uint16_t> ankh::lang::Compiler::resolve_upvalue(size_t fn, std::string_view name) {
+    if (fn == 0) {
+        return std::nullopt;
+    }
+
+    FunctionState &enclosing = functions_[fn - 1];
+    if (const auto local = resolve_local(enclosing, name, functions_[fn].declared_in); local.has_value()) {
+        enclosing.locals[local.value()].captured = true;
+        return add_upvalue(functions_[fn], local.value(), true, marker_);
+    }
+
+    if (const auto upvalue = resolve_upvalue(fn - 1, name); upvalue.has_value()) {
+        return add_upvalue(functions_[fn], upvalue.value(), false, marker_);
+    }
+
+    return std::nullopt;
+}
+
+std::uint16_t ankh::lang::Compiler::add_upvalue(FunctionState &fn, std::uint16_t index, bool is_local,
+                                                const Token &marker) {
+    for (size_t i = 0; i < fn.upvalues.size(); ++i) {
+        if (fn.upvalues[i].index == index && fn.upvalues[i].is_local == is_local) {
+            return static_cast<std::uint16_t>(i);
+        }
+    }
+
+    if (fn.upvalues.size() >= std::numeric_limits<std::uint16_t>::max()) {
+        panic<InterpretationException>(marker, "compile error: too many captured variables in function");
+    }
+
+    fn.upvalues.push_back(Upvalue{index, is_local});
+
+    return static_cast<std::uint16_t>(fn.upvalues.size() - 1);
+}
+
+void ankh::lang::Compiler::emit_get(const Token &name) {
+    if (const auto local = resolve_local(current(), name.str); local.has_value()) {
+        emit_u16(OpCode::GET_LOCAL, local.value(), name);
+    } else if (const auto upvalue = resolve_upvalue(functions_.size() - 1, name.str); upvalue.has_value()) {
+        emit_u16(OpCode::GET_UPVALUE, upvalue.value(), name);
+    } else {
+        emit_u32(OpCode::GET_GLOBAL, static_cast<std::uint32_t>(globals_.resolve(name.str)), name);
+    }
+}
+
+void ankh::lang::Compiler::emit_set(const Token &name) {
+    if (const auto local = resolve_local(current(), name.str); local.has_value()) {
+        emit_u16(OpCode::SET_LOCAL, local.value(), name);
+    } else if (const auto upvalue = resolve_upvalue(functions_.size() - 1, name.str); upvalue.has_value()) {
+        emit_u16(OpCode::SET_UPVALUE, upvalue.value(), name);
+    } else {
+        emit_u32(OpCode::SET_GLOBAL, static_cast<std::uint32_t>(globals_.resolve(name.str)), name);
+    }
+}
+
+void ankh::lang::Compiler::emit(OpCode op, const Token &marker) {
+    marker_ = marker;
+
+    chunk().write(static_cast<std::uint8_t>(op), marker);
+}
+
+void ankh::lang::Compiler::emit_u16(OpCode op, std::uint16_t operand, const Token &marker) {
+    emit(op, marker);
+    chunk().write_u16(operand, marker);
+}
+
+void ankh::lang::Compiler::emit_u32(OpCode op, std::uint32_t operand, const Token &marker) {
+    emit(op, marker);
+    chunk().write_u32(operand, marker);
+}
+
+void ankh::lang::Compiler::emit_constant(ExprResult constant, const Token &marker) {
+    emit_u32(OpCode::CONSTANT, make_constant(std::move(constant), marker), marker);
+}
+
+size_t ankh::lang::Compiler::emit_jump(OpCode op, const Token &marker) {
+    emit_u32(op, 0, marker);
+
+    return chunk().size() - 4;
+}
+
+void ankh::lang::Compiler::patch_jump(size_t offset) {
+    const size_t distance = chunk().size() - (offset + 4);
+    if (distance > std::numeric_limits<std::uint32_t>::max()) {
+        panic<InterpretationException>(marker_, "compile error: too much code to jump over");
+    }
+
+    chunk().patch_u32(offset, static_cast<std::uint32_t>(distance));
+}
+
+void ankh::lang::Compiler::emit_loop(size_t start, const Token &marker) {
+    emit(OpCode::LOOP, marker);
+
+    const size_t distance = chunk().size() + 4 - start;
+    if (distance > std::numeric_limits<std::uint32_t>::max()) {
+        panic<InterpretationException>(marker, "compile error: loop body is too large");
+    }
+
+    chunk().write_u32(static_cast<std::uint32_t>(distance), marker);
+}
+
+std::uint32_t ankh::lang::Compiler::make_constant(ExprResult constant, const Token &marker) {
+    const size_t index = chunk().add_constant(std::move(constant));
+    if (index > std::numeric_limits<std::uint32_t>::max()) {
+        panic<InterpretationException>(marker, "compile error: too many constants in function");
+    }
+
+    return static_cast<std::uint32_t>(index);
+}
@@ -10,7 +10,8 @@ static std::string stringify(const ankh::lang::Array<ankh::lang::ExprResult> &ar
         return "[]";
     }
 
-    std::string result = "[" + array[0].stringify();
+    std::string result = "[";
+    result += array[0].stringify();
     for (size_t i = 1; i < array.size(); ++i) {
         result += ", ";
         result += array[i].stringify();
@@ -46,7 +47,7 @@ std::string ankh::lang::ExprResult::stringify() const noexcept {
     case ankh::lang::ExprResultType::RT_BOOL:
         return b ? "true" : "false";
     case ankh::lang::ExprResultType::RT_CALLABLE:
-        return callable->name();
+        return std::string{callable->name()};
     case ankh::lang::ExprResultType::RT_ARRAY:
         return ::stringify(array);
     case ankh::lang::ExprResultType::RT_DICT:
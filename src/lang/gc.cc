@@ -0,0 +1,102 @@
+#include <cstddef>
+#include <new>
+#include <vector>
+
+#include <ankh/log.hpp>
+
+#include <ankh/lang/types/gc.hpp>
+
+ankh::lang::Heap::~Heap() noexcept {
+    // the owner is gone by now, so whatever is still in use is referred to from outside the heap
+    roots_ = nullptr;
+    try {
+        collect();
+    } catch (const std::bad_alloc &) {
+        ANKH_DEBUG("the garbage of the heap is left behind");
+    }
+
+    for (Collectable *object = head_; object != nullptr;) {
+        Collectable *next = object->next_;
+        object->heap_ = nullptr;
+        object->prev_ = nullptr;
+        object->next_ = nullptr;
+        object = next;
+    }
+}
+
+size_t ankh::lang::Heap::collect() {
+    ANKH_DEBUG("collecting a heap of {} objects", size_);
+
+    // to begin with, every reference to an object is assumed to come from outside the heap
+    for (Collectable *object = head_; object != nullptr; object = object->next_) {
+        object->external_ = object->refs;
+        object->reachable_ = false;
+    }
+
+    struct InternalReferences : public Tracer {
+        const Heap *heap;
+
+        explicit InternalReferences(const Heap *heap) noexcept : heap(heap) {}
+
+        virtual void visit(Collectable *object) override {
+            if (object->heap_ == heap) {
+                --object->external_;
+            }
+        }
+    } internal(this);
+
+    for (Collectable *object = head_; object != nullptr; object = object->next_) {
+        object->trace(internal);
+    }
+
+    struct Reachable : public Tracer {
+        const Heap *heap;
+        std::vector<Collectable *> pending;
+
+        explicit Reachable(const Heap *heap) noexcept : heap(heap) {}
+
+        virtual void visit(Collectable *object) override {
+            if (object->heap_ == heap && !object->reachable_) {
+                object->reachable_ = true;
+                pending.push_back(object);
+            }
+        }
+    } reachable(this);
+
+    if (roots_ != nullptr) {
+        roots_->trace(reachable);
+    }
+
+    for (Collectable *object = head_; object != nullptr; object = object->next_) {
+        if (object->external_ > 0) {
+            reachable.visit(object);
+        }
+    }
+
+    while (!reachable.pending.empty()) {
+        Collectable *object = reachable.pending.back();
+        reachable.pending.pop_back();
+        object->trace(reachable);
+    }
+
+    // the garbage is kept alive until all of it is cleared so none of it is freed while it's still being cleared
+    std::vector<Collectable *> garbage;
+    for (Collectable *object = head_; object != nullptr; object = object->next_) {
+        if (!object->reachable_) {
+            retain(object);
+            garbage.push_back(object);
+        }
+    }
+
+    for (Collectable *object : garbage) {
+        object->clear();
+    }
+
+    for (Collectable *object : garbage) {
+        release(object);
+    }
+
+    ANKH_DEBUG("collected {} objects, {} left", garbage.size(), size_);
+
+    return garbage.size();
+}
@@ -1,18 +1,16 @@
 #include <algorithm>
-#include <ankh/lang/expr_result.hpp>
-#include <ankh/sys/linux.hpp>
-#include <cerrno>
+#include <array>
 #include <cstddef>
-#include <cstdint>
-#include <cstdio>
-#include <cstdlib>
-#include <cstring>
 #include <functional>
-#include <initializer_list>
+#include <iterator>
+#include <memory>
 #include <numeric>
-#include <stdexcept>
+#include <optional>
+#include <span>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include <format>
@@ -20,202 +18,61 @@
 #include <ankh/def.hpp>
 #include <ankh/log.hpp>
 
-#include <ankh/sys/sys.hpp>
-
 #include <ankh/lang/interpreter.hpp>
 #include <ankh/lang/parser.hpp>
 
 #include <ankh/lang/exceptions.hpp>
 #include <ankh/lang/expr.hpp>
+#include <ankh/lang/expr_result.hpp>
+#include <ankh/lang/operators.hpp>
 #include <ankh/lang/token.hpp>
 
 #include <ankh/lang/builtins.hpp>
 #include <ankh/lang/types/array.hpp>
 #include <ankh/lang/types/dictionary.hpp>
-#include <cmath>
-
-#define ANKH_DEFINE_BUILTIN(name, arity, type)                                                                         \
-    do {                                                                                                               \
-        functions_[(name)] = make_callable<type<ExprResult, Interpreter>>(this, global_, (name), (arity));             \
-        ANKH_VERIFY(global_->declare((name), functions_[(name)].get()));                                               \
-    } while (0)
-
-struct ReturnException : public std::runtime_error {
-    explicit ReturnException(ankh::lang::ExprResult result) : std::runtime_error(""), result(std::move(result)) {}
-
-    ankh::lang::ExprResult result;
-};
-
-struct BreakException : public std::runtime_error {
-    BreakException() : std::runtime_error("") {}
-};
-
-static bool operands_are(ankh::lang::ExprResultType type,
-                         std::initializer_list<ankh::lang::ExprResult> elems) noexcept {
-    return std::all_of(elems.begin(), elems.end(),
-                       [=](const ankh::lang::ExprResult &result) { return type == result.type; });
-}
-
-static ankh::lang::Number to_num(const ankh::lang::LiteralExpression *expr) {
-    char *end;
-
-    ankh::lang::Number n = std::strtod(expr->literal.str.c_str(), &end);
-    if (*end == '\0') {
-        return n;
-    }
-
-    const std::string errno_msg(std::strerror(errno));
-
-    ankh::lang::panic<ankh::lang::InterpretationException>(
-        expr->literal, "runtime error: '{}' could not be turned into a number because '{}'", expr->stringify(),
-        errno_msg);
-}
-
-static bool is_integer(ankh::lang::Number n) noexcept {
-    double intpart;
-    return std::modf(n, &intpart) == 0.0;
-}
-
-static ankh::lang::ExprResult negate(const ankh::lang::Token &marker, const ankh::lang::ExprResult &result) {
-    if (result.type == ankh::lang::ExprResultType::RT_NUMBER) {
-        return -1 * result.n;
-    }
-
-    ankh::lang::panic<ankh::lang::InterpretationException>(
-        marker, "runtime error: unary operator(-) expects a number, not a {}",
-        ankh::lang::expr_result_type_str(result.type));
-}
-
-static ankh::lang::ExprResult invert(const ankh::lang::Token &marker, const ankh::lang::ExprResult &result) {
-    if (result.type == ankh::lang::ExprResultType::RT_BOOL) {
-        return !(result.b);
-    }
-
-    ankh::lang::panic<ankh::lang::InterpretationException>(
-        marker, "runtime error: operator(!) expects a boolean expression, not a {}",
-        ankh::lang::expr_result_type_str(result.type));
-}
-
-static ankh::lang::ExprResult eqeq(const ankh::lang::Token &marker, const ankh::lang::ExprResult &left,
-                                   const ankh::lang::ExprResult &right) {
-    if (operands_are(ankh::lang::ExprResultType::RT_NUMBER, {left, right})) {
-        return left.n == right.n;
-    }
-
-    if (operands_are(ankh::lang::ExprResultType::RT_STRING, {left, right})) {
-        return left.str == right.str;
-    }
-
-    if (operands_are(ankh::lang::ExprResultType::RT_BOOL, {left, right})) {
-        return left.b == right.b;
-    }
-
-    if (operands_are(ankh::lang::ExprResultType::RT_NIL, {left, right})) {
-        return true;
-    }
-
-    ankh::lang::panic<ankh::lang::InterpretationException>(
-        marker, "runtime error: unknown overload of operator(==) with LHS as {} and RHS as {}",
-        ankh::lang::expr_result_type_str(left.type), ankh::lang::expr_result_type_str(right.type));
-}
 
-template <class BinaryOperation>
-static ankh::lang::ExprResult arithmetic(const ankh::lang::Token &marker, const ankh::lang::ExprResult &left,
-                                         const ankh::lang::ExprResult &right, BinaryOperation op) {
-    if (operands_are(ankh::lang::ExprResultType::RT_NUMBER, {left, right})) {
-        return op(left.n, right.n);
-    }
-
-    ankh::lang::panic<ankh::lang::InterpretationException>(
-        marker, "runtime error: unknown overload of operator({}) with LHS as {} and RHS as {}", marker.str,
-        ankh::lang::expr_result_type_str(left.type), ankh::lang::expr_result_type_str(right.type));
+ankh::lang::Interpreter::Interpreter() : heap_(this), current_env_(make_env<ExprResult>()), global_(current_env_) {
+    load(builtins::natives());
 }
 
-static ankh::lang::ExprResult division(const ankh::lang::Token &marker, const ankh::lang::ExprResult &left,
-                                       const ankh::lang::ExprResult &right) {
-    if (operands_are(ankh::lang::ExprResultType::RT_NUMBER, {left, right})) {
-        if (right.n == 0) {
-            ankh::lang::panic<ankh::lang::InterpretationException>(marker, "runtime error: division by zero");
+void ankh::lang::Interpreter::load(const Natives &natives) {
+    const HeapScope heap(heap_);
+    for (const NativeDefinition &native : natives.definitions()) {
+        CallablePtr callable =
+            make_callable<BuiltIn<ExprResult, Interpreter>>(this, native.name, native.arity, native.fn);
+        if (functions_.count(native.name) > 0 || !global_->declare(native.name, callable.get())) {
+            throw InterpretationException(std::format("'{}' is already defined", native.name));
         }
-        return left.n / right.n;
-    }
-
-    ankh::lang::panic<ankh::lang::InterpretationException>(
-        marker, "runtime error: unknown overload of operator({}) with LHS as {} and RHS as {}", marker.str,
-        ankh::lang::expr_result_type_str(left.type), ankh::lang::expr_result_type_str(right.type));
-}
-
-// We handle + separately as it has two overloads for numbers and strings
-// The generic arithmetic() function overloads all of the general arithmetic operations
-// on only numbers
-static ankh::lang::ExprResult plus(const ankh::lang::Token &marker, const ankh::lang::ExprResult &left,
-                                   const ankh::lang::ExprResult &right) {
-    if (operands_are(ankh::lang::ExprResultType::RT_NUMBER, {left, right})) {
-        return left.n + right.n;
-    }
 
-    if (operands_are(ankh::lang::ExprResultType::RT_STRING, {left, right})) {
-        return left.str + right.str;
+        functions_[native.name] = callable;
+        natives_.push_back(std::move(callable));
     }
-
-    ankh::lang::panic<ankh::lang::InterpretationException>(
-        marker, "runtime error: unknown overload of operator(+) with LHS as {} and RHS as {}",
-        ankh::lang::expr_result_type_str(left.type), ankh::lang::expr_result_type_str(right.type));
 }
 
-template <class Compare>
-static ankh::lang::ExprResult compare(const ankh::lang::Token &marker, const ankh::lang::ExprResult &left,
-                                      const ankh::lang::ExprResult &right, Compare cmp) {
-    if (operands_are(ankh::lang::ExprResultType::RT_NUMBER, {left, right})) {
-        return cmp(left.n, right.n);
-    }
-
-    if (operands_are(ankh::lang::ExprResultType::RT_STRING, {left, right})) {
-        return cmp(left.str, right.str);
-    }
+ankh::lang::Interpreter::~Interpreter() noexcept = default;
 
-    ankh::lang::panic<ankh::lang::InterpretationException>(
-        marker, "runtime error: unknown overload of operator({}) with LHS as {} and RHS as {}", marker.str,
-        ankh::lang::expr_result_type_str(left.type), ankh::lang::expr_result_type_str(right.type));
+void ankh::lang::Interpreter::interpret(Program &&program) {
+    run(std::make_shared<const Program>(std::move(program)));
 }
 
-template <class Compare>
-static ankh::lang::ExprResult logical(const ankh::lang::Token &marker, const ankh::lang::ExprResult &left,
-                                      const ankh::lang::ExprResult &right, Compare cmp) {
-    if (operands_are(ankh::lang::ExprResultType::RT_BOOL, {left, right})) {
-        return cmp(left.b, right.b);
+void ankh::lang::Interpreter::run(const PreparedProgram &program) {
+    if (program->has_errors()) {
+        throw InterpretationException(program->errors.front());
     }
 
-    ankh::lang::panic<ankh::lang::InterpretationException>(
-        marker, "runtime error: unknown overload of operator({}) with LHS as {} and RHS as {}", marker.str,
-        ankh::lang::expr_result_type_str(left.type), ankh::lang::expr_result_type_str(right.type));
-}
-
-static bool truthy(const ankh::lang::Token &marker, const ankh::lang::ExprResult &result) noexcept {
-    if (result.type == ankh::lang::ExprResultType::RT_BOOL) {
-        return result.b;
+    // a program run over and over is only held on to once, and so are the caches of its call sites
+    auto it = std::find_if(programs_.begin(), programs_.end(),
+                           [&program](const RunProgram &run) { return run.program == program; });
+    if (it == programs_.end()) {
+        programs_.push_back(RunProgram{program, std::vector<CallSite>(program->call_sites)});
+        it = std::prev(programs_.end());
     }
 
-    ankh::lang::panic<ankh::lang::InterpretationException>(marker, "runtime error: '{}' is not a boolean expression",
-                                                           result.stringify());
-}
-
-ankh::lang::Interpreter::Interpreter() : current_env_(make_env<ExprResult>()), global_(current_env_) {
-    ANKH_DEFINE_BUILTIN("print", 1, PrintFn);
-    ANKH_DEFINE_BUILTIN("exit", 1, ExitFn);
-    ANKH_DEFINE_BUILTIN("len", 1, LengthFn);
-    ANKH_DEFINE_BUILTIN("int", 1, IntFn);
-    ANKH_DEFINE_BUILTIN("append", 2, AppendFn);
-    ANKH_DEFINE_BUILTIN("str", 1, StrFn);
-    ANKH_DEFINE_BUILTIN("keys", 1, KeysFn);
-    ANKH_DEFINE_BUILTIN("export", 2, ExportFn);
-}
-
-void ankh::lang::Interpreter::interpret(Program &&program) {
-    programs_.push_back(std::forward<Program>(program));
+    const CallSiteScope<Interpreter> call_sites(this, it->sites.data());
+    const HeapScope heap(heap_);
+    completion_ = Completion::NORMAL;
 
-    const auto &statements = programs_.back().statements;
-    for (const auto &stmt : statements) {
+    for (const auto &stmt : program->statements) {
 #ifndef NDEBUG
         ANKH_DEBUG("{}", stmt->stringify());
 #endif
@@ -223,174 +80,76 @@ void ankh::lang::Interpreter::interpret(Program &&program) {
     }
 }
 
-///////////////////////////////////////////////////////////////////////////////
-/////////////////////////////// BUILTINS //////////////////////////////////////
-///////////////////////////////////////////////////////////////////////////////
-
-void ankh::lang::Interpreter::print(const std::vector<ExprResult> &args) const {
-    const std::string stringy = args[0].stringify();
-    std::puts(stringy.c_str());
-}
-
-void ankh::lang::Interpreter::exit(const std::vector<ExprResult> &args) const {
-    const ExprResult &result = args[0];
-
-    if (result.type != ExprResultType::RT_NUMBER) {
-        builtin_panic<InterpretationException>("exit", "{} is not a viable argument type",
-                                               expr_result_type_str(result.type));
-    }
-
-    if (!is_integer(result.n)) {
-        builtin_panic<InterpretationException>("exit", "'{}' is not an integer", result.n);
-    }
-
-    std::exit(result.n);
-}
-
-void ankh::lang::Interpreter::length(const std::vector<ExprResult> &args) const {
-    const ExprResult &result = args[0];
-    if (result.type == ExprResultType::RT_ARRAY) {
-        throw ReturnException(static_cast<Number>(result.array.size()));
-    }
-    if (result.type == ExprResultType::RT_DICT) {
-        throw ReturnException(static_cast<Number>(result.dict.size()));
-    }
-    if (result.type == ExprResultType::RT_STRING) {
-        throw ReturnException(static_cast<Number>(result.str.size()));
-    }
-
-    builtin_panic<InterpretationException>("length", "{} is not a viable argument type",
-                                           expr_result_type_str(result.type));
-}
-
-void ankh::lang::Interpreter::cast_int(const std::vector<ExprResult> &args) const {
-    const ExprResult &result = args[0];
-    if (result.type == ExprResultType::RT_NUMBER) {
-        Number e = static_cast<std::int64_t>(result.n);
-        ANKH_DEBUG("cast_int(), from {} to {}", result.n, e);
-        throw ReturnException(e);
-    }
+void ankh::lang::Interpreter::reset() {
+    global_->reset(nullptr, nullptr, nullptr, nullptr);
+    functions_.clear();
+    completion_ = Completion::NORMAL;
+    return_value_ = {};
+    builtin_state_ = {};
 
-    if (result.type == ExprResultType::RT_BOOL) {
-        Number e = result.b ? 1 : 0;
-        throw ReturnException(e);
+    for (const CallablePtr &native : natives_) {
+        const std::string name{native->name()};
+        ANKH_VERIFY(global_->declare(name, native.get()));
+        functions_[name] = native;
     }
 
-    builtin_panic<InterpretationException>("int", "{} is not a viable argument type",
-                                           expr_result_type_str(result.type));
+    // functions and lambdas left in garbage cycles never look at their declarations again
+    programs_.clear();
+    sites_ = nullptr;
 }
 
-void ankh::lang::Interpreter::str(const std::vector<ExprResult> &args) const {
-    throw ReturnException(args[0].stringify());
+void ankh::lang::Interpreter::trace(Tracer &tracer) const {
+    trace_value(*global_, tracer);
+    trace_value(frames_, tracer);
+    trace_value(return_value_, tracer);
 }
 
-void ankh::lang::Interpreter::append(const std::vector<ExprResult> &args) const {
-    ExprResult container = args[0];
-    const ExprResult &value = args[1];
-
-    if (container.type == ExprResultType::RT_STRING) {
-        try {
-            str({value});
-        } catch (const ReturnException &e) {
-            container.str += e.result.str;
-        }
-
-        throw ReturnException(container);
+void ankh::lang::Interpreter::set_global(std::string_view name, const ExprResult &value) {
+    if (!global_->assign(name, value)) {
+        ANKH_VERIFY(global_->declare(name, value));
     }
-
-    if (container.type == ExprResultType::RT_ARRAY) {
-        container.array.append(value);
-        throw ReturnException(container);
-    }
-
-    builtin_panic<InterpretationException>("append", "{} is not a viable argument type",
-                                           expr_result_type_str(container.type));
 }
 
-void ankh::lang::Interpreter::keys(const std::vector<ExprResult> &args) const {
-    ExprResult container = args[0];
-    if (container.type == ExprResultType::RT_DICT) {
-        Array<ExprResult> arr;
-        for (const auto &x : container.dict) {
-            arr.append(x.key);
-        }
-        throw ReturnException(arr);
-    }
-
-    builtin_panic<InterpretationException>("keys", "{} is not a viable argument type",
-                                           expr_result_type_str(container.type));
+std::optional<ankh::lang::ExprResult> ankh::lang::Interpreter::global(std::string_view name) const noexcept {
+    return global_->value(name);
 }
 
-void ankh::lang::Interpreter::exportfn(const std::vector<ExprResult> &args) const {
-    const ExprResult name = args[0];
-    if (name.type != ExprResultType::RT_STRING) {
-        builtin_panic<InterpretationException>("export", "exported name must be a string, not a {}",
-                                               expr_result_type_str(name.type));
-    }
-
-    const std::string value = args[1].stringify();
-
-    const bool result = ankh::sys::setenv(name.str, value);
+ankh::lang::ExprResult ankh::lang::Interpreter::visit(BinaryExpression *expr) {
+    const ExprResult left = evaluate(expr->left);
+    const ExprResult right = evaluate(expr->right);
 
-    throw ReturnException(result);
+    return binary(expr->op, left, right);
 }
 
-///////////////////////////////////////////////////////////////////////////////
-/////////////////////////////// END BUILTINS //////////////////////////////////
-///////////////////////////////////////////////////////////////////////////////
-
-ankh::lang::ExprResult ankh::lang::Interpreter::visit(BinaryExpression *expr) {
+ankh::lang::ExprResult ankh::lang::Interpreter::visit(LogicalExpression *expr) {
     const ExprResult left = evaluate(expr->left);
-    const ExprResult right = evaluate(expr->right);
 
-    switch (expr->op.type) {
-    case TokenType::EQEQ:
-        return eqeq(expr->op, left, right);
-    case TokenType::NEQ:
-        return invert(expr->op, eqeq(expr->op, left, right));
-    case TokenType::GT:
-        return compare(expr->op, left, right, std::greater<>{});
-    case TokenType::GTE:
-        return compare(expr->op, left, right, std::greater_equal<>{});
-    case TokenType::LT:
-        return compare(expr->op, left, right, std::less<>{});
-    case TokenType::LTE:
-        return compare(expr->op, left, right, std::less_equal<>{});
-    case TokenType::MINUS:
-        return arithmetic(expr->op, left, right, std::minus<>{});
-    case TokenType::PLUS:
-        return plus(expr->op, left, right);
-    case TokenType::STAR:
-        return arithmetic(expr->op, left, right, std::multiplies<>{});
-    case TokenType::AND:
-        return logical(expr->op, left, right, std::logical_and<>{});
-    case TokenType::OR:
-        return logical(expr->op, left, right, std::logical_or<>{});
-    case TokenType::FSLASH:
-        return division(expr->op, left, right);
-    default:
-        panic<InterpretationException>(expr->op, "runtime error: unknown binary operator '{}'", expr->op.str);
+    // conditions are nearly always booleans so skip the checked path for them
+    if (left.type == ExprResultType::RT_BOOL) {
+        if (left.b == (expr->op.type == TokenType::OR)) {
+            return left;
+        }
+    } else if (short_circuits(expr->op, left)) {
+        return left;
     }
+
+    return logical(expr->op, evaluate(expr->right));
 }
 
 ankh::lang::ExprResult ankh::lang::Interpreter::visit(UnaryExpression *expr) {
-    const ExprResult result = evaluate(expr->right);
-    switch (expr->op.type) {
-    case TokenType::MINUS:
-        return negate(expr->op, result);
-    case TokenType::BANG:
-        return invert(expr->op, result);
-    default:
-        panic<InterpretationException>(expr->op, "runtime error: unknown unary operator '{}'", expr->op.str);
-    }
+    return unary(expr->op, evaluate(expr->right));
 }
 
 ankh::lang::ExprResult ankh::lang::Interpreter::visit(LiteralExpression *expr) {
+    if (expr->value.has_value()) {
+        return expr->value.value();
+    }
+
     switch (expr->literal.type) {
     case TokenType::NUMBER:
-        return to_num(expr);
+        return to_num(expr->literal);
     case TokenType::STRING:
-        return expr->literal.str;
+        return std::string{expr->literal.str};
     case TokenType::ANKH_TRUE:
         return true;
     case TokenType::ANKH_FALSE:
@@ -408,83 +167,92 @@ ankh::lang::ExprResult ankh::lang::Interpreter::visit(ParenExpression *expr) { r
 ankh::lang::ExprResult ankh::lang::Interpreter::visit(IdentifierExpression *expr) {
     ANKH_DEBUG("evaluating identifier expression '{}'", expr->name.str);
 
-    auto possible_value = current_env_->value(expr->name.str);
-    if (possible_value.has_value()) {
+    if (expr->slot.has_value()) {
+        return current_env_->value(expr->slot.value());
+    }
+
+    if (auto possible_value = global_->value(expr->name.str); possible_value.has_value()) {
         return possible_value.value();
     }
 
     panic<InterpretationException>(expr->name, "runtime error: identifier '{}' not defined", expr->name.str);
 }
 
+ankh::lang::ExprResult ankh::lang::Interpreter::callee_of(CallExpression *expr) {
+    // code evaluated outside of a run has no call sites to cache its calls in
+    if (sites_ == nullptr) {
+        return evaluate(expr->callee);
+    }
+
+    CallSite &site = sites_[expr->site];
+    if (site.callee == CallSite::Callee::GLOBAL && site.generation == global_->generation()) {
+        // copied so the callee stays alive during the call even if the global is reassigned
+        return *site.binding;
+    }
+
+    if (site.callee == CallSite::Callee::UNKNOWN) {
+        const auto *identifier = dynamic_cast<const IdentifierExpression *>(expr->callee.get());
+        site.callee = identifier != nullptr && !identifier->slot.has_value() ? CallSite::Callee::GLOBAL
+                                                                              : CallSite::Callee::OTHER;
+    }
+
+    // a miss evaluates the callee the usual way, which also reports a global that isn't declared (yet)
+    ExprResult callee = evaluate(expr->callee);
+    if (site.callee == CallSite::Callee::GLOBAL) {
+        const auto *identifier = static_cast<const IdentifierExpression *>(expr->callee.get());
+        if (const ExprResult *binding = global_->binding(identifier->name.str); binding != nullptr) {
+            site.generation = global_->generation();
+            site.binding = binding;
+        }
+    }
+
+    return callee;
+}
+
 ankh::lang::ExprResult ankh::lang::Interpreter::visit(CallExpression *expr) {
     ANKH_DEBUG("evaluating call expression");
 
-    const ExprResult callee = evaluate(expr->callee);
+    const ExprResult callee = callee_of(expr);
     if (callee.type != ExprResultType::RT_CALLABLE) {
         panic<InterpretationException>(expr->marker, "runtime error: only functions and classes are callable");
     }
 
     Callable *callable = callee.callable;
-    const std::string name = callable->name();
-
     if (expr->args.size() != callable->arity()) {
         panic<InterpretationException>(expr->marker,
                                        "runtime error: expected {} arguments to function '{}' instead of {}",
-                                       callable->arity(), name, expr->args.size());
+                                       callable->arity(), callable->name(), expr->args.size());
     }
 
-    ANKH_DEBUG("function '{}' with matching arity '{}' found", name, expr->args.size());
+    ANKH_DEBUG("function '{}' with matching arity '{}' found", callable->name(), expr->args.size());
 
-    try {
-        callable->invoke(expr->args);
-        return {};
-    } catch (const ReturnException &e) {
-        return e.result;
+    if (profiler_ == nullptr) {
+        return callable->invoke(expr->args);
     }
 
-    ANKH_FATAL("callables should always return");
+    profiler_->enter(callable, expr->marker);
+    struct ProfiledCall {
+        Profiler *profiler;
+        ~ProfiledCall() noexcept { profiler->leave(); }
+    } call{profiler_};
+
+    return callable->invoke(expr->args);
 }
 
 ankh::lang::ExprResult ankh::lang::Interpreter::visit(LambdaExpression *expr) {
-    const std::string &name = expr->generated_name;
-    if (functions_.count(name) > 0) {
-        ANKH_FATAL("lambda function generated name '{}' is duplicated", name);
-    }
-
-    CallablePtr callable = make_callable<Lambda<ExprResult, Interpreter>>(this, expr, current_env_);
-
-    ExprResult result{callable.get()};
-
-    functions_[name] = std::move(callable);
-
-    if (!current_env_->declare(name, result)) {
-        panic<InterpretationException>(expr->marker, "runtime error: '{}' is already defined", name);
-    }
+    // the lambda is anonymous so it lives only as long as the values referring to it
+    CallablePtr callable =
+        make_callable<Lambda<ExprResult, Interpreter>>(this, expr, current_env_->capture(expr->upvalues), sites_);
 
-    ANKH_DEBUG("function '{}' added to scope {}", name, current_env_->scope());
+    ANKH_DEBUG("lambda '{}' created in scope {}", expr->generated_name, current_env_->scope());
 
-    return result;
+    return {callable.get()};
 }
 
 ankh::lang::ExprResult ankh::lang::Interpreter::visit(ankh::lang::CommandExpression *expr) {
     ANKH_DEBUG("executing {}", expr->cmd.str);
 
-    // TODO: popen() uses the underlying shell to invoke commands
-    // This limits the language from being used as a shell itself
-    // Come back and explore if that's something we want to consider doing
-    std::FILE *fp = popen(expr->cmd.str.c_str(), "r");
-    if (fp == nullptr) {
-        ANKH_FATAL("popen: unable to launch {}", expr->cmd.str);
-    }
-
-    char buf[512];
-    std::string output;
-    while (std::fread(buf, sizeof(buf[0]), sizeof(buf), fp) > 0) {
-        output += buf;
-    }
-    pclose(fp);
-
-    return output;
+    return builtins::run_command(std::string{expr->cmd.str}, builtin_state_);
 }
 
 ankh::lang::ExprResult ankh::lang::Interpreter::visit(ArrayExpression *expr) {
@@ -503,98 +271,26 @@ ankh::lang::ExprResult ankh::lang::Interpreter::visit(ankh::lang::IndexExpressio
         panic<InterpretationException>(expr->marker, "runtime error: lookup expects string, array, or dict operand");
     }
 
-    const ExprResult index = evaluate(expr->index);
-    if (index.type == ExprResultType::RT_NUMBER) {
-        if (!is_integer(index.n)) {
-            panic<InterpretationException>(expr->marker, "runtime error: index must be an integral numeric expression");
-        }
-
-        if (indexee.type == ExprResultType::RT_ARRAY) {
-            if (index.n >= indexee.array.size()) {
-                panic<InterpretationException>(expr->marker, "runtime error: index {} must be less than array size {}",
-                                               index.n, indexee.array.size());
-            }
-
-            return indexee.array[index.n];
-        }
-
-        if (indexee.type == ExprResultType::RT_STRING) {
-            if (index.n >= indexee.str.size()) {
-                panic<InterpretationException>(expr->marker,
-                                               "runtime error: index {} must be less than string length {}", index.n,
-                                               indexee.str.size());
-            }
-
-            return std::string{indexee.str[index.n]};
-        }
-
-        panic<InterpretationException>(expr->marker,
-                                       "runtime error: operand must be an array or string for a numeric index");
-    }
-
-    if (index.type == ExprResultType::RT_STRING) {
-        if (indexee.type != ExprResultType::RT_DICT) {
-            panic<InterpretationException>(expr->marker, "runtime error: operand must be a dict for a string index");
-        }
-
-        if (auto possible_value = indexee.dict.value(index.str); possible_value.has_value()) {
-            return possible_value->value;
-        }
-
-        return {};
-    }
-
-    panic<InterpretationException>(expr->marker, "runtime error: '{}' is not a valid lookup expression",
-                                   index.stringify());
+    return index(expr->marker, indexee, evaluate(expr->index));
 }
 
 ankh::lang::ExprResult ankh::lang::Interpreter::visit(SliceExpression *expr) {
-    ExprResult indexee = evaluate(expr->indexee);
+    const ExprResult indexee = evaluate(expr->indexee);
     if (indexee.type != ExprResultType::RT_ARRAY && indexee.type != ExprResultType::RT_STRING) {
         panic<InterpretationException>(expr->marker,
                                        "runtime error: slices are only available on arrays and arrays, not {}",
                                        expr_result_type_str(indexee.type));
     }
 
-    auto assert_is_positive_integer = [&](const ExpressionPtr &e) -> ExprResult {
-        ExprResult result = evaluate(e);
-        if (result.type != ExprResultType::RT_NUMBER || !is_integer(result.n)) {
-            panic<InterpretationException>(expr->marker, "runtime error: slice indexes can only be integers, not {}",
-                                           expr_result_type_str(result.type));
-        }
-        if (result.n < 0) {
-            panic<InterpretationException>(expr->marker, "runtime error: slice indexes can only be positive, not {}",
-                                           expr_result_type_str(result.type));
-        }
-
-        return result;
-    };
-
-    const size_t begin_index = expr->begin ? assert_is_positive_integer(expr->begin).n : 0;
-
-    const size_t sentinel = indexee.type == ExprResultType::RT_ARRAY ? indexee.array.size() : indexee.str.size();
-
-    const size_t end_index = expr->end ? assert_is_positive_integer(expr->end).n : sentinel;
-
-    if (end_index > sentinel) {
-        panic<InterpretationException>(expr->marker, "runtime error: slice index {} out of range", end_index);
-    }
-
-    if (indexee.type == ExprResultType::RT_ARRAY) {
-        Array<ExprResult> result;
-        for (size_t i = begin_index; i < end_index; ++i) {
-            result.append(indexee.array[i]);
-        }
-
-        return result;
+    std::optional<ExprResult> begin, end;
+    if (expr->begin) {
+        begin = evaluate(expr->begin);
     }
-
-    std::string result;
-    for (size_t i = begin_index; i < end_index; ++i) {
-        result += indexee.str[i];
+    if (expr->end) {
+        end = evaluate(expr->end);
     }
 
-    return result;
+    return slice(expr->marker, indexee, begin, end);
 }
 
 ankh::lang::ExprResult ankh::lang::Interpreter::visit(ankh::lang::DictionaryExpression *expr) {
@@ -602,8 +298,9 @@ ankh::lang::ExprResult ankh::lang::Interpreter::visit(ankh::lang::DictionaryExpr
     for (const auto &[key, value] : expr->entries) {
         const ExprResult &key_result = evaluate(key);
         if (key_result.type != ExprResultType::RT_STRING) {
-            panic<InterpretationException>(
-                expr->marker, "runtime error: expression key '{}' does not evaluate to a string", key->stringify());
+            panic<InterpretationException>(expr->marker,
+                                           "runtime error: expression key '{}' does not evaluate to a string",
+                                           key_result.stringify());
         }
         dict.insert(key_result, evaluate(value));
     }
@@ -615,11 +312,16 @@ ankh::lang::ExprResult ankh::lang::Interpreter::visit(ankh::lang::StringExpressi
 
 void ankh::lang::Interpreter::visit(ExpressionStatement *stmt) {
     ANKH_DEBUG("executing expression statement");
-    const ExprResult result = evaluate(stmt->expr);
-    print({result});
+    ExprResult result = evaluate(stmt->expr);
+    builtins::print({&result, 1});
 }
 
 void ankh::lang::Interpreter::visit(VariableDeclaration *stmt) {
+    if (stmt->slot.has_value()) {
+        current_env_->define(stmt->slot->index, evaluate(stmt->initializer));
+        return;
+    }
+
     if (current_env_->contains(stmt->name.str)) {
         panic<InterpretationException>(stmt->name, "runtime error: '{}' is already declared in this scope",
                                        stmt->name.str);
@@ -635,19 +337,63 @@ void ankh::lang::Interpreter::visit(VariableDeclaration *stmt) {
 }
 
 void ankh::lang::Interpreter::visit(AssignmentStatement *stmt) {
-    const ExprResult result = evaluate(stmt->initializer);
-    if (!current_env_->assign(stmt->name.str, result)) {
+    const ExprResult result = stmt->reassigns_argument ? reassign_argument(stmt) : evaluate(stmt->initializer);
+    assign(stmt, result);
+}
+
+void ankh::lang::Interpreter::assign(const AssignmentStatement *stmt, const ExprResult &result) {
+    if (stmt->slot.has_value()) {
+        current_env_->assign(stmt->slot.value(), result);
+    } else if (!global_->assign(stmt->name.str, result)) {
         panic<InterpretationException>(stmt->name, "runtime error: '{}' is not defined", stmt->name.str);
     }
 }
 
+ankh::lang::ExprResult ankh::lang::Interpreter::reassign_argument(AssignmentStatement *stmt) {
+    auto *call = static_cast<CallExpression *>(stmt->initializer.get());
+
+    const ExprResult callee = callee_of(call);
+    auto *builtin = callee.type == ExprResultType::RT_CALLABLE
+                        ? dynamic_cast<BuiltIn<ExprResult, Interpreter> *>(callee.callable)
+                        : nullptr;
+    // functions may refer to the variable while they run, and wrong calls are reported the usual way
+    if (builtin == nullptr || call->args.size() != builtin->arity()) {
+        return evaluate(stmt->initializer);
+    }
+
+    // the arguments are evaluated on the stack when they fit, as they are for any other call of a builtin
+    std::array<ExprResult, BuiltIn<ExprResult, Interpreter>::INLINE_ARGS> inline_args;
+    std::vector<ExprResult> spilled_args;
+    if (call->args.size() > inline_args.size()) {
+        spilled_args.resize(call->args.size());
+    }
+
+    const std::span<ExprResult> args = spilled_args.empty()
+                                           ? std::span<ExprResult>(inline_args.data(), call->args.size())
+                                           : std::span<ExprResult>(spilled_args);
+    for (size_t i = 0; i < call->args.size(); ++i) {
+        args[i] = evaluate(call->args[i]);
+    }
+
+    // a builtin can't refer to the variable, so the variable gives its value up for the builtin to hold the only
+    // reference and append to it in place. The value is put back if the builtin fails and the assignment never happens.
+    assign(stmt, {});
+    try {
+        return builtin->call(args);
+    } catch (...) {
+        assign(stmt, args.front());
+        throw;
+    }
+}
+
 void ankh::lang::Interpreter::visit(CompoundAssignment *stmt) {
-    auto possible_target = current_env_->value(stmt->target.str);
+    auto possible_target =
+        stmt->slot.has_value() ? current_env_->value(stmt->slot.value()) : global_->value(stmt->target.str);
     if (!possible_target) {
         panic<InterpretationException>(stmt->target, "runtime error: '{}' is not defined", stmt->target.str);
     }
 
-    ExprResult target = possible_target.value();
+    const ExprResult target = possible_target.value();
 
     ExprResult value;
     if (stmt->op.str == "+=") {
@@ -663,7 +409,9 @@ void ankh::lang::Interpreter::visit(CompoundAssignment *stmt) {
                                        stmt->op.str);
     }
 
-    if (!current_env_->assign(stmt->target.str, value)) {
+    if (stmt->slot.has_value()) {
+        current_env_->assign(stmt->slot.value(), value);
+    } else if (!global_->assign(stmt->target.str, value)) {
         panic<InterpretationException>(stmt->target,
                                        "runtime error: unable to assign the result of the compound assignment");
     }
@@ -684,18 +432,25 @@ void ankh::lang::Interpreter::visit(ankh::lang::IncOrDecIdentifierStatement *stm
     }
 
     IdentifierExpression *expr = static_cast<IdentifierExpression *>(stmt->expr.get());
-    if (!current_env_->assign(expr->name.str, value)) {
+    if (expr->slot.has_value()) {
+        current_env_->assign(expr->slot.value(), value);
+    } else if (!global_->assign(expr->name.str, value)) {
         ANKH_FATAL("{}:{}, unable to assign '{}'", expr->name.str);
     }
 }
 
 void ankh::lang::Interpreter::visit(BlockStatement *stmt) { execute_block(stmt, current_env_); }
 
-void ankh::lang::Interpreter::execute_block(const BlockStatement *stmt, EnvironmentPtr<ExprResult> environment) {
-    ScopeGuard block_scope(this, environment);
+ankh::lang::Completion ankh::lang::Interpreter::execute_block(const BlockStatement *stmt,
+                                                              EnvironmentPtr<ExprResult> environment) {
+    ScopeGuard block_scope(this, environment, &stmt->locals, &stmt->captures);
     for (const StatementPtr &statement : stmt->statements) {
-        execute(statement);
+        if (execute(statement) != Completion::NORMAL) {
+            break;
+        }
     }
+
+    return completion_;
 }
 
 void ankh::lang::Interpreter::visit(IfStatement *stmt) {
@@ -709,171 +464,119 @@ void ankh::lang::Interpreter::visit(IfStatement *stmt) {
 
 void ankh::lang::Interpreter::visit(WhileStatement *stmt) {
     while (truthy(stmt->marker, evaluate(stmt->condition))) {
-        try {
-            execute(stmt->body);
-        } catch (const BreakException &) {
-            return;
+        if (execute(stmt->body) != Completion::NORMAL) {
+            break;
         }
     }
+
+    // the loop consumes its breaks while returns propagate to the enclosing call
+    if (completion_ == Completion::BREAK) {
+        completion_ = Completion::NORMAL;
+    }
 }
 
 void ankh::lang::Interpreter::visit(ForStatement *stmt) {
-    ScopeGuard for_scope(this, current_env_);
+    ScopeGuard for_scope(this, current_env_, &stmt->locals, &stmt->captures);
 
     if (stmt->init) {
         execute(stmt->init);
     }
 
     while (stmt->condition ? truthy(stmt->marker, evaluate(stmt->condition)) : true) {
-        try {
-            execute(stmt->body);
-        } catch (const BreakException &) {
-            return;
+        if (execute(stmt->body) != Completion::NORMAL) {
+            break;
         }
 
         if (stmt->mutator) {
             execute(stmt->mutator);
         }
     }
+
+    if (completion_ == Completion::BREAK) {
+        completion_ = Completion::NORMAL;
+    }
 }
 
 void ankh::lang::Interpreter::visit(ankh::lang::BreakStatement *stmt) {
     ANKH_UNUSED(stmt);
 
-    throw BreakException();
+    completion_ = Completion::BREAK;
 }
 
 void ankh::lang::Interpreter::visit(ankh::lang::FunctionDeclaration *stmt) { declare_function(stmt, current_env_); }
 
-void ankh::lang::Interpreter::declare_function(FunctionDeclaration *decl, EnvironmentPtr<ExprResult> env) {
+void ankh::lang::Interpreter::declare_function(FunctionDeclaration *decl, const EnvironmentPtr<ExprResult> &env) {
     ANKH_DEBUG("evaluating function declaration of '{}'", decl->name.str);
 
-    const std::string &name = decl->name.str;
-    if (functions_.count(name) > 0) {
+    const std::string name{decl->name.str};
+    // a nested function is declared again by every call of the enclosing one, and only its slot refers to it
+    const bool global = !decl->slot.has_value();
+    if (global && functions_.count(name) > 0) {
         panic<InterpretationException>(decl->name, "runtime error: function '{}' is already declared", name);
     }
 
-    CallablePtr callable = make_callable<Function<ExprResult, Interpreter>>(this, decl, env);
+    CallablePtr callable =
+        make_callable<Function<ExprResult, Interpreter>>(this, decl, env->capture(decl->upvalues), sites_);
 
     ExprResult result{callable.get()};
 
-    functions_[name] = std::move(callable);
-
-    if (!global_->declare(name, result)) {
+    if (!global) {
+        env->define(decl->slot->index, result);
+    } else if (global_->declare(name, result)) {
+        functions_[name] = std::move(callable);
+    } else {
         panic<InterpretationException>(decl->name, "'{}' is already defined", name);
     }
 
-    ANKH_DEBUG("function '{}' added to scope {}", name, global_->scope());
+    ANKH_DEBUG("function '{}' added to scope {}", name, env->scope());
 }
 
 void ankh::lang::Interpreter::visit(ReturnStatement *stmt) {
     ANKH_DEBUG("evaluating return statement");
 
-    const ExprResult result = stmt->expr ? evaluate(stmt->expr) : ExprResult{};
-
-    throw ReturnException(result);
+    return_value_ = stmt->expr ? evaluate(stmt->expr) : ExprResult{};
+    completion_ = Completion::RETURN;
 }
 
 ankh::lang::ExprResult ankh::lang::Interpreter::evaluate(const ExpressionPtr &expr) { return expr->accept(this); }
 
 std::string ankh::lang::Interpreter::substitute(const StringExpression *expr) {
-    std::vector<size_t> opening_brace_indexes;
-    bool is_outer = true;
-
-    std::string result;
-    for (size_t i = 0; i < expr->str.str.length(); ++i) {
-        auto c = expr->str.str[i];
-        if (c == '\\') {
-            if (i < expr->str.str.length() - 1) {
-                char next = expr->str.str[i + 1];
-                if (next == '{' || next == '}') {
-                    result += next;
-                    ++i;
-                    continue;
-                }
-            }
-            // TODO: this should be checked in the parser
-            panic<InterpretationException>(expr->str, "runtime error: unterminated \\");
-        } else if (c == '{') {
-            if (is_outer) {
-                opening_brace_indexes.push_back(i);
-                is_outer = false;
-            } else {
-                panic<InterpretationException>(expr->str,
-                                               "runtime error: nested brace substitution expressions are not allowed");
-            }
-        } else if (c == '}') {
-            if (opening_brace_indexes.empty()) {
-                panic<InterpretationException>(expr->str, "runtime error: mismatched '}'");
-            }
-
-            const size_t start_idx = opening_brace_indexes.back();
-            opening_brace_indexes.pop_back();
-
-            const size_t expr_length = i - start_idx - 1;
-            if (expr_length == 0) {
-                panic<InterpretationException>(expr->str, "runtime error: empty expression evaluation");
-            }
-
-            const std::string expr_str = expr->str.str.substr(start_idx + 1, expr_length);
-            ANKH_DEBUG("{}:{}, parsed expression string '{}' starting @ {}", expr->str.line, expr->str.col, expr_str,
-                       start_idx);
-
-            const ExprResult expr_result = evaluate_single_expr(expr->str, expr_str);
-            ANKH_DEBUG("'{}' => '{}'", expr_str, expr_result.stringify());
-
-            result += expr_result.stringify();
-
-            is_outer = true;
-        } else if (is_outer) {
-            result += c;
-        }
+    if (expr->error.has_value()) {
+        throw InterpretationException(expr->error.value());
     }
 
-    if (!opening_brace_indexes.empty()) {
-        panic<InterpretationException>(expr->str, "runtime error: mismatched '{'");
+    std::string result = expr->literals.front();
+    for (size_t i = 0; i < expr->substitutions.size(); ++i) {
+        result += evaluate(expr->substitutions[i]).stringify();
+        result += expr->literals[i + 1];
     }
 
     return result;
 }
 
-ankh::lang::ExprResult ankh::lang::Interpreter::evaluate_single_expr(const Token &marker, const std::string &str) {
-    auto program = ankh::lang::parse(str);
-    if (program.has_errors()) {
-        std::string begin;
-        const std::string errors =
-            std::accumulate(program.errors.begin(), program.errors.end(), begin, [](auto accum, const auto &v) {
-                accum += '\n';
-                accum += v;
-
-                return accum;
-            });
-
-        panic<InterpretationException>(marker, "runtime error: expression '{}' is not valid because:\n{}", str, errors);
+ankh::lang::Completion ankh::lang::Interpreter::execute(const StatementPtr &stmt) {
+    if (profiler_ != nullptr) {
+        profiler_->poll();
     }
 
-    const auto &statements = program.statements;
-    if (statements.size() > 1) {
-        panic<InterpretationException>(marker, "runtime error: '{}' is a multi return expression",
-                                       program[0]->stringify());
-    }
+    stmt->accept(this);
 
-    if (ExpressionStatement *stmt = instance<ExpressionStatement>(program[0]); stmt == nullptr) {
-        panic<InterpretationException>(marker, "runtime error: '{}' is not an expression", program[0]->stringify());
-    } else {
-        return evaluate(stmt->expr);
-    }
+    return completion_;
 }
 
-void ankh::lang::Interpreter::execute(const StatementPtr &stmt) { stmt->accept(this); }
+ankh::lang::ExprResult ankh::lang::Interpreter::take_return_value() noexcept {
+    completion_ = Completion::NORMAL;
+
+    return std::move(return_value_);
+}
 
 ankh::lang::Interpreter::ScopeGuard::ScopeGuard(ankh::lang::Interpreter *interpreter,
-                                                ankh::lang::EnvironmentPtr<ExprResult> enclosing)
-    : interpreter_(interpreter), prev_(nullptr) {
-    prev_ = interpreter->current_env_;
-    interpreter->current_env_ = make_env<ExprResult>(enclosing);
-    ANKH_DEBUG("new scope created from {} to {} through {}", prev_->scope(), interpreter_->current_env_->scope(),
-               enclosing->scope());
+                                                ankh::lang::EnvironmentPtr<ExprResult> enclosing,
+                                                const Locals *locals, const Captures *captures)
+    : interpreter_(interpreter), env_(interpreter->frames_, std::move(enclosing), locals, captures),
+      prev_(interpreter->current_env_) {
+    interpreter->current_env_ = env_.get();
+    ANKH_DEBUG("new scope created from {} to {}", prev_->scope(), interpreter_->current_env_->scope());
 }
 
 ankh::lang::Interpreter::ScopeGuard::~ScopeGuard() {
@@ -1,4 +1,5 @@
 #include <cctype>
+#include <string_view>
 #include <unordered_map>
 
 #include <ankh/lang/exceptions.hpp>
@@ -6,7 +7,7 @@
 
 #include <ankh/log.hpp>
 
-static const std::unordered_map<std::string, ankh::lang::TokenType> KEYWORDS = {
+static const std::unordered_map<std::string_view, ankh::lang::TokenType> KEYWORDS = {
     {"true", ankh::lang::TokenType::ANKH_TRUE},
     {"false", ankh::lang::TokenType::ANKH_FALSE},
     {"nil", ankh::lang::TokenType::NIL},
@@ -19,15 +20,16 @@ static const std::unordered_map<std::string, ankh::lang::TokenType> KEYWORDS = {
     {"let", ankh::lang::TokenType::LET},
     {"return", ankh::lang::TokenType::ANKH_RETURN}};
 
-ankh::lang::Lexer::Lexer(std::string text) : text_(std::move(text)), cursor_(0), line_(1), col_(1) {}
+ankh::lang::Lexer::Lexer(std::string_view text) : text_(text), cursor_(0), line_(1), col_(1) {}
 
 ankh::lang::Token ankh::lang::Lexer::next() {
     skip_whitespace();
 
     if (is_eof()) {
         // We avoid using tokenize() because we don't need line and col
-        // calculations on the sentinel EOF token
-        return {"EOF", TokenType::ANKH_EOF, line_, col_};
+        // calculations on the sentinel EOF token.
+        // It's placed at the start of the line following the source, as if the source ended with a new line.
+        return {"EOF", TokenType::ANKH_EOF, line_ + 1, 1};
     }
 
     const char c = advance();
@@ -81,13 +83,15 @@ ankh::lang::Token ankh::lang::Lexer::next() {
             advance(); // eat the '&'
             return tokenize("&&", TokenType::AND);
         }
-        panic<ScanException>(tokenize(curr(), TokenType::UNKNOWN), "'&' is not a valid token; did you mean '&&' ?");
+        panic<ScanException>(tokenize(text_.substr(cursor_, 1), TokenType::UNKNOWN),
+                             "'&' is not a valid token; did you mean '&&' ?");
     } else if (c == '|') {
         if (curr() == '|') {
             advance(); // eat the '|'
             return tokenize("||", TokenType::OR);
         }
-        panic<ScanException>(tokenize(curr(), TokenType::UNKNOWN), "'|' is not a valid token; did you mean '||' ?");
+        panic<ScanException>(tokenize(text_.substr(cursor_, 1), TokenType::UNKNOWN),
+                             "'|' is not a valid token; did you mean '||' ?");
     } else if (c == ';') {
         return tokenize(";", TokenType::SEMICOLON);
     } else if (c == ',') {
@@ -97,22 +101,13 @@ ankh::lang::Token ankh::lang::Lexer::next() {
     } else if (c == '$') {
         return scan_command();
     } else if (c == '.') {
-        return tokenize(c, TokenType::DOT);
+        return tokenize(".", TokenType::DOT);
     } else {
-        panic<ScanException>(tokenize(curr(), TokenType::UNKNOWN), "unknown token or token initializer: '{}'", c);
+        panic<ScanException>(tokenize(text_.substr(cursor_, 1), TokenType::UNKNOWN),
+                             "unknown token or token initializer: '{}'", c);
     }
 }
 
-ankh::lang::Token ankh::lang::Lexer::peek() noexcept {
-    size_t old_cursor = cursor_;
-
-    ankh::lang::Token token = next();
-
-    cursor_ = old_cursor;
-
-    return token;
-}
-
 bool ankh::lang::Lexer::is_eof() const noexcept { return cursor_ >= text_.length(); }
 
 void ankh::lang::Lexer::skip_whitespace() noexcept {
@@ -132,65 +127,50 @@ void ankh::lang::Lexer::skip_comment() noexcept {
 }
 
 ankh::lang::Token ankh::lang::Lexer::scan_alnum() noexcept {
-    std::string token(1, prev());
-    while (!is_eof()) {
-        char c = curr();
-        if (c == '_' || std::isalnum(c)) {
-            token += c;
-            advance();
-        } else {
-            break;
-        }
+    const size_t start = cursor_ - 1;
+    while (!is_eof() && (curr() == '_' || std::isalnum(curr()))) {
+        advance();
     }
 
-    const TokenType type = is_keyword(token) ? KEYWORDS.at(token) : TokenType::IDENTIFIER;
+    const std::string_view token = lexeme(start);
+    const auto keyword = KEYWORDS.find(token);
+    const TokenType type = keyword != KEYWORDS.cend() ? keyword->second : TokenType::IDENTIFIER;
 
     return tokenize(token, type);
 }
 
 ankh::lang::Token ankh::lang::Lexer::scan_string() {
-    std::string str;
+    // the token spans the raw text between the quotes; escapes are processed by the parser
+    const size_t start = cursor_;
+    const size_t col = col_ - 1;
+    for (;;) {
+        if (is_eof()) {
+            panic<ScanException>(tokenize(lexeme(cursor_ - 1), TokenType::UNKNOWN), "terminal \" not found");
+        }
 
-    size_t n_meta = 0;
-    while (!is_eof()) {
         const char c = advance();
-        if (is_eof()) {
-            panic<ScanException>(tokenize(c, TokenType::UNKNOWN), "terminal \" not found");
-        } else if (c == '\\') {
-            const char n = advance();
-            if (n == '"') {
-                str += n;
-            } else {
-                str += c;
-                str += n;
-                ++n_meta;
-            }
+        if (c == '\\' && !is_eof()) {
+            advance(); // an escaped quote doesn't terminate the string
         } else if (c == '"') {
             break;
-        } else {
-            str += c;
         }
     }
 
-    // -2:        to account for the quotes
-    // + n_meta:  to account for extra characters added by meta characters
-    return {str, TokenType::STRING, line_, col_ - str.length() - 2 + n_meta};
+    return {text_.substr(start, cursor_ - start - 1), TokenType::STRING, line_, col};
 }
 
 ankh::lang::Token ankh::lang::Lexer::scan_number() {
-    std::string num(1, prev());
+    const size_t start = cursor_ - 1;
 
     bool decimal_found = false;
     while (!is_eof()) {
         char c = curr();
         if (std::isdigit(c)) {
-            num += c;
             advance();
         } else if (c == '.') {
             if (decimal_found) {
-                panic<ScanException>(tokenize(c, TokenType::UNKNOWN), "'.' lexeme not expected");
+                panic<ScanException>(tokenize(text_.substr(cursor_, 1), TokenType::UNKNOWN), "'.' lexeme not expected");
             }
-            num += c;
             decimal_found = true;
             advance();
         } else {
@@ -198,47 +178,47 @@ ankh::lang::Token ankh::lang::Lexer::scan_number() {
         }
     }
 
-    return tokenize(num, TokenType::NUMBER);
+    return tokenize(lexeme(start), TokenType::NUMBER);
 }
 
 ankh::lang::Token ankh::lang::Lexer::scan_compound_operator(char expected, TokenType then,
                                                             TokenType otherwise) noexcept {
-    const std::string before(1, prev());
+    const size_t start = cursor_ - 1;
     if (curr() == expected) {
         advance(); // eat it
-        return tokenize(before + expected, then);
+        return tokenize(lexeme(start), then);
     }
 
-    return tokenize(before, otherwise);
+    return tokenize(lexeme(start), otherwise);
 }
 
 ankh::lang::Token ankh::lang::Lexer::scan_command() {
     if (curr() != '(') {
-        panic<ScanException>(tokenize(curr(), TokenType::UNKNOWN), "'(' token is expected after '$' for command");
+        panic<ScanException>(tokenize(text_.substr(cursor_, 1), TokenType::UNKNOWN),
+                             "'(' token is expected after '$' for command");
     }
 
     advance(); // eat the '('
 
-    std::string value;
-    while (!is_eof()) {
-        char c = advance();
-        if (c == ')') {
+    const size_t start = cursor_;
+    for (;;) {
+        if (is_eof()) {
+            panic<ScanException>(tokenize(lexeme(cursor_ - 1), TokenType::UNKNOWN), "terminal ')' not found");
+        }
+
+        if (advance() == ')') {
             break;
-        } else if (is_eof()) {
-            panic<ScanException>(tokenize(c, TokenType::UNKNOWN), "terminal ')' not found");
-        } else {
-            value += c;
         }
     }
 
-    return tokenize(value, TokenType::COMMAND);
+    return tokenize(text_.substr(start, cursor_ - start - 1), TokenType::COMMAND);
 }
 
 char ankh::lang::Lexer::prev() const noexcept { return text_[cursor_ - 1]; }
 
-char ankh::lang::Lexer::curr() const noexcept { return text_[cursor_]; }
+char ankh::lang::Lexer::curr() const noexcept { return is_eof() ? '\0' : text_[cursor_]; }
 
-char ankh::lang::Lexer::peekc() const noexcept { return text_[cursor_ + 1]; }
+char ankh::lang::Lexer::peekc() const noexcept { return cursor_ + 1 < text_.length() ? text_[cursor_ + 1] : '\0'; }
 
 char ankh::lang::Lexer::advance() noexcept {
     char c = text_[cursor_++];
@@ -248,26 +228,21 @@ char ankh::lang::Lexer::advance() noexcept {
     return c;
 }
 
-ankh::lang::Token ankh::lang::Lexer::tokenize(char c, TokenType type) const noexcept {
-    return tokenize(std::string(1, c), type);
-}
+std::string_view ankh::lang::Lexer::lexeme(size_t start) const noexcept { return text_.substr(start, cursor_ - start); }
 
-ankh::lang::Token ankh::lang::Lexer::tokenize(const std::string &s, TokenType type) const noexcept {
+ankh::lang::Token ankh::lang::Lexer::tokenize(std::string_view s, TokenType type) const noexcept {
     return {s, type, line_, col_ - s.length()};
 }
 
-bool ankh::lang::is_keyword(const std::string &str) noexcept { return KEYWORDS.find(str) != KEYWORDS.cend(); }
+bool ankh::lang::is_keyword(std::string_view str) noexcept { return KEYWORDS.find(str) != KEYWORDS.cend(); }
 
-std::vector<ankh::lang::Token> ankh::lang::scan(const std::string &source) {
-    // The new line is added here so that that while loop below will continue one last iteration
-    // after the last character in the actual source and emit a EOF token.
-    // It didn't need to be a new line; any whitespace character would have worked as well
-    ankh::lang::Lexer lexer(source + "\n");
+std::vector<ankh::lang::Token> ankh::lang::scan(std::string_view source) {
+    ankh::lang::Lexer lexer(source);
 
     std::vector<ankh::lang::Token> tokens;
-    while (!lexer.is_eof()) {
+    do {
         tokens.push_back(lexer.next());
-    }
+    } while (tokens.back().type != TokenType::ANKH_EOF);
 
 #ifndef NDEBUG
     // for (const auto& tok : tokens) {
@@ -0,0 +1,20 @@
+#include <format>
+#include <string>
+
+#include <ankh/lang/exceptions.hpp>
+#include <ankh/lang/native.hpp>
+
+#include <ankh/sys/sys.hpp>
+
+// the function ANKH_EXTENSION defines
+static constexpr const char *EXTENSION_ENTRY = "ankh_extension";
+
+void ankh::lang::load_extension(const std::string &path, Natives &natives) {
+    std::string error;
+    void *entry = ankh::sys::load_symbol(path, EXTENSION_ENTRY, error);
+    if (entry == nullptr) {
+        throw ExtensionException(std::format("could not load extension '{}': {}", path, error));
+    }
+
+    reinterpret_cast<void (*)(Natives &)>(entry)(natives);
+}
@@ -0,0 +1,257 @@
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+
+#include <ankh/lang/exceptions.hpp>
+#include <ankh/lang/operators.hpp>
+#include <ankh/lang/types/array.hpp>
+
+bool ankh::lang::is_integer(Number n) noexcept {
+    double intpart;
+    return std::modf(n, &intpart) == 0.0;
+}
+
+ankh::lang::Number ankh::lang::to_num(const Token &literal) {
+    // strtod needs a terminated string which the token's view isn't
+    const std::string str{literal.str};
+
+    char *end;
+
+    Number n = std::strtod(str.c_str(), &end);
+    if (*end == '\0') {
+        return n;
+    }
+
+    const std::string errno_msg(std::strerror(errno));
+
+    panic<InterpretationException>(literal, "runtime error: '{}' could not be turned into a number because '{}'",
+                                   literal.str, errno_msg);
+}
+
+ankh::lang::ExprResult ankh::lang::negate(const Token &marker, const ExprResult &result) {
+    if (result.type == ExprResultType::RT_NUMBER) {
+        return -1 * result.n;
+    }
+
+    panic<InterpretationException>(marker, "runtime error: unary operator(-) expects a number, not a {}",
+                                   expr_result_type_str(result.type));
+}
+
+ankh::lang::ExprResult ankh::lang::invert(const Token &marker, const ExprResult &result) {
+    if (result.type == ExprResultType::RT_BOOL) {
+        return !(result.b);
+    }
+
+    panic<InterpretationException>(marker, "runtime error: operator(!) expects a boolean expression, not a {}",
+                                   expr_result_type_str(result.type));
+}
+
+ankh::lang::ExprResult ankh::lang::eqeq(const Token &marker, const ExprResult &left, const ExprResult &right) {
+    if (operands_are(ExprResultType::RT_NUMBER, {left, right})) {
+        return left.n == right.n;
+    }
+
+    if (operands_are(ExprResultType::RT_STRING, {left, right})) {
+        return left.str == right.str;
+    }
+
+    if (operands_are(ExprResultType::RT_BOOL, {left, right})) {
+        return left.b == right.b;
+    }
+
+    if (operands_are(ExprResultType::RT_NIL, {left, right})) {
+        return true;
+    }
+
+    panic<InterpretationException>(marker,
+                                   "runtime error: unknown overload of operator(==) with LHS as {} and RHS as {}",
+                                   expr_result_type_str(left.type), expr_result_type_str(right.type));
+}
+
+ankh::lang::ExprResult ankh::lang::division(const Token &marker, const ExprResult &left, const ExprResult &right) {
+    if (operands_are(ExprResultType::RT_NUMBER, {left, right})) {
+        if (right.n == 0) {
+            panic<InterpretationException>(marker, "runtime error: division by zero");
+        }
+        return left.n / right.n;
+    }
+
+    panic<InterpretationException>(
+        marker, "runtime error: unknown overload of operator({}) with LHS as {} and RHS as {}", marker.str,
+        expr_result_type_str(left.type), expr_result_type_str(right.type));
+}
+
+ankh::lang::ExprResult ankh::lang::plus(const Token &marker, const ExprResult &left, const ExprResult &right) {
+    if (operands_are(ExprResultType::RT_NUMBER, {left, right})) {
+        return left.n + right.n;
+    }
+
+    if (operands_are(ExprResultType::RT_STRING, {left, right})) {
+        return left.str.value() + right.str.value();
+    }
+
+    panic<InterpretationException>(marker,
+                                   "runtime error: unknown overload of operator(+) with LHS as {} and RHS as {}",
+                                   expr_result_type_str(left.type), expr_result_type_str(right.type));
+}
+
+ankh::lang::ExprResult ankh::lang::binary(const Token &op, const ExprResult &left, const ExprResult &right) {
+    switch (op.type) {
+    case TokenType::EQEQ:
+        return eqeq(op, left, right);
+    case TokenType::NEQ:
+        return invert(op, eqeq(op, left, right));
+    case TokenType::GT:
+        return compare(op, left, right, std::greater<>{});
+    case TokenType::GTE:
+        return compare(op, left, right, std::greater_equal<>{});
+    case TokenType::LT:
+        return compare(op, left, right, std::less<>{});
+    case TokenType::LTE:
+        return compare(op, left, right, std::less_equal<>{});
+    case TokenType::MINUS:
+        return arithmetic(op, left, right, std::minus<>{});
+    case TokenType::PLUS:
+        return plus(op, left, right);
+    case TokenType::STAR:
+        return arithmetic(op, left, right, std::multiplies<>{});
+    case TokenType::FSLASH:
+        return division(op, left, right);
+    default:
+        panic<InterpretationException>(op, "runtime error: unknown binary operator '{}'", op.str);
+    }
+}
+
+ankh::lang::ExprResult ankh::lang::unary(const Token &op, const ExprResult &right) {
+    switch (op.type) {
+    case TokenType::MINUS:
+        return negate(op, right);
+    case TokenType::BANG:
+        return invert(op, right);
+    default:
+        panic<InterpretationException>(op, "runtime error: unknown unary operator '{}'", op.str);
+    }
+}
+
+bool ankh::lang::truthy(const Token &marker, const ExprResult &result) {
+    if (result.type == ExprResultType::RT_BOOL) {
+        return result.b;
+    }
+
+    panic<InterpretationException>(marker, "runtime error: '{}' is not a boolean expression", result.stringify());
+}
+
+bool ankh::lang::short_circuits(const Token &marker, const ExprResult &left) {
+    if (left.type != ExprResultType::RT_BOOL) {
+        panic<InterpretationException>(marker, "runtime error: operator({}) expects boolean operands, not a {}",
+                                       marker.str, expr_result_type_str(left.type));
+    }
+
+    return marker.type == TokenType::OR ? left.b : !left.b;
+}
+
+ankh::lang::ExprResult ankh::lang::logical(const Token &marker, const ExprResult &right) {
+    if (right.type != ExprResultType::RT_BOOL) {
+        panic<InterpretationException>(marker, "runtime error: operator({}) expects boolean operands, not a {}",
+                                       marker.str, expr_result_type_str(right.type));
+    }
+
+    return right;
+}
+
+ankh::lang::ExprResult ankh::lang::index(const Token &marker, const ExprResult &indexee, const ExprResult &index) {
+    if (indexee.type != ExprResultType::RT_ARRAY && indexee.type != ExprResultType::RT_DICT &&
+        indexee.type != ExprResultType::RT_STRING) {
+        panic<InterpretationException>(marker, "runtime error: lookup expects string, array, or dict operand");
+    }
+
+    if (index.type == ExprResultType::RT_NUMBER) {
+        if (!is_integer(index.n)) {
+            panic<InterpretationException>(marker, "runtime error: index must be an integral numeric expression");
+        }
+
+        if (indexee.type == ExprResultType::RT_ARRAY) {
+            if (index.n >= indexee.array.size()) {
+                panic<InterpretationException>(marker, "runtime error: index {} must be less than array size {}",
+                                               index.n, indexee.array.size());
+            }
+
+            return indexee.array[index.n];
+        }
+
+        if (indexee.type == ExprResultType::RT_STRING) {
+            if (index.n >= indexee.str.size()) {
+                panic<InterpretationException>(marker, "runtime error: index {} must be less than string length {}",
+                                               index.n, indexee.str.size());
+            }
+
+            return std::string{indexee.str[index.n]};
+        }
+
+        panic<InterpretationException>(marker, "runtime error: operand must be an array or string for a numeric index");
+    }
+
+    if (index.type == ExprResultType::RT_STRING) {
+        if (indexee.type != ExprResultType::RT_DICT) {
+            panic<InterpretationException>(marker, "runtime error: operand must be a dict for a string index");
+        }
+
+        if (const auto *entry = indexee.dict.find(index); entry != nullptr) {
+            return entry->value;
+        }
+
+        return {};
+    }
+
+    panic<InterpretationException>(marker, "runtime error: '{}' is not a valid lookup expression", index.stringify());
+}
+
+ankh::lang::ExprResult ankh::lang::slice(const Token &marker, const ExprResult &indexee,
+                                         const std::optional<ExprResult> &begin, const std::optional<ExprResult> &end) {
+    if (indexee.type != ExprResultType::RT_ARRAY && indexee.type != ExprResultType::RT_STRING) {
+        panic<InterpretationException>(marker, "runtime error: slices are only available on arrays and arrays, not {}",
+                                       expr_result_type_str(indexee.type));
+    }
+
+    auto assert_is_positive_integer = [&](const ExprResult &result) -> const ExprResult & {
+        if (result.type != ExprResultType::RT_NUMBER || !is_integer(result.n)) {
+            panic<InterpretationException>(marker, "runtime error: slice indexes can only be integers, not {}",
+                                           expr_result_type_str(result.type));
+        }
+        if (result.n < 0) {
+            panic<InterpretationException>(marker, "runtime error: slice indexes can only be positive, not {}",
+                                           expr_result_type_str(result.type));
+        }
+
+        return result;
+    };
+
+    const size_t begin_index = begin ? assert_is_positive_integer(begin.value()).n : 0;
+
+    const size_t sentinel = indexee.type == ExprResultType::RT_ARRAY ? indexee.array.size() : indexee.str.size();
+
+    const size_t end_index = end ? assert_is_positive_integer(end.value()).n : sentinel;
+
+    if (end_index > sentinel) {
+        panic<InterpretationException>(marker, "runtime error: slice index {} out of range", end_index);
+    }
+
+    if (indexee.type == ExprResultType::RT_ARRAY) {
+        Array<ExprResult> result;
+        for (size_t i = begin_index; i < end_index; ++i) {
+            result.append(indexee.array[i]);
+        }
+
+        return result;
+    }
+
+    std::string result;
+    for (size_t i = begin_index; i < end_index; ++i) {
+        result += indexee.str[i];
+    }
+
+    return result;
+}
@@ -0,0 +1,306 @@
+#include <string>
+#include <utility>
+
+#include <ankh/def.hpp>
+#include <ankh/log.hpp>
+
+#include <ankh/lang/exceptions.hpp>
+#include <ankh/lang/lambda.hpp>
+#include <ankh/lang/operators.hpp>
+#include <ankh/lang/optimizer.hpp>
+#include <ankh/lang/parser.hpp>
+
+static ankh::lang::TokenType literal_type(const ankh::lang::ExprResult &value) noexcept {
+    using ankh::lang::ExprResultType;
+    using ankh::lang::TokenType;
+
+    switch (value.type) {
+    case ExprResultType::RT_NUMBER:
+        return TokenType::NUMBER;
+    case ExprResultType::RT_STRING:
+        return TokenType::STRING;
+    case ExprResultType::RT_BOOL:
+        return value.b ? TokenType::ANKH_TRUE : TokenType::ANKH_FALSE;
+    case ExprResultType::RT_NIL:
+        return TokenType::NIL;
+    default:
+        ANKH_FATAL("'{}' values can't be folded into a literal", expr_result_type_str(value.type));
+    }
+}
+
+void ankh::lang::Optimizer::optimize(Program &program) {
+    arena_ = &program.arena;
+
+    for (const auto &stmt : program.statements) {
+        optimize(stmt);
+    }
+}
+
+ankh::lang::ExprResult ankh::lang::Optimizer::visit(BinaryExpression *expr) {
+    optimize(expr->left);
+    optimize(expr->right);
+
+    const ExprResult *left = constant(expr->left);
+    const ExprResult *right = constant(expr->right);
+    if (left != nullptr && right != nullptr) {
+        try {
+            fold(expr->op, binary(expr->op, *left, *right));
+        } catch (const InterpretationException &e) {
+            ANKH_DEBUG("optimizer: '{}' is left to fail at runtime: {}", expr->stringify(), e.what());
+        }
+    }
+
+    return {};
+}
+
+ankh::lang::ExprResult ankh::lang::Optimizer::visit(LogicalExpression *expr) {
+    optimize(expr->left);
+    optimize(expr->right);
+
+    const ExprResult *left = constant(expr->left);
+    const ExprResult *right = constant(expr->right);
+    if (left != nullptr) {
+        try {
+            if (short_circuits(expr->op, *left)) {
+                fold(expr->op, *left);
+            } else if (right != nullptr) {
+                fold(expr->op, logical(expr->op, *right));
+            }
+        } catch (const InterpretationException &e) {
+            ANKH_DEBUG("optimizer: '{}' is left to fail at runtime: {}", expr->stringify(), e.what());
+        }
+    }
+
+    return {};
+}
+
+ankh::lang::ExprResult ankh::lang::Optimizer::visit(UnaryExpression *expr) {
+    optimize(expr->right);
+
+    if (const ExprResult *right = constant(expr->right); right != nullptr) {
+        try {
+            fold(expr->op, unary(expr->op, *right));
+        } catch (const InterpretationException &e) {
+            ANKH_DEBUG("optimizer: '{}' is left to fail at runtime: {}", expr->stringify(), e.what());
+        }
+    }
+
+    return {};
+}
+
+ankh::lang::ExprResult ankh::lang::Optimizer::visit(LiteralExpression *expr) {
+    if (expr->value.has_value()) {
+        return {};
+    }
+
+    switch (expr->literal.type) {
+    case TokenType::NUMBER:
+        try {
+            expr->value = to_num(expr->literal);
+        } catch (const InterpretationException &e) {
+            ANKH_DEBUG("optimizer: '{}' is left to fail at runtime: {}", expr->stringify(), e.what());
+        }
+        break;
+    case TokenType::STRING:
+        expr->value = std::string{expr->literal.str};
+        break;
+    case TokenType::ANKH_TRUE:
+        expr->value = true;
+        break;
+    case TokenType::ANKH_FALSE:
+        expr->value = false;
+        break;
+    case TokenType::NIL:
+        expr->value = ExprResult{};
+        break;
+    default:
+        break;
+    }
+
+    return {};
+}
+
+ankh::lang::ExprResult ankh::lang::Optimizer::visit(ParenExpression *expr) {
+    optimize(expr->expr);
+
+    if (const ExprResult *value = constant(expr->expr); value != nullptr) {
+        fold(instance<LiteralExpression>(expr->expr)->literal, *value);
+    }
+
+    return {};
+}
+
+ankh::lang::ExprResult ankh::lang::Optimizer::visit(IdentifierExpression *expr) {
+    ANKH_UNUSED(expr);
+
+    return {};
+}
+
+ankh::lang::ExprResult ankh::lang::Optimizer::visit(CallExpression *expr) {
+    optimize(expr->callee);
+    for (auto &arg : expr->args) {
+        optimize(arg);
+    }
+
+    return {};
+}
+
+ankh::lang::ExprResult ankh::lang::Optimizer::visit(LambdaExpression *expr) {
+    optimize(expr->body);
+
+    return {};
+}
+
+ankh::lang::ExprResult ankh::lang::Optimizer::visit(CommandExpression *expr) {
+    ANKH_UNUSED(expr);
+
+    return {};
+}
+
+ankh::lang::ExprResult ankh::lang::Optimizer::visit(ArrayExpression *expr) {
+    for (auto &elem : expr->elems) {
+        optimize(elem);
+    }
+
+    return {};
+}
+
+ankh::lang::ExprResult ankh::lang::Optimizer::visit(IndexExpression *expr) {
+    optimize(expr->indexee);
+    optimize(expr->index);
+
+    return {};
+}
+
+ankh::lang::ExprResult ankh::lang::Optimizer::visit(SliceExpression *expr) {
+    optimize(expr->indexee);
+    if (expr->begin) {
+        optimize(expr->begin);
+    }
+    if (expr->end) {
+        optimize(expr->end);
+    }
+
+    return {};
+}
+
+ankh::lang::ExprResult ankh::lang::Optimizer::visit(DictionaryExpression *expr) {
+    for (auto &[k, v] : expr->entries) {
+        optimize(k);
+        optimize(v);
+    }
+
+    return {};
+}
+
+ankh::lang::ExprResult ankh::lang::Optimizer::visit(StringExpression *expr) {
+    if (expr->error.has_value()) {
+        return {};
+    }
+
+    bool is_constant = true;
+    for (auto &substitution : expr->substitutions) {
+        optimize(substitution);
+        is_constant = is_constant && constant(substitution) != nullptr;
+    }
+
+    if (!is_constant) {
+        return {};
+    }
+
+    std::string result = expr->literals.front();
+    for (size_t i = 0; i < expr->substitutions.size(); ++i) {
+        result += constant(expr->substitutions[i])->stringify();
+        result += expr->literals[i + 1];
+    }
+
+    fold(expr->str, std::move(result));
+
+    return {};
+}
+
+void ankh::lang::Optimizer::visit(ExpressionStatement *stmt) { optimize(stmt->expr); }
+
+void ankh::lang::Optimizer::visit(VariableDeclaration *stmt) { optimize(stmt->initializer); }
+
+void ankh::lang::Optimizer::visit(AssignmentStatement *stmt) { optimize(stmt->initializer); }
+
+void ankh::lang::Optimizer::visit(CompoundAssignment *stmt) { optimize(stmt->value); }
+
+void ankh::lang::Optimizer::visit(IncOrDecIdentifierStatement *stmt) {
+    // the target is always an identifier so there's nothing to fold
+    ANKH_UNUSED(stmt);
+}
+
+void ankh::lang::Optimizer::visit(BlockStatement *stmt) {
+    for (const auto &statement : stmt->statements) {
+        optimize(statement);
+    }
+}
+
+void ankh::lang::Optimizer::visit(IfStatement *stmt) {
+    optimize(stmt->condition);
+    optimize(stmt->then_block);
+    if (stmt->else_block != nullptr) {
+        optimize(stmt->else_block);
+    }
+}
+
+void ankh::lang::Optimizer::visit(WhileStatement *stmt) {
+    optimize(stmt->condition);
+    optimize(stmt->body);
+}
+
+void ankh::lang::Optimizer::visit(ForStatement *stmt) {
+    if (stmt->init) {
+        optimize(stmt->init);
+    }
+    if (stmt->condition) {
+        optimize(stmt->condition);
+    }
+    if (stmt->mutator) {
+        optimize(stmt->mutator);
+    }
+
+    optimize(stmt->body);
+}
+
+void ankh::lang::Optimizer::visit(BreakStatement *stmt) { ANKH_UNUSED(stmt); }
+
+void ankh::lang::Optimizer::visit(FunctionDeclaration *stmt) { optimize(stmt->body); }
+
+void ankh::lang::Optimizer::visit(ReturnStatement *stmt) {
+    if (stmt->expr) {
+        optimize(stmt->expr);
+    }
+}
+
+void ankh::lang::Optimizer::optimize(ExpressionPtr &expr) {
+    expr->accept(this);
+
+    if (!folded_.has_value()) {
+        return;
+    }
+
+    Folded folded = std::move(folded_.value());
+    folded_.reset();
+
+    ANKH_DEBUG("optimizer: '{}' folded into '{}'", expr->stringify(), folded.value.stringify());
+
+    // the literal keeps the original source text so it's still recognizable when stringified
+    Token literal{arena_->copy(expr->stringify()), literal_type(folded.value), folded.marker.line, folded.marker.col};
+    expr = make_expression<LiteralExpression>(*arena_, std::move(literal), std::move(folded.value));
+}
+
+void ankh::lang::Optimizer::optimize(const StatementPtr &stmt) { stmt->accept(this); }
+
+void ankh::lang::Optimizer::fold(const Token &marker, ExprResult value) { folded_ = Folded{marker, std::move(value)}; }
+
+const ankh::lang::ExprResult *ankh::lang::Optimizer::constant(const ExpressionPtr &expr) noexcept {
+    const LiteralExpression *literal = instance<LiteralExpression>(expr);
+    if (literal == nullptr || !literal->value.has_value()) {
+        return nullptr;
+    }
+
+    return &literal->value.value();
+}
@@ -2,6 +2,7 @@
 #include <ankh/lang/expr.hpp>
 #include <ankh/lang/statement.hpp>
 #include <initializer_list>
+#include <numeric>
 #include <random>
 
 #include <ankh/log.hpp>
@@ -9,6 +10,7 @@
 #include <ankh/lang/exceptions.hpp>
 #include <ankh/lang/lambda.hpp>
 #include <ankh/lang/lexer.hpp>
+#include <ankh/lang/optimizer.hpp>
 #include <ankh/lang/parser.hpp>
 #include <ankh/lang/static_analyzer.hpp>
 #include <ankh/lang/token.hpp>
@@ -30,25 +32,63 @@ static std::string generate_lambda_name() noexcept {
     return name;
 }
 
-ankh::lang::Program ankh::lang::parse(const std::string &source) {
-    const std::vector<ankh::lang::Token> tokens = ankh::lang::scan(source);
+// The string with its escaped quotes replaced by the quotes themselves
+static std::string unescape(std::string_view str) {
+    std::string result;
+    result.reserve(str.size());
+    for (size_t i = 0; i < str.size(); ++i) {
+        if (str[i] == '\\' && i + 1 < str.size() && str[i + 1] == '"') {
+            ++i;
+        }
+        result += str[i];
+    }
+
+    return result;
+}
+
+// Parses, analyzes and optimizes the text, which the arena holds or which otherwise outlives the program
+static ankh::lang::Program parse_text(std::string_view text, ankh::lang::Arena arena) {
+    using ankh::lang::ParseException;
 
-    ankh::lang::Parser parser(tokens);
+    ankh::lang::Parser parser(text, std::move(arena));
 
     ankh::lang::Program program = parser.parse();
 
     ankh::lang::StaticAnalyzer analyzer;
 
     try {
-        program.hop_table = analyzer.resolve(program);
+        analyzer.resolve(program);
     } catch (const ParseException &e) {
         program.errors.push_back(e.what());
+
+        return program;
     }
 
+    ankh::lang::Optimizer optimizer;
+    optimizer.optimize(program);
+
     return program;
 }
 
-ankh::lang::Parser::Parser(const std::vector<Token> &tokens) : tokens_(tokens), cursor_(0) {}
+ankh::lang::Program ankh::lang::parse(const std::string &source) {
+    // the tokens are views into the source so it's copied into the arena the program keeps alive
+    ankh::lang::Arena arena;
+    const std::string_view text = arena.copy(source);
+
+    return parse_text(text, std::move(arena));
+}
+
+ankh::lang::Program ankh::lang::parse_in_place(std::string_view source) { return parse_text(source, Arena()); }
+
+ankh::lang::PreparedProgram ankh::lang::prepare(const std::string &source) {
+    return std::make_shared<const Program>(parse(source));
+}
+
+ankh::lang::Parser::Parser(std::string_view source, Arena arena)
+    : lexer_(source), window_{Token{"", TokenType::UNKNOWN, 0, 0}, Token{"", TokenType::UNKNOWN, 0, 0}}, cursor_(0),
+      arena_(std::move(arena)) {
+    scan_current();
+}
 
 ankh::lang::Program ankh::lang::Parser::parse() noexcept {
     // PERFORMANCE: see if we can reserve some room up front
@@ -58,11 +98,14 @@ ankh::lang::Program ankh::lang::Parser::parse() noexcept {
             program.statements.push_back(declaration());
         } catch (const ankh::lang::ParseException &e) {
             ANKH_DEBUG("parse exception: {}", e.what());
-            program.errors.push_back(e.what());
+            errors_.push_back(e.what());
             synchronize_next_statement();
         }
     }
 
+    program.errors = std::move(errors_);
+    program.arena = std::move(arena_);
+
     return program;
 }
 
@@ -100,7 +143,7 @@ ankh::lang::StatementPtr ankh::lang::Parser::parse_variable_declaration() {
 
     semicolon();
 
-    return make_statement<VariableDeclaration>(identifier->name, std::move(rhs), storage_class);
+    return make_statement<VariableDeclaration>(arena_, identifier->name, std::move(rhs), storage_class);
 }
 
 ankh::lang::StatementPtr ankh::lang::Parser::parse_function_declaration() {
@@ -120,7 +163,7 @@ ankh::lang::StatementPtr ankh::lang::Parser::parse_function_declaration() {
 
     StatementPtr body = block();
 
-    return make_statement<FunctionDeclaration>(name, std::move(params), std::move(body));
+    return make_statement<FunctionDeclaration>(arena_, name, std::move(params), std::move(body));
 }
 
 ankh::lang::StatementPtr ankh::lang::Parser::assignment(ExpressionPtr target) {
@@ -139,9 +182,9 @@ ankh::lang::StatementPtr ankh::lang::Parser::assignment(ExpressionPtr target) {
     semicolon();
 
     if (op.type == TokenType::EQ) {
-        return make_statement<AssignmentStatement>(identifier->name, std::move(rhs));
+        return make_statement<AssignmentStatement>(arena_, identifier->name, std::move(rhs));
     } else {
-        return make_statement<CompoundAssignment>(identifier->name, op, std::move(rhs));
+        return make_statement<CompoundAssignment>(arena_, identifier->name, op, std::move(rhs));
     }
 }
 
@@ -159,7 +202,7 @@ ankh::lang::StatementPtr ankh::lang::Parser::statement() {
     } else if (match(ankh::lang::TokenType::ANKH_RETURN)) {
         return parse_return();
     } else if (match(ankh::lang::TokenType::BREAK)) {
-        return make_statement<BreakStatement>(prev());
+        return make_statement<BreakStatement>(arena_, prev());
     } else if (check({TokenType::INC, TokenType::DEC})) {
         return parse_inc_dec();
     } else if (check(TokenType::LET)) {
@@ -173,7 +216,7 @@ ankh::lang::StatementPtr ankh::lang::Parser::statement() {
 
     semicolon();
 
-    return make_statement<ExpressionStatement>(std::move(expr));
+    return make_statement<ExpressionStatement>(arena_, std::move(expr));
 }
 
 ankh::lang::StatementPtr ankh::lang::Parser::parse_inc_dec() {
@@ -184,7 +227,7 @@ ankh::lang::StatementPtr ankh::lang::Parser::parse_inc_dec() {
     semicolon();
 
     if (instanceof <IdentifierExpression>(target)) {
-        return make_statement<IncOrDecIdentifierStatement>(op, std::move(target));
+        return make_statement<IncOrDecIdentifierStatement>(arena_, op, std::move(target));
     }
 
     panic<ParseException>(op, "syntax error: only identifiers are valid increment/decrement targets");
@@ -201,7 +244,7 @@ ankh::lang::StatementPtr ankh::lang::Parser::block() {
 
     consume(ankh::lang::TokenType::RBRACE, "'}' expected to terminate block");
 
-    return make_statement<BlockStatement>(std::move(statements));
+    return make_statement<BlockStatement>(arena_, std::move(statements));
 }
 
 ankh::lang::StatementPtr ankh::lang::Parser::parse_if() {
@@ -220,7 +263,8 @@ ankh::lang::StatementPtr ankh::lang::Parser::parse_if() {
         }
     }
 
-    return make_statement<IfStatement>(if_token, std::move(condition), std::move(then_block), std::move(else_block));
+    return make_statement<IfStatement>(arena_, if_token, std::move(condition), std::move(then_block),
+                                       std::move(else_block));
 }
 
 ankh::lang::StatementPtr ankh::lang::Parser::parse_while() {
@@ -229,7 +273,7 @@ ankh::lang::StatementPtr ankh::lang::Parser::parse_while() {
     ExpressionPtr condition = expression();
     StatementPtr body = block();
 
-    return make_statement<WhileStatement>(while_token, std::move(condition), std::move(body));
+    return make_statement<WhileStatement>(arena_, while_token, std::move(condition), std::move(body));
 }
 
 ankh::lang::StatementPtr ankh::lang::Parser::parse_for() {
@@ -239,7 +283,7 @@ ankh::lang::StatementPtr ankh::lang::Parser::parse_for() {
     if (check(TokenType::LBRACE)) {
         StatementPtr body = block();
 
-        return make_statement<ForStatement>(for_token, nullptr, nullptr, nullptr, std::move(body));
+        return make_statement<ForStatement>(arena_, for_token, nullptr, nullptr, nullptr, std::move(body));
     }
 
     StatementPtr init = nullptr;
@@ -259,7 +303,7 @@ ankh::lang::StatementPtr ankh::lang::Parser::parse_for() {
 
     StatementPtr body = block();
 
-    return make_statement<ForStatement>(for_token, std::move(init), std::move(condition), std::move(mutator),
+    return make_statement<ForStatement>(arena_, for_token, std::move(init), std::move(condition), std::move(mutator),
                                         std::move(body));
 }
 
@@ -268,14 +312,14 @@ ankh::lang::StatementPtr ankh::lang::Parser::parse_return() {
     const Token &return_token = prev();
 
     if (check(TokenType::RBRACE) || match(TokenType::SEMICOLON)) {
-        return make_statement<ReturnStatement>(return_token, nullptr);
+        return make_statement<ReturnStatement>(arena_, return_token, nullptr);
     }
 
     ExpressionPtr expr = expression();
 
     semicolon();
 
-    return make_statement<ReturnStatement>(return_token, std::move(expr));
+    return make_statement<ReturnStatement>(arena_, return_token, std::move(expr));
 }
 
 ankh::lang::ExpressionPtr ankh::lang::Parser::expression() { return parse_or(); }
@@ -285,7 +329,7 @@ ankh::lang::ExpressionPtr ankh::lang::Parser::parse_or() {
     while (match(ankh::lang::TokenType::OR)) {
         const Token &op = prev();
         ankh::lang::ExpressionPtr right = parse_and();
-        left = make_expression<ankh::lang::BinaryExpression>(std::move(left), op, std::move(right));
+        left = make_expression<ankh::lang::LogicalExpression>(arena_, std::move(left), op, std::move(right));
     }
 
     return left;
@@ -296,7 +340,7 @@ ankh::lang::ExpressionPtr ankh::lang::Parser::parse_and() {
     while (match(ankh::lang::TokenType::AND)) {
         const Token &op = prev();
         ankh::lang::ExpressionPtr right = equality();
-        left = make_expression<ankh::lang::BinaryExpression>(std::move(left), op, std::move(right));
+        left = make_expression<ankh::lang::LogicalExpression>(arena_, std::move(left), op, std::move(right));
     }
 
     return left;
@@ -307,7 +351,7 @@ ankh::lang::ExpressionPtr ankh::lang::Parser::equality() {
     while (match({ankh::lang::TokenType::EQEQ, ankh::lang::TokenType::NEQ})) {
         Token op = prev();
         ankh::lang::ExpressionPtr right = comparison();
-        left = make_expression<BinaryExpression>(std::move(left), op, std::move(right));
+        left = make_expression<BinaryExpression>(arena_, std::move(left), op, std::move(right));
     }
 
     return left;
@@ -319,7 +363,7 @@ ankh::lang::ExpressionPtr ankh::lang::Parser::comparison() {
                   ankh::lang::TokenType::GTE})) {
         Token op = prev();
         ankh::lang::ExpressionPtr right = term();
-        left = make_expression<BinaryExpression>(std::move(left), op, std::move(right));
+        left = make_expression<BinaryExpression>(arena_, std::move(left), op, std::move(right));
     }
 
     return left;
@@ -330,7 +374,7 @@ ankh::lang::ExpressionPtr ankh::lang::Parser::term() {
     while (match({ankh::lang::TokenType::MINUS, ankh::lang::TokenType::PLUS})) {
         Token op = prev();
         ankh::lang::ExpressionPtr right = factor();
-        left = make_expression<BinaryExpression>(std::move(left), op, std::move(right));
+        left = make_expression<BinaryExpression>(arena_, std::move(left), op, std::move(right));
     }
 
     return left;
@@ -341,7 +385,7 @@ ankh::lang::ExpressionPtr ankh::lang::Parser::factor() {
     while (match({ankh::lang::TokenType::STAR, ankh::lang::TokenType::FSLASH})) {
         Token op = prev();
         ankh::lang::ExpressionPtr right = unary();
-        left = make_expression<BinaryExpression>(std::move(left), op, std::move(right));
+        left = make_expression<BinaryExpression>(arena_, std::move(left), op, std::move(right));
     }
 
     return left;
@@ -351,7 +395,7 @@ ankh::lang::ExpressionPtr ankh::lang::Parser::unary() {
     if (match({ankh::lang::TokenType::BANG, ankh::lang::TokenType::MINUS})) {
         Token op = prev();
         ankh::lang::ExpressionPtr right = unary();
-        return make_expression<UnaryExpression>(op, std::move(right));
+        return make_expression<UnaryExpression>(arena_, op, std::move(right));
     }
 
     return operable();
@@ -389,7 +433,7 @@ ankh::lang::ExpressionPtr ankh::lang::Parser::call(ExpressionPtr callee) {
 
     consume(TokenType::RPAREN, "')' expected to terminate callable arguments");
 
-    return make_expression<CallExpression>(lparen, std::move(callee), std::move(args));
+    return make_expression<CallExpression>(arena_, lparen, std::move(callee), std::move(args));
 }
 
 ankh::lang::ExpressionPtr ankh::lang::Parser::index(ExpressionPtr indexee) {
@@ -403,7 +447,7 @@ ankh::lang::ExpressionPtr ankh::lang::Parser::index(ExpressionPtr indexee) {
             end = expression();
             consume(TokenType::RBRACKET, "']' expected to terminate slice operation");
         }
-        return make_expression<SliceExpression>(lbracket, std::move(indexee), std::move(begin), std::move(end));
+        return make_expression<SliceExpression>(arena_, lbracket, std::move(indexee), std::move(begin), std::move(end));
     }
 
     begin = expression();
@@ -413,25 +457,25 @@ ankh::lang::ExpressionPtr ankh::lang::Parser::index(ExpressionPtr indexee) {
             end = expression();
             consume(TokenType::RBRACKET, "']' expected to terminate slice operation");
         }
-        return make_expression<SliceExpression>(lbracket, std::move(indexee), std::move(begin), std::move(end));
+        return make_expression<SliceExpression>(arena_, lbracket, std::move(indexee), std::move(begin), std::move(end));
     }
 
     consume(TokenType::RBRACKET, "']' expected to terminate index operation");
 
-    return make_expression<IndexExpression>(lbracket, std::move(indexee), std::move(begin));
+    return make_expression<IndexExpression>(arena_, lbracket, std::move(indexee), std::move(begin));
 }
 
 ankh::lang::ExpressionPtr ankh::lang::Parser::primary() {
     if (match(TokenType::STRING)) {
-        return make_expression<StringExpression>(prev());
+        return parse_string(prev());
     }
 
     if (match({TokenType::NUMBER, TokenType::ANKH_TRUE, TokenType::ANKH_FALSE, TokenType::NIL})) {
-        return make_expression<LiteralExpression>(prev());
+        return make_expression<LiteralExpression>(arena_, prev());
     }
 
     if (match(TokenType::IDENTIFIER)) {
-        return make_expression<IdentifierExpression>(prev());
+        return make_expression<IdentifierExpression>(arena_, prev());
     }
 
     if (match(TokenType::LPAREN)) {
@@ -439,7 +483,7 @@ ankh::lang::ExpressionPtr ankh::lang::Parser::primary() {
 
         consume(TokenType::RPAREN, "')' expected to terminate parenthetic expression");
 
-        return make_expression<ParenExpression>(std::move(expr));
+        return make_expression<ParenExpression>(arena_, std::move(expr));
     }
 
     if (match(TokenType::FN)) {
@@ -452,7 +496,7 @@ ankh::lang::ExpressionPtr ankh::lang::Parser::primary() {
             panic<ParseException>(cmd, "syntax error: command cannot be empty", cmd.line, cmd.col);
         }
 
-        return make_expression<CommandExpression>(cmd);
+        return make_expression<CommandExpression>(arena_, cmd);
     }
 
     if (check(TokenType::LBRACKET)) {
@@ -466,6 +510,112 @@ ankh::lang::ExpressionPtr ankh::lang::Parser::primary() {
     panic<ParseException>(curr(), "syntax error: primary expression expected, found '{}' instead", curr().str);
 }
 
+ankh::lang::ExpressionPtr ankh::lang::Parser::parse_string(const Token &str) {
+    try {
+        std::vector<size_t> opening_brace_indexes;
+        bool is_outer = true;
+
+        std::vector<std::string> literals(1);
+        std::vector<ExpressionPtr> substitutions;
+        for (size_t i = 0; i < str.str.length(); ++i) {
+            auto c = str.str[i];
+            if (c == '\\') {
+                if (i < str.str.length() - 1) {
+                    char next = str.str[i + 1];
+                    if (next == '"') {
+                        // quotes within a substitution are unescaped along with the rest of its source below
+                        if (is_outer) {
+                            literals.back() += next;
+                        }
+                        ++i;
+                        continue;
+                    }
+                    if (next == '{' || next == '}') {
+                        literals.back() += next;
+                        ++i;
+                        continue;
+                    }
+                }
+                panic<InterpretationException>(str, "runtime error: unterminated \\");
+            } else if (c == '{') {
+                if (is_outer) {
+                    opening_brace_indexes.push_back(i);
+                    is_outer = false;
+                } else {
+                    panic<InterpretationException>(
+                        str, "runtime error: nested brace substitution expressions are not allowed");
+                }
+            } else if (c == '}') {
+                if (opening_brace_indexes.empty()) {
+                    panic<InterpretationException>(str, "runtime error: mismatched '}}'");
+                }
+
+                const size_t start_idx = opening_brace_indexes.back();
+                opening_brace_indexes.pop_back();
+
+                const size_t expr_length = i - start_idx - 1;
+                if (expr_length == 0) {
+                    panic<InterpretationException>(str, "runtime error: empty expression evaluation");
+                }
+
+                substitutions.push_back(parse_substitution(str, unescape(str.str.substr(start_idx + 1, expr_length))));
+                literals.emplace_back();
+
+                is_outer = true;
+            } else if (is_outer) {
+                literals.back() += c;
+            }
+        }
+
+        if (!opening_brace_indexes.empty()) {
+            panic<InterpretationException>(str, "runtime error: mismatched '{{'");
+        }
+
+        return make_expression<StringExpression>(arena_, str, std::move(literals), std::move(substitutions));
+    } catch (const InterpretationException &e) {
+        return make_expression<StringExpression>(arena_, str, std::string{e.what()});
+    }
+}
+
+ankh::lang::ExpressionPtr ankh::lang::Parser::parse_substitution(const Token &marker, const std::string &str) {
+    // the tokens of the substitution have to live as long as the program it's part of
+    Parser parser(arena_.copy(str));
+
+    Program program = parser.parse();
+    if (program.has_errors()) {
+        std::string begin;
+        const std::string errors =
+            std::accumulate(program.errors.begin(), program.errors.end(), begin, [](auto accum, const auto &v) {
+                accum += '\n';
+                accum += v;
+
+                return accum;
+            });
+
+        panic<InterpretationException>(marker, "runtime error: expression '{}' is not valid because:\n{}", str, errors);
+    }
+
+    if (program.statements.empty()) {
+        panic<InterpretationException>(marker, "runtime error: empty expression evaluation");
+    }
+
+    if (program.statements.size() > 1) {
+        panic<InterpretationException>(marker, "runtime error: '{}' is a multi return expression",
+                                       program[0]->stringify());
+    }
+
+    ExpressionStatement *stmt = instance<ExpressionStatement>(program[0]);
+    if (stmt == nullptr) {
+        panic<InterpretationException>(marker, "runtime error: '{}' is not an expression", program[0]->stringify());
+    }
+
+    // the substitution now belongs to the enclosing program, which has to keep its memory alive
+    arena_.merge(std::move(program.arena));
+
+    // the substitution is resolved by the static analyzer in the scope of the string
+    return std::move(stmt->expr);
+}
+
 ankh::lang::ExpressionPtr ankh::lang::Parser::lambda() {
     const Token &fn_token = prev();
 
@@ -485,7 +635,7 @@ ankh::lang::ExpressionPtr ankh::lang::Parser::lambda() {
 
     const std::string name = generate_lambda_name();
 
-    return make_expression<LambdaExpression>(fn_token, name, std::move(params), std::move(body));
+    return make_expression<LambdaExpression>(arena_, fn_token, name, std::move(params), std::move(body));
 }
 
 ankh::lang::ExpressionPtr ankh::lang::Parser::parse_array() {
@@ -500,7 +650,7 @@ ankh::lang::ExpressionPtr ankh::lang::Parser::parse_array() {
 
     consume(TokenType::RBRACKET, "']' expected to terminate array expression");
 
-    return make_expression<ArrayExpression>(std::move(elems));
+    return make_expression<ArrayExpression>(arena_, std::move(elems));
 }
 
 ankh::lang::ExpressionPtr ankh::lang::Parser::dict() {
@@ -516,7 +666,7 @@ ankh::lang::ExpressionPtr ankh::lang::Parser::dict() {
 
     consume(TokenType::RBRACE, "'}' expected to terminate dictionary expression");
 
-    return make_expression<DictionaryExpression>(lbrace, std::move(entries));
+    return make_expression<DictionaryExpression>(arena_, lbrace, std::move(entries));
 }
 
 ankh::lang::Entry<ankh::lang::ExpressionPtr> ankh::lang::Parser::entry() {
@@ -533,7 +683,7 @@ ankh::lang::ExpressionPtr ankh::lang::Parser::key() {
     if (match(TokenType::IDENTIFIER)) {
         Token str = prev();
         str.type = ankh::lang::TokenType::STRING;
-        return make_expression<StringExpression>(str);
+        return make_expression<StringExpression>(arena_, str);
     }
 
     consume(TokenType::LBRACKET, "'[' expected to start expression key");
@@ -545,18 +695,32 @@ ankh::lang::ExpressionPtr ankh::lang::Parser::key() {
     return expr;
 }
 
-const ankh::lang::Token &ankh::lang::Parser::prev() const noexcept { return tokens_[cursor_ - 1]; }
+ankh::lang::Token ankh::lang::Parser::prev() const noexcept { return window_[(cursor_ - 1) % WINDOW]; }
 
-const ankh::lang::Token &ankh::lang::Parser::curr() const noexcept { return tokens_[cursor_]; }
+ankh::lang::Token ankh::lang::Parser::curr() const noexcept { return window_[cursor_ % WINDOW]; }
 
-const ankh::lang::Token &ankh::lang::Parser::advance() noexcept {
+ankh::lang::Token ankh::lang::Parser::advance() noexcept {
     if (!is_eof()) {
         ++cursor_;
+        scan_current();
     }
 
     return prev();
 }
 
+void ankh::lang::Parser::scan_current() noexcept {
+    for (;;) {
+        try {
+            window_[cursor_ % WINDOW] = lexer_.next();
+            return;
+        } catch (const ScanException &e) {
+            // the lexer has moved past the offending text so scanning picks up right after it
+            ANKH_DEBUG("scan exception: {}", e.what());
+            errors_.push_back(e.what());
+        }
+    }
+}
+
 bool ankh::lang::Parser::is_eof() const noexcept { return curr().type == ankh::lang::TokenType::ANKH_EOF; }
 
 bool ankh::lang::Parser::match(ankh::lang::TokenType type) noexcept {
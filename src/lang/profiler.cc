@@ -0,0 +1,108 @@
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <format>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <ankh/def.hpp>
+
+#include <ankh/lang/profiler.hpp>
+
+#include <ankh/sys/sys.hpp>
+
+// the code outside of any function
+static constexpr std::string_view SCRIPT = "<script>";
+
+std::atomic<size_t> ankh::lang::Profiler::ticks_{0};
+
+bool ankh::lang::Profiler::start() noexcept {
+    if (running_) {
+        return true;
+    }
+
+    ticks_.store(0, std::memory_order_relaxed);
+    sampled_ = ankh::sys::cpu_time();
+    running_ = ankh::sys::start_profiling_timer(&Profiler::tick, interval_);
+
+    return running_;
+}
+
+void ankh::lang::Profiler::stop() noexcept {
+    if (!running_) {
+        return;
+    }
+
+    ankh::sys::stop_profiling_timer();
+    running_ = false;
+}
+
+void ankh::lang::Profiler::tick(int signal) noexcept {
+    ANKH_UNUSED(signal);
+
+    ticks_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ankh::lang::Profiler::sample() {
+    if (ticks_.exchange(0, std::memory_order_relaxed) == 0) {
+        return;
+    }
+
+    const std::chrono::microseconds now = ankh::sys::cpu_time();
+    const std::chrono::microseconds time = now - sampled_;
+    sampled_ = now;
+    total_ += time;
+
+    std::string stack{SCRIPT};
+    // a recursive function is on the stack many times but its total time only counts the sample once
+    std::vector<std::string> names{std::string{SCRIPT}};
+    for (const Frame &frame : frames_) {
+        std::string name{frame.callee->name()};
+        stack += std::format(";{} ({}:{})", name, frame.site->line, frame.site->col);
+        if (std::find(names.begin(), names.end(), name) == names.end()) {
+            names.push_back(std::move(name));
+        }
+    }
+
+    stacks_[stack] += time;
+    for (const std::string &name : names) {
+        functions_[name].total += time;
+    }
+    functions_[frames_.empty() ? std::string{SCRIPT} : std::string{frames_.back().callee->name()}].self += time;
+}
+
+void ankh::lang::Profiler::write_folded(std::ostream &out) const {
+    std::vector<std::pair<std::string, std::chrono::microseconds>> stacks(stacks_.begin(), stacks_.end());
+    std::sort(stacks.begin(), stacks.end());
+
+    for (const auto &[stack, time] : stacks) {
+        out << stack << ' ' << time.count() << '\n';
+    }
+}
+
+void ankh::lang::Profiler::write_table(std::ostream &out) const {
+    if (total_.count() == 0) {
+        out << "no samples were taken\n";
+        return;
+    }
+
+    std::vector<std::pair<std::string, Times>> functions(functions_.begin(), functions_.end());
+    std::sort(functions.begin(), functions.end(), [](const auto &lhs, const auto &rhs) {
+        return lhs.second.self != rhs.second.self ? lhs.second.self > rhs.second.self : lhs.first < rhs.first;
+    });
+
+    const auto ms = [](std::chrono::microseconds time) {
+        return std::chrono::duration<double, std::milli>(time).count();
+    };
+    const auto percent = [this](std::chrono::microseconds time) {
+        return 100.0 * static_cast<double>(time.count()) / static_cast<double>(total_.count());
+    };
+
+    out << std::format("{:>12} {:>7} {:>12} {:>7}  {}\n", "self (ms)", "self", "total (ms)", "total", "function");
+    for (const auto &[name, times] : functions) {
+        out << std::format("{:>12.1f} {:>6.1f}% {:>12.1f} {:>6.1f}%  {}\n", ms(times.self), percent(times.self),
+                           ms(times.total), percent(times.total), name);
+    }
+}
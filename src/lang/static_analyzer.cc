@@ -6,35 +6,29 @@
 #include <ankh/lang/lambda.hpp>
 #include <ankh/lang/static_analyzer.hpp>
 
-ankh::lang::HopTable ankh::lang::StaticAnalyzer::resolve(const Program &program) {
-    hop_table_.clear();
+void ankh::lang::StaticAnalyzer::resolve(Program &program) {
     scopes_.clear();
+    closures_.clear();
+    analyses_.clear();
+    call_sites_ = 0;
 
-    // initialize global scope
-    begin_scope();
+    // initialize global scope; globals don't get slots since they are looked up by name
+    begin_scope(nullptr, nullptr);
     begin_analysis(FunctionType::NONE, LoopType::NONE);
 
-    for (const auto &stmt : program.statements) {
-        analyze(stmt);
-    }
+    analyze_scope(program.statements);
 
-#ifndef NDEBUG
-    // ANKH_DEBUG("========================== HOP TABLE BEGIN ===================================");
-    for (const auto &[entity, hops] : hop_table_) {
-        const std::string serialized =
-            reinterpret_cast<const Expression *>(entity)  ? static_cast<const Expression *>(entity)->stringify()
-            : reinterpret_cast<const Statement *>(entity) ? static_cast<const Statement *>(entity)->stringify()
-                                                          : "";
+    program.call_sites = call_sites_;
+}
 
-        ANKH_DEBUG("HOP TABLE: '{}' @ {} => {}", serialized, entity, hops);
-    }
-    // ANKH_DEBUG("========================== HOP TABLE END ===================================");
-#endif
+ankh::lang::ExprResult ankh::lang::StaticAnalyzer::visit(BinaryExpression *expr) {
+    analyze(expr->left);
+    analyze(expr->right);
 
-    return hop_table_;
+    return {};
 }
 
-ankh::lang::ExprResult ankh::lang::StaticAnalyzer::visit(BinaryExpression *expr) {
+ankh::lang::ExprResult ankh::lang::StaticAnalyzer::visit(LogicalExpression *expr) {
     analyze(expr->left);
     analyze(expr->right);
 
@@ -66,12 +60,14 @@ ankh::lang::ExprResult ankh::lang::StaticAnalyzer::visit(IdentifierExpression *e
         panic<ParseException>(expr->name, "can't read local variable in its own initializer");
     }
 
-    resolve(expr, expr->name);
+    expr->slot = resolve(expr->name);
 
     return {};
 }
 
 ankh::lang::ExprResult ankh::lang::StaticAnalyzer::visit(CallExpression *expr) {
+    expr->site = call_sites_++;
+
     analyze(expr->callee);
     for (const auto &arg : expr->args) {
         analyze(arg);
@@ -83,19 +79,16 @@ ankh::lang::ExprResult ankh::lang::StaticAnalyzer::visit(CallExpression *expr) {
 ankh::lang::ExprResult ankh::lang::StaticAnalyzer::visit(LambdaExpression *expr) {
     ANKH_DEBUG("static analyzer: analyzing '{}'", expr->stringify());
 
-    const Token name{expr->generated_name, TokenType::IDENTIFIER, 0, 0};
-    declare(name);
-    define(name);
-
-    begin_analysis(FunctionType::FUNCTION, current_analysis().loop_type);
-    begin_scope();
+    // a lambda created in a loop is still called outside of it, so its body can't break out of the loop
+    begin_analysis(FunctionType::FUNCTION, LoopType::NONE);
+    begin_closure(&expr->locals, &expr->captures, &expr->upvalues);
     for (const auto &param : expr->params) {
         declare(param);
         define(param);
     }
     analyze(expr->body);
 
-    end_scope();
+    end_closure();
     end_analysis();
 
     return {};
@@ -146,7 +139,9 @@ ankh::lang::ExprResult ankh::lang::StaticAnalyzer::visit(DictionaryExpression *e
 }
 
 ankh::lang::ExprResult ankh::lang::StaticAnalyzer::visit(StringExpression *expr) {
-    ANKH_UNUSED(expr);
+    for (const auto &substitution : expr->substitutions) {
+        analyze(substitution);
+    }
 
     return {};
 }
@@ -156,7 +151,7 @@ void ankh::lang::StaticAnalyzer::visit(ExpressionStatement *stmt) { analyze(stmt
 void ankh::lang::StaticAnalyzer::visit(VariableDeclaration *stmt) {
     ANKH_DEBUG("static analyzer: analyzing '{}'", stmt->stringify());
 
-    declare(stmt->name);
+    stmt->slot = declare(stmt->name);
     analyze(stmt->initializer);
     define(stmt->name);
 }
@@ -165,12 +160,18 @@ void ankh::lang::StaticAnalyzer::visit(AssignmentStatement *stmt) {
     ANKH_DEBUG("static analyzer: analyzing '{}'", stmt->stringify());
 
     analyze(stmt->initializer);
-    resolve(stmt, stmt->name);
+    stmt->slot = resolve(stmt->name);
+
+    if (const auto *call = dynamic_cast<CallExpression *>(stmt->initializer.get());
+        call != nullptr && !call->args.empty() && dynamic_cast<IdentifierExpression *>(call->callee.get()) != nullptr) {
+        const auto *arg = dynamic_cast<IdentifierExpression *>(call->args.front().get());
+        stmt->reassigns_argument = arg != nullptr && arg->name.str == stmt->name.str && arg->slot == stmt->slot;
+    }
 }
 
 void ankh::lang::StaticAnalyzer::visit(CompoundAssignment *stmt) {
     analyze(stmt->value);
-    resolve(stmt, stmt->target);
+    stmt->slot = resolve(stmt->target);
 }
 
 void ankh::lang::StaticAnalyzer::visit(IncOrDecIdentifierStatement *stmt) { analyze(stmt->expr); }
@@ -178,10 +179,8 @@ void ankh::lang::StaticAnalyzer::visit(IncOrDecIdentifierStatement *stmt) { anal
 void ankh::lang::StaticAnalyzer::visit(BlockStatement *stmt) {
     begin_analysis(current_analysis().fn_type, current_analysis().loop_type);
 
-    begin_scope();
-    for (const auto &stmt : stmt->statements) {
-        analyze(stmt);
-    }
+    begin_scope(&stmt->locals, &stmt->captures);
+    analyze_scope(stmt->statements);
     end_scope();
 
     end_analysis();
@@ -204,7 +203,7 @@ void ankh::lang::StaticAnalyzer::visit(WhileStatement *stmt) {
 
 void ankh::lang::StaticAnalyzer::visit(ForStatement *stmt) {
     begin_analysis(current_analysis().fn_type, LoopType::LOOP);
-    begin_scope();
+    begin_scope(&stmt->locals, &stmt->captures);
 
     if (stmt->init) {
         analyze(stmt->init);
@@ -231,21 +230,42 @@ void ankh::lang::StaticAnalyzer::visit(BreakStatement *stmt) {
 }
 
 void ankh::lang::StaticAnalyzer::visit(FunctionDeclaration *stmt) {
-    ANKH_DEBUG("static analyzer: analyzing '{}'", stmt->stringify());
+    // the function has been declared along with the others of its scope, its body is analyzed along with theirs
+    top().functions.push_back(stmt);
+}
 
-    declare(stmt->name);
-    define(stmt->name);
+void ankh::lang::StaticAnalyzer::analyze_scope(const std::vector<StatementPtr> &statements) {
+    for (const auto &stmt : statements) {
+        if (auto *function = dynamic_cast<FunctionDeclaration *>(stmt.get()); function != nullptr) {
+            function->slot = declare(function->name);
+            define(function->name);
+        }
+    }
+
+    for (const auto &stmt : statements) {
+        analyze(stmt);
+    }
+
+    // analyzing a body pushes scopes of its own, which may move the current one
+    const std::vector<FunctionDeclaration *> functions = std::move(top().functions);
+    for (FunctionDeclaration *function : functions) {
+        analyze_function(function);
+    }
+}
+
+void ankh::lang::StaticAnalyzer::analyze_function(FunctionDeclaration *stmt) {
+    ANKH_DEBUG("static analyzer: analyzing '{}'", stmt->stringify());
 
     // we can't define functions in loops so we hardcode NONE
     begin_analysis(FunctionType::FUNCTION, LoopType::NONE);
-    begin_scope();
+    begin_closure(&stmt->locals, &stmt->captures, &stmt->upvalues);
     for (const auto &param : stmt->params) {
         declare(param);
         define(param);
     }
     analyze(stmt->body);
 
-    end_scope();
+    end_closure();
     end_analysis();
 }
 
@@ -259,10 +279,32 @@ void ankh::lang::StaticAnalyzer::visit(ReturnStatement *stmt) {
     }
 }
 
-void ankh::lang::StaticAnalyzer::begin_scope() { scopes_.emplace_back(); }
+void ankh::lang::StaticAnalyzer::begin_scope(Locals *locals, Captures *captures) {
+    if (locals != nullptr) {
+        locals->clear();
+    }
+    if (captures != nullptr) {
+        captures->clear();
+    }
+
+    scopes_.emplace_back(locals, captures);
+}
 
 void ankh::lang::StaticAnalyzer::end_scope() { scopes_.pop_back(); }
 
+void ankh::lang::StaticAnalyzer::begin_closure(Locals *locals, Captures *captures, std::vector<Slot> *upvalues) {
+    upvalues->clear();
+    closures_.emplace_back(scopes_.size(), upvalues);
+
+    begin_scope(locals, captures);
+}
+
+void ankh::lang::StaticAnalyzer::end_closure() {
+    end_scope();
+
+    closures_.pop_back();
+}
+
 void ankh::lang::StaticAnalyzer::begin_analysis(FunctionType fn_type, LoopType loop_type) noexcept {
     analyses_.emplace_back(fn_type, loop_type);
 }
@@ -287,38 +329,100 @@ ankh::lang::StaticAnalyzer::Scope &ankh::lang::StaticAnalyzer::top() noexcept {
 
 const ankh::lang::StaticAnalyzer::Scope &ankh::lang::StaticAnalyzer::top() const noexcept { return scopes_.back(); }
 
-void ankh::lang::StaticAnalyzer::declare(const ankh::lang::Token &token) {
-    ANKH_VERIFY(top().variables.count(token.str) == 0);
-
-    top().variables.insert({token.str, false});
+std::optional<ankh::lang::Slot> ankh::lang::StaticAnalyzer::declare(const ankh::lang::Token &token) {
+    if (top().variables.count(token.str) > 0) {
+        panic<ParseException>(token, "'{}' is already declared in this scope", token.str);
+    }
 
     ANKH_DEBUG("'{}' declared at scope {}", token.str, scopes_.size() - 1);
+
+    if (top().locals == nullptr) {
+        top().variables.insert({token.str, Variable{false, 0}});
+
+        return std::nullopt;
+    }
+
+    const size_t index = top().locals->size();
+    top().locals->emplace_back(token.str);
+    top().variables.insert({token.str, Variable{false, index}});
+
+    return Slot{0, index};
 }
 
 void ankh::lang::StaticAnalyzer::define(const ankh::lang::Token &token) {
     ANKH_VERIFY(top().variables.count(token.str) > 0);
 
-    top().variables[token.str] = true;
+    top().variables.at(token.str).defined = true;
 
     ANKH_DEBUG("'{}' defined at scope {}", token.str, scopes_.size() - 1);
 }
 
 bool ankh::lang::StaticAnalyzer::is_declared_but_not_defined(const Token &token) const noexcept {
-    return top().variables.count(token.str) > 0 && top().variables.at(token.str) == false;
+    return top().variables.count(token.str) > 0 && !top().variables.at(token.str).defined;
 }
 
 void ankh::lang::StaticAnalyzer::analyze(const ExpressionPtr &expr) { expr->accept(this); }
 
 void ankh::lang::StaticAnalyzer::analyze(const StatementPtr &stmt) { stmt->accept(this); }
 
-void ankh::lang::StaticAnalyzer::resolve(const void *entity, const Token &name) {
-    for (auto it = scopes_.crbegin(); it != scopes_.crend(); ++it) {
-        if (it->variables.count(name.str) > 0) {
-            const size_t hops = it - scopes_.crbegin();
-            ANKH_DEBUG("'{}' is {} hops away from current scope {}", name.str, hops, scopes_.size() - 1);
-            ANKH_VERIFY(hop_table_.count(entity) == 0);
-            hop_table_[entity] = hops;
-            return;
+std::optional<ankh::lang::Slot> ankh::lang::StaticAnalyzer::resolve(const Token &name) {
+    return resolve(name, closures_.size());
+}
+
+std::optional<ankh::lang::Slot> ankh::lang::StaticAnalyzer::resolve(const Token &name, size_t nesting) {
+    // the scopes of the code nested in that many closures, which make up a single environment chain at runtime
+    const size_t first = nesting == 0 ? 0 : closures_[nesting - 1].scope;
+    const size_t last = nesting == closures_.size() ? scopes_.size() : closures_[nesting].scope;
+    for (size_t i = last; i > first; --i) {
+        const Scope &scope = scopes_[i - 1];
+        if (const auto var = scope.variables.find(name.str); var != scope.variables.end()) {
+            if (scope.locals == nullptr) {
+                ANKH_DEBUG("'{}' resolved to a global", name.str);
+                return std::nullopt;
+            }
+
+            ANKH_DEBUG("'{}' is {} hops away from scope {} in slot {}", name.str, last - i, last - 1,
+                       var->second.index);
+
+            return Slot{last - i, var->second.index};
         }
     }
+
+    // outside of every closure there's nothing left but globals, which are looked up by name
+    if (nesting == 0) {
+        // anything we can't find is assumed to be a global that is declared later or by another program e.g. builtins
+        ANKH_DEBUG("'{}' is unresolved", name.str);
+        return std::nullopt;
+    }
+
+    const auto enclosing = resolve(name, nesting - 1);
+    if (!enclosing.has_value()) {
+        return std::nullopt;
+    }
+
+    return capture(name, enclosing.value(), nesting);
+}
+
+ankh::lang::Slot ankh::lang::StaticAnalyzer::capture(const Token &name, const Slot &slot, size_t nesting) {
+    // a variable declared right in the enclosing closure is moved into a cell the closure can share
+    if (!slot.upvalue) {
+        Scope &scope = scopes_[closures_[nesting - 1].scope - 1 - slot.depth];
+        Variable &var = scope.variables.at(name.str);
+        if (!var.captured) {
+            var.captured = true;
+            scope.captures->push_back(var.index);
+        }
+    }
+
+    std::vector<Slot> &upvalues = *closures_[nesting - 1].upvalues;
+    for (size_t i = 0; i < upvalues.size(); ++i) {
+        if (upvalues[i] == slot) {
+            return Slot{0, i, true};
+        }
+    }
+
+    ANKH_DEBUG("'{}' captured as upvalue {}", name.str, upvalues.size());
+    upvalues.push_back(slot);
+
+    return Slot{0, upvalues.size() - 1, true};
 }
@@ -0,0 +1,619 @@
+#include <algorithm>
+#include <cstdint>
+#include <format>
+#include <functional>
+#include <iterator>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <ankh/def.hpp>
+#include <ankh/log.hpp>
+
+#include <ankh/lang/builtins.hpp>
+#include <ankh/lang/compiler.hpp>
+#include <ankh/lang/exceptions.hpp>
+#include <ankh/lang/operators.hpp>
+#include <ankh/lang/vm.hpp>
+
+// Labels as values let every instruction jump straight to the next one instead of going through a switch
+#if defined(__GNUC__) || defined(__clang__)
+#define ANKH_VM_COMPUTED_GOTO
+#endif
+
+static constexpr size_t MAX_FRAMES = 4096;
+
+ankh::lang::ExprResult ankh::lang::Object::invoke(const std::vector<ExpressionPtr> &args) {
+    ANKH_UNUSED(args);
+
+    ANKH_FATAL("'{}' was created by the VM and can't be invoked by the interpreter", name());
+}
+
+ankh::lang::VM::VM() : heap_(this) {
+    stack_.reserve(1024);
+    frames_.reserve(MAX_FRAMES);
+
+    load(builtins::natives());
+}
+
+ankh::lang::VM::~VM() noexcept = default;
+
+void ankh::lang::VM::interpret(Program &&program) {
+    const HeapScope heap(heap_);
+    Compiler compiler(globals_);
+    std::unique_ptr<Prototype> script = compiler.compile(program);
+#ifndef NDEBUG
+    ANKH_DEBUG("{}", disassemble(*script));
+#endif
+
+    const CallablePtr callable = make_closure(script.get());
+    auto *closure = static_cast<Closure *>(callable.get());
+    scripts_.push_back(std::move(script));
+    programs_.push_back(std::move(program));
+
+    stack_.push_back(ExprResult{callable.get()});
+    frames_.push_back(CallFrame{closure, closure->prototype->chunk.code(), 0});
+
+    try {
+        run();
+    } catch (...) {
+        reset();
+        throw;
+    }
+}
+
+std::optional<ankh::lang::ExprResult> ankh::lang::VM::global(const std::string &name) const noexcept {
+    if (const auto index = globals_.find(name); index.has_value() && globals_[index.value()].defined) {
+        return {globals_[index.value()].value};
+    }
+
+    return std::nullopt;
+}
+
+#pragma GCC diagnostic push
+// computed gotos are a GNU extension
+#pragma GCC diagnostic ignored "-Wpedantic"
+
+void ankh::lang::VM::run() {
+    CallFrame *frame = &frames_.back();
+    const Chunk *chunk = &frame->closure->prototype->chunk;
+    const std::uint8_t *ip = frame->ip;
+    size_t base = frame->base;
+
+#define READ_U8() (*ip++)
+#define READ_U16() (ip += 2, read_u16(ip - 2))
+#define READ_U32() (ip += 4, read_u32(ip - 4))
+// ip is past the current instruction's operands so the byte before it belongs to the current instruction
+#define MARKER() (chunk->marker(ip - chunk->code() - 1))
+#define PEEK(n) (stack_[stack_.size() - 1 - (n)])
+#define LOAD_FRAME()                                                                                                   \
+    do {                                                                                                               \
+        frame = &frames_.back();                                                                                       \
+        chunk = &frame->closure->prototype->chunk;                                                                     \
+        ip = frame->ip;                                                                                                \
+        base = frame->base;                                                                                            \
+    } while (0)
+// numbers are operated on in place; everything else goes through the shared operator semantics
+#define BINARY_OP(number_op, slow_op)                                                                                  \
+    do {                                                                                                               \
+        ExprResult &lhs = PEEK(1);                                                                                     \
+        const ExprResult &rhs = PEEK(0);                                                                               \
+        if (lhs.type == ExprResultType::RT_NUMBER && rhs.type == ExprResultType::RT_NUMBER) {                          \
+            number_op;                                                                                                 \
+        } else {                                                                                                       \
+            lhs = slow_op;                                                                                             \
+        }                                                                                                              \
+        stack_.pop_back();                                                                                             \
+    } while (0)
+#define COMPARISON_OP(op, cmp)                                                                                         \
+    BINARY_OP((lhs.b = lhs.n op rhs.n, lhs.type = ExprResultType::RT_BOOL), compare(MARKER(), lhs, rhs, cmp))
+
+#ifdef ANKH_VM_COMPUTED_GOTO
+    static const void *dispatch_table[] = {
+#define ANKH_OPCODE_LABEL(op) &&op_##op,
+        ANKH_OPCODES(ANKH_OPCODE_LABEL)
+#undef ANKH_OPCODE_LABEL
+    };
+// computed gotos don't run destructors, so instructions dispatch only once their block's locals are gone
+#define DISPATCH() goto *dispatch_table[*ip++]
+#define CASE(op) op_##op:
+#define FALLTHROUGH()
+
+    DISPATCH();
+#else
+#define DISPATCH() goto dispatch
+#define CASE(op) case OpCode::op:
+#define FALLTHROUGH() [[fallthrough]]
+
+dispatch:
+    switch (static_cast<OpCode>(*ip++)) {
+#endif
+
+    CASE(CONSTANT) {
+        stack_.push_back(chunk->constant(READ_U32()));
+    }
+    DISPATCH();
+
+    CASE(NIL) {
+        stack_.emplace_back();
+    }
+    DISPATCH();
+
+    CASE(ANKH_TRUE) {
+        stack_.emplace_back(true);
+    }
+    DISPATCH();
+
+    CASE(ANKH_FALSE) {
+        stack_.emplace_back(false);
+    }
+    DISPATCH();
+
+    CASE(POP) {
+        stack_.pop_back();
+    }
+    DISPATCH();
+
+    CASE(GET_LOCAL) {
+        stack_.push_back(stack_[base + READ_U16()]);
+    }
+    DISPATCH();
+
+    CASE(SET_LOCAL) {
+        stack_[base + READ_U16()] = std::move(stack_.back());
+        stack_.pop_back();
+    }
+    DISPATCH();
+
+    CASE(GET_GLOBAL) {
+        const Global &global = globals_[READ_U32()];
+        if (!global.defined) {
+            panic<InterpretationException>(MARKER(), "runtime error: identifier '{}' not defined", global.name);
+        }
+
+        stack_.push_back(global.value);
+    }
+    DISPATCH();
+
+    CASE(SET_GLOBAL) {
+        Global &global = globals_[READ_U32()];
+        if (!global.defined) {
+            panic<InterpretationException>(MARKER(), "runtime error: '{}' is not defined", global.name);
+        }
+
+        global.value = std::move(stack_.back());
+        stack_.pop_back();
+    }
+    DISPATCH();
+
+    CASE(DEFINE_GLOBAL) {
+        Global &global = globals_[READ_U32()];
+        if (global.defined) {
+            panic<InterpretationException>(MARKER(), "runtime error: '{}' is already declared in this scope",
+                                           global.name);
+        }
+
+        global.value = std::move(stack_.back());
+        global.defined = true;
+        stack_.pop_back();
+    }
+    DISPATCH();
+
+    CASE(GET_UPVALUE) {
+        stack_.push_back(upvalue(frame->closure, READ_U16()));
+    }
+    DISPATCH();
+
+    CASE(SET_UPVALUE) {
+        upvalue(frame->closure, READ_U16()) = std::move(stack_.back());
+        stack_.pop_back();
+    }
+    DISPATCH();
+
+    CASE(CLOSE_UPVALUE) {
+        close_upvalues(stack_.size() - 1);
+        stack_.pop_back();
+    }
+    DISPATCH();
+
+    CASE(EQ) {
+        BINARY_OP((lhs.b = lhs.n == rhs.n, lhs.type = ExprResultType::RT_BOOL), eqeq(MARKER(), lhs, rhs));
+    }
+    DISPATCH();
+
+    CASE(NEQ) {
+        BINARY_OP((lhs.b = lhs.n != rhs.n, lhs.type = ExprResultType::RT_BOOL),
+                  invert(MARKER(), eqeq(MARKER(), lhs, rhs)));
+    }
+    DISPATCH();
+
+    CASE(GT) {
+        COMPARISON_OP(>, std::greater<>{});
+    }
+    DISPATCH();
+
+    CASE(GTE) {
+        COMPARISON_OP(>=, std::greater_equal<>{});
+    }
+    DISPATCH();
+
+    CASE(LT) {
+        COMPARISON_OP(<, std::less<>{});
+    }
+    DISPATCH();
+
+    CASE(LTE) {
+        COMPARISON_OP(<=, std::less_equal<>{});
+    }
+    DISPATCH();
+
+    CASE(ADD) {
+        BINARY_OP(lhs.n += rhs.n, plus(MARKER(), lhs, rhs));
+    }
+    DISPATCH();
+
+    CASE(SUB) {
+        BINARY_OP(lhs.n -= rhs.n, arithmetic(MARKER(), lhs, rhs, std::minus<>{}));
+    }
+    DISPATCH();
+
+    CASE(MUL) {
+        BINARY_OP(lhs.n *= rhs.n, arithmetic(MARKER(), lhs, rhs, std::multiplies<>{}));
+    }
+    DISPATCH();
+
+    CASE(DIV) {
+        // division by zero is reported by the slow path
+        BINARY_OP(lhs = rhs.n == 0 ? division(MARKER(), lhs, rhs) : ExprResult{lhs.n / rhs.n},
+                  division(MARKER(), lhs, rhs));
+    }
+    DISPATCH();
+
+    CASE(AND) {
+        const std::uint32_t offset = READ_U32();
+        const ExprResult &left = stack_.back();
+        if (left.type == ExprResultType::RT_BOOL ? !left.b : short_circuits(MARKER(), left)) {
+            ip += offset;
+        } else {
+            stack_.pop_back();
+        }
+    }
+    DISPATCH();
+
+    CASE(OR) {
+        const std::uint32_t offset = READ_U32();
+        const ExprResult &left = stack_.back();
+        if (left.type == ExprResultType::RT_BOOL ? left.b : short_circuits(MARKER(), left)) {
+            ip += offset;
+        } else {
+            stack_.pop_back();
+        }
+    }
+    DISPATCH();
+
+    CASE(CHECK_BOOL) {
+        if (stack_.back().type != ExprResultType::RT_BOOL) {
+            logical(MARKER(), stack_.back());
+        }
+    }
+    DISPATCH();
+
+    CASE(NEGATE) {
+        ExprResult &top = stack_.back();
+        if (top.type == ExprResultType::RT_NUMBER) {
+            top.n = -top.n;
+        } else {
+            top = negate(MARKER(), top);
+        }
+    }
+    DISPATCH();
+
+    CASE(NOT) {
+        ExprResult &top = stack_.back();
+        if (top.type == ExprResultType::RT_BOOL) {
+            top.b = !top.b;
+        } else {
+            top = invert(MARKER(), top);
+        }
+    }
+    DISPATCH();
+
+    CASE(JUMP) {
+        const std::uint32_t offset = READ_U32();
+        ip += offset;
+    }
+    DISPATCH();
+
+    CASE(JUMP_IF_FALSE) {
+        const std::uint32_t offset = READ_U32();
+        const ExprResult &condition = stack_.back();
+        const bool truth = condition.type == ExprResultType::RT_BOOL ? condition.b : truthy(MARKER(), condition);
+        stack_.pop_back();
+        if (!truth) {
+            ip += offset;
+        }
+    }
+    DISPATCH();
+
+    CASE(LOOP) {
+        const std::uint32_t offset = READ_U32();
+        ip -= offset;
+    }
+    DISPATCH();
+
+    // a native can't refer to the variable the result is assigned to, anything else is called like CALL does
+    CASE(CALL_REASSIGN) {
+        const std::uint16_t argc = read_u16(ip);
+
+        const ExprResult &callee = PEEK(argc);
+        if (callee.type == ExprResultType::RT_CALLABLE) {
+            Object *object = static_cast<Object *>(callee.callable);
+            if (object->kind == Object::Kind::NATIVE && argc == object->arity()) {
+                ip += 2;
+                call_native(static_cast<Native *>(object), argc, &assigned(ip, frame));
+                DISPATCH();
+            }
+        }
+    }
+    FALLTHROUGH();
+
+    CASE(CALL) {
+        const std::uint16_t argc = READ_U16();
+
+        const ExprResult &callee = PEEK(argc);
+        if (callee.type != ExprResultType::RT_CALLABLE) {
+            panic<InterpretationException>(MARKER(), "runtime error: only functions and classes are callable");
+        }
+
+        Object *object = static_cast<Object *>(callee.callable);
+        if (argc != object->arity()) {
+            panic<InterpretationException>(MARKER(),
+                                           "runtime error: expected {} arguments to function '{}' instead of {}",
+                                           object->arity(), object->name(), argc);
+        }
+
+        if (object->kind == Object::Kind::NATIVE) {
+            call_native(static_cast<Native *>(object), argc, nullptr);
+        } else {
+            if (frames_.size() == MAX_FRAMES) {
+                panic<InterpretationException>(MARKER(), "runtime error: stack overflow");
+            }
+
+            Closure *closure = static_cast<Closure *>(object);
+
+            frame->ip = ip;
+            frames_.push_back(CallFrame{closure, closure->prototype->chunk.code(), stack_.size() - argc - 1});
+            LOAD_FRAME();
+        }
+    }
+    DISPATCH();
+
+    CASE(CLOSURE) {
+        const Prototype *prototype = chunk->prototype(READ_U32());
+
+        const CallablePtr callable = make_closure(prototype);
+        auto *closure = static_cast<Closure *>(callable.get());
+        for (size_t i = 0; i < prototype->upvalue_count; ++i) {
+            const bool is_local = READ_U8() == 1;
+            const std::uint16_t index = READ_U16();
+
+            closure->upvalues[i] = is_local ? capture_upvalue(base + index) : frame->closure->upvalues[index];
+        }
+
+        stack_.push_back(ExprResult{callable.get()});
+    }
+    DISPATCH();
+
+    CASE(ANKH_RETURN) {
+        ExprResult result = std::move(stack_.back());
+
+        close_upvalues(base);
+        stack_.erase(stack_.begin() + base, stack_.end());
+        frames_.pop_back();
+
+        if (frames_.empty()) {
+            return;
+        }
+
+        stack_.push_back(std::move(result));
+        LOAD_FRAME();
+    }
+    DISPATCH();
+
+    CASE(ARRAY) {
+        const std::uint32_t count = READ_U32();
+
+        std::vector<ExprResult> elems(std::make_move_iterator(stack_.end() - count),
+                                      std::make_move_iterator(stack_.end()));
+        stack_.erase(stack_.end() - count, stack_.end());
+
+        stack_.emplace_back(Array<ExprResult>(std::move(elems)));
+    }
+    DISPATCH();
+
+    CASE(DICT) {
+        const std::uint32_t count = READ_U32();
+        const size_t first = stack_.size() - 2 * count;
+
+        Dictionary<ExprResult> dict;
+        for (size_t i = first; i < stack_.size(); i += 2) {
+            const ExprResult &key = stack_[i];
+            if (key.type != ExprResultType::RT_STRING) {
+                panic<InterpretationException>(
+                    MARKER(), "runtime error: expression key '{}' does not evaluate to a string", key.stringify());
+            }
+            dict.insert(key, stack_[i + 1]);
+        }
+        stack_.erase(stack_.begin() + first, stack_.end());
+
+        stack_.emplace_back(std::move(dict));
+    }
+    DISPATCH();
+
+    CASE(INDEX) {
+        ExprResult result = index(MARKER(), PEEK(1), PEEK(0));
+        stack_.pop_back();
+        stack_.back() = std::move(result);
+    }
+    DISPATCH();
+
+    CASE(SLICE) {
+        const std::uint8_t flags = READ_U8();
+
+        std::optional<ExprResult> begin, end;
+        if (flags & SLICE_HAS_END) {
+            end = std::move(stack_.back());
+            stack_.pop_back();
+        }
+        if (flags & SLICE_HAS_BEGIN) {
+            begin = std::move(stack_.back());
+            stack_.pop_back();
+        }
+
+        stack_.back() = slice(MARKER(), stack_.back(), begin, end);
+    }
+    DISPATCH();
+
+    CASE(COMMAND) {
+        const std::string &cmd = chunk->constant(READ_U32()).str;
+
+        stack_.push_back(builtins::run_command(cmd, builtin_state_));
+    }
+    DISPATCH();
+
+    CASE(INTERPOLATE) {
+        const std::uint32_t count = READ_U32();
+
+        std::string result;
+        for (size_t i = stack_.size() - count; i < stack_.size(); ++i) {
+            result += stack_[i].stringify();
+        }
+        stack_.erase(stack_.end() - count, stack_.end());
+
+        stack_.emplace_back(std::move(result));
+    }
+    DISPATCH();
+
+    CASE(ECHO) {
+        builtins::print({&stack_.back(), 1});
+        stack_.pop_back();
+    }
+    DISPATCH();
+
+    CASE(PANIC) { throw InterpretationException(chunk->constant(READ_U32()).str); }
+
+#ifndef ANKH_VM_COMPUTED_GOTO
+    }
+
+    ANKH_FATAL("unknown opcode {}", static_cast<int>(*(ip - 1)));
+#endif
+
+#undef FALLTHROUGH
+#undef CASE
+#undef DISPATCH
+#undef COMPARISON_OP
+#undef BINARY_OP
+#undef LOAD_FRAME
+#undef PEEK
+#undef MARKER
+#undef READ_U32
+#undef READ_U16
+#undef READ_U8
+}
+
+#pragma GCC diagnostic pop
+
+void ankh::lang::VM::load(const Natives &natives) {
+    const HeapScope heap(heap_);
+    for (const NativeDefinition &native : natives.definitions()) {
+        Global &global = globals_[globals_.resolve(native.name)];
+        if (global.defined) {
+            throw InterpretationException(std::format("'{}' is already defined", native.name));
+        }
+
+        natives_.push_back(make_callable<Native>(native.name, native.arity, native.fn));
+        global.value = ExprResult{natives_.back().get()};
+        global.defined = true;
+    }
+}
+
+void ankh::lang::VM::call_native(const Native *native, size_t argc, ExprResult *reassigned) {
+    // the arguments are passed in place on the stack, which the native can't touch
+    const std::span<ExprResult> args(stack_.data() + stack_.size() - argc, argc);
+    const BuiltinScope state(builtin_state_);
+
+    ExprResult result;
+    if (reassigned == nullptr) {
+        result = native->fn(args);
+    } else {
+        // the value is put back if the native fails and the assignment never happens
+        *reassigned = ExprResult();
+        try {
+            result = native->fn(args);
+        } catch (...) {
+            *reassigned = std::move(args.front());
+            throw;
+        }
+    }
+
+    stack_.erase(stack_.end() - argc - 1, stack_.end());
+    stack_.push_back(std::move(result));
+}
+
+ankh::lang::ExprResult &ankh::lang::VM::assigned(const std::uint8_t *ip, const CallFrame *frame) noexcept {
+    switch (static_cast<OpCode>(*ip)) {
+    case OpCode::SET_LOCAL:
+        return stack_[frame->base + read_u16(ip + 1)];
+    case OpCode::SET_UPVALUE:
+        return upvalue(frame->closure, read_u16(ip + 1));
+    case OpCode::SET_GLOBAL:
+        return globals_[read_u32(ip + 1)].value;
+    default:
+        ANKH_FATAL("CALL_REASSIGN followed by {} rather than an assignment", opcode_str(static_cast<OpCode>(*ip)));
+    }
+}
+
+ankh::lang::CallablePtr ankh::lang::VM::make_closure(const Prototype *prototype) {
+    return make_callable<Closure>(prototype);
+}
+
+ankh::lang::UpvaluePtr ankh::lang::VM::capture_upvalue(size_t slot) {
+    auto it = std::lower_bound(open_upvalues_.begin(), open_upvalues_.end(), slot,
+                               [](const UpvaluePtr &upvalue, size_t slot) { return upvalue->slot < slot; });
+    if (it != open_upvalues_.end() && (*it)->slot == slot) {
+        return *it;
+    }
+
+    return *open_upvalues_.insert(it, UpvaluePtr::make(slot));
+}
+
+void ankh::lang::VM::close_upvalues(size_t slot) noexcept {
+    while (!open_upvalues_.empty() && open_upvalues_.back()->slot >= slot) {
+        Upvalue &upvalue = *open_upvalues_.back();
+        upvalue.closed = stack_[upvalue.slot];
+        upvalue.open = false;
+
+        open_upvalues_.pop_back();
+    }
+}
+
+ankh::lang::ExprResult &ankh::lang::VM::upvalue(const Closure *closure, size_t index) noexcept {
+    Upvalue &upvalue = *closure->upvalues[index];
+
+    return upvalue.open ? stack_[upvalue.slot] : upvalue.closed;
+}
+
+void ankh::lang::VM::trace(Tracer &tracer) const {
+    trace_value(stack_, tracer);
+    trace_value(open_upvalues_, tracer);
+    trace_value(globals_, tracer);
+}
+
+void ankh::lang::VM::reset() noexcept {
+    // closures which escaped before the error must not refer to the stack anymore
+    close_upvalues(0);
+
+    stack_.clear();
+    frames_.clear();
+}
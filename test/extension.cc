@@ -0,0 +1,29 @@
+#include <string>
+#include <string_view>
+
+#include <ankh/lang/native.hpp>
+
+// The extension the tests load, see ANKH_TEST_EXTENSION
+
+static std::string repeat(std::string_view str, int times) {
+    std::string repeated;
+    for (int i = 0; i < times; ++i) {
+        repeated += str;
+    }
+
+    return repeated;
+}
+
+static ankh::lang::Array<ankh::lang::ExprResult> pair(const ankh::lang::ExprResult &first,
+                                                      const ankh::lang::ExprResult &second) {
+    ankh::lang::Array<ankh::lang::ExprResult> array;
+    array.append(first);
+    array.append(second);
+
+    return array;
+}
+
+ANKH_EXTENSION(natives) {
+    natives.define<"repeat", repeat>();
+    natives.define<"pair", pair>();
+}
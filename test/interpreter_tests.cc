@@ -1,15 +1,30 @@
 #include <catch2/catch_test_macros.hpp>
 
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <functional>
 #include <initializer_list>
 #include <memory>
+#include <span>
+#include <sstream>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
 #include <vector>
 
+#include <ankh/lang/builtins.hpp>
 #include <ankh/lang/expr.hpp>
+#include <ankh/lang/exceptions.hpp>
 #include <ankh/lang/interpreter.hpp>
+#include <ankh/lang/native.hpp>
 #include <ankh/lang/parser.hpp>
+#include <ankh/lang/profiler.hpp>
 #include <ankh/lang/program.hpp>
 #include <ankh/lang/statement.hpp>
+#include <ankh/lang/types/gc.hpp>
 
 #include <ankh/def.hpp>
 
@@ -153,6 +168,22 @@ TEST_CASE("primary expressions", "[interpreter]") {
         REQUIRE(actual_result.str == "the value is {} false");
     }
 
+    SECTION("strings, escaped quotes") {
+        const std::string source =
+            R"(
+            let word = "\"quoted\""
+            "{word} and {\"sub\" + \"stituted\"}"
+        )";
+
+        auto [program, results] = interpret(interpreter, source);
+
+        REQUIRE(!program.has_errors());
+
+        ankh::lang::ExprResult actual_result = results.back();
+        REQUIRE(actual_result.type == ankh::lang::ExprResultType::RT_STRING);
+        REQUIRE(actual_result.str == "\"quoted\" and substituted");
+    }
+
     SECTION("strings, substitution expression, multi") {
         const std::string source =
             R"(
@@ -168,6 +199,28 @@ TEST_CASE("primary expressions", "[interpreter]") {
         REQUIRE(actual_result.str == "the value is true is true");
     }
 
+    SECTION("strings, substitution expression, locals") {
+        const std::string source =
+            R"(
+            fn repeat(word, n) {
+                let line = ""
+                for let i = 0; i < n; i += 1 {
+                    line = "{line}{word}{i < n - 1},"
+                }
+                return line
+            }
+            repeat("ab", 3)
+        )";
+
+        auto [program, results] = interpret(interpreter, source);
+
+        REQUIRE(!program.has_errors());
+
+        ankh::lang::ExprResult actual_result = results.back();
+        REQUIRE(actual_result.type == ankh::lang::ExprResultType::RT_STRING);
+        REQUIRE(actual_result.str == "abtrue,abtrue,abfalse,");
+    }
+
     SECTION("lambda, rvalue") {
         const std::string source = R"(
             let function = fn (a, b) {
@@ -211,6 +264,50 @@ TEST_CASE("primary expressions", "[interpreter]") {
         REQUIRE(identifier.str == "jello\n");
     }
 
+    SECTION("command, quoting") {
+        const std::string source = R"(
+            let result = $(printf '%s|%s' "a  b" c\ d)
+        )";
+
+        auto [program, results] = interpret(interpreter, source);
+
+        REQUIRE(!program.has_errors());
+
+        ankh::lang::ExprResult identifier = results[0];
+        REQUIRE(identifier.type == ankh::lang::ExprResultType::RT_STRING);
+        REQUIRE(identifier.str == "a  b|c d");
+    }
+
+    SECTION("command, large output") {
+        const std::string source = R"(
+            let result = $(seq 1 100000)
+        )";
+
+        auto [program, results] = interpret(interpreter, source);
+
+        REQUIRE(!program.has_errors());
+
+        ankh::lang::ExprResult identifier = results[0];
+        REQUIRE(identifier.type == ankh::lang::ExprResultType::RT_STRING);
+        REQUIRE(identifier.str.size() == 588895);
+    }
+
+    SECTION("command, exit status") {
+        const std::unordered_map<std::string, ankh::lang::Number> src_to_expected_result = {
+            {"$(true)", 0}, {"$(false)", 1}, {"$(exit 3)", 3}, {"$(ankh-command-that-does-not-exist)", 127}};
+
+        for (const auto &[src, expected_result] : src_to_expected_result) {
+            INFO(src);
+            auto [program, results] = interpret(interpreter, src + "\nstatus()");
+
+            REQUIRE(!program.has_errors());
+
+            ankh::lang::ExprResult actual_result = results.back();
+            REQUIRE(actual_result.type == ankh::lang::ExprResultType::RT_NUMBER);
+            REQUIRE(actual_result.n == expected_result);
+        }
+    }
+
     SECTION("parenthetic expression") {
         const std::string source = R"(
             let result = ( 1 + 2 )
@@ -331,6 +428,154 @@ TEST_CASE("call expressions", "[interpreter]") {
         ankh::lang::ExprResult result = results.back();
         REQUIRE(result.type == ankh::lang::ExprResultType::RT_NIL);
     }
+
+    SECTION("lambda call, the environment it captures outlives the call creating it") {
+        const std::string source = R"(
+            fn counter(start) {
+                let count = start
+                return fn () {
+                    count += 1
+                    return count
+                }
+            }
+
+            fn add(a, b) {
+                let sum = a + b
+                return sum
+            }
+
+            let next = counter(10)
+            add(1, 2)
+            next()
+            add(3, 4)
+            next()
+        )";
+
+        auto [program, results] = interpret(interpreter, source);
+
+        REQUIRE(!program.has_errors());
+
+        ankh::lang::ExprResult result = results.back();
+        REQUIRE(result.type == ankh::lang::ExprResultType::RT_NUMBER);
+        REQUIRE(result.n == 12);
+    }
+
+    SECTION("lambda call, closures nested in one another share the variables they capture") {
+        const std::string source = R"(
+            fn account(balance) {
+                let deposit = fn (amount) {
+                    return fn () {
+                        balance += amount
+                        return balance
+                    }
+                }
+                let withdraw = fn (amount) {
+                    balance -= amount
+                    return balance
+                }
+                return [deposit(5), withdraw]
+            }
+
+            let ops = account(100)
+            let deposit = ops[0]
+            let withdraw = ops[1]
+            deposit()
+            withdraw(30)
+            deposit()
+        )";
+
+        auto [program, results] = interpret(interpreter, source);
+
+        REQUIRE(!program.has_errors());
+
+        ankh::lang::ExprResult result = results.back();
+        REQUIRE(result.type == ankh::lang::ExprResultType::RT_NUMBER);
+        REQUIRE(result.n == 80);
+    }
+
+    SECTION("lambda call, lambdas evaluated many times are only kept by the values referring to them") {
+        const std::string source = R"(
+            fn adder(n) {
+                return fn (x) { return x + n }
+            }
+
+            let total = 0
+            for let i = 0; i < 100; ++i {
+                let add = adder(i)
+                let twice = fn (x) { return add(add(x)) }
+                total += twice(1)
+            }
+            total
+        )";
+
+        const size_t functions = interpreter.functions().size();
+
+        auto [program, results] = interpret(interpreter, source);
+
+        REQUIRE(!program.has_errors());
+        REQUIRE(interpreter.functions().size() == functions + 1);
+
+        ankh::lang::ExprResult result = results.back();
+        REQUIRE(result.type == ankh::lang::ExprResultType::RT_NUMBER);
+        REQUIRE(result.n == 10000);
+    }
+
+    SECTION("lambda call, lambdas only referred to by the variables they capture are freed") {
+        // the results the tracing interpreter keeps would keep the lambdas alive
+        ankh::lang::Interpreter plain;
+
+        const std::string source = R"(
+            let total = 0
+            for let i = 0; i < 100; ++i {
+                let down = nil
+                down = fn (x) {
+                    if x == 0 {
+                        return 0
+                    }
+                    return 1 + down(x - 1)
+                }
+                total += down(i)
+            }
+        )";
+
+        const size_t objects = plain.heap().size();
+
+        ankh::lang::Program program = ankh::lang::parse(source);
+        REQUIRE(!program.has_errors());
+        plain.interpret(std::move(program));
+
+        REQUIRE(plain.heap().size() > objects);
+
+        plain.heap().collect();
+        REQUIRE(plain.heap().size() == objects);
+    }
+
+    SECTION("global call, the function called is the one the global refers to at the time of the call") {
+        const std::string source = R"(
+            let f = fn () { return 1 }
+            fn g() { return f() }
+
+            let sum = 0
+            for let i = 0; i < 3; ++i {
+                sum += g()
+                f = fn () { return 10 }
+            }
+        )";
+
+        auto [program, results] = interpret(interpreter, source);
+
+        REQUIRE(!program.has_errors());
+        REQUIRE(interpreter.environment().value("sum")->n == 21);
+
+        // the call site in g outlives the program declaring it
+        auto [reassigned, reassigned_results] = interpret(interpreter, R"(
+            f = fn () { return 100 }
+            g()
+        )");
+
+        REQUIRE(!reassigned.has_errors());
+        REQUIRE(reassigned_results.back().n == 100);
+    }
 }
 
 TEST_CASE("unary expressions", "[interpreter]") {
@@ -403,6 +648,26 @@ TEST_CASE("PEMDAS", "[interpreter]") {
         }
     }
 
+    SECTION("factors, folded constants") {
+        const std::string source = R"(
+            let result = 0
+            for let i = 0; i < 3; ++i {
+                result += 60 * 60 * 24
+            }
+
+            if false {
+                result = 1 / 0
+            }
+        )";
+
+        INFO(source);
+        auto [program, results] = interpret(interpreter, source);
+
+        REQUIRE(!program.has_errors());
+        REQUIRE(interpreter.environment().value("result").value().n == 259200);
+        REQUIRE_THROWS(interpret(interpreter, "result = 1 / 0"));
+    }
+
     SECTION("factors, non-numbers") {
         std::unordered_map<std::string, ankh::lang::ExprResult> src_to_expected_result = {{"true / 2", {}},
                                                                                           {"\"fwat\" / 2", {}}};
@@ -459,7 +724,7 @@ TEST_CASE("PEMDAS", "[interpreter]") {
             {"1 + 2 * 3", ankh::lang::Number{7}},
             {"24 / (3 * 4)", ankh::lang::Number{2}},
             {"8 + 2 * 3 / 2", ankh::lang::Number{11}},
-            {"(1 - (2 * 3)) * 2 * (21 / 7)", ankh::lang::Number{-24}}};
+            {"(1 - (2 * 3)) * 2 * (21 / 7)", ankh::lang::Number{-30}}};
 
         for (const auto &[src, expected_result] : src_to_expected_result) {
             auto [program, results] = interpret(interpreter, src);
@@ -468,7 +733,7 @@ TEST_CASE("PEMDAS", "[interpreter]") {
             ankh::lang::ExprResult actual_result = results.back();
 
             REQUIRE(actual_result.type == expected_result.type);
-            REQUIRE(actual_result.str == expected_result.str);
+            REQUIRE(actual_result.n == expected_result.n);
         }
     }
 
@@ -556,7 +821,7 @@ TEST_CASE("boolean", "[interpreter]") {
         }
     }
 
-    SECTION("and, strict evaluation") {
+    SECTION("and, short circuit") {
         const std::string source = R"(
             let count = 0
 
@@ -603,7 +868,7 @@ TEST_CASE("boolean", "[interpreter]") {
         }
     }
 
-    SECTION("or, strict evaluation") {
+    SECTION("or, short circuit") {
         const std::string source = R"(
             let count = 0
 
@@ -621,7 +886,26 @@ TEST_CASE("boolean", "[interpreter]") {
         auto [program, results] = interpret(interpreter, source);
 
         REQUIRE(!program.has_errors());
-        REQUIRE(interpreter.environment().value("count").value().n == 2);
+        REQUIRE(interpreter.environment().value("count").value().n == 1);
+    }
+
+    SECTION("short circuit, guard") {
+        std::unordered_map<std::string, bool> src_to_expected_result = {
+            {"let xs = [1]; let i = 1; i < len(xs) && xs[i] == 1", false},
+            {"let ys = [1]; let j = 1; j >= len(ys) || ys[j] == 1", true},
+            {"false && 1", false},
+            {"true || 1", true}};
+
+        for (const auto &[src, expected_result] : src_to_expected_result) {
+            INFO(src);
+            auto [program, results] = interpret(interpreter, src);
+
+            REQUIRE(!program.has_errors());
+            ankh::lang::ExprResult actual_result = results.back();
+
+            REQUIRE(actual_result.type == ankh::lang::ExprResultType::RT_BOOL);
+            REQUIRE(actual_result.b == expected_result);
+        }
     }
 }
 
@@ -754,6 +1038,15 @@ TEST_CASE("increment/decrement statements", "[interpreter]") {
     }
 }
 
+// appends every argument after the first to it, taking more arguments than fit on the stack
+static ankh::lang::ExprResult append_all(std::span<ankh::lang::ExprResult> args) {
+    for (size_t i = 1; i < args.size(); ++i) {
+        args[0].array.append(std::move(args[i]));
+    }
+
+    return std::move(args[0]);
+}
+
 TEST_CASE("arrays", "[interpreter]") {
     TracingInterpreter interpreter(std::make_unique<ankh::lang::Interpreter>());
 
@@ -801,6 +1094,74 @@ TEST_CASE("arrays", "[interpreter]") {
 
         REQUIRE_THROWS(interpret(interpreter, source));
     }
+
+    SECTION("arrays are values, appending to one leaves its copies as they were") {
+        const std::string source = R"(
+            let a = [1, 2]
+            let b = a
+            b = append(b, 3)
+            let c = append(a, 4)
+
+            fn collect(n) {
+                let xs = []
+                let ys = xs
+                let add = fn (x) { xs = append(xs, x) }
+                for let i = 0; i < n; ++i {
+                    add(i)
+                    ys = append(ys, i * 2)
+                }
+                return xs[n - 1] + ys[n - 1] + len(ys)
+            }
+
+            len(a) * 100 + len(b) * 10 + len(c) + collect(3) * 1000
+        )";
+
+        INFO(source);
+
+        auto [program, results] = interpret(interpreter, source);
+        REQUIRE(!program.has_errors());
+
+        ankh::lang::ExprResult actual_result = results.back();
+        REQUIRE(actual_result.type == ankh::lang::ExprResultType::RT_NUMBER);
+        REQUIRE(actual_result.n == 9233);
+    }
+
+    SECTION("a failed append leaves the variable as it was") {
+        REQUIRE_THROWS(interpret(interpreter, "let a = 1\na = append(a, 2)"));
+
+        auto [program, results] = interpret(interpreter, "a + 1");
+        REQUIRE(!program.has_errors());
+        REQUIRE(results.back().n == 2);
+    }
+
+    SECTION("builtins take their arguments as a span") {
+        std::array<ankh::lang::ExprResult, 2> args = {ankh::lang::Array<ankh::lang::ExprResult>{},
+                                                      ankh::lang::ExprResult{ankh::lang::Number{1}}};
+        args[0] = ankh::lang::builtins::append(args);
+        REQUIRE(args[0].array.size() == 1);
+        REQUIRE(ankh::lang::builtins::length(std::span(args.data(), 1)).n == 1);
+
+        ankh::lang::Natives natives;
+        natives.define("append_all", 6, append_all);
+        interpreter.load(natives);
+
+        // both reassign the variable they're given, with their arguments on the stack and on the heap
+        const std::string source = R"(
+            let xs = []
+            for let i = 0; i < 3; ++i {
+                xs = append(xs, i)
+                xs = append_all(xs, i, i, i, i, i)
+            }
+            len(xs)
+        )";
+
+        INFO(source);
+
+        auto [program, results] = interpret(interpreter, source);
+        REQUIRE(!program.has_errors());
+        REQUIRE(results.back().n == 18);
+        REQUIRE(interpreter.environment().value("xs")->array[17].n == 2);
+    }
 }
 
 TEST_CASE("assignments", "[interpreter]") {
@@ -905,6 +1266,33 @@ TEST_CASE("dicts", "[interpreter]") {
         REQUIRE(actual_result.str == "g");
     }
 
+    SECTION("dict declaration, insertion order") {
+        std::string source = "let a = {";
+        for (int i = 0; i < 100; ++i) {
+            source += std::format("k{}: {},", i, i);
+        }
+        // a repeated key keeps its first value
+        source += "k0: 100 }";
+
+        INFO(source);
+
+        auto [program, results] = interpret(interpreter, source);
+        REQUIRE(!program.has_errors());
+
+        ankh::lang::ExprResult actual_result = results.back();
+        REQUIRE(actual_result.type == ankh::lang::ExprResultType::RT_DICT);
+        REQUIRE(actual_result.dict.size() == 100);
+
+        int i = 0;
+        for (const auto &[key, value] : actual_result.dict) {
+            REQUIRE(key.str.value() == std::format("k{}", i));
+            REQUIRE(value.n == i);
+            REQUIRE(actual_result.dict.value(key.str.value())->value.n == i);
+            ++i;
+        }
+        REQUIRE(!actual_result.dict.value(std::string{"k100"}).has_value());
+    }
+
     SECTION("dict lookup, non-string") {
         const std::string source = R"(
             let a = {
@@ -1235,3 +1623,414 @@ TEST_CASE("test slices, out of bounds", "[interpreter]") {
 
     REQUIRE_THROWS(interpret(interpreter, R"([1,2,3][:99])"));
 }
+
+TEST_CASE("locals are read and written through their slots", "[interpreter]") {
+    const std::string source = R"(
+        let result = 0
+        fn outer(a) {
+            let b = a + 1
+            fn inner(c) {
+                b += c
+                return a + b
+            }
+            return inner(10)
+        }
+        {
+            let result = 100
+            result = outer(1)
+        }
+        for let i = 0; i < 3; ++i {
+            let i2 = i * 2
+            result = result + i2
+        }
+    )";
+
+    INFO(source);
+
+    TracingInterpreter interpreter(std::make_unique<ankh::lang::Interpreter>());
+
+    auto [program, results] = interpret(interpreter, source);
+    REQUIRE(!program.has_errors());
+
+    REQUIRE(interpreter.environment().value("result")->n == 6);
+    REQUIRE(!interpreter.environment().value("i"));
+}
+
+TEST_CASE("nested functions see the whole scope they're declared in", "[interpreter]") {
+    TracingInterpreter interpreter(std::make_unique<ankh::lang::Interpreter>());
+
+    SECTION("functions calling one another whichever is declared first") {
+        const std::string source = R"(
+            fn check(n) {
+                fn is_even(n) {
+                    if n == 0 {
+                        return true
+                    }
+                    return is_odd(n - 1)
+                }
+                fn is_odd(n) {
+                    if n == 0 {
+                        return false
+                    }
+                    return is_even(n - 1)
+                }
+                return is_even(n)
+            }
+            # the second call declares the nested functions again
+            let result = check(10) == !check(7)
+        )";
+
+        INFO(source);
+
+        auto [program, results] = interpret(interpreter, source);
+        REQUIRE(!program.has_errors());
+        REQUIRE(interpreter.environment().value("result")->b);
+    }
+
+    SECTION("functions reading variables declared after them") {
+        const std::string source = R"(
+            fn outer() {
+                let x = 1
+                {
+                    let before = x
+                    fn get() { return x + before }
+                    let x = 41
+                    return get()
+                }
+            }
+            let result = outer()
+        )";
+
+        INFO(source);
+
+        auto [program, results] = interpret(interpreter, source);
+        REQUIRE(!program.has_errors());
+        REQUIRE(interpreter.environment().value("result")->n == 42);
+    }
+}
+
+TEST_CASE("substitution expressions can read locals", "[interpreter]") {
+    const std::string source = R"(
+        fn greet(name) {
+            let greeting = "hello"
+            return "{greeting}, {name}"
+        }
+        greet("ankh")
+    )";
+
+    INFO(source);
+
+    TracingInterpreter interpreter(std::make_unique<ankh::lang::Interpreter>());
+
+    auto [program, results] = interpret(interpreter, source);
+    REQUIRE(!program.has_errors());
+
+    REQUIRE(results.back().type == ankh::lang::ExprResultType::RT_STRING);
+    REQUIRE(results.back().str == "hello, ankh");
+}
+
+TEST_CASE("return and break complete their enclosing call and loop", "[interpreter]") {
+    const std::string source = R"(
+        fn find(xs, x) {
+            for let i = 0; i < len(xs); ++i {
+                while true {
+                    if xs[i] == x {
+                        return i
+                    }
+                    break
+                }
+            }
+            return -1
+        }
+
+        let result = 0
+        while true {
+            {
+                result = find([3, 5, 7], 7) * 10 + find([3], 4)
+                break
+            }
+            result = 100
+        }
+    )";
+
+    INFO(source);
+
+    TracingInterpreter interpreter(std::make_unique<ankh::lang::Interpreter>());
+
+    auto [program, results] = interpret(interpreter, source);
+
+    REQUIRE(interpreter.environment().value("result")->n == 19);
+}
+
+TEST_CASE("the profiler samples the functions being called", "[interpreter]") {
+    const std::string source = R"(
+        fn work(n) {
+            let total = 0
+            for let i = 0; i < n; ++i {
+                total += i
+            }
+            return total
+        }
+
+        work(20000)
+    )";
+
+    ankh::lang::Interpreter interpreter;
+    ankh::lang::Profiler profiler(std::chrono::microseconds(100));
+    REQUIRE(profiler.start());
+    interpreter.profile(&profiler);
+
+    // samples are only taken as often as the kernel's clock ticks
+    for (int i = 0; i < 1000 && !profiler.functions().contains("work"); ++i) {
+        ankh::lang::Program program = ankh::lang::parse(source);
+        REQUIRE(!program.has_errors());
+        interpreter.interpret(std::move(program));
+    }
+
+    profiler.stop();
+    interpreter.profile(nullptr);
+
+    REQUIRE(profiler.functions().contains("work"));
+    REQUIRE(profiler.functions().at("<script>").total == profiler.total());
+
+    std::ostringstream folded;
+    profiler.write_folded(folded);
+    REQUIRE(folded.str().find("<script>;work (10:13) ") != std::string::npos);
+}
+
+static std::string greet(std::string_view name, bool loudly) {
+    return "hello, " + std::string{name} + (loudly ? "!" : ".");
+}
+
+static std::uint8_t inverted(std::uint8_t byte) { return static_cast<std::uint8_t>(~byte); }
+
+TEST_CASE("natives defined by the host and by extensions are called like builtins", "[interpreter]") {
+    TracingInterpreter interpreter(std::make_unique<ankh::lang::Interpreter>());
+
+    SECTION("typed natives") {
+        ankh::lang::Natives natives;
+        natives.define<"greet", greet>();
+        interpreter.load(natives);
+
+        auto [program, results] = interpret(interpreter, R"(greet("ankh", true))");
+
+        REQUIRE(!program.has_errors());
+        REQUIRE(results.back().str == "hello, ankh!");
+
+        try {
+            interpret(interpreter, R"(greet("ankh", 1))");
+            FAIL("the argument of the wrong type was converted");
+        } catch (const ankh::lang::InterpretationException &e) {
+            REQUIRE(std::string{e.what()}.find("greet, argument 2 must be a boolean") != std::string::npos);
+        }
+
+        ankh::lang::Natives bytes_natives;
+        bytes_natives.define<"inverted", inverted>();
+        interpreter.load(bytes_natives);
+
+        auto [bytes, inverted_results] = interpret(interpreter, R"(inverted(0) + inverted(255))");
+
+        REQUIRE(!bytes.has_errors());
+        REQUIRE(inverted_results.back().n == 255);
+
+        // integers the parameter can't hold aren't converted to it, nor are infinity (too many digits to be a double)
+        // and not a number (infinity less itself)
+        const std::string infinity = "1" + std::string(400, '0');
+        for (const std::string &source : {std::string{"inverted(256)"}, std::string{"inverted(-1)"},
+                                          "inverted(" + infinity + ")",
+                                          "inverted(" + infinity + " - " + infinity + ")"}) {
+            INFO(source);
+
+            try {
+                interpret(interpreter, source);
+                FAIL("the argument out of range was converted");
+            } catch (const ankh::lang::InterpretationException &e) {
+                REQUIRE(std::string{e.what()}.find("inverted, argument 1 must be an integer") != std::string::npos);
+            }
+        }
+
+        // natives can't replace one another or the builtins
+        REQUIRE_THROWS_AS(interpreter.load(natives), ankh::lang::InterpretationException);
+    }
+
+    SECTION("extensions") {
+        ankh::lang::Natives natives;
+        ankh::lang::load_extension(ANKH_TEST_EXTENSION, natives);
+        interpreter.load(natives);
+
+        const std::string source = R"(
+            let repeated = repeat("ab", 3)
+            let pairs = 0
+            for let i = 0; i < 100; ++i {
+                pairs += len(pair(i, repeated))
+            }
+        )";
+
+        // the arrays the extension creates live in the heap of the interpreter calling it
+        const size_t objects = interpreter.heap().size();
+
+        auto [program, results] = interpret(interpreter, source);
+
+        REQUIRE(!program.has_errors());
+        REQUIRE(interpreter.environment().value("repeated")->str == "ababab");
+        REQUIRE(interpreter.environment().value("pairs")->n == 200);
+
+        // the tracing interpreter holds on to every array it evaluated
+        REQUIRE(interpreter.heap().size() == objects + 100);
+
+        ankh::lang::Natives missing;
+        REQUIRE_THROWS_AS(ankh::lang::load_extension("no-such-extension.so", missing),
+                          ankh::lang::ExtensionException);
+    }
+}
+
+TEST_CASE("prepared programs are run many times against reset interpreters", "[interpreter]") {
+    const ankh::lang::PreparedProgram program = ankh::lang::prepare(R"(
+        fn discount(total) {
+            if total > 100 {
+                return total / 10
+            }
+            return 0
+        }
+
+        let price = total - discount(total)
+    )");
+    REQUIRE(!program->has_errors());
+
+    ankh::lang::Interpreter interpreter;
+    for (const auto &[total, price] : std::initializer_list<std::pair<double, double>>{{50, 50}, {200, 180}}) {
+        INFO(total);
+
+        interpreter.reset();
+        interpreter.set_global("total", total);
+        interpreter.run(program);
+
+        REQUIRE(interpreter.global("price")->n == price);
+        // the program is held on to until the next reset rather than once per run
+        REQUIRE(program.use_count() == 2);
+    }
+
+    interpreter.reset();
+    REQUIRE(program.use_count() == 1);
+    REQUIRE(!interpreter.global("price").has_value());
+    REQUIRE(interpreter.global("len").has_value());
+
+    // the caches of the call sites belong to whichever interpreter runs the program
+    ankh::lang::Interpreter other;
+    other.set_global("total", 1000.0);
+    other.run(program);
+    REQUIRE(other.global("price")->n == 900);
+
+    interpreter.set_global("total", 300.0);
+    interpreter.run(program);
+    REQUIRE(interpreter.global("price")->n == 270);
+
+    REQUIRE_THROWS_AS(interpreter.run(ankh::lang::prepare("let = 1")), ankh::lang::InterpretationException);
+}
+
+TEST_CASE("calls evaluated outside of a run skip the call site caches", "[interpreter]") {
+    const ankh::lang::Program program = ankh::lang::parse(R"(
+        fn twice(n) { return 2 * n }
+        let x = twice(4)
+        twice(twice(5))
+    )");
+    REQUIRE(!program.has_errors());
+    REQUIRE(program.size() == 3);
+
+    ankh::lang::Interpreter interpreter;
+    interpreter.execute(program[0]);
+    interpreter.execute(program[1]);
+    REQUIRE(interpreter.global("x")->n == 8);
+
+    auto stmt = ankh::lang::instance<ankh::lang::ExpressionStatement>(program[2]);
+    REQUIRE(stmt != nullptr);
+    REQUIRE(interpreter.evaluate(stmt->expr).n == 20);
+    REQUIRE(interpreter.evaluate(stmt->expr).n == 20);
+}
+
+TEST_CASE("the exit status of commands belongs to the interpreter running them", "[interpreter]") {
+    const ankh::lang::PreparedProgram status = ankh::lang::prepare("let result = status()");
+    REQUIRE(!status->has_errors());
+
+    ankh::lang::Interpreter failing;
+    failing.interpret(ankh::lang::parse("$(exit 3)"));
+    ankh::lang::Interpreter succeeding;
+    succeeding.interpret(ankh::lang::parse("$(true)"));
+
+    failing.run(status);
+    REQUIRE(failing.global("result")->n == 3);
+    succeeding.run(status);
+    REQUIRE(succeeding.global("result")->n == 0);
+
+    failing.reset();
+    failing.run(status);
+    REQUIRE(failing.global("result")->n == 0);
+}
+
+TEST_CASE("interpreters running the same prepared program on threads of their own", "[interpreter]") {
+    // every round leaves behind lambdas which capture themselves, for the heap of each interpreter to collect
+    const ankh::lang::PreparedProgram program = ankh::lang::prepare(R"(
+        result = 0
+        i = 0
+        while i < 50 {
+            let again = nil
+            again = fn (n) {
+                if n < 0 {
+                    return again(0)
+                }
+                return score(n)
+            }
+            result += again(i)
+            i += 1
+        }
+    )");
+    REQUIRE(!program->has_errors());
+
+    // the callee is declared by another program for each interpreter, so the calls run with the caches of both
+    ankh::lang::Interpreter doubling;
+    doubling.set_global("result", 0.0);
+    doubling.set_global("i", 0.0);
+    doubling.interpret(ankh::lang::parse("fn score(n) { return twice(n) }\nfn twice(n) { return 2 * n }"));
+    ankh::lang::Interpreter squaring;
+    squaring.set_global("result", 0.0);
+    squaring.set_global("i", 0.0);
+    squaring.interpret(ankh::lang::parse("fn score(n) { return square(n) }\nfn square(n) { return n * n }"));
+
+    struct Rounds {
+        std::vector<double> results;
+        // the objects left in the heap once the garbage of the first round and of the last one is collected
+        size_t first_objects = 0;
+        size_t last_objects = 0;
+    };
+
+    const auto run = [&program](ankh::lang::Interpreter &interpreter, Rounds &rounds) {
+        for (int round = 0; round < 20; ++round) {
+            interpreter.run(program);
+            rounds.results.push_back(interpreter.global("result")->n);
+
+            interpreter.heap().collect();
+            (round == 0 ? rounds.first_objects : rounds.last_objects) = interpreter.heap().size();
+        }
+    };
+
+    // assertions aren't made on the threads since they aren't thread safe
+    Rounds doubled;
+    Rounds squared;
+    std::thread doubling_thread(run, std::ref(doubling), std::ref(doubled));
+    std::thread squaring_thread(run, std::ref(squaring), std::ref(squared));
+    doubling_thread.join();
+    squaring_thread.join();
+
+    REQUIRE(doubled.results == std::vector<double>(20, 2450));
+    REQUIRE(squared.results == std::vector<double>(20, 40425));
+    REQUIRE(doubled.last_objects == doubled.first_objects);
+    REQUIRE(squared.last_objects == squared.first_objects);
+
+    // running the program left it as it was for an interpreter that never ran it
+    ankh::lang::Interpreter fresh;
+    fresh.set_global("result", 0.0);
+    fresh.set_global("i", 0.0);
+    fresh.interpret(ankh::lang::parse("fn score(n) { return n }"));
+    fresh.run(program);
+    REQUIRE(fresh.global("result")->n == 1225);
+}
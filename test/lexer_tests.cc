@@ -1,6 +1,9 @@
 #include <catch2/catch_test_macros.hpp>
 
+#include <algorithm>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include <ankh/lang/exceptions.hpp>
@@ -170,7 +173,8 @@ TEST_CASE("scan string tokens, backslash double quote", "[lexer]") {
 
     auto tokens = ankh::lang::scan(source);
 
-    REQUIRE(tokens[0] == ankh::lang::Token{"this string \" has a double quote", ankh::lang::TokenType::STRING, 2, 10});
+    // the escape is left for the parser to process
+    REQUIRE(tokens[0] == ankh::lang::Token{"this string \\\" has a double quote", ankh::lang::TokenType::STRING, 2, 9});
 }
 
 TEST_CASE("scan string tokens, backslash metacharacter", "[lexer]") {
@@ -181,7 +185,7 @@ TEST_CASE("scan string tokens, backslash metacharacter", "[lexer]") {
 
     auto tokens = ankh::lang::scan(source);
 
-    REQUIRE(tokens[0] == ankh::lang::Token{"this string \\b has a bell", ankh::lang::TokenType::STRING, 2, 10});
+    REQUIRE(tokens[0] == ankh::lang::Token{"this string \\b has a bell", ankh::lang::TokenType::STRING, 2, 9});
 }
 
 TEST_CASE("scan number tokens", "[lexer]") {
@@ -294,3 +298,36 @@ TEST_CASE("scan command operator missing terminal (", "[lexer]") {
 
     REQUIRE_THROWS_AS(ankh::lang::scan(source), ankh::lang::ScanException);
 }
+
+// Scripts mapped into memory are scanned where they are, with nothing after their last byte
+static std::vector<ankh::lang::Token> scan_unterminated(std::string_view text, std::unique_ptr<char[]> &buffer) {
+    buffer = std::make_unique<char[]>(text.size());
+    std::copy(text.begin(), text.end(), buffer.get());
+
+    return ankh::lang::scan(std::string_view{buffer.get(), text.size()});
+}
+
+TEST_CASE("scan sources which end without a terminator", "[lexer]") {
+    std::unique_ptr<char[]> buffer;
+
+    auto tokens = scan_unterminated("let x = 12.5", buffer);
+    REQUIRE(tokens.size() == 5);
+    REQUIRE(tokens[3] == ankh::lang::Token{"12.5", ankh::lang::TokenType::NUMBER, 1, 9});
+    REQUIRE(tokens[4].type == ankh::lang::TokenType::ANKH_EOF);
+    // the tokens are views into the source rather than copies of it
+    REQUIRE(tokens[3].str.data() == buffer.get() + 8);
+
+    tokens = scan_unterminated("x += y", buffer);
+    REQUIRE(tokens.size() == 4);
+    REQUIRE(tokens[2] == ankh::lang::Token{"y", ankh::lang::TokenType::IDENTIFIER, 1, 6});
+
+    tokens = scan_unterminated("a >", buffer);
+    REQUIRE(tokens.size() == 3);
+    REQUIRE(tokens[1] == ankh::lang::Token{">", ankh::lang::TokenType::GT, 1, 3});
+
+    tokens = scan_unterminated("# a comment up to the end", buffer);
+    REQUIRE(tokens.size() == 1);
+
+    REQUIRE_THROWS_AS(scan_unterminated("\"never closed", buffer), ankh::lang::ScanException);
+    REQUIRE_THROWS_AS(scan_unterminated("$(echo", buffer), ankh::lang::ScanException);
+}
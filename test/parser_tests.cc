@@ -1,21 +1,47 @@
 #include <catch2/catch_test_macros.hpp>
 
+#include <filesystem>
+#include <format>
+#include <fstream>
 #include <initializer_list>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
+#include <ankh/lang/cache.hpp>
 #include <ankh/lang/exceptions.hpp>
 #include <ankh/lang/expr.hpp>
 #include <ankh/lang/lambda.hpp>
 #include <ankh/lang/parser.hpp>
+#include <ankh/lang/static_analyzer.hpp>
 #include <ankh/lang/statement.hpp>
 #include <ankh/lang/token.hpp>
 
+#include <ankh/sys/linux.hpp>
+
+// ankh::lang::parse() would fold away most of the constant expressions used here so these tests skip the optimizer
+static ankh::lang::Program parse(const std::string &source) {
+    ankh::lang::Arena arena;
+    const std::string_view text = arena.copy(source);
+
+    ankh::lang::Parser parser(text, std::move(arena));
+
+    ankh::lang::Program program = parser.parse();
+
+    ankh::lang::StaticAnalyzer analyzer;
+    try {
+        analyzer.resolve(program);
+    } catch (const ankh::lang::ParseException &e) {
+        program.errors.push_back(e.what());
+    }
+
+    return program;
+}
+
 static void test_binary_expression_parse(const std::string &op) noexcept {
     const std::string source("1" + op + "2" + "\n");
 
-    auto program = ankh::lang::parse(source);
+    auto program = parse(source);
     REQUIRE(program.size() == 1);
 
     auto stmt = ankh::lang::instance<ankh::lang::ExpressionStatement>(program[0]);
@@ -31,22 +57,22 @@ static void test_binary_expression_parse(const std::string &op) noexcept {
 static void test_boolean_binary_expression(const std::string &op) noexcept {
     const std::string source("true" + op + "false" + "\n");
 
-    auto program = ankh::lang::parse(source);
+    auto program = parse(source);
     REQUIRE(program.size() == 1);
 
     auto stmt = ankh::lang::instance<ankh::lang::ExpressionStatement>(program[0]);
     REQUIRE(stmt != nullptr);
 
-    auto binary = ankh::lang::instance<ankh::lang::BinaryExpression>(stmt->expr);
-    REQUIRE(binary != nullptr);
-    REQUIRE(binary->left != nullptr);
-    REQUIRE(binary->right != nullptr);
+    auto logical = ankh::lang::instance<ankh::lang::LogicalExpression>(stmt->expr);
+    REQUIRE(logical != nullptr);
+    REQUIRE(logical->left != nullptr);
+    REQUIRE(logical->right != nullptr);
 }
 
 static void test_unary_expression(const std::string &op) noexcept {
     const std::string source(op + "3" + "\n");
 
-    auto program = ankh::lang::parse(source);
+    auto program = parse(source);
 
     REQUIRE(program.size() == 1);
 
@@ -66,7 +92,7 @@ TEST_CASE("parse language statements", "[parser]") {
             1 + 2
         )";
 
-        auto program = ankh::lang::parse(source);
+        auto program = parse(source);
 
         REQUIRE(program.size() == 1);
 
@@ -83,7 +109,7 @@ TEST_CASE("parse language statements", "[parser]") {
             let i = 1
         )";
 
-        auto program = ankh::lang::parse(source);
+        auto program = parse(source);
 
         REQUIRE(program.size() == 1);
 
@@ -105,7 +131,7 @@ TEST_CASE("parse language statements", "[parser]") {
             i = 3
         )";
 
-        auto program = ankh::lang::parse(source);
+        auto program = parse(source);
 
         REQUIRE(program.size() == 2);
 
@@ -128,7 +154,7 @@ TEST_CASE("parse language statements", "[parser]") {
         for (const auto &source : sources) {
             INFO(source);
 
-            auto program = ankh::lang::parse(source);
+            auto program = parse(source);
             REQUIRE(!program.has_errors());
             REQUIRE(program.size() == 1);
 
@@ -151,7 +177,7 @@ TEST_CASE("parse language statements", "[parser]") {
             ++i
         )";
 
-        auto program = ankh::lang::parse(source);
+        auto program = parse(source);
 
         REQUIRE(program.size() == 1);
         REQUIRE(!program.has_errors());
@@ -169,7 +195,7 @@ TEST_CASE("parse language statements", "[parser]") {
             ++"foo"
         )";
 
-        auto program = ankh::lang::parse(source);
+        auto program = parse(source);
         REQUIRE(program.has_errors());
     }
 
@@ -179,7 +205,7 @@ TEST_CASE("parse language statements", "[parser]") {
             --i
         )";
 
-        auto program = ankh::lang::parse(source);
+        auto program = parse(source);
 
         REQUIRE(program.size() == 1);
         REQUIRE(!program.has_errors());
@@ -197,7 +223,7 @@ TEST_CASE("parse language statements", "[parser]") {
             --"foo"
         )";
 
-        auto program = ankh::lang::parse(source);
+        auto program = parse(source);
         REQUIRE(program.has_errors());
     }
 
@@ -210,7 +236,7 @@ TEST_CASE("parse language statements", "[parser]") {
             }
         )";
 
-        auto program = ankh::lang::parse(source);
+        auto program = parse(source);
 
         REQUIRE(program.size() == 1);
 
@@ -227,7 +253,7 @@ TEST_CASE("parse language statements", "[parser]") {
             }
         )";
 
-        auto program = ankh::lang::parse(source);
+        auto program = parse(source);
 
         REQUIRE(program.size() == 1);
 
@@ -248,7 +274,7 @@ TEST_CASE("parse language statements", "[parser]") {
             }
         )";
 
-        auto program = ankh::lang::parse(source);
+        auto program = parse(source);
 
         REQUIRE(program.size() == 1);
 
@@ -270,7 +296,7 @@ TEST_CASE("parse language statements", "[parser]") {
             }
         )";
 
-        auto program = ankh::lang::parse(source);
+        auto program = parse(source);
 
         REQUIRE(program.size() == 1);
 
@@ -292,7 +318,7 @@ TEST_CASE("parse language statements", "[parser]") {
             }
         )";
 
-        auto program = ankh::lang::parse(source);
+        auto program = parse(source);
 
         REQUIRE(program.size() == 2);
 
@@ -314,7 +340,7 @@ TEST_CASE("parse language statements", "[parser]") {
             }
         )";
 
-        auto program = ankh::lang::parse(source);
+        auto program = parse(source);
 
         REQUIRE(program.size() == 1);
 
@@ -342,7 +368,7 @@ TEST_CASE("for statements", "[parser]") {
             }
         )";
 
-        auto program = ankh::lang::parse(source);
+        auto program = parse(source);
         REQUIRE(!program.has_errors());
 
         auto for_stmt = ankh::lang::instance<ankh::lang::ForStatement>(program[0]);
@@ -359,7 +385,7 @@ TEST_CASE("for statements", "[parser]") {
             }
         )";
 
-        auto program = ankh::lang::parse(source);
+        auto program = parse(source);
         REQUIRE(!program.has_errors());
 
         auto for_stmt = ankh::lang::instance<ankh::lang::ForStatement>(program[0]);
@@ -375,7 +401,7 @@ TEST_CASE("for statements", "[parser]") {
             }
         )";
 
-        auto program = ankh::lang::parse(source);
+        auto program = parse(source);
         REQUIRE(!program.has_errors());
 
         auto for_stmt = ankh::lang::instance<ankh::lang::ForStatement>(program[0]);
@@ -391,7 +417,7 @@ TEST_CASE("for statements", "[parser]") {
             }
         )";
 
-        auto program = ankh::lang::parse(source);
+        auto program = parse(source);
         REQUIRE(!program.has_errors());
 
         auto for_stmt = ankh::lang::instance<ankh::lang::ForStatement>(program[0]);
@@ -407,7 +433,7 @@ TEST_CASE("for statements", "[parser]") {
             }
         )";
 
-        auto program = ankh::lang::parse(source);
+        auto program = parse(source);
         REQUIRE(!program.has_errors());
 
         auto for_stmt = ankh::lang::instance<ankh::lang::ForStatement>(program[0]);
@@ -428,7 +454,7 @@ TEST_CASE("parse language expressions", "[parser]") {
             nil
         )";
 
-        auto program = ankh::lang::parse(source);
+        auto program = parse(source);
 
         REQUIRE(program.size() == 4);
 
@@ -445,7 +471,7 @@ TEST_CASE("parse language expressions", "[parser]") {
             ( "an expression" )
         )";
 
-        auto program = ankh::lang::parse(source);
+        auto program = parse(source);
 
         REQUIRE(program.size() == 1);
 
@@ -461,7 +487,7 @@ TEST_CASE("parse language expressions", "[parser]") {
             a
         )";
 
-        auto program = ankh::lang::parse(source);
+        auto program = parse(source);
 
         REQUIRE(program.size() == 1);
 
@@ -471,13 +497,50 @@ TEST_CASE("parse language expressions", "[parser]") {
         REQUIRE(ankh::lang:: instanceof <ankh::lang::IdentifierExpression>(stmt->expr));
     }
 
+    SECTION("parse string substitutions") {
+        const std::string source =
+            R"(
+            "i={i} \{total\}={ i + 1 }"
+        )";
+
+        auto program = parse(source);
+
+        REQUIRE(!program.has_errors());
+        REQUIRE(program.size() == 1);
+
+        auto stmt = ankh::lang::instance<ankh::lang::ExpressionStatement>(program[0]);
+        REQUIRE(stmt != nullptr);
+
+        auto str = ankh::lang::instance<ankh::lang::StringExpression>(stmt->expr);
+        REQUIRE(str != nullptr);
+        REQUIRE(!str->error.has_value());
+        REQUIRE(str->literals == std::vector<std::string>{"i=", " {total}=", ""});
+        REQUIRE(str->substitutions.size() == 2);
+        REQUIRE(ankh::lang:: instanceof <ankh::lang::IdentifierExpression>(str->substitutions[0]));
+        REQUIRE(ankh::lang:: instanceof <ankh::lang::BinaryExpression>(str->substitutions[1]));
+    }
+
+    SECTION("parse malformed string substitution") {
+        auto program = parse(R"("the value is {a")");
+
+        // the error is only reported if the string is evaluated
+        REQUIRE(!program.has_errors());
+
+        auto stmt = ankh::lang::instance<ankh::lang::ExpressionStatement>(program[0]);
+        REQUIRE(stmt != nullptr);
+
+        auto str = ankh::lang::instance<ankh::lang::StringExpression>(stmt->expr);
+        REQUIRE(str != nullptr);
+        REQUIRE(str->error.has_value());
+    }
+
     SECTION("parse function call, no args") {
         const std::string source =
             R"(
             a()
         )";
 
-        auto program = ankh::lang::parse(source);
+        auto program = parse(source);
         REQUIRE(program.size() == 1);
 
         auto stmt = ankh::lang::instance<ankh::lang::ExpressionStatement>(program[0]);
@@ -499,7 +562,7 @@ TEST_CASE("parse language expressions", "[parser]") {
             a(1, 2)
         )";
 
-        auto program = ankh::lang::parse(source);
+        auto program = parse(source);
 
         REQUIRE(program.size() == 1);
 
@@ -522,7 +585,7 @@ TEST_CASE("parse language expressions", "[parser]") {
             a(1, 2)()
         )";
 
-        auto program = ankh::lang::parse(source);
+        auto program = parse(source);
 
         REQUIRE(program.size() == 1);
 
@@ -550,7 +613,7 @@ TEST_CASE("parse language expressions", "[parser]") {
             }
         )";
 
-        auto program = ankh::lang::parse(source);
+        auto program = parse(source);
 
         REQUIRE(program.size() == 1);
 
@@ -603,7 +666,7 @@ TEST_CASE("parse language expressions", "[parser]") {
             $(echo hello)
         )";
 
-        auto program = ankh::lang::parse(source);
+        auto program = parse(source);
 
         REQUIRE(program.size() == 1);
 
@@ -622,7 +685,7 @@ TEST_CASE("parse language expressions", "[parser]") {
             $()
         )";
 
-        auto program = ankh::lang::parse(source);
+        auto program = parse(source);
 
         REQUIRE(program.has_errors());
     }
@@ -633,7 +696,7 @@ TEST_CASE("parse language expressions", "[parser]") {
             foo()[0]
         )";
 
-        auto program = ankh::lang::parse(source);
+        auto program = parse(source);
 
         REQUIRE(program.size() == 1);
 
@@ -651,7 +714,7 @@ TEST_CASE("parse language expressions", "[parser]") {
             foo[0]()
         )";
 
-        auto program = ankh::lang::parse(source);
+        auto program = parse(source);
 
         REQUIRE(program.size() == 1);
 
@@ -668,7 +731,7 @@ TEST_CASE("parse language expressions", "[parser]") {
             foo[]
         )";
 
-        auto program = ankh::lang::parse(source);
+        auto program = parse(source);
 
         REQUIRE(program.has_errors());
     }
@@ -681,7 +744,7 @@ TEST_CASE("parse language expressions", "[parser]") {
             }
         )";
 
-        auto program = ankh::lang::parse(source);
+        auto program = parse(source);
 
         REQUIRE(!program.has_errors());
         REQUIRE(program.size() == 1);
@@ -707,7 +770,7 @@ TEST_CASE("parse language expressions", "[parser]") {
             let dict = {}
         )";
 
-        auto program = ankh::lang::parse(source);
+        auto program = parse(source);
 
         REQUIRE(!program.has_errors());
         REQUIRE(program.size() == 1);
@@ -729,7 +792,7 @@ TEST_CASE("parse language expressions", "[parser]") {
             }
         )";
 
-        auto program = ankh::lang::parse(source);
+        auto program = parse(source);
 
         REQUIRE(!program.has_errors());
         REQUIRE(program.size() == 1);
@@ -758,7 +821,7 @@ TEST_CASE("parse language expressions", "[parser]") {
             }
         )";
 
-        auto program = ankh::lang::parse(source);
+        auto program = parse(source);
 
         REQUIRE(!program.has_errors());
         REQUIRE(program.size() == 1);
@@ -787,7 +850,7 @@ TEST_CASE("parse language expressions", "[parser]") {
             }
         )";
 
-        auto program = ankh::lang::parse(source);
+        auto program = parse(source);
 
         REQUIRE(!program.has_errors());
         REQUIRE(program.size() == 1);
@@ -810,7 +873,7 @@ TEST_CASE("parse language expressions", "[parser]") {
             }
         )";
 
-        auto program = ankh::lang::parse(source);
+        auto program = parse(source);
 
         REQUIRE(program.has_errors());
     }
@@ -827,7 +890,7 @@ TEST_CASE("parse language expressions", "[parser]") {
             dict["f"]
         )";
 
-        auto program = ankh::lang::parse(source);
+        auto program = parse(source);
 
         REQUIRE(!program.has_errors());
         REQUIRE(program.size() == 2);
@@ -853,7 +916,7 @@ TEST_CASE("parse arrays", "[parser]") {
     for (const auto &[source, expected_count] : sourcesToExpectedElementCount) {
         INFO(source);
 
-        auto program = ankh::lang::parse(source);
+        auto program = parse(source);
         REQUIRE(program.size() == 1);
         REQUIRE(!program.has_errors());
 
@@ -878,7 +941,7 @@ TEST_CASE("parse slices", "[parser]") {
     for (const auto &[source, has_begin, has_end] : testCases) {
         INFO(source);
 
-        auto program = ankh::lang::parse(source);
+        auto program = parse(source);
         REQUIRE(program.size() == 1);
         REQUIRE(!program.has_errors());
 
@@ -897,7 +960,7 @@ TEST_CASE("parse slices", "[parser]") {
 }
 
 TEST_CASE("test parse statement without a empty line at the end does not infinite loop", "[parser]") {
-    auto program = ankh::lang::parse("1 + 2");
+    auto program = parse("1 + 2");
 
     REQUIRE(program.size() == 1);
 }
@@ -909,7 +972,7 @@ TEST_CASE("parse two arrays as two separate statements rather than an index oper
         [0]
     )";
 
-    auto program = ankh::lang::parse(source);
+    auto program = parse(source);
     REQUIRE(program.size() == 2);
 
     for (auto &stmt : program.statements) {
@@ -925,7 +988,7 @@ TEST_CASE("top level return not allowed", "[parser]") {
         return;
     )";
 
-    auto program = ankh::lang::parse(source);
+    auto program = parse(source);
     REQUIRE(program.has_errors());
 
     REQUIRE(program.errors[0] == "2:9, a return statement can only be within function scope");
@@ -937,12 +1000,43 @@ TEST_CASE("top level break not allowed", "[parser]") {
         break
     )";
 
-    auto program = ankh::lang::parse(source);
+    auto program = parse(source);
     REQUIRE(program.has_errors());
 
     REQUIRE(program.errors[0] == "2:9, a break statement can only be within loop scope");
 }
 
+TEST_CASE("break not allowed in a lambda created in a loop", "[parser]") {
+    const std::string source =
+        R"(
+        while true {
+            let f = fn () {
+                break
+            }
+        }
+    )";
+
+    auto program = parse(source);
+    REQUIRE(program.has_errors());
+
+    REQUIRE(program.errors[0] == "4:17, a break statement can only be within loop scope");
+}
+
+TEST_CASE("scan errors are reported and parsing carries on after them", "[parser]") {
+    const std::string source =
+        R"(
+        let a = 1 & 2
+        let b = 3
+    )";
+
+    auto program = parse(source);
+    REQUIRE(program.has_errors());
+    REQUIRE(program.errors[0] == "2:19, '&' is not a valid token; did you mean '&&' ?");
+
+    REQUIRE(program.size() == 3);
+    REQUIRE(program[2]->stringify() == "let b = 3");
+}
+
 TEST_CASE("local variable declaration cannot be read in its own declaration", "[parser]") {
     const std::string source =
         R"(
@@ -952,8 +1046,463 @@ TEST_CASE("local variable declaration cannot be read in its own declaration", "[
         }
     )";
 
-    auto program = ankh::lang::parse(source);
+    auto program = parse(source);
     REQUIRE(program.has_errors());
 
     REQUIRE(program.errors[0] == "4:21, can't read local variable in its own initializer");
 }
+
+TEST_CASE("variable declared twice in the same scope", "[parser]") {
+    const std::string source =
+        R"(
+        {
+            let a = 1
+            let a = 2
+        }
+    )";
+
+    auto program = parse(source);
+    REQUIRE(program.has_errors());
+
+    REQUIRE(program.errors[0] == "4:17, 'a' is already declared in this scope");
+}
+
+TEST_CASE("locals are resolved to slots, globals are not", "[parser]") {
+    const std::string source =
+        R"(
+        let g = 1
+        {
+            let a = 2
+            let b = 3
+            {
+                b + g
+            }
+        }
+    )";
+
+    auto program = parse(source);
+    REQUIRE(!program.has_errors());
+    REQUIRE(program.size() == 2);
+
+    auto decl = ankh::lang::instance<ankh::lang::VariableDeclaration>(program[0]);
+    REQUIRE(decl != nullptr);
+    REQUIRE(!decl->slot.has_value());
+
+    auto outer = ankh::lang::instance<ankh::lang::BlockStatement>(program[1]);
+    REQUIRE(outer != nullptr);
+    REQUIRE(outer->locals == ankh::lang::Locals{"a", "b"});
+
+    auto inner = ankh::lang::instance<ankh::lang::BlockStatement>(outer->statements[2]);
+    REQUIRE(inner != nullptr);
+    REQUIRE(inner->locals.empty());
+
+    auto stmt = ankh::lang::instance<ankh::lang::ExpressionStatement>(inner->statements[0]);
+    REQUIRE(stmt != nullptr);
+
+    auto binary = ankh::lang::instance<ankh::lang::BinaryExpression>(stmt->expr);
+    REQUIRE(binary != nullptr);
+
+    auto b = ankh::lang::instance<ankh::lang::IdentifierExpression>(binary->left);
+    REQUIRE(b != nullptr);
+    REQUIRE(b->slot.has_value());
+    REQUIRE(b->slot->depth == 1);
+    REQUIRE(b->slot->index == 1);
+
+    auto g = ankh::lang::instance<ankh::lang::IdentifierExpression>(binary->right);
+    REQUIRE(g != nullptr);
+    REQUIRE(!g->slot.has_value());
+}
+
+TEST_CASE("closures capture the variables they use from enclosing functions", "[parser]") {
+    const std::string source =
+        R"(
+        fn f(a) {
+            {
+                let b = a
+            }
+            let c = fn () {
+                return fn () { return a + c }
+            }
+        }
+        for let i = 0; i < 3; ++i {
+            i
+        }
+    )";
+
+    auto program = parse(source);
+    REQUIRE(!program.has_errors());
+    REQUIRE(program.size() == 2);
+
+    auto fn = ankh::lang::instance<ankh::lang::FunctionDeclaration>(program[0]);
+    REQUIRE(fn != nullptr);
+    REQUIRE(fn->captures == ankh::lang::Captures{0});
+    REQUIRE(fn->upvalues.empty());
+
+    auto body = ankh::lang::instance<ankh::lang::BlockStatement>(fn->body);
+    REQUIRE(body != nullptr);
+    REQUIRE(body->locals.front() == "c");
+    REQUIRE(body->captures == ankh::lang::Captures{0});
+
+    auto plain = ankh::lang::instance<ankh::lang::BlockStatement>(body->statements[0]);
+    REQUIRE(plain != nullptr);
+    REQUIRE(plain->captures.empty());
+
+    auto decl = ankh::lang::instance<ankh::lang::VariableDeclaration>(body->statements[1]);
+    REQUIRE(decl != nullptr);
+
+    // the outer lambda only captures what the inner one needs so it can hand it down
+    auto outer = ankh::lang::instance<ankh::lang::LambdaExpression>(decl->initializer);
+    REQUIRE(outer != nullptr);
+    REQUIRE(outer->captures.empty());
+    REQUIRE(outer->upvalues == std::vector<ankh::lang::Slot>{{1, 0}, {0, 0}});
+
+    auto outer_body = ankh::lang::instance<ankh::lang::BlockStatement>(outer->body);
+    REQUIRE(outer_body != nullptr);
+    auto ret = ankh::lang::instance<ankh::lang::ReturnStatement>(outer_body->statements[0]);
+    REQUIRE(ret != nullptr);
+
+    auto inner = ankh::lang::instance<ankh::lang::LambdaExpression>(ret->expr);
+    REQUIRE(inner != nullptr);
+    REQUIRE(inner->upvalues == std::vector<ankh::lang::Slot>{{0, 0, true}, {0, 1, true}});
+
+    auto inner_body = ankh::lang::instance<ankh::lang::BlockStatement>(inner->body);
+    REQUIRE(inner_body != nullptr);
+    auto inner_ret = ankh::lang::instance<ankh::lang::ReturnStatement>(inner_body->statements[0]);
+    REQUIRE(inner_ret != nullptr);
+    auto sum = ankh::lang::instance<ankh::lang::BinaryExpression>(inner_ret->expr);
+    REQUIRE(sum != nullptr);
+    auto c = ankh::lang::instance<ankh::lang::IdentifierExpression>(sum->right);
+    REQUIRE(c != nullptr);
+    REQUIRE(c->slot == ankh::lang::Slot{0, 1, true});
+
+    auto loop = ankh::lang::instance<ankh::lang::ForStatement>(program[1]);
+    REQUIRE(loop != nullptr);
+    REQUIRE(loop->captures.empty());
+}
+
+TEST_CASE("optimize constant expressions", "[parser]") {
+    SECTION("folding") {
+        const std::unordered_map<std::string, ankh::lang::ExprResult> src_to_expected_result = {
+            {"60 * 60 * 24", ankh::lang::Number{86400}},
+            {"-(1 + 2) * 2", ankh::lang::Number{-6}},
+            {R"("con" + "cat")", std::string{"concat"}},
+            {R"("x = {1 + 2}")", std::string{"x = 3.000000"}},
+            {"1 < 2", true},
+            {R"("a" == "b")", false},
+            {"!(1 >= 2) && true", true},
+            {"false && a", false},
+            {"true || a", true},
+            {"nil", ankh::lang::ExprResult{}}};
+
+        for (const auto &[src, expected_result] : src_to_expected_result) {
+            INFO(src);
+            auto program = ankh::lang::parse(src);
+            REQUIRE(!program.has_errors());
+            REQUIRE(program.size() == 1);
+
+            auto stmt = ankh::lang::instance<ankh::lang::ExpressionStatement>(program[0]);
+            REQUIRE(stmt != nullptr);
+
+            auto literal = ankh::lang::instance<ankh::lang::LiteralExpression>(stmt->expr);
+            REQUIRE(literal != nullptr);
+            REQUIRE(literal->value.has_value());
+            REQUIRE(literal->value.value() == expected_result);
+        }
+    }
+
+    SECTION("no folding") {
+        for (const std::string src : {"1 / 0", R"(1 + "a")", "a * 2", "true && a", R"("{a}")", "-true"}) {
+            INFO(src);
+            auto program = ankh::lang::parse(src);
+            REQUIRE(!program.has_errors());
+            REQUIRE(program.size() == 1);
+
+            auto stmt = ankh::lang::instance<ankh::lang::ExpressionStatement>(program[0]);
+            REQUIRE(stmt != nullptr);
+            REQUIRE(!ankh::lang::instanceof <ankh::lang::LiteralExpression>(stmt->expr));
+        }
+    }
+
+    SECTION("literal conversion") {
+        auto program = ankh::lang::parse("a * 2.5");
+        REQUIRE(program.size() == 1);
+
+        auto stmt = ankh::lang::instance<ankh::lang::ExpressionStatement>(program[0]);
+        REQUIRE(stmt != nullptr);
+
+        auto binary = ankh::lang::instance<ankh::lang::BinaryExpression>(stmt->expr);
+        REQUIRE(binary != nullptr);
+
+        auto literal = ankh::lang::instance<ankh::lang::LiteralExpression>(binary->right);
+        REQUIRE(literal != nullptr);
+        REQUIRE(literal->value.has_value());
+        REQUIRE(literal->value->n == 2.5);
+    }
+}
+
+TEST_CASE("cached programs load back as they were parsed", "[parser]") {
+    const std::string source =
+        R"(
+        let g = 1 + 2
+        fn f(a, b) {
+            let s = "{a} and {b}"
+            for let i = 0; i < 3; ++i {
+                s += "!"
+            }
+            s = append(s, "?")
+            return s
+        }
+        {
+            let d = {k: [1, 2][0:1]}
+            let h = fn (x) { return x * g + d["k"][0] }
+            if !true { $(echo hi) } else { h(d["k"]) }
+        }
+    )";
+
+    auto program = ankh::lang::parse(source);
+    REQUIRE(!program.has_errors());
+
+    const std::string data = ankh::lang::serialize(program, source);
+
+    SECTION("round trip") {
+        auto cached = ankh::lang::deserialize(data, source);
+        REQUIRE(cached.has_value());
+        REQUIRE(cached->size() == program.size());
+        for (size_t i = 0; i < program.size(); ++i) {
+            REQUIRE(cached.value()[i]->stringify() == program[i]->stringify());
+        }
+
+        auto decl = ankh::lang::instance<ankh::lang::VariableDeclaration>(cached.value()[0]);
+        REQUIRE(decl != nullptr);
+        REQUIRE(!decl->slot.has_value());
+
+        auto folded = ankh::lang::instance<ankh::lang::LiteralExpression>(decl->initializer);
+        REQUIRE(folded != nullptr);
+        REQUIRE(folded->value.has_value());
+        REQUIRE(folded->value->n == 3);
+
+        auto block = ankh::lang::instance<ankh::lang::BlockStatement>(cached.value()[2]);
+        REQUIRE(block != nullptr);
+        auto original = ankh::lang::instance<ankh::lang::BlockStatement>(program[2]);
+        REQUIRE(block->locals == original->locals);
+        REQUIRE(block->locals.front() == "d");
+
+        auto fn = ankh::lang::instance<ankh::lang::FunctionDeclaration>(cached.value()[1]);
+        REQUIRE(fn != nullptr);
+        REQUIRE(fn->params.size() == 2);
+        REQUIRE(fn->params[1].str == "b");
+        REQUIRE(fn->params[1].line == 3);
+        REQUIRE(fn->locals == ankh::lang::Locals{"a", "b"});
+        REQUIRE(fn->captures.empty());
+        REQUIRE(block->captures == ankh::lang::Captures{0});
+
+        auto body = ankh::lang::instance<ankh::lang::BlockStatement>(fn->body);
+        REQUIRE(body != nullptr);
+        auto reassignment = ankh::lang::instance<ankh::lang::AssignmentStatement>(body->statements[2]);
+        REQUIRE(reassignment != nullptr);
+        REQUIRE(reassignment->reassigns_argument);
+
+        auto h = ankh::lang::instance<ankh::lang::VariableDeclaration>(block->statements[1]);
+        REQUIRE(h != nullptr);
+        auto lambda = ankh::lang::instance<ankh::lang::LambdaExpression>(h->initializer);
+        REQUIRE(lambda != nullptr);
+        REQUIRE(lambda->upvalues == std::vector<ankh::lang::Slot>{{0, 0}});
+    }
+
+    SECTION("the cached program outlives the data") {
+        std::optional<ankh::lang::Program> cached;
+        {
+            const std::string copy = data;
+            cached = ankh::lang::deserialize(copy, source);
+        }
+        REQUIRE(cached.has_value());
+        REQUIRE(cached.value()[0]->stringify() == program[0]->stringify());
+    }
+
+    SECTION("different source") {
+        REQUIRE(!ankh::lang::deserialize(data, source + " ").has_value());
+        REQUIRE(!ankh::lang::deserialize(data, "let g = 1 + 3").has_value());
+    }
+
+    SECTION("corrupt data") {
+        for (size_t size = 0; size < data.size(); size += 7) {
+            INFO(size);
+            REQUIRE(!ankh::lang::deserialize(std::string_view{data}.substr(0, size), source).has_value());
+        }
+        REQUIRE(!ankh::lang::deserialize(data + "x", source).has_value());
+
+        std::string corrupt = data;
+        corrupt[0] = 'b';
+        REQUIRE(!ankh::lang::deserialize(corrupt, source).has_value());
+    }
+}
+
+TEST_CASE("cached programs with slots out of range are rejected", "[parser]") {
+    const std::string source = R"(
+        fn f(a) {
+            let b = a
+            return fn () { return b }
+        }
+    )";
+
+    auto program = ankh::lang::parse(source);
+    REQUIRE(!program.has_errors());
+    REQUIRE(ankh::lang::deserialize(ankh::lang::serialize(program, source), source).has_value());
+
+    auto fn = ankh::lang::instance<ankh::lang::FunctionDeclaration>(program[0]);
+    REQUIRE(fn != nullptr);
+    auto body = ankh::lang::instance<ankh::lang::BlockStatement>(fn->body);
+    REQUIRE(body != nullptr);
+    auto decl = ankh::lang::instance<ankh::lang::VariableDeclaration>(body->statements[0]);
+    REQUIRE(decl != nullptr);
+    auto a = ankh::lang::instance<ankh::lang::IdentifierExpression>(decl->initializer);
+    REQUIRE(a != nullptr);
+    auto ret = ankh::lang::instance<ankh::lang::ReturnStatement>(body->statements[1]);
+    REQUIRE(ret != nullptr);
+    auto lambda = ankh::lang::instance<ankh::lang::LambdaExpression>(ret->expr);
+    REQUIRE(lambda != nullptr);
+    auto lambda_body = ankh::lang::instance<ankh::lang::BlockStatement>(lambda->body);
+    REQUIRE(lambda_body != nullptr);
+    auto lambda_ret = ankh::lang::instance<ankh::lang::ReturnStatement>(lambda_body->statements[0]);
+    REQUIRE(lambda_ret != nullptr);
+    auto b = ankh::lang::instance<ankh::lang::IdentifierExpression>(lambda_ret->expr);
+    REQUIRE(b != nullptr);
+
+    REQUIRE(a->slot == ankh::lang::Slot{1, 0});
+    REQUIRE(decl->slot == ankh::lang::Slot{0, 0});
+    REQUIRE(lambda->upvalues == std::vector<ankh::lang::Slot>{{0, 0}});
+    REQUIRE(b->slot == ankh::lang::Slot{0, 0, true});
+
+    // the entries are well formed, so only checking the slots against their scopes tells them apart
+    const auto rejected = [&](ankh::lang::Slot &slot, ankh::lang::Slot corrupt) {
+        const ankh::lang::Slot original = slot;
+        slot = corrupt;
+        const bool result = !ankh::lang::deserialize(ankh::lang::serialize(program, source), source).has_value();
+        slot = original;
+
+        return result;
+    };
+
+    REQUIRE(rejected(a->slot.value(), {1, 1}));
+    REQUIRE(rejected(a->slot.value(), {2, 0}));
+    REQUIRE(rejected(a->slot.value(), {0, 0, true}));
+    REQUIRE(rejected(decl->slot.value(), {1, 0}));
+    REQUIRE(rejected(decl->slot.value(), {0, 1}));
+    // a closure's outermost scope has no enclosing one to reach
+    REQUIRE(rejected(b->slot.value(), {1, 0}));
+    REQUIRE(rejected(b->slot.value(), {0, 1, true}));
+    // a variable captured by a closure has to be one its scope captures
+    REQUIRE(rejected(lambda->upvalues[0], {0, 1}));
+    REQUIRE(rejected(lambda->upvalues[0], {1, 0}));
+}
+
+TEST_CASE("programs keep their nodes alive when they're moved", "[parser]") {
+    const std::string source = R"(
+        fn greet(name) {
+            let greeting = "hello {name}"
+            return greeting
+        }
+        let h = fn (x) { return greet(x) }
+    )";
+
+    std::vector<std::string> expected;
+    ankh::lang::Program program;
+    {
+        // the source the tokens refer to is gone by the time the program is used
+        const std::string copy = source;
+        program = ankh::lang::parse(copy);
+        REQUIRE(!program.has_errors());
+        for (const auto &stmt : program.statements) {
+            expected.push_back(stmt->stringify());
+        }
+    }
+
+    SECTION("move construction") {
+        ankh::lang::Program moved(std::move(program));
+        REQUIRE(program.size() == 0);
+        REQUIRE(moved.size() == expected.size());
+        for (size_t i = 0; i < moved.size(); ++i) {
+            REQUIRE(moved[i]->stringify() == expected[i]);
+        }
+    }
+
+    SECTION("move assignment over another program") {
+        ankh::lang::Program moved = ankh::lang::parse("let other = [1, 2, 3]\nprint(other)");
+        REQUIRE(moved.size() == 2);
+
+        moved = std::move(program);
+        REQUIRE(moved.size() == expected.size());
+        for (size_t i = 0; i < moved.size(); ++i) {
+            REQUIRE(moved[i]->stringify() == expected[i]);
+        }
+
+        auto fn = ankh::lang::instance<ankh::lang::FunctionDeclaration>(moved[0]);
+        REQUIRE(fn != nullptr);
+        REQUIRE(fn->name.str == "greet");
+        REQUIRE(fn->params[0].str == "name");
+    }
+
+    SECTION("programs moved around by a growing vector") {
+        std::vector<ankh::lang::Program> programs;
+        programs.push_back(std::move(program));
+        for (int i = 0; i < 16; ++i) {
+            programs.push_back(ankh::lang::parse("let x = " + std::to_string(i)));
+        }
+
+        REQUIRE(programs.front().size() == expected.size());
+        for (size_t i = 0; i < expected.size(); ++i) {
+            REQUIRE(programs.front()[i]->stringify() == expected[i]);
+        }
+        REQUIRE(programs.back()[0]->stringify() == ankh::lang::parse("let x = 15")[0]->stringify());
+    }
+}
+
+TEST_CASE("scripts are parsed where they're mapped", "[parser]") {
+    // larger than the buffer scripts used to be read through
+    std::string source;
+    for (int i = 0; i < 8192; ++i) {
+        source += std::format("let x{} = {}\n", i, i);
+    }
+    REQUIRE(source.size() > 64 * 1024);
+
+    const std::filesystem::path path = std::filesystem::temp_directory_path() / "ankh-parser-tests-script.ankh";
+    std::ofstream(path) << source;
+
+    SECTION("regular file") {
+        auto file = ankh::sys::MappedFile::open(path);
+        REQUIRE(file.has_value());
+        REQUIRE(file->contents() == source);
+
+        auto program = ankh::lang::parse_in_place(file->contents());
+        REQUIRE(!program.has_errors());
+        REQUIRE(program.size() == 8192);
+
+        auto decl = ankh::lang::instance<ankh::lang::VariableDeclaration>(program[8191]);
+        REQUIRE(decl != nullptr);
+        REQUIRE(decl->name.str == "x8191");
+        // the names are views into the mapping rather than copies of the script
+        REQUIRE(decl->name.str.data() >= file->contents().data());
+        REQUIRE(decl->name.str.data() < file->contents().data() + file->contents().size());
+    }
+
+    SECTION("pipe") {
+        int fds[2];
+        REQUIRE(::pipe(fds) == 0);
+        const std::string script = "let piped = 1\n";
+        REQUIRE(::write(fds[1], script.data(), script.size()) == static_cast<ssize_t>(script.size()));
+        ::close(fds[1]);
+
+        auto file = ankh::sys::MappedFile::open(std::format("/proc/self/fd/{}", fds[0]));
+        ::close(fds[0]);
+        REQUIRE(file.has_value());
+        REQUIRE(file->contents() == script);
+        REQUIRE(ankh::lang::parse_in_place(file->contents()).size() == 1);
+    }
+
+    SECTION("missing file") {
+        std::filesystem::remove(path);
+        REQUIRE(!ankh::sys::MappedFile::open(path).has_value());
+    }
+
+    std::filesystem::remove(path);
+}
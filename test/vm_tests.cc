@@ -0,0 +1,750 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <ankh/lang/exceptions.hpp>
+#include <ankh/lang/expr_result.hpp>
+#include <ankh/lang/interpreter.hpp>
+#include <ankh/lang/native.hpp>
+#include <ankh/lang/parser.hpp>
+#include <ankh/lang/program.hpp>
+#include <ankh/lang/types/gc.hpp>
+#include <ankh/lang/vm.hpp>
+
+static void run(ankh::lang::VM &vm, const std::string &source) {
+    ankh::lang::Program program = ankh::lang::parse(source);
+    REQUIRE(!program.has_errors());
+
+    vm.interpret(std::move(program));
+}
+
+// evaluates the expression in a fresh VM by binding it to the global 'result'
+static ankh::lang::ExprResult evaluate(const std::string &expr) {
+    ankh::lang::VM vm;
+
+    run(vm, "let result = " + expr);
+
+    auto result = vm.global("result");
+    REQUIRE(result.has_value());
+
+    return result.value();
+}
+
+static ankh::lang::ExprResult result_of(const std::string &source) {
+    ankh::lang::VM vm;
+
+    run(vm, source);
+
+    auto result = vm.global("result");
+    REQUIRE(result.has_value());
+
+    return result.value();
+}
+
+static void require_throws(const std::string &source) {
+    INFO(source);
+
+    ankh::lang::VM vm;
+    REQUIRE_THROWS(run(vm, source));
+}
+
+TEST_CASE("primary expressions", "[vm]") {
+    SECTION("literals") {
+        REQUIRE(evaluate("123").n == 123);
+        REQUIRE(evaluate("\"here is a string\"").str == "here is a string");
+        REQUIRE(evaluate("true").b == true);
+        REQUIRE(evaluate("false").b == false);
+        REQUIRE(evaluate("nil").type == ankh::lang::ExprResultType::RT_NIL);
+    }
+
+    SECTION("strings, substitution expression") {
+        const std::string source = R"(
+            let a = "lol"
+            let result = "the value of a is {a}"
+        )";
+
+        INFO(source);
+        REQUIRE(result_of(source).str == "the value of a is lol");
+    }
+
+    SECTION("strings, substitution expression, malformed") {
+        require_throws(R"(let a = "lol"; "the value of a is {a")");
+        require_throws(R"(let a = "lol"; "the value of a is a}")");
+        require_throws(R"("the value is {{expression will be unevaluated}}")");
+    }
+
+    SECTION("strings, substitution expression, non-string expression") {
+        REQUIRE(evaluate(R"("the value is {1 == 2}")").str == "the value is false");
+    }
+
+    SECTION("strings, substitution expression, raw braces") {
+        const std::string source = R"(
+            let a = 1 > 2
+            let result = "the value is \{\} {a}"
+        )";
+
+        INFO(source);
+        REQUIRE(result_of(source).str == "the value is {} false");
+    }
+
+    SECTION("strings, substitution expression, multi") {
+        REQUIRE(evaluate(R"("the value is {true || false} is { true }")").str == "the value is true is true");
+    }
+
+    SECTION("strings, substitution expression, locals") {
+        const std::string source = R"(
+            fn repeat(word, n) {
+                let line = ""
+                for let i = 0; i < n; i += 1 {
+                    line = "{line}{word}{i < n - 1},"
+                }
+                return line
+            }
+            let result = repeat("ab", 3)
+        )";
+
+        INFO(source);
+        REQUIRE(result_of(source).str == "abtrue,abtrue,abfalse,");
+    }
+
+    SECTION("lambda, rvalue") {
+        REQUIRE(evaluate("fn (a, b) { return a + b }").type == ankh::lang::ExprResultType::RT_CALLABLE);
+    }
+
+    SECTION("command") {
+        REQUIRE(evaluate("$(echo hello)").str == "hello\n");
+        REQUIRE(evaluate(R"($(echo hello | tr -s 'h' "j"))").str == "jello\n");
+        REQUIRE(evaluate(R"($(printf '%s|%s' "a  b" c\ d))").str == "a  b|c d");
+        REQUIRE(result_of("$(exit 3)\nlet result = status()").n == 3);
+    }
+
+    SECTION("parenthetic expression") { REQUIRE(evaluate("( 1 + 2 )").n == 3); }
+}
+
+TEST_CASE("call expressions", "[vm]") {
+    SECTION("function call, non-recursive") {
+        const std::string source = R"(
+            fn foo() {
+                return "foobar"
+            }
+
+            let result = foo()
+        )";
+
+        INFO(source);
+        REQUIRE(result_of(source).str == "foobar");
+    }
+
+    SECTION("function call, recursive") {
+        const std::string source = R"(
+            fn fib(n) {
+                # base case
+                if n <= 1 { return n }
+
+                # general case
+                return fib(n - 2) + fib(n - 1)
+            }
+
+            let result = fib(10)
+        )";
+
+        INFO(source);
+        REQUIRE(result_of(source).n == 55);
+    }
+
+    SECTION("function call, no return statement -- should return nil") {
+        const std::string source = R"(
+            fn foo() {
+                let a = 1
+                "bar"
+            }
+
+            let result = foo()
+        )";
+
+        INFO(source);
+        REQUIRE(result_of(source).type == ankh::lang::ExprResultType::RT_NIL);
+    }
+
+    SECTION("lambda call") {
+        const std::string source = R"(
+            let f = fn (a, b) {
+                return a + b
+            }
+
+            let result = f("a", "b")
+        )";
+
+        INFO(source);
+        REQUIRE(result_of(source).str == "ab");
+    }
+
+    SECTION("wrong number of arguments") { require_throws("fn foo(a) { return a }\nfoo(1, 2)"); }
+
+    SECTION("non-callable") { require_throws("let a = 1; a()"); }
+
+    SECTION("unbounded recursion") { require_throws("fn foo() { return foo() }\nfoo()"); }
+}
+
+TEST_CASE("unary expressions", "[vm]") {
+    REQUIRE(evaluate("!true").b == false);
+    REQUIRE(evaluate("!(1 == 2)").b == true);
+    REQUIRE(evaluate("-2").n == -2);
+
+    require_throws("!9");
+    require_throws(R"(-"what")");
+}
+
+TEST_CASE("PEMDAS", "[vm]") {
+    const std::unordered_map<std::string, ankh::lang::Number> src_to_expected_result = {
+        {"4 / 2", 2},          {"4.2 / 2", 2.1},         {"6 / (1 + 1)", 3},   {"4 * 3", 12},
+        {"2 * 8.3", 16.6},     {"12 / 3 * 2", 8},        {"1 - 2 + 3", 2},     {"7 - (2 + 3)", 2},
+        {"8 + 2 * 3 / 2", 11}, {"24 / (3 * 4)", 2},      {"1 - 3 + 2", 0},     {"(1 - (2 * 3)) * 2 * (21 / 7)", -30}};
+
+    for (const auto &[src, expected_result] : src_to_expected_result) {
+        INFO(src);
+
+        ankh::lang::ExprResult actual_result = evaluate(src);
+        REQUIRE(actual_result.type == ankh::lang::ExprResultType::RT_NUMBER);
+        REQUIRE(actual_result.n == expected_result);
+    }
+
+    REQUIRE(evaluate(R"("foo" + "bar")").str == "foobar");
+
+    for (const auto &src : {"true / 2", "\"fwat\" / 2", "1 + true", "\"fwat\" - true", "3 / 0"}) {
+        require_throws(src);
+    }
+}
+
+TEST_CASE("ordering", "[vm]") {
+    const std::unordered_map<std::string, bool> src_to_expected_result = {
+        {"2 > 1", true},   {"2 < 3", true},         {"1 >= 1", true},         {"5 <= 4", false},
+        {"1 != 2", true},  {"3 == 2", false},       {"true == true", true},   {"false != true", true},
+        {"\"a\" != \"a\"", false}};
+
+    for (const auto &[src, expected_result] : src_to_expected_result) {
+        INFO(src);
+
+        ankh::lang::ExprResult actual_result = evaluate(src);
+        REQUIRE(actual_result.type == ankh::lang::ExprResultType::RT_BOOL);
+        REQUIRE(actual_result.b == expected_result);
+    }
+
+    for (const auto &src : {"2 > \"foo\"", "2 < true", "1 >= \"\"", "1 != \"foo\"", "false == 9.1"}) {
+        require_throws(src);
+    }
+}
+
+TEST_CASE("boolean", "[vm]") {
+    const std::unordered_map<std::string, bool> src_to_expected_result = {
+        {"true && true", true},  {"true && false", false}, {"false && false", false}, {"false && true", false},
+        {"true || true", true},  {"true || false", true},  {"false || true", true},   {"false || false", false}};
+
+    for (const auto &[src, expected_result] : src_to_expected_result) {
+        INFO(src);
+
+        ankh::lang::ExprResult actual_result = evaluate(src);
+        REQUIRE(actual_result.type == ankh::lang::ExprResultType::RT_BOOL);
+        REQUIRE(actual_result.b == expected_result);
+    }
+
+    for (const auto &src : {"2 && \"foo\"", "true && -1", "1 || \"foo\"", "false || 9.1"}) {
+        require_throws(src);
+    }
+
+    SECTION("short circuit") {
+        const std::string source = R"(
+            let result = 0
+
+            fn update() {
+                result = result + 1
+                return result
+            }
+
+            if update() > 0 && update() < 0 {
+            } else {
+            }
+
+            if update() > 0 || update() < 0 {
+            } else {
+            }
+        )";
+
+        INFO(source);
+        REQUIRE(result_of(source).n == 3);
+
+        REQUIRE(!result_of("let xs = [1]; let i = 1; let result = i < len(xs) && xs[i] == 1").b);
+        REQUIRE(result_of("let xs = [1]; let i = 1; let result = i >= len(xs) || xs[i] == 1").b);
+        REQUIRE(!evaluate("false && 1").b);
+        REQUIRE(evaluate("true || 1").b);
+    }
+}
+
+TEST_CASE("loops", "[vm]") {
+    const std::vector<std::string> sources = {
+        R"(
+            let result = 0
+            for let i = 0; i < 2; ++i {
+                result = result + 1
+            }
+        )",
+        R"(
+            let result = 0
+            for ; result < 2; ++result {}
+        )",
+        R"(
+            let result = 0
+            for let i = 0; i < 2; {
+                ++result
+                ++i
+            }
+        )",
+        R"(
+            let result = 0
+            for {
+                if result == 2 {
+                    break
+                }
+                ++result
+            }
+        )",
+        R"(
+            let result = 0
+            while result != 2 {
+                ++result
+            }
+        )",
+        R"(
+            let result = 0
+            while true {
+                let x = result
+                {
+                    let y = x
+                    if y == 2 {
+                        break
+                    }
+                }
+                ++result
+            }
+        )"};
+
+    for (const auto &source : sources) {
+        INFO(source);
+
+        ankh::lang::VM vm;
+        run(vm, source);
+
+        REQUIRE(vm.global("result")->n == 2);
+        REQUIRE(!vm.global("i"));
+    }
+}
+
+TEST_CASE("assignments", "[vm]") {
+    const std::unordered_map<std::string, ankh::lang::Number> src_to_expected = {
+        {"let result = 0; result = 1", 1},  {"let result = 0; ++result", 1},  {"let result = 0; --result", -1},
+        {"let result = 0; result += 3", 3}, {"let result = 0; result -= 3", -3}, {"let result = 1; result *= 3", 3},
+        {"let result = 6; result /= 3", 2}};
+
+    for (const auto &[source, expected] : src_to_expected) {
+        INFO(source);
+        REQUIRE(result_of(source).n == expected);
+    }
+
+    require_throws("let i = 0; x = 1");
+    require_throws("print(x)");
+}
+
+TEST_CASE("arrays and dicts", "[vm]") {
+    SECTION("array expressions") {
+        ankh::lang::ExprResult actual_result = evaluate("[1, 2]");
+        REQUIRE(actual_result.type == ankh::lang::ExprResultType::RT_ARRAY);
+        REQUIRE(actual_result.array ==
+                ankh::lang::Array(std::vector<ankh::lang::ExprResult>{ankh::lang::Number{1}, ankh::lang::Number{2}}));
+
+        REQUIRE(evaluate("[]").array.size() == 0);
+    }
+
+    SECTION("index expressions") {
+        REQUIRE(result_of("let a = [1, 2]; let result = a[0] + a[1]").n == 3);
+        REQUIRE(evaluate(R"("foo"[0])").str == "f");
+
+        require_throws("let a = [1, 2]; a[3]");
+    }
+
+    SECTION("arrays are values, appending to one leaves its copies as they were") {
+        const std::string source = R"(
+            let a = [1, 2]
+            let b = a
+            b = append(b, 3)
+            let c = append(a, 4)
+
+            fn collect(n) {
+                let xs = []
+                let ys = xs
+                let add = fn (x) { xs = append(xs, x) }
+                for let i = 0; i < n; ++i {
+                    add(i)
+                    ys = append(ys, i * 2)
+                }
+                return xs[n - 1] + ys[n - 1] + len(ys)
+            }
+
+            let result = len(a) * 100 + len(b) * 10 + len(c) + collect(3) * 1000
+        )";
+
+        INFO(source);
+        REQUIRE(result_of(source).n == 9233);
+    }
+
+    SECTION("dicts") {
+        ankh::lang::ExprResult actual_result = evaluate(R"({ a: "b", c: 2, d: [], ["e" + "f"]: "abc" })");
+        REQUIRE(actual_result.type == ankh::lang::ExprResultType::RT_DICT);
+        REQUIRE(actual_result.dict.size() == 4);
+        REQUIRE(actual_result.dict.value(std::string{"ef"})->value.str == "abc");
+
+        REQUIRE(result_of(R"(let a = { f: "g" }; let result = a["f"])").str == "g");
+
+        require_throws(R"(let a = { f: "g" }; a[x])");
+        require_throws(R"(let a = { [1]: "g" })");
+
+        const std::string source = R"(
+            let a = { c: 1, a: 2, b: 3, a: 4 }
+            let k = keys(a)
+            let result = k[0] + k[1] + k[2] + str(a["a"] == 2)
+        )";
+
+        INFO(source);
+        REQUIRE(result_of(source).str == "cabtrue");
+    }
+
+    SECTION("dicts, bad keys are reported as the interpreter does") {
+        const std::string source = R"(let a = { [1 + 1]: "g" })";
+
+        std::string interpreter_error;
+        try {
+            ankh::lang::Interpreter interpreter;
+            interpreter.interpret(ankh::lang::parse(source));
+        } catch (const ankh::lang::InterpretationException &e) {
+            interpreter_error = e.what();
+        }
+
+        std::string vm_error;
+        try {
+            ankh::lang::VM vm;
+            run(vm, source);
+        } catch (const ankh::lang::InterpretationException &e) {
+            vm_error = e.what();
+        }
+
+        REQUIRE(!vm_error.empty());
+        REQUIRE(vm_error == interpreter_error);
+    }
+
+    SECTION("slices") {
+        const std::unordered_map<std::string, size_t> src_to_expected_count = {
+            {"[1,2,3][1:]", 2}, {"[1,2,3][:]", 3}, {"[1,2,3][1:3]", 2}, {"[1,2,3][:1]", 1}};
+
+        for (const auto &[src, expected_count] : src_to_expected_count) {
+            INFO(src);
+            REQUIRE(evaluate(src).array.size() == expected_count);
+        }
+
+        for (const auto &src : {R"([1,2,3]["42":])", R"([1,2,3][:"42"])", "[1,2,3][:-1]", "[1,2,3][:99]"}) {
+            require_throws(src);
+        }
+    }
+}
+
+TEST_CASE("if statements", "[vm]") {
+    const std::string source = R"(
+        fn classify(a) {
+            if a == 1 {
+                return "one"
+            } else if a == 2 {
+                return "two"
+            } else {
+                return "many"
+            }
+        }
+
+        let result = classify(1) + classify(2) + classify(3)
+    )";
+
+    INFO(source);
+    REQUIRE(result_of(source).str == "onetwomany");
+}
+
+TEST_CASE("vm has predefined functions", "[vm]") {
+    ankh::lang::VM vm;
+
+    for (const auto &[name, arity] :
+         std::unordered_map<std::string, size_t>{{"print", 1}, {"exit", 1}, {"len", 1}, {"int", 1},
+                                                 {"append", 2}, {"str", 1},  {"keys", 1}}) {
+        INFO(name);
+
+        auto fn = vm.global(name);
+        REQUIRE(fn.has_value());
+        REQUIRE(fn->type == ankh::lang::ExprResultType::RT_CALLABLE);
+        REQUIRE(fn->callable->arity() == arity);
+    }
+
+    REQUIRE(result_of(R"(let result = len(append([1], 2)) + int(true) + len(keys({ a: 1 })))").n == 4);
+
+    // the exit status of commands belongs to the vm running them
+    ankh::lang::VM other;
+    run(vm, "$(exit 3)");
+    run(other, "$(true)");
+    run(vm, "let status_of_vm = status()");
+    run(other, "let status_of_other = status()");
+    REQUIRE(vm.global("status_of_vm")->n == 3);
+    REQUIRE(other.global("status_of_other")->n == 0);
+}
+
+static double average(double a, double b) { return (a + b) / 2; }
+
+TEST_CASE("vm calls the natives loaded into it", "[vm]") {
+    ankh::lang::VM vm;
+
+    ankh::lang::Natives natives;
+    natives.define<"average", average>();
+    vm.load(natives);
+
+    run(vm, "let result = average(1, 2)");
+    REQUIRE(vm.global("result")->n == 1.5);
+
+    REQUIRE_THROWS_AS(run(vm, R"(result = average("1", 2))"), ankh::lang::InterpretationException);
+    REQUIRE(vm.global("result")->n == 1.5);
+
+    // natives can't replace one another or the builtins
+    REQUIRE_THROWS_AS(vm.load(natives), ankh::lang::InterpretationException);
+}
+
+TEST_CASE("locals and closures", "[vm]") {
+    SECTION("locals are read and written through their slots") {
+        const std::string source = R"(
+            let result = 0
+            fn outer(a) {
+                let b = a + 1
+                fn inner(c) {
+                    b += c
+                    return a + b
+                }
+                return inner(10)
+            }
+            {
+                let result = 100
+                result = outer(1)
+            }
+            for let i = 0; i < 3; ++i {
+                let i2 = i * 2
+                result = result + i2
+            }
+        )";
+
+        INFO(source);
+        REQUIRE(result_of(source).n == 6);
+    }
+
+    SECTION("closures outlive the variables they capture") {
+        const std::string source = R"(
+            fn counter() {
+                let i = 0
+                return fn () {
+                    ++i
+                    return i
+                }
+            }
+
+            let a = counter()
+            let b = counter()
+            a()
+            a()
+            b()
+            let result = a() * 10 + b()
+        )";
+
+        INFO(source);
+        REQUIRE(result_of(source).n == 32);
+    }
+
+    SECTION("closures share captured variables") {
+        const std::string source = R"(
+            let get = nil
+            let set = nil
+            {
+                let shared = 1
+                get = fn () { return shared }
+                set = fn (v) { shared = v }
+            }
+            set(42)
+            let result = get()
+        )";
+
+        INFO(source);
+        REQUIRE(result_of(source).n == 42);
+    }
+
+    SECTION("each loop iteration captures its own variables") {
+        const std::string source = R"(
+            let fns = []
+            for let i = 0; i < 3; ++i {
+                let j = i
+                fns = append(fns, fn () { return j })
+            }
+            let result = fns[0]() + fns[1]() * 10 + fns[2]() * 100
+        )";
+
+        INFO(source);
+        REQUIRE(result_of(source).n == 210);
+    }
+
+    SECTION("nested functions calling one another whichever is declared first") {
+        const std::string source = R"(
+            fn check(n) {
+                fn is_even(n) {
+                    if n == 0 {
+                        return true
+                    }
+                    return is_odd(n - 1)
+                }
+                fn is_odd(n) {
+                    if n == 0 {
+                        return false
+                    }
+                    return is_even(n - 1)
+                }
+                return is_even(n)
+            }
+            # the second call declares the nested functions again
+            let result = check(10) == !check(7)
+        )";
+
+        INFO(source);
+        REQUIRE(result_of(source).b);
+    }
+
+    SECTION("nested functions reading variables declared after them") {
+        const std::string source = R"(
+            fn outer() {
+                let x = 1
+                {
+                    let before = x
+                    fn get() { return x + before }
+                    let x = 41
+                    return get()
+                }
+            }
+            let result = outer()
+        )";
+
+        INFO(source);
+        REQUIRE(result_of(source).n == 42);
+    }
+
+    SECTION("closures are freed along with the last value referring to them") {
+        ankh::lang::VM vm;
+
+        const std::string source = R"(
+            let total = 0
+            for let i = 0; i < 100; ++i {
+                let add = fn (x) { return x + i }
+                total += add(1)
+            }
+        )";
+
+        // the VM's heap holds nothing but its natives so far
+        const size_t objects = vm.heap().size();
+
+        INFO(source);
+        run(vm, source);
+        REQUIRE(vm.global("total")->n == 5050);
+
+        REQUIRE(vm.heap().size() == objects);
+    }
+
+    SECTION("closures only referred to by the variables they capture are freed") {
+        ankh::lang::VM vm;
+
+        const std::string source = R"(
+            let total = 0
+            for let i = 0; i < 100; ++i {
+                let down = nil
+                down = fn (x) {
+                    if x == 0 {
+                        return 0
+                    }
+                    return 1 + down(x - 1)
+                }
+                total += down(i)
+            }
+        )";
+
+        // the VM's heap holds nothing but its natives so far
+        const size_t objects = vm.heap().size();
+
+        INFO(source);
+        run(vm, source);
+        REQUIRE(vm.global("total")->n == 4950);
+
+        REQUIRE(vm.heap().size() > objects);
+
+        vm.heap().collect();
+        REQUIRE(vm.heap().size() == objects);
+    }
+
+    SECTION("substitution expressions can read locals") {
+        const std::string source = R"(
+            fn greet(name) {
+                let greeting = "hello"
+                return "{greeting}, {name}"
+            }
+            let result = greet("ankh")
+        )";
+
+        INFO(source);
+        REQUIRE(result_of(source).str == "hello, ankh");
+    }
+}
+
+TEST_CASE("vm recovers from runtime errors", "[vm]") {
+    ankh::lang::VM vm;
+
+    REQUIRE_THROWS(run(vm, "let a = 1\nfn foo() { return 1 / 0 }\nfoo()"));
+
+    run(vm, "let result = a + 1");
+    REQUIRE(vm.global("result")->n == 2);
+
+    // the variable gives its value up to the call, and gets it back when the call fails
+    REQUIRE_THROWS(run(vm, "a = append(a, 2)"));
+    REQUIRE(vm.global("a")->n == 1);
+}
+
+TEST_CASE("return and break complete their enclosing call and loop", "[vm]") {
+    const std::string source = R"(
+        fn find(xs, x) {
+            for let i = 0; i < len(xs); ++i {
+                while true {
+                    if xs[i] == x {
+                        return i
+                    }
+                    break
+                }
+            }
+            return -1
+        }
+
+        let result = 0
+        while true {
+            {
+                result = find([3, 5, 7], 7) * 10 + find([3], 4)
+                break
+            }
+            result = 100
+        }
+    )";
+
+    INFO(source);
+    REQUIRE(result_of(source).n == 19);
+}